@@ -28,6 +28,8 @@ static const char* HELP =
     "         directories consisting of a single directory\n"
     "   8.    Removal of an entire 30-level deep tree of\n"
     "         directories consisting of a lots and lots of files\n"
+    "   9.    Unmount and remount of a tree of 127 directories\n"
+    "         w/ 100 files each\n"
     "\n"
     "OUTPUT\n"
     "   The ouput consists of a CSV w/out header:\n"
@@ -206,6 +208,31 @@ void e8()
   TEAR_DOWN();
 }
 
+void e9()
+{
+  char path[32] = { 0 };
+
+  SETUP();
+
+  for (int i = 0; i < 127; i++) {
+    sprintf(path, "/d%03d", i);
+    fs_filesystem_mkdir(g_fs, path);
+
+    for (int j = 0; j < 100; j++) {
+      sprintf(path, "/d%03d/f%02d", i, j);
+      fs_filesystem_touch(g_fs, path);
+    }
+  }
+
+  TICK();
+  fs_filesystem_destroy(g_fs);
+  g_fs = fs_filesystem_create(0);
+  fs_filesystem_mount(g_fs, FS_FNAME);
+  TOCK();
+
+  TEAR_DOWN();
+}
+
 int main(int argc, char* argv[])
 {
   if (argc < 2) {
@@ -237,6 +264,7 @@ int main(int argc, char* argv[])
   e6();
   e7();
   e8();
+  e9();
 
   return 0;
 }
@@ -0,0 +1,133 @@
+#ifndef FSSIM__BLOCKMAP_H
+#define FSSIM__BLOCKMAP_H
+
+#include "fssim/common.h"
+#include "fssim/constants.h"
+#include "fssim/fat.h"
+
+/**
+ * BLOCKMAP - logical to physical blocks of a file
+ *
+ * Regular files are stored in one of two ways:
+ *
+ *  - plain: `fblock` starts a FAT chain holding
+ *    the data, block after block;
+ *  - mapped (FS_FBLOCK_MAPPED set in `fblock`):
+ *    the chain holds a table w/ the physical
+ *    block of each logical one instead. Data
+ *    blocks are chains of their own (one block).
+ *
+ * A FS_BLOCKMAP_HOLE entry (block 0 is always the
+ * root directory's) takes no space and reads back
+ * as zeros. So does an *unwritten* block (entry
+ * w/ FS_BLOCKMAP_UNWRITTEN), which is reserved
+ * for the file but has never been written.
+ *
+ *  table: | magic | count | block0 | .. | blockN |
+ *           4B      4B      4B             4B
+ *
+ * Compressed files (FS_FBLOCK_COMPRESSED too)
+ * are mapped by cluster of FS_CLUSTER_BLOCKS
+ * instead: each one is stored (fs_lz_compress())
+ * in a chain of its own, along w/ its length. A
+ * cluster that doesn't get smaller is kept as
+ * is, its length being that of the data.
+ *
+ *  table: | magic | count | block0 | length0 | .. |
+ *           4B      4B      4B       4B
+ */
+
+typedef struct fs_blockmap_t {
+  uint32_t count; // logical blocks
+  uint32_t size;  // room in `blocks`
+  uint32_t* blocks;
+  uint32_t* lengths; // compressed: bytes stored per cluster
+  uint8_t* unwritten; // bit per block (NULL: all written)
+} fs_blockmap_t;
+
+static inline int fs_fblock_is_mapped(uint32_t fblock)
+{
+  return !!(fblock & FS_FBLOCK_MAPPED);
+}
+
+static inline int fs_fblock_is_compressed(uint32_t fblock)
+{
+  return !!(fblock & FS_FBLOCK_COMPRESSED);
+}
+
+/**
+ * First block of the chain of the file whose
+ * directory entry says `fblock`.
+ */
+static inline uint32_t fs_fblock_chain(uint32_t fblock)
+{
+  return fblock & ~(FS_FBLOCK_MAPPED | FS_FBLOCK_COMPRESSED);
+}
+
+static inline int fs_blockmap_is_unwritten(fs_blockmap_t* map, uint32_t i)
+{
+  return map->unwritten && CHECK_LBIT(map->unwritten[i / 8], i % 8);
+}
+
+static inline uint32_t fs_blockmap_count_for(uint64_t size)
+{
+  return (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+}
+
+static inline uint32_t fs_blockmap_clusters_for(uint64_t size)
+{
+  return (size + FS_CLUSTER_SIZE - 1) / FS_CLUSTER_SIZE;
+}
+
+/**
+ * Map of `count` holes.
+ */
+fs_blockmap_t* fs_blockmap_create(uint32_t count);
+
+/**
+ * Map of `count` clusters, all holes.
+ */
+fs_blockmap_t* fs_blockmap_create_compressed(uint32_t count);
+void fs_blockmap_destroy(fs_blockmap_t* map);
+
+/**
+ * Grows (w/ holes) or shrinks the map to `count`
+ * logical blocks (clusters, if compressed).
+ */
+void fs_blockmap_resize(fs_blockmap_t* map, uint32_t count);
+
+/**
+ * Flags block `i` as unwritten (or not).
+ */
+void fs_blockmap_set_unwritten(fs_blockmap_t* map, uint32_t i, int unwritten);
+
+/**
+ * Map of the first `count` blocks of the plain
+ * file starting at `first`.
+ */
+fs_blockmap_t* fs_blockmap_from_chain(fs_fat_t* fat, uint32_t first,
+                                      uint32_t count);
+
+/**
+ * Whether the map has holes or unwritten blocks
+ * (a plain chain can't have them).
+ */
+int fs_blockmap_is_sparse(fs_blockmap_t* map);
+
+/**
+ * Links the data blocks of a map w/out holes
+ * into a single chain, returning its first
+ * block.
+ */
+uint32_t fs_blockmap_chain(fs_blockmap_t* map, fs_fat_t* fat);
+
+size_t fs_blockmap_serialized_size(fs_blockmap_t* map);
+size_t fs_blockmap_serialize(fs_blockmap_t* map, unsigned char* buf, size_t n);
+
+/**
+ * Returns NULL if `buf` is malformed. Tells both
+ * kinds of table apart by their magic.
+ */
+fs_blockmap_t* fs_blockmap_load(unsigned char* buf, size_t n);
+
+#endif
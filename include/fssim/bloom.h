@@ -0,0 +1,56 @@
+#ifndef FSSIM__BLOOM_H
+#define FSSIM__BLOOM_H
+
+#include "fssim/common.h"
+#include "fssim/constants.h"
+#include "fssim/fbmap.h"
+
+/**
+ * BLOOM - subtree name summaries
+ *
+ * A small Bloom filter per directory holding
+ * every name below it: the whole name and each
+ * of its trigrams (so that globs w/ literal
+ * parts can be checked too). A filter that
+ * doesn't have all the keys of a query proves
+ * that nothing in the subtree matches it.
+ *
+ * Filters are kept in a map keyed by the first
+ * block of the directory (fbmap.h), so they
+ * survive the eviction of its node and can
+ * describe directories that only live on disk.
+ */
+
+typedef struct fs_bloom_t {
+  uint32_t fblock;
+  uint8_t stale; // a superset since names were removed
+  uint8_t bits[FS_BLOOM_SIZE];
+} fs_bloom_t;
+
+typedef fs_fbmap_t fs_bloom_map_t;
+
+void fs_bloom_add(uint8_t* bits, const char* fname);
+void fs_bloom_merge(uint8_t* bits, const uint8_t* other);
+
+/**
+ * Keys that any name matching `glob` must have.
+ * Returns how many were written to `keys` (0:
+ * no way to tell).
+ */
+unsigned fs_bloom_glob_keys(const char* glob, uint32_t* keys, unsigned n);
+int fs_bloom_has_keys(const uint8_t* bits, const uint32_t* keys, unsigned n);
+
+fs_bloom_map_t* fs_bloom_map_create(size_t size);
+void fs_bloom_map_destroy(fs_bloom_map_t* map);
+
+fs_bloom_t* fs_bloom_get(fs_bloom_map_t* map, uint32_t fblock);
+
+/**
+ * Returns the filter of `fblock`, adding an
+ * empty one if missing. Pointers previously
+ * returned may be invalidated.
+ */
+fs_bloom_t* fs_bloom_put(fs_bloom_map_t* map, uint32_t fblock);
+void fs_bloom_remove(fs_bloom_map_t* map, uint32_t fblock);
+
+#endif
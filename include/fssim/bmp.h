@@ -33,6 +33,18 @@ void fs_bmp_free(fs_bmp_t* bmp, uint32_t block);
  */
 uint32_t fs_bmp_alloc(fs_bmp_t* bmp);
 
+/**
+ * Same, for `count` contiguous blocks: returns
+ * the first one, or UINT32_MAX if there's no run
+ * that long.
+ */
+uint32_t fs_bmp_alloc_run(fs_bmp_t* bmp, uint32_t count);
+
+/**
+ * Number of blocks not in use
+ */
+size_t fs_bmp_free_count(fs_bmp_t* bmp);
+
 fs_bmp_t* fs_bmp_load(unsigned char* buf, size_t blocks);
 
 // TODO
@@ -17,6 +17,10 @@ typedef struct fs_cli_command_t {
 
 int fs_cli_command_mount(char** argv, unsigned argc, fs_simulator_t* sim);
 int fs_cli_command_cp(char** argv, unsigned argc, fs_simulator_t* sim);
+int fs_cli_command_mv(char** argv, unsigned argc, fs_simulator_t* sim);
+int fs_cli_command_append(char** argv, unsigned argc, fs_simulator_t* sim);
+int fs_cli_command_truncate(char** argv, unsigned argc, fs_simulator_t* sim);
+int fs_cli_command_fallocate(char** argv, unsigned argc, fs_simulator_t* sim);
 int fs_cli_command_mkdir(char** argv, unsigned argc, fs_simulator_t* sim);
 int fs_cli_command_rmdir(char** argv, unsigned argc, fs_simulator_t* sim);
 int fs_cli_command_cat(char** argv, unsigned argc, fs_simulator_t* sim);
@@ -25,13 +29,17 @@ int fs_cli_command_rm(char** argv, unsigned argc, fs_simulator_t* sim);
 int fs_cli_command_ls(char** argv, unsigned argc, fs_simulator_t* sim);
 int fs_cli_command_find(char** argv, unsigned argc, fs_simulator_t* sim);
 int fs_cli_command_df(char** argv, unsigned argc, fs_simulator_t* sim);
+int fs_cli_command_du(char** argv, unsigned argc, fs_simulator_t* sim);
 int fs_cli_command_unmount(char** argv, unsigned argc, fs_simulator_t* sim);
 int fs_cli_command_help(char** argv, unsigned argc, fs_simulator_t* sim);
 int fs_cli_command_sai(char** argv, unsigned argc, fs_simulator_t* sim);
+int fs_cli_command_stats(char** argv, unsigned argc, fs_simulator_t* sim);
+int fs_cli_command_scrub(char** argv, unsigned argc, fs_simulator_t* sim);
+int fs_cli_command_snapshot(char** argv, unsigned argc, fs_simulator_t* sim);
 
 static const char* FS_CLI_PROMPT = "[ep3] ";
 
-#define FS_CLI_COMMANDS_SIZE 13
+#define FS_CLI_COMMANDS_SIZE 21
 
 const static char* FS_CLI_WELCOME =
     "\n"
@@ -39,18 +47,26 @@ const static char* FS_CLI_WELCOME =
     "If you need help, type `help`.\n\n";
 
 const static fs_cli_command_t FS_CLI_COMMANDS[] = {
+  { "append", &fs_cli_command_append },
   { "cat", &fs_cli_command_cat },
   { "cp", &fs_cli_command_cp },
   { "df", &fs_cli_command_df },
+  { "du", &fs_cli_command_du },
+  { "fallocate", &fs_cli_command_fallocate },
   { "find", &fs_cli_command_find },
   { "help", &fs_cli_command_help },
   { "ls", &fs_cli_command_ls },
   { "mkdir", &fs_cli_command_mkdir },
   { "mount", &fs_cli_command_mount },
+  { "mv", &fs_cli_command_mv },
   { "rm", &fs_cli_command_rm },
   { "rmdir", &fs_cli_command_rmdir },
   { "sai", &fs_cli_command_sai },
+  { "scrub", &fs_cli_command_scrub },
+  { "snapshot", &fs_cli_command_snapshot },
+  { "stats", &fs_cli_command_stats },
   { "touch", &fs_cli_command_touch },
+  { "truncate", &fs_cli_command_truncate },
   { "unmount", &fs_cli_command_unmount },
 };
 
@@ -61,12 +77,38 @@ const static char* FS_CLI_HELP =
     "  Starts a prompt which accepts the following commands:\n"
     "\n"
     "COMMANDS:\n"
-    "  mount <fname>         mounts the fs in the given <fname>. In\n"
+    "  mount <fname> [budget]\n"
+    "                        mounts the fs in the given <fname>. In\n"
     "                        case <fname> already exists, countinues\n"
-    "                        from where it stopped.\n"
+    "                        from where it stopped. With [budget]\n"
+    "                        (bytes), directory metadata is kept\n"
+    "                        under it, loaded on demand.\n"
     "\n"
-    "  cp <src> <dest>       copies a file from the real system to the\n"
-    "                        simulated filesystem (dest).\n"
+    "  cp [-z|-d] <src> <dest>\n"
+    "                        copies a file from the real system to the\n"
+    "                        simulated filesystem (dest). W/ `-z`, it's\n"
+    "                        stored compressed; w/ `-d`, blocks already\n"
+    "                        in the image are shared.\n"
+    "\n"
+    "  cp --reflink <src> <dest>\n"
+    "                        copies a file of the simulated filesystem\n"
+    "                        instantly, sharing its blocks\n"
+    "\n"
+    "  append <src> <dest>   adds a file from the real system to the\n"
+    "                        end of <dest> (created if missing)\n"
+    "\n"
+    "  truncate <fname> <size>\n"
+    "                        cuts <fname> short to <size> bytes (or\n"
+    "                        grows it, w/ zeros)\n"
+    "\n"
+    "  fallocate [-k] <fname> <size>\n"
+    "                        reserves contiguous blocks for the first\n"
+    "                        <size> bytes of <fname> (created if\n"
+    "                        missing), which read as zeros until\n"
+    "                        written. W/ `-k`, its size stays.\n"
+    "\n"
+    "  mv <src> <dest>       moves (renames) a file or a directory,\n"
+    "                        replacing <dest> if it's a file\n"
     "\n"
     "  mkdir <dir>           creates a directory named <dir>\n"
     "\n"
@@ -84,14 +126,34 @@ const static char* FS_CLI_HELP =
     "                        <dir>, showing $name, $size, $last_mod for\n"
     "                        files and an indicator for directories.\n"
     "\n"
-    "  find <dir> <fname>    taking <dir> as root, recursively searches\n"
-    "                        for a file named <fname>\n"
+    "  find <dir> <glob> [-size [+-]N[K|M]] [-mmin [+-]N]\n"
+    "                        taking <dir> as root, recursively searches\n"
+    "                        (in parallel) for files whose name matches\n"
+    "                        <glob>, optionally bigger (+), smaller (-)\n"
+    "                        or exactly as big as N bytes and modified\n"
+    "                        more (+), less (-) or exactly N minutes ago\n"
     "\n"
     "  df                    shows filesystem info, including number of\n"
     "                        diferectories, files, freespace and wasted\n"
     "                        space\n"
     "\n"
-    "  unmount               unmounts the current filesystem\n"
+    "  du <dir>              shows the number of files and directories\n"
+    "                        below <dir> and the space they take\n"
+    "\n"
+    "  stats                 shows internal statistics (path cache\n"
+    "                        hit rates, metadata memory)\n"
+    "\n"
+    "  scrub                 checks every block in use (and the FAT)\n"
+    "                        against its checksum, in parallel,\n"
+    "                        listing the corrupt ones\n"
+    "\n"
+    "  snapshot <dir>        creates <dir> holding a read-only copy of\n"
+    "                        the whole tree, sharing its blocks. It\n"
+    "                        goes away w/ `rmdir`\n"
+    "\n"
+    "  unmount               unmounts the current filesystem,\n"
+    "                        leaving a snapshot of the tree for a\n"
+    "                        fast remount\n"
     "\n"
     "  help                  shows this message\n"
     "\n"
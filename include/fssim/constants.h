@@ -11,6 +11,27 @@
 
 #define FS_NAME_MAX 11
 
+// a directory must fit in a single block: 32B of
+// metadata + 127 32B entries.
+#define FS_DIR_MAX_CHILDREN 127
+
+// directories w/ more than FS_DIR_HTABLE_THRESHOLD
+// children get an open-addressing index of them.
+// FS_DIR_HTABLE_SIZE must be a power of two and at
+// least twice FS_DIR_MAX_CHILDREN (load <= .5).
+#define FS_DIR_HTABLE_THRESHOLD 8
+#define FS_DIR_HTABLE_SIZE 256
+
+// objects per slab chunk in a file arena
+#define FS_ARENA_CHUNK_FILES 1024
+#define FS_ARENA_CHUNK_DIRENTS 64
+#define FS_ARENA_CHUNK_HTABLES 16
+
+// directory children arrays grow in size classes
+// of FS_ARENA_DIRENTS_MIN << k entries
+#define FS_ARENA_DIRENTS_MIN 4
+#define FS_ARENA_DIRENTS_CLASSES 6
+
 #define FS_BLOCK_SIZE 4096
 #define FS_PARTITION_SIZE 100 * FS_MEGABYTE
 #define FS_BLOCKS_NUM FS_PARTITION_SIZE / FS_BLOCK_SIZE
@@ -27,6 +48,7 @@
 
 #define FS_LS_FORMAT "%c %7s %16s %-10s\n"
 #define FS_LS_FORMAT_SIZE 39
+#define FS_READDIR_BATCH 32
 
 static const char* FS_FSIZE_UNITS[] = { "B", "KB", "MB", "GB" };
 
@@ -46,4 +68,148 @@ typedef enum fs_file_type {
 
 #define FS_OFFSET_FILE_ENTRY 32
 
+// first byte of a directory entry
+#define FS_ENTRY_DIRECTORY 0x01
+#define FS_ENTRY_READONLY 0x02
+
+#define FS_TREE_EVICTED 0xff
+
+// bytes 1..31 of the header of the root directory
+// block: set by a clean unmount
+#define FS_ROOT_FLAGS_OFFSET 1
+#define FS_ROOT_FLAG_CLEAN 0x01
+#define FS_ROOT_FLAG_CSUM 0x02 // has a checksum table
+#define FS_ROOT_SNAPSHOT_OFFSET 2
+#define FS_ROOT_SNAPSHOT_SIZE_OFFSET 6
+#define FS_ROOT_NAMEIDX_OFFSET 10
+#define FS_ROOT_NAMEIDX_SIZE_OFFSET 14
+#define FS_ROOT_USAGE_OFFSET 18 // fs_fsinfo_serialize()
+#define FS_ROOT_HEADER_SIZE 30
+
+// used | wasted | files (2B) | directories (2B)
+#define FS_FSINFO_SERIALIZED_SIZE 12
+
+// magic | size | bmp next-fit cursor | partial (has evicted dirs) |
+// end of the tree (where the dedup table starts) | the table's size
+#define FS_SNAPSHOT_MAGIC 0x46534e50 // "FSNP"
+#define FS_SNAPSHOT_HEADER_SIZE 24
+
+// magic | fs_nameidx_serialize()
+#define FS_NAMEIDX_MAGIC 0x46534e58 // "FSNX"
+
+#define FS_DCACHE_SIZE 1024
+#define FS_DCACHE_PATH_MAX 128
+
+#define FS_SCRATCH_SIZE 4096
+
+#define FS_DIRBLOCK_CACHE_SIZE 16
+
+#define FS_NAMEIDX_SIZE 1024
+
+#define FS_FIND_THREADS_MAX 64
+#define FS_FIND_DEQUE_SIZE 64
+
+// bytes per filter (8 bits each), bits set per
+// key and most keys a glob query gets
+#define FS_BLOOM_SIZE 128
+#define FS_BLOOM_HASHES 3
+#define FS_BLOOM_KEYS_MAX 16
+#define FS_BLOOM_MAP_SIZE 64
+
+#define FS_FSINFO_MAP_SIZE 64
+
+// set in the `fblock` of files stored as a block
+// table (see blockmap.h)
+#define FS_FBLOCK_MAPPED 0x80000000u
+#define FS_BLOCKMAP_HOLE 0
+#define FS_BLOCKMAP_MAGIC 0x46534d50 // "FSMP"
+#define FS_BLOCKMAP_HEADER_SIZE 8
+// set in table entries of blocks reserved w/
+// `fallocate` but not written yet
+#define FS_BLOCKMAP_UNWRITTEN 0x80000000u
+
+// blocks read from the source per request on
+// `cp`
+#define FS_INGEST_BLOCKS 16
+
+// compressed files: FS_CLUSTER_BLOCKS logical
+// blocks are compressed (and read back) together
+#define FS_FBLOCK_COMPRESSED 0x40000000u
+#define FS_BLOCKMAP_Z_MAGIC 0x46534d5a // "FSMZ"
+#define FS_CLUSTER_BLOCKS 16
+#define FS_CLUSTER_SIZE (FS_CLUSTER_BLOCKS * FS_BLOCK_SIZE)
+
+#define FS_LZ_HASH_BITS 12
+#define FS_LZ_MIN_MATCH 4
+
+// magic | fs_dedup_serialize()
+#define FS_DEDUP_MAGIC 0x46534444 // "FSDD"
+#define FS_DEDUP_MAP_SIZE 1024
+
+// CRC32C of every block, in a table taking the
+// last blocks of the image:
+// magic | crc of superblock, FAT and BMP | crc0 | ..
+#define FS_CSUM_MAGIC 0x46534353 // "FSCS"
+#define FS_CSUM_HEADER_SIZE 8
+// entry of a block reserved w/ `fallocate` and not
+// written yet: skipped when checking (so is a
+// block whose CRC happens to be just that)
+#define FS_CSUM_UNWRITTEN 0xffffffffu
+
+// blocks per request when reading data back
+// (`cat`, `scrub`)
+#define FS_READ_BLOCKS 64
+
+// blocks hinted ahead of a sequential stream of
+// reads: the window starts at the first and
+// doubles up to the second
+#define FS_READAHEAD_MIN 8
+#define FS_READAHEAD_MAX 256
+
+// fs_filesystem_open()
+#define FS_OPEN_WRITE 0x01
+#define FS_OPEN_CREATE 0x02
+
+// new blocks a handle keeps in memory before
+// taking room for them all at once (delayed
+// allocation)
+#define FS_DELALLOC_BLOCKS 256
+
+// fs_filesystem_fallocate()
+#define FS_FALLOC_KEEP_SIZE 0x01
+
+// last blocks of plain files kept for `append`
+// (direct-mapped by first block)
+#define FS_TAILS_SIZE 64
+
+#define FS_DU_FORMAT                                                           \
+  "Files:          %5u\n"                                                      \
+  "Directories:    %5u\n"                                                      \
+  "Used Space:     %6s\n"                                                      \
+  "Wasted Space:   %6s\n"
+
+#define FS_DU_FORMAT_SIZE sizeof(FS_DU_FORMAT) + 22
+
+#define FS_DCACHE_STATS_FORMAT                                                 \
+  "Path cache:\n"                                                              \
+  "  Hits:           %10llu\n"                                                 \
+  "  Negative hits:  %10llu\n"                                                 \
+  "  Misses:         %10llu\n"                                                 \
+  "  Hit rate:       %9.1f%%\n"                                                \
+  "  Invalidations:  %10llu\n"
+
+#define FS_DCACHE_STATS_FORMAT_SIZE sizeof(FS_DCACHE_STATS_FORMAT) + 64
+
+#define FS_META_STATS_FORMAT                                                   \
+  "Metadata:\n"                                                                \
+  "  Resident:       %10llu B\n"                                               \
+  "  Budget:         %10llu B\n"                                               \
+  "  Evictions:      %10llu\n"                                                 \
+  "  Reloads:        %10llu\n"
+
+#define FS_META_STATS_FORMAT_SIZE sizeof(FS_META_STATS_FORMAT) + 64
+
+#define FS_STATS_FORMAT_SIZE                                                   \
+  (FS_DCACHE_STATS_FORMAT_SIZE + FS_META_STATS_FORMAT_SIZE)
+
 #endif
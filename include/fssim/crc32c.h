@@ -0,0 +1,26 @@
+#ifndef FSSIM__CRC32C_H
+#define FSSIM__CRC32C_H
+
+#include "fssim/common.h"
+
+/**
+ * CRC32C - Castagnoli checksums
+ *
+ * Computed w/ the `crc32` instruction of SSE4.2
+ * where the CPU has it (checked once, at run
+ * time) and w/ slicing-by-8 tables otherwise.
+ * Both give the same result.
+ */
+
+/**
+ * Extends `crc` (0 to start) w/ the `n` bytes at
+ * `buf`.
+ */
+uint32_t fs_crc32c(uint32_t crc, const void* buf, size_t n);
+
+/**
+ * The same, always w/ the tables.
+ */
+uint32_t fs_crc32c_sw(uint32_t crc, const void* buf, size_t n);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef FSSIM__DCACHE_H
+#define FSSIM__DCACHE_H
+
+#include "fssim/common.h"
+#include "fssim/constants.h"
+#include "fssim/file.h"
+
+/**
+ * DCACHE - Directory Entry Cache
+ *
+ * Direct-mapped cache of (normalized) absolute
+ * path -> fs_file_t*. A NULL file represents a
+ * negative entry: the path is known not to
+ * exist.
+ *
+ * Invalidating the whole cache is O(1): entries
+ * are only valid if they carry the current
+ * generation.
+ */
+
+typedef struct fs_dcache_entry_t {
+  uint32_t hash;
+  uint32_t generation;
+  uint16_t length;
+  char path[FS_DCACHE_PATH_MAX];
+  fs_file_t* file;
+} fs_dcache_entry_t;
+
+typedef struct fs_dcache_stats_t {
+  uint64_t hits;
+  uint64_t negative_hits;
+  uint64_t misses;
+  uint64_t invalidations;
+} fs_dcache_stats_t;
+
+typedef struct fs_dcache_t {
+  size_t size;
+  uint32_t generation;
+  fs_dcache_entry_t* entries;
+  fs_dcache_stats_t stats;
+} fs_dcache_t;
+
+/**
+ * Creates a cache w/ `size` slots. `size` must be
+ * a power of two.
+ */
+fs_dcache_t* fs_dcache_create(size_t size);
+void fs_dcache_destroy(fs_dcache_t* cache);
+
+/**
+ * Writes to `buf` the normalized version of the
+ * absolute `path` (no repeated nor trailing
+ * slashes). Returns its length or -1 if it
+ * doesn't fit in `n` bytes.
+ */
+int fs_dcache_normalize(const char* path, char* buf, size_t n);
+
+/**
+ * Returns 1 on a hit, setting `file` (NULL if the
+ * entry is negative), 0 otherwise.
+ */
+int fs_dcache_get(fs_dcache_t* cache, const char* path, fs_file_t** file);
+
+/**
+ * Caches `file` (NULL for a negative entry) under
+ * `path`, replacing whatever occupied the slot.
+ */
+void fs_dcache_put(fs_dcache_t* cache, const char* path, fs_file_t* file);
+
+/**
+ * Drops the entry for `path` (if any).
+ */
+void fs_dcache_forget(fs_dcache_t* cache, const char* path);
+
+/**
+ * Drops every entry.
+ */
+void fs_dcache_invalidate(fs_dcache_t* cache);
+
+int fs_dcache_stats(fs_dcache_t* cache, char* buf, size_t n);
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef FSSIM__DEDUP_H
+#define FSSIM__DEDUP_H
+
+#include "fssim/common.h"
+#include "fssim/constants.h"
+#include "fssim/fat.h"
+
+/**
+ * DEDUP - block fingerprints
+ *
+ * Maps the hash of the content of a data block
+ * to the block holding it, so that a block being
+ * written can take a reference to an identical
+ * one instead (fs_fat_share()).
+ *
+ * Only blocks written through here (`owned`) are
+ * handed out: a block that gets freed must be
+ * forgotten (fs_dedup_forget()) so that it can't
+ * be shared once reused by something else.
+ * Entries may still go stale (their block
+ * fingerprinted again w/ another content) and
+ * hashes may collide, so a candidate is only
+ * taken after comparing its content.
+ *
+ * Persisted along w/ the reference counts of the
+ * FAT (the only copy of them besides the tables
+ * of the files):
+ *
+ *  | magic | fps | refs | hash | block | .. | block | refs | .. |
+ *    4B      4B    4B     8B     4B           4B      2B
+ */
+
+typedef struct fs_dedup_entry_t {
+  uint64_t hash;
+  uint32_t block;
+} fs_dedup_entry_t;
+
+typedef struct fs_dedup_t {
+  size_t count;
+  size_t mask;
+  fs_dedup_entry_t* slots;
+  size_t blocks;
+  uint8_t* owned; // a bit per block
+} fs_dedup_t;
+
+uint64_t fs_dedup_hash(const uint8_t* block);
+
+fs_dedup_t* fs_dedup_create(size_t size, size_t blocks);
+void fs_dedup_destroy(fs_dedup_t* dedup);
+
+/**
+ * Block last seen w/ `hash`, UINT32_MAX if none.
+ */
+uint32_t fs_dedup_get(fs_dedup_t* dedup, uint64_t hash);
+
+/**
+ * Records (or replaces) the block w/ `hash`.
+ */
+void fs_dedup_put(fs_dedup_t* dedup, uint64_t hash, uint32_t block);
+
+static inline int fs_dedup_owns(fs_dedup_t* dedup, uint32_t block)
+{
+  return block < dedup->blocks &&
+         CHECK_LBIT(dedup->owned[block / 8], block % 8);
+}
+
+/**
+ * `block` is about to be freed.
+ */
+static inline void fs_dedup_forget(fs_dedup_t* dedup, uint32_t block)
+{
+  if (fs_dedup_owns(dedup, block))
+    SET_LBIT(dedup->owned[block / 8], block % 8);
+}
+
+/**
+ * Entries whose block was forgotten are dropped.
+ */
+size_t fs_dedup_serialized_size(fs_dedup_t* dedup, fs_fat_t* fat);
+size_t fs_dedup_serialize(fs_dedup_t* dedup, fs_fat_t* fat, unsigned char* buf,
+                          size_t n);
+
+/**
+ * Returns NULL if `buf` is malformed. Reference
+ * counts go to `fat`.
+ */
+fs_dedup_t* fs_dedup_load(fs_fat_t* fat, unsigned char* buf, size_t n);
+
+#endif
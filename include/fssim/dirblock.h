@@ -0,0 +1,84 @@
+#ifndef FSSIM__DIRBLOCK_H
+#define FSSIM__DIRBLOCK_H
+
+#include "fssim/common.h"
+#include "fssim/constants.h"
+#include "fssim/file.h"
+
+/**
+ * DIRBLOCK - raw directory blocks
+ *
+ * Operations over directory blocks as laid out
+ * by fs_file_serialize_dir():
+ *
+ *  0      32     64           4096
+ *  +------+------+-- ..  --+------+
+ *  | hdr  | ent0 |         | e126 |
+ *  +------+------+-- ..  --+------+
+ *
+ *  ent: | flags | fname | fblock | ctime | mtime | atime | size |
+ *         1B      11B     4B       4B      4B      4B      4B
+ *
+ * w/ FS_ENTRY_DIRECTORY and FS_ENTRY_READONLY
+ * in `flags`
+ *
+ * so that a path can be resolved w/out
+ * materializing tree nodes. Blocks are kept in a
+ * small direct-mapped cache keyed by block
+ * number.
+ */
+
+/**
+ * What an entry holds: enough to stat or read a
+ * file w/out a tree node.
+ */
+typedef struct fs_dirent_t {
+  uint32_t fblock;
+  fs_file_attr_t attrs;
+} fs_dirent_t;
+
+typedef struct fs_dirblock_cache_t {
+  size_t size;
+  uint32_t* tags; // block held by each slot (UINT32_MAX: empty)
+  uint8_t* blocks;
+} fs_dirblock_cache_t;
+
+static inline unsigned fs_dirblock_count(const uint8_t* block)
+{
+  return block[0];
+}
+
+/**
+ * Searches the entries of `block` for `fname`
+ * (`length` bytes, not necessarily
+ * NUL-terminated). Returns the index of the
+ * entry or -1.
+ */
+int fs_dirblock_find(const uint8_t* block, const char* fname, size_t length);
+
+void fs_dirblock_entry(const uint8_t* block, unsigned i, fs_dirent_t* entry);
+
+/**
+ * (De)serialization of a single 32B entry.
+ */
+void fs_dirblock_encode(uint8_t* buf, uint32_t fblock,
+                        const fs_file_attr_t* attrs);
+void fs_dirblock_decode(const uint8_t* buf, fs_dirent_t* entry);
+
+fs_dirblock_cache_t* fs_dirblock_cache_create(size_t size);
+void fs_dirblock_cache_destroy(fs_dirblock_cache_t* cache);
+
+/**
+ * Returns the cached copy of `fblock` (NULL if
+ * not cached).
+ */
+uint8_t* fs_dirblock_cache_get(fs_dirblock_cache_t* cache, uint32_t fblock);
+
+/**
+ * Assigns a slot to `fblock` (dropping whatever it
+ * held) and returns it so that it gets filled.
+ */
+uint8_t* fs_dirblock_cache_slot(fs_dirblock_cache_t* cache, uint32_t fblock);
+void fs_dirblock_cache_forget(fs_dirblock_cache_t* cache, uint32_t fblock);
+
+#endif
@@ -20,11 +20,17 @@
  *
  *  say file->block = x. Then x->1->2 corresponds
  *  to the physical blocks of the file.
+ *
+ * Blocks may be shared by several files (see
+ * dedup.h): `refs` counts the references each one
+ * has besides the first. Sharing a block shares
+ * the rest of its chain too.
  */
 
 typedef struct fs_fat_t {
   size_t length;
   uint32_t* blocks;
+  uint16_t* refs;
   fs_bmp_t* bmp;
 } fs_fat_t;
 
@@ -32,9 +38,25 @@ fs_fat_t* fs_fat_create(size_t length);
 fs_fat_t* fs_fat_load(unsigned char* buf, size_t blocks);
 void fs_fat_destroy(fs_fat_t* fat);
 
+/**
+ * Drops a reference to the chain at `file_pos`,
+ * only freeing it when it was the last one.
+ */
 void fs_fat_removefile(fs_fat_t* fat, uint32_t file_pos);
+
+/**
+ * Adds a reference to the chain at `block`.
+ * Returns 0 if it already has as many as it can.
+ */
+int fs_fat_share(fs_fat_t* fat, uint32_t block);
 uint32_t fs_fat_addfile(fs_fat_t* fat);
 uint32_t fs_fat_addblock(fs_fat_t* fat, uint32_t file_pos);
+
+/**
+ * Allocates a whole chain of `count` blocks at
+ * once, returning its first block.
+ */
+uint32_t fs_fat_allocfile(fs_fat_t* fat, uint32_t count);
 int fs_fat_serialize(fs_fat_t* fat, unsigned char* buf, int n);
 
 #endif
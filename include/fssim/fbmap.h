@@ -0,0 +1,41 @@
+#ifndef FSSIM__FBMAP_H
+#define FSSIM__FBMAP_H
+
+#include "fssim/common.h"
+
+/**
+ * FBMAP - per-directory maps
+ *
+ * Open-addressing map keyed by the first block of
+ * a file (linear probing, at most half full,
+ * backward-shift deletion: no tombstones).
+ *
+ * Entries are `entry_size` bytes each and start
+ * w/ their `uint32_t` key; a key of UINT32_MAX
+ * marks an empty slot.
+ */
+
+typedef struct fs_fbmap_t {
+  size_t count;
+  size_t mask;
+  size_t entry_size;
+  uint8_t* slots;
+} fs_fbmap_t;
+
+/**
+ * `size` must be a power of two.
+ */
+fs_fbmap_t* fs_fbmap_create(size_t size, size_t entry_size);
+void fs_fbmap_destroy(fs_fbmap_t* map);
+
+void* fs_fbmap_get(fs_fbmap_t* map, uint32_t fblock);
+
+/**
+ * Returns the entry of `fblock`, adding a zeroed
+ * one (but for its key) if missing. Pointers
+ * previously returned may be invalidated.
+ */
+void* fs_fbmap_put(fs_fbmap_t* map, uint32_t fblock);
+void fs_fbmap_remove(fs_fbmap_t* map, uint32_t fblock);
+
+#endif
@@ -3,11 +3,12 @@
 
 #include "fssim/common.h"
 #include "fssim/constants.h"
-#include "fssim/llist.h"
+#include "fssim/slab.h"
 #include "fssim/file_utils.h"
 
 typedef struct fs_file_attrs_t {
   uint8_t is_directory;
+  uint8_t readonly; // part of a snapshot
   char fname[FS_NAME_MAX];
   int32_t ctime;
   int32_t mtime;
@@ -15,28 +16,182 @@ typedef struct fs_file_attrs_t {
   uint32_t size;
 } fs_file_attr_t;
 
+/**
+ * Backing storage for the nodes of a tree. The
+ * `files` slab is the node table: every file is
+ * addressable by its 32-bit id (see
+ * fs_file_id()). Directory children arrays and
+ * indexes come from the other slabs.
+ */
+typedef struct fs_file_arena_t {
+  fs_slab_t* files;
+  fs_slab_t* dirents[FS_ARENA_DIRENTS_CLASSES];
+  fs_slab_t* htables;
+} fs_file_arena_t;
+
+/**
+ * Whether the children of a directory are in
+ * memory. Evicted directories keep their own
+ * node; their children are read back from the
+ * directory block when needed.
+ */
+typedef enum fs_file_residency {
+  FS_FILE_RESIDENT = 0, // recently used
+  FS_FILE_COLD,         // candidate for eviction
+  FS_FILE_PINNED,       // in use, can't be evicted
+  FS_FILE_EVICTED
+} fs_file_residency;
+
+/**
+ * Directories keep their children in a single
+ * contiguous block of `children_size` slots laid
+ * out as columns (ids first, then names), in
+ * insertion order:
+ *
+ *  children
+ *  |
+ *  v
+ *  +----+----+-- ..  --+-------+-------+-- ..  --+
+ *  | id | id |         | fname | fname |         |
+ *  +----+----+-- ..  --+-------+-------+-- ..  --+
+ *    4B                   11B
+ *
+ * so that a lookup walks names linearly and a
+ * scan walks ids linearly.
+ */
 typedef struct fs_file_t {
   uint32_t fblock;
   fs_file_attr_t attrs;
 
   struct fs_file_t* parent;
-  fs_llist_t* children;
+  fs_file_arena_t* arena;
+
+  uint32_t* children;
+
+  // lazily built (see FS_DIR_HTABLE_THRESHOLD).
+  // id + 1 in `arena->htables` (0: not built).
+  // Each slot holds a child index + 1 (0: empty).
+  uint32_t htable;
+
   uint8_t children_count;
+  uint8_t children_size;
+  uint8_t owns_arena;
+  uint8_t residency;
 } fs_file_t;
 
 static const struct fs_file_attrs_t fs_zeroed_file_attrs = { 0 };
 static const struct fs_file_t fs_zeroed_file = { 0 };
 
+fs_file_arena_t* fs_file_arena_create();
+
+/**
+ * Releases every node allocated from the arena at
+ * once. Trees living in it must not be used
+ * afterwards.
+ */
+void fs_file_arena_destroy(fs_file_arena_t* arena);
+
+/**
+ * Bytes of node, children and index slots
+ * currently handed out by the arena.
+ */
+size_t fs_file_arena_usage(fs_file_arena_t* arena);
+
 // TODO remove parent arg
 //      identify root with FILE_TYPE, which makes
 //      much more sense.
+/**
+ * Creates a file in the same arena as `parent`.
+ * W/out a parent, the file gets an arena of its
+ * own, released when it is destroyed.
+ */
 fs_file_t* fs_file_create(const char* fname, fs_file_type type,
                           fs_file_t* parent);
+
+/**
+ * Creates a file backed by `arena` (NULL for a
+ * new one, owned by the file).
+ */
+fs_file_t* fs_file_create_in(fs_file_arena_t* arena, const char* fname,
+                             fs_file_type type, fs_file_t* parent);
 void fs_file_load_dir(fs_file_t* file, unsigned char* buf);
 void fs_file_destroy(fs_file_t* file);
+
+/**
+ * Releases everything below `dir` back to the
+ * arena, leaving `dir` itself as
+ * FS_FILE_EVICTED. fs_file_load_dir() brings
+ * its children back.
+ */
+void fs_file_evict(fs_file_t* dir);
+
+/**
+ * Appends `other` to `dir`. Both must live in the
+ * same arena.
+ */
 void fs_file_addchild(fs_file_t* dir, fs_file_t* other);
+
+/**
+ * Unlinks `child` from the directory. The file
+ * itself is not destroyed.
+ */
+void fs_file_removechild(fs_file_t* dir, fs_file_t* child);
+
+/**
+ * Searches `dir` (one layer only) for a child
+ * named `fname`.
+ */
+fs_file_t* fs_file_lookup(fs_file_t* dir, const char* fname);
+
+/**
+ * Same as fs_file_lookup() for a name that is
+ * not NUL-terminated (e.g, a path component).
+ */
+fs_file_t* fs_file_lookupn(fs_file_t* dir, const char* fname, size_t length);
 int fs_file_serialize_dir(fs_file_t* file, unsigned char* buf, int n);
 
+/**
+ * Compact serialization of the whole tree below
+ * `dir`, in preorder: the children count of a
+ * directory (FS_TREE_EVICTED if its children
+ * are only on disk) followed by its children,
+ * each as a directory block entry followed by
+ * its own tree if a directory.
+ */
+size_t fs_file_tree_size(fs_file_t* dir);
+size_t fs_file_serialize_tree(fs_file_t* dir, unsigned char* buf, size_t n);
+
+/**
+ * Rebuilds below `dir` a tree serialized w/
+ * fs_file_serialize_tree(). Returns the number of
+ * bytes consumed or 0 if `buf` is malformed (in
+ * which case `dir` is left partially loaded).
+ */
+size_t fs_file_load_tree(fs_file_t* dir, unsigned char* buf, size_t n);
+
+static inline uint32_t fs_file_id(const fs_file_t* file)
+{
+  return fs_slab_id(file);
+}
+
+static inline fs_file_t* fs_file_node(fs_file_arena_t* arena, uint32_t id)
+{
+  return (fs_file_t*)fs_slab_at(arena->files, id);
+}
+
+/**
+ * The i-th child of `dir`, in insertion order.
+ */
+static inline fs_file_t* fs_file_child(fs_file_t* dir, unsigned i)
+{
+  return fs_file_node(dir->arena, dir->children[i]);
+}
+
+static inline const char* fs_file_child_name(fs_file_t* dir, unsigned i)
+{
+  return (const char*)(dir->children + dir->children_size) + i * FS_NAME_MAX;
+}
+
 inline static void fs_file_destructor(void* data)
 {
   fs_file_destroy((fs_file_t*)data);
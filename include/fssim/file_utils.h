@@ -6,6 +6,22 @@
 #include <time.h>
 #include <sys/sendfile.h>
 
+/**
+ * Zero-copy iterator over the components of an
+ * absolute path: each step points `name` into the
+ * original string, `length` bytes long.
+ *
+ *   fs_path_iter_t it;
+ *   fs_utils_pathiter(&it, "/bin//ls/");
+ *   while (fs_utils_pathnext(&it))
+ *     ... "bin" (3), "ls" (2)
+ */
+typedef struct fs_path_iter_t {
+  const char* cursor;
+  const char* name;
+  size_t length;
+} fs_path_iter_t;
+
 int32_t fs_utils_gettime();
 int fs_utils_fsize(FILE* file);
 char** fs_utils_splitpath(const char* input, unsigned* size);
@@ -13,6 +29,43 @@ int fs_utils_secs2str(int32_t secs, char* buf, int n);
 int fs_utils_fsize2str(int32_t secs, char* buf, int n);
 FILE* fs_utils_mkfile(const char* fname, size_t size);
 
+/**
+ * Whether the `n` bytes at `buf` (a multiple of
+ * 64) are all zero.
+ */
+int fs_utils_iszero(const uint8_t* buf, size_t n);
+
+static inline void fs_utils_pathiter(fs_path_iter_t* it, const char* path)
+{
+  ASSERT(path[0] == '/', "%s is not an abs path.", path);
+
+  it->cursor = path;
+  it->name = NULL;
+  it->length = 0;
+}
+
+static inline int fs_utils_pathnext(fs_path_iter_t* it)
+{
+  const char* p = it->cursor;
+
+  while (*p == '/')
+    p++;
+
+  if (!*p) {
+    it->cursor = p;
+    return 0;
+  }
+
+  it->name = p;
+  while (*p && *p != '/')
+    p++;
+
+  it->length = p - it->name;
+  it->cursor = p;
+
+  return 1;
+}
+
 static int fs_utils_fexists(const char* fname)
 {
   return !access(fname, F_OK) ? 1 : 0;
@@ -47,6 +100,15 @@ static inline unsigned char* serialize_int32_t(unsigned char* buffer,
   return buffer + 4;
 }
 
+static inline unsigned char* serialize_uint16_t(unsigned char* buffer,
+                                                uint16_t value)
+{
+  buffer[0] = value >> 8;
+  buffer[1] = value;
+
+  return buffer + 2;
+}
+
 static inline unsigned char* serialize_uint8_t(unsigned char* buffer,
                                                uint8_t value)
 {
@@ -62,13 +124,18 @@ static inline uint8_t deserialize_uint8_t(unsigned char* buffer)
   return value;
 }
 
+static inline uint16_t deserialize_uint16_t(unsigned char* buffer)
+{
+  return buffer[0] << 8 | buffer[1];
+}
+
 static inline uint32_t deserialize_uint32_t(unsigned char* buffer)
 {
   uint32_t value = 0;
 
-  value |= buffer[0] << 24;
-  value |= buffer[1] << 16;
-  value |= buffer[2] << 8;
+  value |= (uint32_t)buffer[0] << 24;
+  value |= (uint32_t)buffer[1] << 16;
+  value |= (uint32_t)buffer[2] << 8;
   value |= buffer[3];
 
   return value;
@@ -78,9 +145,9 @@ static inline int32_t deserialize_int32_t(unsigned char* buffer)
 {
   uint32_t value = 0;
 
-  value |= buffer[0] << 24;
-  value |= buffer[1] << 16;
-  value |= buffer[2] << 8;
+  value |= (uint32_t)buffer[0] << 24;
+  value |= (uint32_t)buffer[1] << 16;
+  value |= (uint32_t)buffer[2] << 8;
   value |= buffer[3];
 
   return value;
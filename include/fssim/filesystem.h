@@ -1,11 +1,21 @@
 #ifndef FSSIM__FILESYSTEM_H
 #define FSSIM__FILESYSTEM_H
 
+#include "fssim/blockmap.h"
+#include "fssim/bloom.h"
 #include "fssim/common.h"
+#include "fssim/crc32c.h"
+#include "fssim/dcache.h"
+#include "fssim/dedup.h"
+#include "fssim/dirblock.h"
 #include "fssim/fat.h"
 #include "fssim/file.h"
+#include "fssim/find.h"
 #include "fssim/fsinfo.h"
+#include "fssim/lz.h"
+#include "fssim/nameidx.h"
 #include "fssim/file_utils.h"
+#include "fssim/scratch.h"
 
 #include <math.h>
 
@@ -14,6 +24,14 @@ typedef struct fs_filesystem_t {
   size_t block_size;
 
   fs_fat_t* fat;
+  fs_dcache_t* dcache;
+  fs_nameidx_t* names;
+  fs_dedup_t* dedup; // fingerprints of shared data blocks
+  fs_bloom_map_t* blooms; // by directory, built by searches
+  fs_fsinfo_map_t* usage; // subtree rollups, by directory
+  fs_dirblock_cache_t* dirblocks;
+  fs_scratch_t* scratch;
+  fs_file_arena_t* arena;
   fs_file_t* root;
   fs_file_t* cwd;
   FILE* file;
@@ -21,34 +39,333 @@ typedef struct fs_filesystem_t {
   uint8_t block_buf[FS_BLOCK_SIZE];
 
   int32_t blocks_offset;
+
+  // metadata budget (bytes of tree nodes; 0: unlimited)
+  size_t budget;
+  uint64_t evictions;
+  uint64_t reloads;
+
+  // checksum of every block (NULL: an image from
+  // before them) and the first block of its table
+  uint32_t* crcs;
+  uint32_t crcs_first;
+  uint64_t corrupt; // blocks that failed verification
+
+  // ends of the chains of plain files, so that
+  // appends don't walk them (`first` 0: empty)
+  struct {
+    uint32_t first;
+    uint32_t tail;
+  } tails[FS_TAILS_SIZE];
+
+  struct fs_handle_t* handles; // open ones
 } fs_filesystem_t;
 
+/**
+ * Gets every corrupt block found by a scrub
+ * (UINT32_MAX: the superblock, FAT and BMP).
+ */
+typedef void (*fs_scrub_cb)(uint32_t block, void* ctx);
+
 const static fs_filesystem_t fs_zeroed_filesystem = { 0 };
 
+/**
+ * Cursor over the entries of a directory, newest
+ * first. Entries come straight from the directory
+ * block, so a listing takes constant memory and
+ * doesn't materialize evicted subtrees.
+ */
+typedef struct fs_readdir_t {
+  fs_dirent_t dir; // the directory itself
+  uint32_t pos;    // entries yielded so far
+} fs_readdir_t;
+
+/**
+ * Readahead state of a stream of reads: where the
+ * next one has to start to be sequential, and how
+ * far ahead blocks have been hinted (in blocks).
+ */
+typedef struct fs_readahead_t {
+  uint64_t next;
+  uint32_t window;
+  uint32_t end; // exclusive
+} fs_readahead_t;
+
+/**
+ * An open regular file: its node and block map
+ * are resolved once, by fs_filesystem_open().
+ * Writes only go to the blocks they touch (new
+ * ones for holes and for blocks shared w/ other
+ * files); the map and the attributes are written
+ * back once, by fs_filesystem_fsync() or close.
+ *
+ * With a metadata budget the node gets resolved
+ * again (by `path`) when written back.
+ *
+ * Files w/ handles open on them (or below them)
+ * can't be removed or moved. A handle that writes
+ * has its file to itself.
+ */
+typedef struct fs_handle_t {
+  struct fs_filesystem_t* fs;
+  fs_file_t* file;
+  char* path;
+  fs_blockmap_t* map;
+  uint32_t size;
+  uint32_t chained; // blocks still linked in a plain chain
+  uint32_t cluster; // in `buf` (compressed; UINT32_MAX: none)
+  uint8_t flags;    // FS_OPEN_*
+  uint8_t dirty;    // map or size changed
+  uint8_t written;  // mtime to update
+  uint8_t* buf;     // FS_READ_BLOCKS blocks
+  // written blocks w/ no room yet: the logical
+  // block of each and their data (up to
+  // FS_DELALLOC_BLOCKS)
+  uint32_t* pending;
+  uint8_t* pending_buf;
+  uint32_t npending;
+  fs_readahead_t ra;
+  // first blocks of the file (as last written
+  // back) and of every directory above it
+  uint32_t fblock;
+  uint32_t* dirs;
+  uint32_t ndirs;
+  struct fs_handle_t* next; // in `fs->handles`
+} fs_handle_t;
+
 fs_filesystem_t* fs_filesystem_create(size_t blocks);
 void fs_filesystem_load(fs_filesystem_t* fs);
 void fs_filesystem_destroy(fs_filesystem_t* fs);
 
 int fs_filesystem_serialize(fs_filesystem_t* fs, unsigned char* buf, int n);
-void fs_filesystem_unmount(fs_filesystem_t* fs); // TODO
+/**
+ * Clean unmount: persists the allocator and a
+ * compact snapshot of the tree, then flags the
+ * image as clean so that the next mount reads
+ * the snapshot instead of walking every
+ * directory block. Destroying w/out unmounting
+ * leaves the image dirty (slow path).
+ */
+void fs_filesystem_unmount(fs_filesystem_t* fs);
 int fs_filesystem_serialize_superblock(fs_filesystem_t* fs, unsigned char* buf,
                                        int n);
 
 void fs_filesystem_mount(fs_filesystem_t* fs, const char* fname);
 
+/**
+ * Bounds the memory taken by the in-memory tree
+ * to about `bytes` (0: unlimited). Subtrees that
+ * weren't used recently get evicted and are read
+ * back from their directory blocks on demand.
+ * Set before mounting so that the tree gets
+ * loaded lazily as well.
+ *
+ * With a budget, `fs_file_t` pointers are only
+ * valid until the next command.
+ */
+void fs_filesystem_set_budget(fs_filesystem_t* fs, size_t bytes);
+
+/**
+ * Resolves an absolute path to its file (or NULL
+ * if it doesn't exist), going through the path
+ * cache first.
+ */
+fs_file_t* fs_filesystem_lookup(fs_filesystem_t* fs, const char* path);
+
+/**
+ * Resolves an absolute path into `entry` w/out
+ * materializing tree nodes: evicted directories
+ * are searched in their (cached) raw blocks.
+ * Returns 0 if the path doesn't exist.
+ */
+int fs_filesystem_stat(fs_filesystem_t* fs, const char* path,
+                       fs_dirent_t* entry);
+
+/**
+ * Positions `cursor` before the newest entry of
+ * the directory at `path`. Returns 0 if there's
+ * no such directory.
+ */
+int fs_filesystem_opendir(fs_filesystem_t* fs, const char* path,
+                          fs_readdir_t* cursor);
+
+/**
+ * Fills `batch` w/ up to `n` entries, advancing
+ * `cursor`. Returns how many, 0 once exhausted.
+ */
+unsigned fs_filesystem_readdir(fs_filesystem_t* fs, fs_readdir_t* cursor,
+                               fs_dirent_t* batch, unsigned n);
+
+/**
+ * Recursive search below `root`, streaming every
+ * match of `query` to `cb` (see find.h) from up
+ * to `threads` workers (0: one per core).
+ * Returns the number of matches.
+ */
+uint64_t fs_filesystem_search(fs_filesystem_t* fs, const char* root,
+                              const fs_find_query_t* query, unsigned threads,
+                              fs_find_cb cb, void* ctx);
+
 // commands
-void fs_filesystem_ls(fs_filesystem_t* fs, const char* abspath, char* buf,
-                      size_t n);
+void fs_filesystem_ls(fs_filesystem_t* fs, const char* abspath, FILE* out);
 fs_file_t* fs_filesystem_find(fs_filesystem_t* fs, const char* root,
                               const char* fname);
 fs_file_t* fs_filesystem_cp(fs_filesystem_t* fs, const char* src,
                             const char* dest);
+
+/**
+ * `cp`, storing the data compressed a cluster
+ * (FS_CLUSTER_SIZE) at a time. `cat` reads it
+ * back as is.
+ */
+fs_file_t* fs_filesystem_cp_compressed(fs_filesystem_t* fs, const char* src,
+                                       const char* dest);
+
+/**
+ * `cp`, sharing the blocks that are already
+ * somewhere else in the image (see dedup.h).
+ */
+fs_file_t* fs_filesystem_cp_dedup(fs_filesystem_t* fs, const char* src,
+                                  const char* dest);
+
+/**
+ * Copies `src` (a file in the image) to `dest`
+ * w/out copying its data: both share its blocks
+ * until one of them goes.
+ */
+fs_file_t* fs_filesystem_reflink(fs_filesystem_t* fs, const char* src,
+                                 const char* dest);
+
+/**
+ * Creates the directory `path` holding a frozen
+ * copy of the whole tree (older snapshots
+ * aside). It shares the blocks of every file and
+ * nothing in it may be changed; it only goes
+ * away as a whole, w/ `rmdir`.
+ */
+fs_file_t* fs_filesystem_snapshot(fs_filesystem_t* fs, const char* path);
 void fs_filesystem_cat(fs_filesystem_t* fs, const char* src, int fd);
+
+/**
+ * Opens the regular file at `path` (w/
+ * FS_OPEN_CREATE, creating it if missing). W/out
+ * FS_OPEN_WRITE only reads are allowed; read-only
+ * and compressed files can't be written. Returns
+ * NULL on failure.
+ */
+fs_handle_t* fs_filesystem_open(fs_filesystem_t* fs, const char* path,
+                                int flags);
+
+/**
+ * Reads up to `n` bytes at `offset`. Returns how
+ * many (0 at the end of the file) or -1 if the
+ * first block is corrupt.
+ */
+ssize_t fs_filesystem_pread(fs_handle_t* h, void* buf, size_t n,
+                            uint64_t offset);
+
+/**
+ * Writes `n` bytes at `offset`, growing the file
+ * (w/ a hole in between) if past its end.
+ * Returns `n`, or -1 on failure.
+ */
+ssize_t fs_filesystem_pwrite(fs_handle_t* h, const void* buf, size_t n,
+                             uint64_t offset);
+
+/**
+ * Writes back the map and the attributes of the
+ * file. Returns 0 on success.
+ */
+int fs_filesystem_fsync(fs_handle_t* h);
+
+/**
+ * Cuts the file short (or grows it w/ a hole) to
+ * `size` bytes. Returns 0 on success.
+ */
+int fs_filesystem_ftruncate(fs_handle_t* h, uint32_t size);
+
+/**
+ * fs_filesystem_fsync() and releases `h`.
+ */
+int fs_filesystem_close(fs_handle_t* h);
+
+/**
+ * Adds the contents of `src` (in the real
+ * system) to the end of `dest`, creating it if
+ * needed. A plain file grows from its last block
+ * on: the rest of the chain isn't walked again.
+ */
+fs_file_t* fs_filesystem_append(fs_filesystem_t* fs, const char* src,
+                                const char* dest);
+
+/**
+ * fs_filesystem_ftruncate() on the file at
+ * `path`.
+ */
+int fs_filesystem_truncate(fs_filesystem_t* fs, const char* path,
+                           uint32_t size);
+
+/**
+ * Reserves blocks for the first `size` bytes of
+ * the file at `path` (created if missing) where
+ * it has none, in a single run if there's one
+ * that long. They aren't written: they read as
+ * zeros until they are, and writes (appends) go
+ * to them instead of taking new ones. The file
+ * grows to `size` unless FS_FALLOC_KEEP_SIZE.
+ * Returns 0 on success.
+ */
+int fs_filesystem_fallocate(fs_filesystem_t* fs, const char* path,
+                            uint32_t size, int flags);
 fs_file_t* fs_filesystem_touch(fs_filesystem_t* fs, const char* fname);
 fs_file_t* fs_filesystem_mkdir(fs_filesystem_t* fs, const char* fname);
 int fs_filesystem_rm(fs_filesystem_t* fs, const char* path);
 int fs_filesystem_rmdir(fs_filesystem_t* fs, const char* path);
+
+/**
+ * Moves (or renames) `src` to `dest`, replacing
+ * what's there if it's a file (an empty
+ * directory, if `src` is one). Only the entries
+ * move: data and subtrees stay where they are.
+ */
+fs_file_t* fs_filesystem_rename(fs_filesystem_t* fs, const char* src,
+                                const char* dest);
 int fs_filesystem_df(fs_filesystem_t* fs, char* buf, size_t n);
+int fs_filesystem_du(fs_filesystem_t* fs, const char* path, char* buf,
+                     size_t n);
+int fs_filesystem_stats(fs_filesystem_t* fs, char* buf, size_t n);
+
+/**
+ * Reads every block in use (along w/ the FAT and
+ * BMP) from up to `threads` workers (0: one per
+ * core), checking it against its checksum. Every
+ * corrupt one goes to `cb` (if any). Returns how
+ * many there are.
+ */
+uint64_t fs_filesystem_scrub(fs_filesystem_t* fs, unsigned threads,
+                             fs_scrub_cb cb, void* ctx);
+
+/**
+ * Records the checksums of the `count` blocks
+ * starting at `block` just written from `buf`.
+ */
+void fs_filesystem_checksum(fs_filesystem_t* fs, uint32_t block,
+                            const uint8_t* buf, uint32_t count);
+
+/**
+ * Same, for the `n` bytes of superblock, FAT and
+ * BMP at `buf`.
+ */
+void fs_filesystem_checksum_meta(fs_filesystem_t* fs, const uint8_t* buf,
+                                 size_t n);
+
+/**
+ * Writes the whole directory block `fblock` from
+ * `buf`, keeping its cached copy and its checksum
+ * up to date.
+ */
+void fs_filesystem_write_dirblock(fs_filesystem_t* fs, uint32_t fblock,
+                                  const uint8_t* buf);
 
 static inline int fs_filesystem_persist_sbfatbmp(fs_filesystem_t* fs)
 {
@@ -58,6 +375,7 @@ static inline int fs_filesystem_persist_sbfatbmp(fs_filesystem_t* fs)
   fseek(fs->file, 0, SEEK_SET);
   PASSERT(fwrite(fs->buf, sizeof(uint8_t), written, fs->file) == written,
           "fwrite: ");
+  fs_filesystem_checksum_meta(fs, fs->buf, written);
 
   return written;
 }
@@ -66,13 +384,13 @@ static inline int fs_filesystem_persist_cwd(fs_filesystem_t* fs)
 {
   int n = 0;
 
-  PASSERT(~fseek(fs->file,
-                 fs->blocks_offset + (FS_BLOCK_SIZE * fs->cwd->fblock),
-                 SEEK_SET),
-          "fseek: ");
   n += fs_file_serialize_dir(fs->cwd, fs->block_buf, FS_BLOCK_SIZE);
-  PASSERT(fwrite(fs->block_buf, sizeof(uint8_t), n, fs->file) == n, "");
-  PASSERT(fflush(fs->file) != EOF, "fflush: ");
+
+  // the whole block goes: its checksum covers it
+  memset(fs->block_buf + n, 0, FS_BLOCK_SIZE - n);
+  if (fs->cwd == fs->root && fs->crcs)
+    fs->block_buf[FS_ROOT_FLAGS_OFFSET] = FS_ROOT_FLAG_CSUM;
+  fs_filesystem_write_dirblock(fs, fs->cwd->fblock, fs->block_buf);
 
   return n;
 }
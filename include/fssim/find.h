@@ -0,0 +1,117 @@
+#ifndef FSSIM__FIND_H
+#define FSSIM__FIND_H
+
+#include "fssim/bloom.h"
+#include "fssim/common.h"
+#include "fssim/constants.h"
+#include "fssim/dirblock.h"
+#include "fssim/file.h"
+
+#include <pthread.h>
+
+/**
+ * FIND - parallel recursive search
+ *
+ * Entries below a directory are matched against
+ * a query: a name glob (fnmatch(3)) and
+ * inclusive size and mtime ranges.
+ *
+ * The walk runs on a pool of workers, each w/
+ * its own deque of directories to expand: a
+ * worker pushes and pops at the tail (depth
+ * first, cache friendly) and, when out of work,
+ * steals from the head of someone else's (the
+ * biggest subtrees). Matches are handed to the
+ * callback as they're found, one call at a time.
+ *
+ * The tree is only read. Evicted directories
+ * are walked on their raw blocks (pread(2) on
+ * `fd`), so a search doesn't load them.
+ *
+ * W/ `blooms` set, a directory whose subtree
+ * filter lacks the keys of the glob isn't
+ * expanded at all.
+ */
+
+typedef struct fs_find_query_t {
+  const char* glob; // NULL: any name
+  uint32_t min_size;
+  uint32_t max_size;
+  int32_t min_mtime;
+  int32_t max_mtime;
+} fs_find_query_t;
+
+const static fs_find_query_t fs_find_any = { NULL, 0, UINT32_MAX, INT32_MIN,
+                                             INT32_MAX };
+
+/**
+ * Called for every match w/ its absolute path.
+ * Returning nonzero stops the search.
+ */
+typedef int (*fs_find_cb)(const char* path, const fs_dirent_t* entry,
+                          void* ctx);
+
+typedef struct fs_find_item_t {
+  fs_file_t* dir; // NULL: evicted, walk `fblock`
+  uint32_t fblock;
+  char* path;
+} fs_find_item_t;
+
+typedef struct fs_find_deque_t {
+  pthread_mutex_t lock;
+  size_t head;
+  size_t tail;
+  size_t size;
+  fs_find_item_t* items;
+} fs_find_deque_t;
+
+typedef struct fs_find_t {
+  const fs_find_query_t* query;
+  fs_find_cb cb;
+  void* ctx;
+
+  // where the raw directory blocks live
+  int fd;
+  off_t blocks_offset;
+
+  fs_bloom_map_t* blooms; // NULL: no pruning
+  uint32_t keys[FS_BLOOM_KEYS_MAX];
+  unsigned keys_count;
+
+  unsigned threads; // 0: one per core
+  fs_find_deque_t* deques;
+  pthread_mutex_t cb_lock;
+  int64_t pending;
+  int stop;
+
+  uint64_t matches;
+  uint64_t steals;
+  uint64_t pruned; // subtrees skipped
+} fs_find_t;
+
+int fs_find_match(const fs_find_query_t* query, const fs_file_attr_t* attrs);
+
+/**
+ * Whether `glob` only matches itself (no
+ * wildcards): such searches can be answered by
+ * the name index instead of a walk.
+ */
+static inline int fs_find_is_literal(const char* glob)
+{
+  return !strpbrk(glob, "*?[\\");
+}
+
+/**
+ * Workers to run for a request of `threads` (0:
+ * one per core), at most FS_FIND_THREADS_MAX.
+ */
+unsigned fs_find_threads(unsigned threads);
+
+/**
+ * Searches below `dir` (whose path is `path`)
+ * w/ the query and callback set in `find`.
+ * Returns the number of matches.
+ */
+uint64_t fs_find_run(fs_find_t* find, fs_file_t* dir, const char* path);
+
+#endif
@@ -2,7 +2,9 @@
 #define FSSIM__FSINFO_H
 
 #include "fssim/common.h"
+#include "fssim/fbmap.h"
 #include "fssim/file.h"
+#include "fssim/file_utils.h"
 
 typedef struct fs_fsinfo_t {
   uint32_t usedspace;   // B
@@ -11,6 +13,86 @@ typedef struct fs_fsinfo_t {
   uint16_t directories; // count
 } fs_fsinfo_t;
 
+/**
+ * Accounts for a single file (not what's below
+ * it, if a directory).
+ */
+static inline void fs_fsinfo_add_attrs(fs_fsinfo_t* info,
+                                       const fs_file_attr_t* attrs)
+{
+  if (attrs->is_directory) {
+    info->directories += 1;
+    info->usedspace += FS_BLOCK_SIZE;
+  } else {
+    info->files += 1;
+    info->usedspace += attrs->size;
+    info->wastedspace += attrs->size % FS_BLOCK_SIZE;
+  }
+}
+
+static inline void fs_fsinfo_add(fs_fsinfo_t* info, fs_file_t* f)
+{
+  fs_fsinfo_add_attrs(info, &f->attrs);
+}
+
+static inline void fs_fsinfo_merge(fs_fsinfo_t* info, const fs_fsinfo_t* other)
+{
+  info->usedspace += other->usedspace;
+  info->wastedspace += other->wastedspace;
+  info->files += other->files;
+  info->directories += other->directories;
+}
+
+static inline void fs_fsinfo_unmerge(fs_fsinfo_t* info,
+                                     const fs_fsinfo_t* other)
+{
+  info->usedspace -= other->usedspace;
+  info->wastedspace -= other->wastedspace;
+  info->files -= other->files;
+  info->directories -= other->directories;
+}
+
+static inline void fs_fsinfo_serialize(const fs_fsinfo_t* info,
+                                       unsigned char* buf)
+{
+  buf = serialize_uint32_t(buf, info->usedspace);
+  buf = serialize_uint32_t(buf, info->wastedspace);
+  buf = serialize_uint16_t(buf, info->files);
+  serialize_uint16_t(buf, info->directories);
+}
+
+static inline void fs_fsinfo_deserialize(fs_fsinfo_t* info,
+                                         const unsigned char* buf)
+{
+  info->usedspace = deserialize_uint32_t((unsigned char*)buf);
+  info->wastedspace = deserialize_uint32_t((unsigned char*)buf + 4);
+  info->files = deserialize_uint16_t((unsigned char*)buf + 8);
+  info->directories = deserialize_uint16_t((unsigned char*)buf + 10);
+}
+
+/**
+ * Subtree rollups of directories, keyed by their
+ * first block (fbmap.h).
+ */
+typedef struct fs_fsinfo_entry_t {
+  uint32_t fblock;
+  fs_fsinfo_t info;
+} fs_fsinfo_entry_t;
+
+typedef fs_fbmap_t fs_fsinfo_map_t;
+
+fs_fsinfo_map_t* fs_fsinfo_map_create(size_t size);
+void fs_fsinfo_map_destroy(fs_fsinfo_map_t* map);
+fs_fsinfo_t* fs_fsinfo_map_get(fs_fsinfo_map_t* map, uint32_t fblock);
+
+/**
+ * Returns the rollup of `fblock`, adding a zeroed
+ * one if missing. Pointers previously returned
+ * may be invalidated.
+ */
+fs_fsinfo_t* fs_fsinfo_map_put(fs_fsinfo_map_t* map, uint32_t fblock);
+void fs_fsinfo_map_remove(fs_fsinfo_map_t* map, uint32_t fblock);
+
 /**
  * Calculates file infomation given a root dir
  * and a properly initialized fsinfo structure.
@@ -18,22 +100,13 @@ typedef struct fs_fsinfo_t {
 static void fs_fsinfo_calculate(fs_fsinfo_t* info, fs_file_t* root)
 {
   fs_file_t* f = NULL;
-  fs_llist_t* l = root->children;
 
-  while (l) {
-    f = (fs_file_t*)l->data;
+  for (unsigned i = 0; i < root->children_count; i++) {
+    f = fs_file_child(root, i);
+    fs_fsinfo_add(info, f);
 
-    if (f->attrs.is_directory) {
-      info->directories += 1;
-      info->usedspace += FS_BLOCK_SIZE;
+    if (f->attrs.is_directory)
       fs_fsinfo_calculate(info, f);
-    } else {
-      info->files += 1;
-      info->usedspace += f->attrs.size;
-      info->wastedspace += f->attrs.size % FS_BLOCK_SIZE;
-    }
-
-    l = l->next;
   }
 }
 
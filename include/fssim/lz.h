@@ -0,0 +1,41 @@
+#ifndef FSSIM__LZ_H
+#define FSSIM__LZ_H
+
+#include "fssim/common.h"
+
+/**
+ * LZ - byte-oriented LZ77 codec
+ *
+ * The LZ4 block format: sequences of literals
+ * followed by a match (a 2B offset back into
+ * what was already decoded), w/ a greedy
+ * single-probe compressor. Fast on both sides
+ * and no state across calls, so any chunk can be
+ * decoded by itself.
+ *
+ *  sequence: | token | lit. len+ | literals | offset | match len+ |
+ *              1B      0..nB       0..nB      2B       0..nB
+ *
+ * The token holds the literal length (high
+ * nibble) and the match length minus
+ * FS_LZ_MIN_MATCH (low one); a nibble of 15 goes
+ * on w/ extra bytes, each adding up to 255. The
+ * last sequence only has literals.
+ */
+
+/**
+ * Compresses the `n` bytes at `src` into at most
+ * `cap` bytes at `dst`. Returns how many were
+ * written, 0 if it didn't fit.
+ */
+size_t fs_lz_compress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap);
+
+/**
+ * Returns the size of what `src` decodes to
+ * (written to `dst`), -1 if it's malformed or
+ * doesn't fit in `cap` bytes.
+ */
+ssize_t fs_lz_decompress(const uint8_t* src, size_t n, uint8_t* dst,
+                         size_t cap);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef FSSIM__NAMEIDX_H
+#define FSSIM__NAMEIDX_H
+
+#include "fssim/common.h"
+#include "fssim/constants.h"
+#include "fssim/file_utils.h"
+
+/**
+ * NAMEIDX - global filename index
+ *
+ * Hash multimap from file name to every file
+ * carrying it. Files are identified by their
+ * first block (unique while they exist) and
+ * point to the first block of their parent, so
+ * the index alone answers "is it below this
+ * directory?" and rebuilds full paths.
+ *
+ * Entries are chained twice: by name hash (for
+ * probes) and by block (for removals and parent
+ * walks). Chains hold entry + 1 (0: end).
+ */
+
+typedef struct fs_nameidx_entry_t {
+  char fname[FS_NAME_MAX];
+  uint8_t is_directory;
+  uint32_t fblock;
+  uint32_t parent;
+  uint32_t next_name;
+  uint32_t next_block;
+} fs_nameidx_entry_t;
+
+typedef struct fs_nameidx_t {
+  uint32_t root;
+  uint32_t count;
+  uint32_t top;  // slots ever handed out
+  uint32_t size;
+  uint32_t free; // reusable slots
+  uint32_t mask;
+  uint32_t* names;
+  uint32_t* blocks;
+  fs_nameidx_entry_t* entries;
+} fs_nameidx_t;
+
+fs_nameidx_t* fs_nameidx_create(uint32_t root);
+void fs_nameidx_destroy(fs_nameidx_t* idx);
+
+void fs_nameidx_add(fs_nameidx_t* idx, const char* fname, uint32_t fblock,
+                    uint32_t parent, uint8_t is_directory);
+
+/**
+ * Removes the file whose first block is
+ * `fblock`. Returns 0 if it wasn't indexed.
+ */
+int fs_nameidx_remove(fs_nameidx_t* idx, uint32_t fblock);
+
+fs_nameidx_entry_t* fs_nameidx_get(fs_nameidx_t* idx, uint32_t fblock);
+
+/**
+ * Iterates over the files named `fname`
+ * (compared up to FS_NAME_MAX chars): pass NULL
+ * as `prev` to get the first. NULL when done.
+ */
+fs_nameidx_entry_t* fs_nameidx_next(fs_nameidx_t* idx, const char* fname,
+                                    size_t length, fs_nameidx_entry_t* prev);
+
+/**
+ * Whether `entry` lives (at any depth) below
+ * the directory whose first block is `dir`.
+ */
+int fs_nameidx_is_below(fs_nameidx_t* idx, fs_nameidx_entry_t* entry,
+                        uint32_t dir);
+
+/**
+ * Writes the absolute path of `entry` to `buf`
+ * if it fits in `n` bytes. Returns its length
+ * either way (like snprintf), -1 if a parent is
+ * missing.
+ */
+int fs_nameidx_path(fs_nameidx_t* idx, fs_nameidx_entry_t* entry, char* buf,
+                    size_t n);
+
+size_t fs_nameidx_serialized_size(fs_nameidx_t* idx);
+size_t fs_nameidx_serialize(fs_nameidx_t* idx, unsigned char* buf, size_t n);
+
+/**
+ * Returns NULL if `buf` is malformed.
+ */
+fs_nameidx_t* fs_nameidx_load(uint32_t root, unsigned char* buf, size_t n);
+
+#endif
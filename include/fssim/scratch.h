@@ -0,0 +1,42 @@
+#ifndef FSSIM__SCRATCH_H
+#define FSSIM__SCRATCH_H
+
+#include "fssim/common.h"
+
+/**
+ * SCRATCH - per-command bump allocator
+ *
+ * A fixed buffer handed out linearly. A command
+ * takes a mark when it starts and releases back
+ * to it when done, dropping everything it
+ * allocated in between at once:
+ *
+ *   size_t mark = fs_scratch_mark(scratch);
+ *   char* name = fs_scratch_strndup(scratch, s, n);
+ *   ...
+ *   fs_scratch_release(scratch, mark);
+ */
+
+typedef struct fs_scratch_t {
+  size_t size;
+  size_t used;
+  uint8_t* buf;
+} fs_scratch_t;
+
+fs_scratch_t* fs_scratch_create(size_t size);
+void fs_scratch_destroy(fs_scratch_t* scratch);
+
+void* fs_scratch_alloc(fs_scratch_t* scratch, size_t n);
+char* fs_scratch_strndup(fs_scratch_t* scratch, const char* str, size_t n);
+
+static inline size_t fs_scratch_mark(fs_scratch_t* scratch)
+{
+  return scratch->used;
+}
+
+static inline void fs_scratch_release(fs_scratch_t* scratch, size_t mark)
+{
+  scratch->used = mark;
+}
+
+#endif
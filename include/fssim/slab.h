@@ -0,0 +1,62 @@
+#ifndef FSSIM__SLAB_H
+#define FSSIM__SLAB_H
+
+#include "fssim/common.h"
+
+/**
+ * SLAB - fixed-size object allocator
+ *
+ * Objects are carved out of chunks of
+ * `per_chunk` objects each. Freed objects go to
+ * a free list and are handed back by the next
+ * allocations. Destroying the slab releases
+ * every chunk at once, regardless of how many
+ * objects are still alive.
+ *
+ * Each object is also addressable by a 32-bit
+ * id (its slot index), stable for its lifetime:
+ *
+ *   chunk 0               chunk 1
+ *  +----+----+----+----+ +----+----+-- ..
+ *  | 0  | 1  | 2  | 3  | | 4  | 5  |
+ *  +----+----+----+----+ +----+----+-- ..
+ *
+ * Every slot starts w/ a small header holding
+ * its id so that going from an object to its id
+ * is O(1) as well.
+ */
+
+typedef struct fs_slab_t {
+  size_t objsize;
+  size_t slotsize;
+  size_t per_chunk;
+  size_t live;
+
+  uint8_t** chunks;
+  size_t chunks_count;
+  size_t chunks_size;
+  size_t bump; // next untouched slot of the last chunk
+
+  void* freelist;
+} fs_slab_t;
+
+#define FS_SLAB_HEADER_SIZE 8
+
+fs_slab_t* fs_slab_create(size_t objsize, size_t per_chunk);
+void fs_slab_destroy(fs_slab_t* slab);
+
+void* fs_slab_alloc(fs_slab_t* slab);
+void fs_slab_free(fs_slab_t* slab, void* obj);
+
+static inline uint32_t fs_slab_id(const void* obj)
+{
+  return *(const uint32_t*)((const uint8_t*)obj - FS_SLAB_HEADER_SIZE);
+}
+
+static inline void* fs_slab_at(fs_slab_t* slab, uint32_t id)
+{
+  return slab->chunks[id / slab->per_chunk] +
+         (id % slab->per_chunk) * slab->slotsize + FS_SLAB_HEADER_SIZE;
+}
+
+#endif
@@ -0,0 +1,185 @@
+#include "fssim/blockmap.h"
+
+fs_blockmap_t* fs_blockmap_create(uint32_t count)
+{
+  fs_blockmap_t* map = calloc(1, sizeof(*map));
+  PASSERT(map, FS_ERR_MALLOC);
+
+  fs_blockmap_resize(map, count);
+
+  return map;
+}
+
+fs_blockmap_t* fs_blockmap_create_compressed(uint32_t count)
+{
+  fs_blockmap_t* map = calloc(1, sizeof(*map));
+  PASSERT(map, FS_ERR_MALLOC);
+
+  // a non-NULL `lengths` is what tells them apart
+  map->lengths = malloc(sizeof(*map->lengths));
+  PASSERT(map->lengths, FS_ERR_MALLOC);
+  fs_blockmap_resize(map, count);
+
+  return map;
+}
+
+void fs_blockmap_destroy(fs_blockmap_t* map)
+{
+  free(map->blocks);
+  free(map->lengths);
+  free(map->unwritten);
+  free(map);
+}
+
+void fs_blockmap_resize(fs_blockmap_t* map, uint32_t count)
+{
+  if (count > map->size) {
+    map->size = count > 2 * map->size ? count : 2 * map->size;
+    map->blocks = realloc(map->blocks, map->size * sizeof(*map->blocks));
+    PASSERT(map->blocks, FS_ERR_MALLOC);
+
+    if (map->lengths) {
+      map->lengths =
+          realloc(map->lengths, map->size * sizeof(*map->lengths));
+      PASSERT(map->lengths, FS_ERR_MALLOC);
+    }
+
+    if (map->unwritten) {
+      map->unwritten = realloc(map->unwritten, map->size / 8 + 1);
+      PASSERT(map->unwritten, FS_ERR_MALLOC);
+    }
+  }
+
+  if (count > map->count) {
+    memset(map->blocks + map->count, 0,
+           (count - map->count) * sizeof(*map->blocks));
+    if (map->lengths)
+      memset(map->lengths + map->count, 0,
+             (count - map->count) * sizeof(*map->lengths));
+    for (uint32_t i = map->count; map->unwritten && i < count; i++)
+      fs_blockmap_set_unwritten(map, i, 0);
+  }
+
+  map->count = count;
+}
+
+void fs_blockmap_set_unwritten(fs_blockmap_t* map, uint32_t i, int unwritten)
+{
+  if (!map->unwritten) {
+    if (!unwritten)
+      return;
+
+    map->unwritten = calloc(map->size / 8 + 1, 1);
+    PASSERT(map->unwritten, FS_ERR_MALLOC);
+  }
+
+  if (unwritten)
+    map->unwritten[i / 8] |= 128 >> (i % 8);
+  else
+    map->unwritten[i / 8] &= ~(128 >> (i % 8));
+}
+
+fs_blockmap_t* fs_blockmap_from_chain(fs_fat_t* fat, uint32_t first,
+                                      uint32_t count)
+{
+  fs_blockmap_t* map = fs_blockmap_create(count);
+  uint32_t block = first;
+
+  for (uint32_t i = 0; i < count; i++) {
+    map->blocks[i] = block;
+
+    if (fat->blocks[block] == block) {
+      fs_blockmap_resize(map, i + 1);
+      break;
+    }
+
+    block = fat->blocks[block];
+  }
+
+  return map;
+}
+
+int fs_blockmap_is_sparse(fs_blockmap_t* map)
+{
+  for (uint32_t i = 0; i < map->count; i++)
+    if (map->blocks[i] == FS_BLOCKMAP_HOLE ||
+        fs_blockmap_is_unwritten(map, i))
+      return 1;
+
+  return 0;
+}
+
+uint32_t fs_blockmap_chain(fs_blockmap_t* map, fs_fat_t* fat)
+{
+  ASSERT(map->count && !fs_blockmap_is_sparse(map),
+         "Only maps w/ data and w/out holes make a chain");
+
+  for (uint32_t i = 0; i + 1 < map->count; i++)
+    fat->blocks[map->blocks[i]] = map->blocks[i + 1];
+  fat->blocks[map->blocks[map->count - 1]] = map->blocks[map->count - 1];
+
+  return map->blocks[0];
+}
+
+size_t fs_blockmap_serialized_size(fs_blockmap_t* map)
+{
+  return FS_BLOCKMAP_HEADER_SIZE +
+         (size_t)map->count * (map->lengths ? 8 : 4);
+}
+
+size_t fs_blockmap_serialize(fs_blockmap_t* map, unsigned char* buf, size_t n)
+{
+  size_t to_write = fs_blockmap_serialized_size(map);
+
+  ASSERT(n >= to_write, "`buf` must at least have %lu bytes remaining. Has %lu",
+         to_write, n);
+
+  buf = serialize_uint32_t(buf, map->lengths ? FS_BLOCKMAP_Z_MAGIC
+                                             : FS_BLOCKMAP_MAGIC);
+  buf = serialize_uint32_t(buf, map->count);
+
+  for (uint32_t i = 0; i < map->count; i++) {
+    buf = serialize_uint32_t(buf, map->blocks[i] |
+                                      (fs_blockmap_is_unwritten(map, i)
+                                           ? FS_BLOCKMAP_UNWRITTEN
+                                           : 0));
+    if (map->lengths)
+      buf = serialize_uint32_t(buf, map->lengths[i]);
+  }
+
+  return to_write;
+}
+
+fs_blockmap_t* fs_blockmap_load(unsigned char* buf, size_t n)
+{
+  fs_blockmap_t* map = NULL;
+  uint32_t magic = 0;
+  uint32_t count = 0;
+  size_t entry = 0;
+
+  if (n < FS_BLOCKMAP_HEADER_SIZE)
+    return NULL;
+
+  magic = deserialize_uint32_t(buf);
+  if (magic != FS_BLOCKMAP_MAGIC && magic != FS_BLOCKMAP_Z_MAGIC)
+    return NULL;
+
+  entry = magic == FS_BLOCKMAP_Z_MAGIC ? 8 : 4;
+  if ((n - FS_BLOCKMAP_HEADER_SIZE) / entry <
+      (count = deserialize_uint32_t(buf + 4)))
+    return NULL;
+
+  map = entry == 8 ? fs_blockmap_create_compressed(count)
+                   : fs_blockmap_create(count);
+  buf += FS_BLOCKMAP_HEADER_SIZE;
+
+  for (uint32_t i = 0; i < count; i++, buf += entry) {
+    map->blocks[i] = deserialize_uint32_t(buf) & ~FS_BLOCKMAP_UNWRITTEN;
+    if (map->blocks[i] != deserialize_uint32_t(buf))
+      fs_blockmap_set_unwritten(map, i, 1);
+    if (map->lengths)
+      map->lengths[i] = deserialize_uint32_t(buf + 4);
+  }
+
+  return map;
+}
@@ -0,0 +1,165 @@
+#include "fssim/bloom.h"
+
+#define _BITS (FS_BLOOM_SIZE * 8)
+#define _SEED_NAME 0x9e3779b9u
+#define _SEED_TRIGRAM 0x85ebca6bu
+#define _SEGMENT_MAX 64
+
+static inline uint32_t _key(const char* s, size_t length, uint32_t seed)
+{
+  uint32_t hash = 2166136261u ^ seed;
+
+  for (size_t i = 0; i < length; i++)
+    hash = (hash ^ (uint8_t)s[i]) * 16777619u;
+
+  // fnv's low bits are weak: finish w/ murmur3's
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+
+  return hash;
+}
+
+// double hashing: an odd step never repeats a bit
+static inline uint32_t _bit(uint32_t key, unsigned i)
+{
+  return (key + i * ((key >> 16) | 1)) % _BITS;
+}
+
+static inline void _set(uint8_t* bits, uint32_t key)
+{
+  for (unsigned i = 0; i < FS_BLOOM_HASHES; i++)
+    bits[_bit(key, i) / 8] |= 1 << (_bit(key, i) % 8);
+}
+
+static inline int _test(const uint8_t* bits, uint32_t key)
+{
+  for (unsigned i = 0; i < FS_BLOOM_HASHES; i++)
+    if (!(bits[_bit(key, i) / 8] & (1 << (_bit(key, i) % 8))))
+      return 0;
+
+  return 1;
+}
+
+void fs_bloom_add(uint8_t* bits, const char* fname)
+{
+  size_t length = strnlen(fname, FS_NAME_MAX);
+
+  _set(bits, _key(fname, length, _SEED_NAME));
+
+  for (size_t i = 0; i + 3 <= length; i++)
+    _set(bits, _key(fname + i, 3, _SEED_TRIGRAM));
+}
+
+void fs_bloom_merge(uint8_t* bits, const uint8_t* other)
+{
+  for (unsigned i = 0; i < FS_BLOOM_SIZE; i++)
+    bits[i] |= other[i];
+}
+
+static unsigned _segment_keys(const char* segment, size_t length,
+                              uint32_t* keys, unsigned count, unsigned n)
+{
+  for (size_t i = 0; i + 3 <= length && count < n; i++)
+    keys[count++] = _key(segment + i, 3, _SEED_TRIGRAM);
+
+  return count;
+}
+
+// past the `]` closing the bracket expression at
+// `c`. NULL if unsure how fnmatch(3) reads it.
+static const char* _skip_bracket(const char* c)
+{
+  c++;
+  if (*c == '!' || *c == '^')
+    c++;
+  if (*c == ']')
+    c++;
+
+  for (; *c && *c != ']'; c++)
+    if (*c == '[' && (c[1] == ':' || c[1] == '.' || c[1] == '='))
+      return NULL;
+
+  return *c ? c : NULL;
+}
+
+unsigned fs_bloom_glob_keys(const char* glob, uint32_t* keys, unsigned n)
+{
+  char segment[_SEGMENT_MAX];
+  size_t length = 0;
+  unsigned count = 0;
+  int literal = 1;
+
+  if (!glob)
+    return 0;
+
+  // every trigram of a literal run is in the name
+  for (const char* c = glob; *c; c++) {
+    if (*c == '*' || *c == '?' || *c == '[') {
+      count = _segment_keys(segment, length, keys, count, n);
+      length = 0;
+      literal = 0;
+
+      if (*c == '[' && !(c = _skip_bracket(c)))
+        return 0;
+
+      continue;
+    }
+
+    if (*c == '\\') {
+      literal = 0;
+      if (!*++c)
+        return 0;
+    }
+
+    if (length == _SEGMENT_MAX) {
+      count = _segment_keys(segment, length, keys, count, n);
+      length = 0;
+    }
+
+    segment[length++] = *c;
+  }
+
+  count = _segment_keys(segment, length, keys, count, n);
+
+  if (literal && count < n)
+    keys[count++] = _key(glob, strnlen(glob, FS_NAME_MAX), _SEED_NAME);
+
+  return count;
+}
+
+int fs_bloom_has_keys(const uint8_t* bits, const uint32_t* keys, unsigned n)
+{
+  for (unsigned i = 0; i < n; i++)
+    if (!_test(bits, keys[i]))
+      return 0;
+
+  return 1;
+}
+
+fs_bloom_map_t* fs_bloom_map_create(size_t size)
+{
+  return fs_fbmap_create(size, sizeof(fs_bloom_t));
+}
+
+void fs_bloom_map_destroy(fs_bloom_map_t* map)
+{
+  fs_fbmap_destroy(map);
+}
+
+fs_bloom_t* fs_bloom_get(fs_bloom_map_t* map, uint32_t fblock)
+{
+  return fs_fbmap_get(map, fblock);
+}
+
+fs_bloom_t* fs_bloom_put(fs_bloom_map_t* map, uint32_t fblock)
+{
+  return fs_fbmap_put(map, fblock);
+}
+
+void fs_bloom_remove(fs_bloom_map_t* map, uint32_t fblock)
+{
+  fs_fbmap_remove(map, fblock);
+}
@@ -47,6 +47,61 @@ uint32_t fs_bmp_alloc(fs_bmp_t* bmp)
   ASSERT(0, "fs_bmp_alloc(): No free space found");
 }
 
+uint32_t fs_bmp_alloc_run(fs_bmp_t* bmp, uint32_t count)
+{
+  uint32_t first = 0;
+  uint32_t run = 0;
+  size_t end = 0;
+
+  ASSERT(count, "Must allocate at least one block");
+
+  // from the cursor on, then from the start up to
+  // the runs that cross it
+  for (int pass = 0; pass < 2; pass++) {
+    end = pass ? bmp->last_block + count - 1 : bmp->num_blocks;
+    if (end > bmp->num_blocks)
+      end = bmp->num_blocks;
+
+    run = 0;
+    for (size_t b = pass ? 0 : bmp->last_block; b < end; b++) {
+      // full bytes go at once
+      if (!(b % 8) && b + 8 <= end && bmp->mapping[b / 8] == 0xff) {
+        run = 0;
+        b += 7;
+        continue;
+      }
+
+      if (FS_BMP_IS_ON_(bmp, b)) {
+        run = 0;
+        continue;
+      }
+
+      if (!run++)
+        first = b;
+      if (run < count)
+        continue;
+
+      for (b = first; b < first + count; b++)
+        FS_BMP_FLIP_(bmp, b);
+      bmp->last_block = (first + count) % bmp->num_blocks;
+
+      return first;
+    }
+  }
+
+  return UINT32_MAX;
+}
+
+size_t fs_bmp_free_count(fs_bmp_t* bmp)
+{
+  size_t used = 0;
+
+  for (size_t i = 0; i < bmp->size; i++)
+    used += __builtin_popcount(bmp->mapping[i]);
+
+  return bmp->num_blocks - used;
+}
+
 int fs_bmp_serialize(fs_bmp_t* bmp, unsigned char* buf, int n)
 {
   ASSERT(n >= bmp->size, "`buf` must at least have %lu bytes remaining. Has %d",
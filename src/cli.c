@@ -81,7 +81,9 @@ void fs_cli_run()
 
 int fs_cli_command_mount(char** argv, unsigned argc, fs_simulator_t* sim)
 {
-  _F_CHECK_ARGC(argc, 2);
+  if (argc != 3) {
+    _F_CHECK_ARGC(argc, 2);
+  }
 
   if (sim->fs) {
     fprintf(stderr, "Filesystem already mounted at %s.\n"
@@ -92,6 +94,8 @@ int fs_cli_command_mount(char** argv, unsigned argc, fs_simulator_t* sim)
   }
   
   sim->fs = fs_filesystem_create(FS_BLOCKS_NUM);
+  if (argc == 3)
+    fs_filesystem_set_budget(sim->fs, strtoull(argv[2], NULL, 10));
   fs_filesystem_mount(sim->fs, argv[1]);
   strncpy(sim->mounted_at, argv[1], PATH_MAX);
   fprintf(stderr, "Filesystem sucessfully mounted at %s\n", sim->mounted_at);
@@ -102,6 +106,22 @@ int fs_cli_command_mount(char** argv, unsigned argc, fs_simulator_t* sim)
 int fs_cli_command_cp(char** argv, unsigned argc, fs_simulator_t* sim)
 {
   _F_CHECK_MOUNTED(sim);
+
+  if (argc == 4 && !strcmp(argv[1], "-z")) {
+    fs_filesystem_cp_compressed(sim->fs, argv[2], argv[3]);
+    return 0;
+  }
+
+  if (argc == 4 && !strcmp(argv[1], "-d")) {
+    fs_filesystem_cp_dedup(sim->fs, argv[2], argv[3]);
+    return 0;
+  }
+
+  if (argc == 4 && !strcmp(argv[1], "--reflink")) {
+    fs_filesystem_reflink(sim->fs, argv[2], argv[3]);
+    return 0;
+  }
+
   _F_CHECK_ARGC(argc, 3);
 
   fs_filesystem_cp(sim->fs, argv[1], argv[2]);
@@ -109,6 +129,78 @@ int fs_cli_command_cp(char** argv, unsigned argc, fs_simulator_t* sim)
   return 0;
 }
 
+int fs_cli_command_append(char** argv, unsigned argc, fs_simulator_t* sim)
+{
+  _F_CHECK_MOUNTED(sim);
+  _F_CHECK_ARGC(argc, 3);
+
+  fs_filesystem_append(sim->fs, argv[1], argv[2]);
+
+  return 0;
+}
+
+// a file size, in bytes
+static int _parse_size(const char* arg, uint32_t* size)
+{
+  char* end = NULL;
+  unsigned long long n = strtoull(arg, &end, 10);
+
+  if (!*arg || *end || n > UINT32_MAX) {
+    fprintf(stderr, "Invalid size `%s`.\n", arg);
+    return 0;
+  }
+
+  *size = n;
+  return 1;
+}
+
+int fs_cli_command_truncate(char** argv, unsigned argc, fs_simulator_t* sim)
+{
+  _F_CHECK_MOUNTED(sim);
+  _F_CHECK_ARGC(argc, 3);
+  uint32_t size = 0;
+
+  if (!_parse_size(argv[2], &size))
+    return 1;
+
+  fs_filesystem_truncate(sim->fs, argv[1], size);
+
+  return 0;
+}
+
+int fs_cli_command_fallocate(char** argv, unsigned argc, fs_simulator_t* sim)
+{
+  _F_CHECK_MOUNTED(sim);
+  uint32_t size = 0;
+
+  if (argc == 4 && !strcmp(argv[1], "-k")) {
+    if (!_parse_size(argv[3], &size))
+      return 1;
+
+    fs_filesystem_fallocate(sim->fs, argv[2], size, FS_FALLOC_KEEP_SIZE);
+    return 0;
+  }
+
+  _F_CHECK_ARGC(argc, 3);
+
+  if (!_parse_size(argv[2], &size))
+    return 1;
+
+  fs_filesystem_fallocate(sim->fs, argv[1], size, 0);
+
+  return 0;
+}
+
+int fs_cli_command_mv(char** argv, unsigned argc, fs_simulator_t* sim)
+{
+  _F_CHECK_MOUNTED(sim);
+  _F_CHECK_ARGC(argc, 3);
+
+  fs_filesystem_rename(sim->fs, argv[1], argv[2]);
+
+  return 0;
+}
+
 int fs_cli_command_mkdir(char** argv, unsigned argc, fs_simulator_t* sim)
 {
   _F_CHECK_MOUNTED(sim);
@@ -164,10 +256,47 @@ int fs_cli_command_ls(char** argv, unsigned argc, fs_simulator_t* sim)
   _F_CHECK_MOUNTED(sim);
   _F_CHECK_ARGC(argc, 2);
 
-  char buf[FS_LS_FORMAT_SIZE * 64] = { 0 };
+  fs_filesystem_ls(sim->fs, argv[1], stderr);
 
-  fs_filesystem_ls(sim->fs, argv[1], buf, FS_LS_FORMAT_SIZE * 64);
-  fprintf(stderr, "%s", buf);
+  return 0;
+}
+
+// find(1)-like numeric argument: "+N" (more than
+// N), "-N" (less than N) or "N" (exactly N), w/
+// an optional K/M suffix. Sets [lo, hi]. "-0"
+// (nothing is less than 0) isn't a range.
+static int _parse_range(const char* arg, int64_t* lo, int64_t* hi)
+{
+  char* end = NULL;
+  int sign = *arg == '+' || *arg == '-';
+  int64_t n = strtoll(arg + sign, &end, 10);
+
+  if (end == arg + sign || n < 0 || (*arg == '-' && !n))
+    return 0;
+
+  if (*end == 'K')
+    n *= FS_KILOBYTE, end++;
+  else if (*end == 'M')
+    n *= FS_MEGABYTE, end++;
+
+  if (*end)
+    return 0;
+
+  if (*arg == '+')
+    *lo = n + 1;
+  else if (*arg == '-')
+    *hi = n - 1;
+  else
+    *lo = *hi = n;
+
+  return 1;
+}
+
+static int _find_print(const char* path, const fs_dirent_t* entry, void* ctx)
+{
+  (void)ctx;
+
+  fprintf(stderr, "%s%s\n", path, entry->attrs.is_directory ? "/" : "");
 
   return 0;
 }
@@ -175,10 +304,41 @@ int fs_cli_command_ls(char** argv, unsigned argc, fs_simulator_t* sim)
 int fs_cli_command_find(char** argv, unsigned argc, fs_simulator_t* sim)
 {
   _F_CHECK_MOUNTED(sim);
-  _F_CHECK_ARGC(argc, 3);
 
-  // TODO FIXME 
-  LOGERR("Not correctly implemented yet");
+  fs_find_query_t query = fs_find_any;
+  int32_t now = fs_utils_gettime();
+  int64_t lo = 0;
+  int64_t hi = INT64_MAX;
+
+  if (argc < 3 || argc % 2 == 0) {
+    _F_CHECK_ARGC(argc, 3);
+  }
+
+  for (unsigned i = 3; i < argc; i += 2, lo = 0, hi = INT64_MAX) {
+    if (!_parse_range(argv[i + 1], &lo, &hi)) {
+      fprintf(stderr, "ERROR: Invalid value `%s` for `%s`.\n", argv[i + 1],
+              argv[i]);
+      return 1;
+    }
+
+    if (!strcmp(argv[i], "-size")) {
+      query.min_size = lo > UINT32_MAX ? UINT32_MAX : lo;
+      query.max_size = hi > UINT32_MAX ? UINT32_MAX : hi;
+    } else if (!strcmp(argv[i], "-mmin")) {
+      // modified [lo, hi] whole minutes ago
+      query.max_mtime = now - lo * 60;
+      if (hi != INT64_MAX)
+        query.min_mtime = now - (hi + 1) * 60 + 1;
+    } else {
+      fprintf(stderr, "ERROR: Unknown predicate `%s`.\n"
+                      "Enter `help` if you need help.\n",
+              argv[i]);
+      return 1;
+    }
+  }
+
+  query.glob = argv[2];
+  fs_filesystem_search(sim->fs, argv[1], &query, 0, _find_print, NULL);
 
   return 0;
 }
@@ -194,11 +354,73 @@ int fs_cli_command_df(char** argv, unsigned argc, fs_simulator_t* sim)
   return 0;
 }
 
+int fs_cli_command_du(char** argv, unsigned argc, fs_simulator_t* sim)
+{
+  _F_CHECK_MOUNTED(sim);
+  _F_CHECK_ARGC(argc, 2);
+  char buf[FS_DU_FORMAT_SIZE] = { 0 };
+
+  if (fs_filesystem_du(sim->fs, argv[1], buf, FS_DU_FORMAT_SIZE))
+    fprintf(stderr, "%s", buf);
+
+  return 0;
+}
+
+int fs_cli_command_stats(char** argv, unsigned argc, fs_simulator_t* sim)
+{
+  _F_CHECK_MOUNTED(sim);
+  _F_CHECK_ARGC(argc, 1);
+  char buf[FS_STATS_FORMAT_SIZE] = { 0 };
+
+  fs_filesystem_stats(sim->fs, buf, FS_STATS_FORMAT_SIZE);
+  fprintf(stderr, "%s", buf);
+
+  return 0;
+}
+
+static void _scrub_print(uint32_t block, void* ctx)
+{
+  (void)ctx;
+
+  if (block == UINT32_MAX)
+    fprintf(stderr, "FAT/BMP: checksum mismatch\n");
+  else
+    fprintf(stderr, "block %u: checksum mismatch\n", block);
+}
+
+int fs_cli_command_scrub(char** argv, unsigned argc, fs_simulator_t* sim)
+{
+  _F_CHECK_MOUNTED(sim);
+  _F_CHECK_ARGC(argc, 1);
+  uint64_t bad = 0;
+
+  if (!sim->fs->crcs) {
+    fprintf(stderr, "This image has no checksums.\n");
+    return 1;
+  }
+
+  bad = fs_filesystem_scrub(sim->fs, 0, _scrub_print, NULL);
+  fprintf(stderr, "%llu corrupt block(s)\n", (unsigned long long)bad);
+
+  return 0;
+}
+
+int fs_cli_command_snapshot(char** argv, unsigned argc, fs_simulator_t* sim)
+{
+  _F_CHECK_MOUNTED(sim);
+  _F_CHECK_ARGC(argc, 2);
+
+  fs_filesystem_snapshot(sim->fs, argv[1]);
+
+  return 0;
+}
+
 int fs_cli_command_unmount(char** argv, unsigned argc, fs_simulator_t* sim)
 {
   _F_CHECK_MOUNTED(sim);
   _F_CHECK_ARGC(argc, 1);
 
+  fs_filesystem_unmount(sim->fs);
   fs_filesystem_destroy(sim->fs);
   sim->fs = NULL;
 
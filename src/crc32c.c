@@ -0,0 +1,104 @@
+#include "fssim/crc32c.h"
+
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define _HAS_SSE42_PATH 1
+#endif
+
+// reflected Castagnoli polynomial
+#define _POLY 0x82f63b78u
+
+static uint32_t _table[8][256];
+static pthread_once_t _table_once = PTHREAD_ONCE_INIT;
+
+static void _table_init(void)
+{
+  uint32_t crc = 0;
+
+  for (unsigned i = 0; i < 256; i++) {
+    crc = i;
+    for (unsigned k = 0; k < 8; k++)
+      crc = crc & 1 ? (crc >> 1) ^ _POLY : crc >> 1;
+    _table[0][i] = crc;
+  }
+
+  // _table[k][i]: byte i followed by k zeros
+  for (unsigned i = 0; i < 256; i++)
+    for (unsigned k = 1; k < 8; k++)
+      _table[k][i] =
+          (_table[k - 1][i] >> 8) ^ _table[0][_table[k - 1][i] & 0xff];
+}
+
+uint32_t fs_crc32c_sw(uint32_t crc, const void* buf, size_t n)
+{
+  const uint8_t* p = buf;
+  uint64_t word = 0;
+
+  pthread_once(&_table_once, _table_init);
+  crc = ~crc;
+
+  for (; n && ((uintptr_t)p & 7); n--)
+    crc = (crc >> 8) ^ _table[0][(crc ^ *p++) & 0xff];
+
+  // 8B per step, one lookup per byte of the word
+  // (little-endian)
+  for (; n >= 8; n -= 8, p += 8) {
+    memcpy(&word, p, 8);
+    word ^= crc;
+    crc = _table[7][word & 0xff] ^ _table[6][(word >> 8) & 0xff] ^
+          _table[5][(word >> 16) & 0xff] ^ _table[4][(word >> 24) & 0xff] ^
+          _table[3][(word >> 32) & 0xff] ^ _table[2][(word >> 40) & 0xff] ^
+          _table[1][(word >> 48) & 0xff] ^ _table[0][word >> 56];
+  }
+
+  for (; n; n--)
+    crc = (crc >> 8) ^ _table[0][(crc ^ *p++) & 0xff];
+
+  return ~crc;
+}
+
+#ifdef _HAS_SSE42_PATH
+__attribute__((target("sse4.2"))) static uint32_t
+_crc32c_hw(uint32_t crc, const void* buf, size_t n)
+{
+  const uint8_t* p = buf;
+  uint64_t acc = ~crc;
+  uint64_t word = 0;
+
+  for (; n && ((uintptr_t)p & 7); n--)
+    acc = _mm_crc32_u8(acc, *p++);
+
+  for (; n >= 8; n -= 8, p += 8) {
+    memcpy(&word, p, 8);
+    acc = _mm_crc32_u64(acc, word);
+  }
+
+  for (; n; n--)
+    acc = _mm_crc32_u8(acc, *p++);
+
+  return ~(uint32_t)acc;
+}
+#endif
+
+#ifdef _HAS_SSE42_PATH
+static int _hw;
+static pthread_once_t _hw_once = PTHREAD_ONCE_INIT;
+
+static void _hw_init(void)
+{
+  _hw = __builtin_cpu_supports("sse4.2");
+}
+#endif
+
+uint32_t fs_crc32c(uint32_t crc, const void* buf, size_t n)
+{
+#ifdef _HAS_SSE42_PATH
+  pthread_once(&_hw_once, _hw_init);
+  if (_hw)
+    return _crc32c_hw(crc, buf, n);
+#endif
+
+  return fs_crc32c_sw(crc, buf, n);
+}
@@ -0,0 +1,152 @@
+#include "fssim/dcache.h"
+
+// FNV-1a
+static inline uint32_t _hash_path(const char* path, size_t length)
+{
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < length; i++)
+    hash = (hash ^ (uint8_t)path[i]) * 16777619u;
+
+  return hash;
+}
+
+fs_dcache_t* fs_dcache_create(size_t size)
+{
+  ASSERT(size && !(size & (size - 1)), "Size must be a power of two");
+
+  fs_dcache_t* cache = malloc(sizeof(*cache));
+  PASSERT(cache, FS_ERR_MALLOC);
+
+  cache->size = size;
+  // generation 0 is never valid so that calloc'd
+  // entries start as empty
+  cache->generation = 1;
+  cache->stats = (fs_dcache_stats_t){ 0 };
+  cache->entries = calloc(size, sizeof(*cache->entries));
+  PASSERT(cache->entries, FS_ERR_MALLOC);
+
+  return cache;
+}
+
+void fs_dcache_destroy(fs_dcache_t* cache)
+{
+  free(cache->entries);
+  free(cache);
+}
+
+int fs_dcache_normalize(const char* path, char* buf, size_t n)
+{
+  size_t written = 0;
+
+  ASSERT(path[0] == '/', "%s is not an abs path.", path);
+
+  for (; *path; path++) {
+    if (*path == '/' && written && buf[written - 1] == '/')
+      continue;
+    if (written + 1 >= n)
+      return -1;
+    buf[written++] = *path;
+  }
+
+  if (written > 1 && buf[written - 1] == '/')
+    written--;
+  buf[written] = '\0';
+
+  return written;
+}
+
+static fs_dcache_entry_t* _dcache_slot(fs_dcache_t* cache, const char* path,
+                                       char* normalized, int* length,
+                                       uint32_t* hash)
+{
+  if (!~(*length = fs_dcache_normalize(path, normalized, FS_DCACHE_PATH_MAX)))
+    return NULL;
+
+  *hash = _hash_path(normalized, *length);
+
+  return &cache->entries[*hash & (cache->size - 1)];
+}
+
+static inline int _dcache_matches(fs_dcache_t* cache, fs_dcache_entry_t* entry,
+                                  const char* path, int length, uint32_t hash)
+{
+  return entry->generation == cache->generation && entry->hash == hash &&
+         entry->length == length && !memcmp(entry->path, path, length);
+}
+
+int fs_dcache_get(fs_dcache_t* cache, const char* path, fs_file_t** file)
+{
+  char normalized[FS_DCACHE_PATH_MAX];
+  int length = 0;
+  uint32_t hash = 0;
+  fs_dcache_entry_t* entry =
+      _dcache_slot(cache, path, normalized, &length, &hash);
+
+  if (!entry || !_dcache_matches(cache, entry, normalized, length, hash)) {
+    cache->stats.misses++;
+    return 0;
+  }
+
+  if (entry->file)
+    cache->stats.hits++;
+  else
+    cache->stats.negative_hits++;
+
+  *file = entry->file;
+
+  return 1;
+}
+
+void fs_dcache_put(fs_dcache_t* cache, const char* path, fs_file_t* file)
+{
+  char normalized[FS_DCACHE_PATH_MAX];
+  int length = 0;
+  uint32_t hash = 0;
+  fs_dcache_entry_t* entry =
+      _dcache_slot(cache, path, normalized, &length, &hash);
+
+  if (!entry)
+    return;
+
+  entry->hash = hash;
+  entry->generation = cache->generation;
+  entry->length = length;
+  entry->file = file;
+  memcpy(entry->path, normalized, length + 1);
+}
+
+void fs_dcache_forget(fs_dcache_t* cache, const char* path)
+{
+  char normalized[FS_DCACHE_PATH_MAX];
+  int length = 0;
+  uint32_t hash = 0;
+  fs_dcache_entry_t* entry =
+      _dcache_slot(cache, path, normalized, &length, &hash);
+
+  if (entry && _dcache_matches(cache, entry, normalized, length, hash))
+    entry->generation = 0;
+}
+
+void fs_dcache_invalidate(fs_dcache_t* cache)
+{
+  cache->stats.invalidations++;
+
+  // wrapped around: old entries could look valid again
+  if (!++cache->generation) {
+    memset(cache->entries, 0, cache->size * sizeof(*cache->entries));
+    cache->generation = 1;
+  }
+}
+
+int fs_dcache_stats(fs_dcache_t* cache, char* buf, size_t n)
+{
+  fs_dcache_stats_t* s = &cache->stats;
+  uint64_t lookups = s->hits + s->negative_hits + s->misses;
+  double rate = lookups ? 100.0 * (s->hits + s->negative_hits) / lookups : 0;
+
+  return snprintf(buf, n, FS_DCACHE_STATS_FORMAT, (unsigned long long)s->hits,
+                  (unsigned long long)s->negative_hits,
+                  (unsigned long long)s->misses, rate,
+                  (unsigned long long)s->invalidations);
+}
@@ -0,0 +1,220 @@
+#include "fssim/dedup.h"
+
+#define _EMPTY_SLOT UINT32_MAX
+#define _PRIME 0x9e3779b97f4a7c15ull
+#define _FP_SIZE 12
+#define _REF_SIZE 6
+
+static inline uint64_t _rotl(uint64_t x, unsigned r)
+{
+  return x << r | x >> (64 - r);
+}
+
+uint64_t fs_dedup_hash(const uint8_t* block)
+{
+  uint64_t lanes[4] = { 1, 2, 3, 4 };
+  uint64_t word = 0;
+  uint64_t hash = 0;
+
+  // four independent lanes keep the multipliers
+  // busy
+  for (size_t i = 0; i < FS_BLOCK_SIZE; i += 32) {
+    for (unsigned j = 0; j < 4; j++) {
+      memcpy(&word, block + i + j * 8, 8);
+      lanes[j] = (lanes[j] ^ word) * _PRIME;
+      lanes[j] ^= lanes[j] >> 29;
+    }
+  }
+
+  hash = lanes[0] ^ _rotl(lanes[1], 17) ^ _rotl(lanes[2], 31) ^
+         _rotl(lanes[3], 47);
+
+  // murmur3's finalizer
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+
+  return hash;
+}
+
+static fs_dedup_entry_t* _alloc_slots(size_t size)
+{
+  fs_dedup_entry_t* slots = malloc(size * sizeof(*slots));
+  PASSERT(slots, FS_ERR_MALLOC);
+
+  for (size_t i = 0; i < size; i++)
+    slots[i].block = _EMPTY_SLOT;
+
+  return slots;
+}
+
+fs_dedup_t* fs_dedup_create(size_t size, size_t blocks)
+{
+  fs_dedup_t* dedup = calloc(1, sizeof(*dedup));
+  PASSERT(dedup, FS_ERR_MALLOC);
+
+  dedup->mask = size - 1;
+  dedup->slots = _alloc_slots(size);
+  dedup->blocks = blocks;
+  dedup->owned = calloc(blocks / 8 + 1, 1);
+  PASSERT(dedup->owned, FS_ERR_MALLOC);
+
+  return dedup;
+}
+
+void fs_dedup_destroy(fs_dedup_t* dedup)
+{
+  free(dedup->slots);
+  free(dedup->owned);
+  free(dedup);
+}
+
+// slot holding `hash` or the empty one where it
+// would go
+static size_t _find(fs_dedup_t* dedup, uint64_t hash)
+{
+  size_t i = hash & dedup->mask;
+
+  while (dedup->slots[i].block != _EMPTY_SLOT && dedup->slots[i].hash != hash)
+    i = (i + 1) & dedup->mask;
+
+  return i;
+}
+
+uint32_t fs_dedup_get(fs_dedup_t* dedup, uint64_t hash)
+{
+  uint32_t block = dedup->slots[_find(dedup, hash)].block;
+
+  return fs_dedup_owns(dedup, block) ? block : _EMPTY_SLOT;
+}
+
+// doubles the slots, reinserting every entry
+static void _grow(fs_dedup_t* dedup)
+{
+  fs_dedup_entry_t* old = dedup->slots;
+  size_t size = dedup->mask + 1;
+
+  dedup->mask = size * 2 - 1;
+  dedup->slots = _alloc_slots(size * 2);
+
+  for (size_t i = 0; i < size; i++)
+    if (old[i].block != _EMPTY_SLOT)
+      dedup->slots[_find(dedup, old[i].hash)] = old[i];
+
+  free(old);
+}
+
+void fs_dedup_put(fs_dedup_t* dedup, uint64_t hash, uint32_t block)
+{
+  size_t i = _find(dedup, hash);
+
+  if (dedup->slots[i].block == _EMPTY_SLOT) {
+    // at most half full: probes stay short
+    if (2 * (dedup->count + 1) > dedup->mask + 1) {
+      _grow(dedup);
+      i = _find(dedup, hash);
+    }
+
+    dedup->count++;
+  }
+
+  dedup->slots[i].hash = hash;
+  dedup->slots[i].block = block;
+
+  if (block < dedup->blocks && !fs_dedup_owns(dedup, block))
+    SET_LBIT(dedup->owned[block / 8], block % 8);
+}
+
+size_t fs_dedup_serialized_size(fs_dedup_t* dedup, fs_fat_t* fat)
+{
+  size_t size = 12;
+
+  for (size_t i = 0; i <= dedup->mask; i++)
+    if (dedup->slots[i].block != _EMPTY_SLOT &&
+        fs_dedup_owns(dedup, dedup->slots[i].block))
+      size += _FP_SIZE;
+
+  for (size_t i = 0; i < fat->length; i++)
+    if (fat->refs[i])
+      size += _REF_SIZE;
+
+  return size;
+}
+
+size_t fs_dedup_serialize(fs_dedup_t* dedup, fs_fat_t* fat, unsigned char* buf,
+                          size_t n)
+{
+  size_t to_write = fs_dedup_serialized_size(dedup, fat);
+  unsigned char* counts = buf + 4;
+  uint32_t fps = 0;
+  uint32_t refs = 0;
+
+  ASSERT(n >= to_write, "`buf` must at least have %lu bytes remaining. Has %lu",
+         to_write, n);
+
+  buf = serialize_uint32_t(buf, FS_DEDUP_MAGIC) + 8;
+
+  for (size_t i = 0; i <= dedup->mask; i++) {
+    if (dedup->slots[i].block == _EMPTY_SLOT ||
+        !fs_dedup_owns(dedup, dedup->slots[i].block))
+      continue;
+
+    buf = serialize_uint32_t(buf, dedup->slots[i].hash >> 32);
+    buf = serialize_uint32_t(buf, dedup->slots[i].hash);
+    buf = serialize_uint32_t(buf, dedup->slots[i].block);
+    fps++;
+  }
+
+  for (uint32_t i = 0; i < fat->length; i++) {
+    if (!fat->refs[i])
+      continue;
+
+    buf = serialize_uint32_t(buf, i);
+    buf = serialize_uint16_t(buf, fat->refs[i]);
+    refs++;
+  }
+
+  serialize_uint32_t(counts, fps);
+  serialize_uint32_t(counts + 4, refs);
+
+  return to_write;
+}
+
+fs_dedup_t* fs_dedup_load(fs_fat_t* fat, unsigned char* buf, size_t n)
+{
+  fs_dedup_t* dedup = NULL;
+  uint32_t fps = 0;
+  uint32_t refs = 0;
+  uint32_t block = 0;
+
+  if (n < 12 || deserialize_uint32_t(buf) != FS_DEDUP_MAGIC)
+    return NULL;
+
+  fps = deserialize_uint32_t(buf + 4);
+  refs = deserialize_uint32_t(buf + 8);
+  if (n != 12 + (size_t)fps * _FP_SIZE + (size_t)refs * _REF_SIZE)
+    return NULL;
+
+  dedup = fs_dedup_create(FS_DEDUP_MAP_SIZE, fat->length);
+  buf += 12;
+
+  for (uint32_t i = 0; i < fps; i++, buf += _FP_SIZE)
+    fs_dedup_put(dedup,
+                 (uint64_t)deserialize_uint32_t(buf) << 32 |
+                     deserialize_uint32_t(buf + 4),
+                 deserialize_uint32_t(buf + 8));
+
+  for (uint32_t i = 0; i < refs; i++, buf += _REF_SIZE) {
+    if ((block = deserialize_uint32_t(buf)) >= fat->length) {
+      memset(fat->refs, 0, fat->length * sizeof(*fat->refs));
+      fs_dedup_destroy(dedup);
+      return NULL;
+    }
+
+    fat->refs[block] = deserialize_uint16_t(buf + 4);
+  }
+
+  return dedup;
+}
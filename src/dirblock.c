@@ -0,0 +1,127 @@
+#include "fssim/dirblock.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// entry bytes holding the name (1..11)
+#define _NAME_MASK (((1 << FS_NAME_MAX) - 1) << 1)
+
+static inline const uint8_t* _entry(const uint8_t* block, unsigned i)
+{
+  return block + FS_OFFSET_FILE_ENTRY * (i + 1);
+}
+
+int fs_dirblock_find(const uint8_t* block, const char* fname, size_t length)
+{
+  uint8_t target[16] = { 0 };
+  unsigned count = fs_dirblock_count(block);
+
+  // names are truncated and zero-padded to
+  // FS_NAME_MAX when stored
+  if (length > FS_NAME_MAX)
+    length = FS_NAME_MAX;
+  memcpy(target + 1, fname, length);
+
+#ifdef __SSE2__
+  // one 16B load per entry, from its start (32B
+  // strides): the name sits at bytes 1..11.
+  const __m128i t = _mm_loadu_si128((const __m128i*)target);
+
+  for (unsigned i = 0; i < count; i++) {
+    __m128i e = _mm_loadu_si128((const __m128i*)_entry(block, i));
+
+    if ((_mm_movemask_epi8(_mm_cmpeq_epi8(e, t)) & _NAME_MASK) == _NAME_MASK)
+      return i;
+  }
+#else
+  for (unsigned i = 0; i < count; i++)
+    if (!memcmp(_entry(block, i) + 1, target + 1, FS_NAME_MAX))
+      return i;
+#endif
+
+  return -1;
+}
+
+void fs_dirblock_entry(const uint8_t* block, unsigned i, fs_dirent_t* entry)
+{
+  fs_dirblock_decode(_entry(block, i), entry);
+}
+
+void fs_dirblock_encode(uint8_t* buf, uint32_t fblock,
+                        const fs_file_attr_t* attrs)
+{
+  serialize_uint8_t(buf, attrs->is_directory |
+                         (attrs->readonly ? FS_ENTRY_READONLY : 0));
+  memcpy(buf + 1, attrs->fname, FS_NAME_MAX);
+  serialize_uint32_t(buf + 12, fblock);
+  serialize_int32_t(buf + 16, attrs->ctime);
+  serialize_int32_t(buf + 20, attrs->mtime);
+  serialize_int32_t(buf + 24, attrs->atime);
+  serialize_uint32_t(buf + 28, attrs->size);
+}
+
+void fs_dirblock_decode(const uint8_t* block_entry, fs_dirent_t* entry)
+{
+  unsigned char* buf = (unsigned char*)block_entry;
+
+  entry->attrs.is_directory = !!(buf[0] & FS_ENTRY_DIRECTORY);
+  entry->attrs.readonly = !!(buf[0] & FS_ENTRY_READONLY);
+  memcpy(entry->attrs.fname, buf + 1, FS_NAME_MAX);
+  entry->fblock = deserialize_uint32_t(buf + 12);
+  entry->attrs.ctime = deserialize_int32_t(buf + 16);
+  entry->attrs.mtime = deserialize_int32_t(buf + 20);
+  entry->attrs.atime = deserialize_int32_t(buf + 24);
+  entry->attrs.size = deserialize_uint32_t(buf + 28);
+}
+
+fs_dirblock_cache_t* fs_dirblock_cache_create(size_t size)
+{
+  ASSERT(size && !(size & (size - 1)), "Size must be a power of two");
+
+  fs_dirblock_cache_t* cache = malloc(sizeof(*cache));
+  PASSERT(cache, FS_ERR_MALLOC);
+
+  cache->size = size;
+  cache->tags = malloc(size * sizeof(*cache->tags));
+  PASSERT(cache->tags, FS_ERR_MALLOC);
+  memset(cache->tags, 0xff, size * sizeof(*cache->tags));
+  cache->blocks = malloc(size * FS_BLOCK_SIZE);
+  PASSERT(cache->blocks, FS_ERR_MALLOC);
+
+  return cache;
+}
+
+void fs_dirblock_cache_destroy(fs_dirblock_cache_t* cache)
+{
+  free(cache->tags);
+  free(cache->blocks);
+  free(cache);
+}
+
+uint8_t* fs_dirblock_cache_get(fs_dirblock_cache_t* cache, uint32_t fblock)
+{
+  size_t slot = fblock & (cache->size - 1);
+
+  if (cache->tags[slot] != fblock)
+    return NULL;
+
+  return cache->blocks + slot * FS_BLOCK_SIZE;
+}
+
+uint8_t* fs_dirblock_cache_slot(fs_dirblock_cache_t* cache, uint32_t fblock)
+{
+  size_t slot = fblock & (cache->size - 1);
+
+  cache->tags[slot] = fblock;
+
+  return cache->blocks + slot * FS_BLOCK_SIZE;
+}
+
+void fs_dirblock_cache_forget(fs_dirblock_cache_t* cache, uint32_t fblock)
+{
+  size_t slot = fblock & (cache->size - 1);
+
+  if (cache->tags[slot] == fblock)
+    cache->tags[slot] = UINT32_MAX;
+}
@@ -9,6 +9,9 @@ fs_fat_t* fs_fat_create(size_t length)
   fat->blocks = calloc(fat->length, sizeof(*fat->blocks));
   PASSERT(fat->blocks, FS_ERR_MALLOC);
 
+  fat->refs = calloc(fat->length, sizeof(*fat->refs));
+  PASSERT(fat->refs, FS_ERR_MALLOC);
+
   while (length-- > 0)
     fat->blocks[length] = length;
 
@@ -26,6 +29,8 @@ fs_fat_t* fs_fat_load(unsigned char* buf, size_t blocks)
   fat->length = blocks;
   fat->blocks = calloc(fat->length, sizeof(*fat->blocks));
   PASSERT(fat->blocks, FS_ERR_MALLOC);
+  fat->refs = calloc(fat->length, sizeof(*fat->refs));
+  PASSERT(fat->refs, FS_ERR_MALLOC);
 
   for (; i < blocks; i++)
     fat->blocks[i] = deserialize_uint32_t(buf + (i * 4));
@@ -39,6 +44,7 @@ void fs_fat_destroy(fs_fat_t* fat)
 {
   fs_bmp_destroy(fat->bmp);
   free(fat->blocks);
+  free(fat->refs);
   free(fat);
 }
 
@@ -63,10 +69,53 @@ uint32_t fs_fat_addblock(fs_fat_t* fat, uint32_t file_pos)
   return free_block;
 }
 
+uint32_t fs_fat_allocfile(fs_fat_t* fat, uint32_t count)
+{
+  uint32_t first = 0;
+  uint32_t last = 0;
+
+  ASSERT(count, "Must allocate at least one block");
+
+  // a single extent when there's room for one
+  first = fs_bmp_alloc_run(fat->bmp, count);
+  if (first != UINT32_MAX) {
+    for (last = first; last < first + count - 1; last++)
+      fat->blocks[last] = last + 1;
+    fat->blocks[last] = last;
+    return first;
+  }
+
+  first = fs_fat_addfile(fat);
+  last = first;
+
+  // keeps track of the tail: no walking the chain
+  while (--count) {
+    fat->blocks[last] = fs_bmp_alloc(fat->bmp);
+    last = fat->blocks[last];
+    fat->blocks[last] = last;
+  }
+
+  return first;
+}
+
+int fs_fat_share(fs_fat_t* fat, uint32_t block)
+{
+  if (fat->refs[block] == UINT16_MAX)
+    return 0;
+
+  fat->refs[block]++;
+  return 1;
+}
+
 void fs_fat_removefile(fs_fat_t* fat, uint32_t file_pos)
 {
   uint32_t tmp_pos;
 
+  if (fat->refs[file_pos]) {
+    fat->refs[file_pos]--;
+    return;
+  }
+
   while (1) {
     tmp_pos = file_pos;
     fs_bmp_free(fat->bmp, file_pos);
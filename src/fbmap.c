@@ -0,0 +1,132 @@
+#include "fssim/fbmap.h"
+
+#define _EMPTY_SLOT UINT32_MAX
+
+static inline uint32_t* _key(fs_fbmap_t* map, size_t i)
+{
+  return (uint32_t*)(map->slots + i * map->entry_size);
+}
+
+static inline size_t _slot(fs_fbmap_t* map, uint32_t fblock)
+{
+  return (fblock * 2654435761u) & map->mask;
+}
+
+static uint8_t* _alloc_slots(size_t size, size_t entry_size)
+{
+  uint8_t* slots = malloc(size * entry_size);
+  PASSERT(slots, FS_ERR_MALLOC);
+
+  for (size_t i = 0; i < size; i++)
+    *(uint32_t*)(slots + i * entry_size) = _EMPTY_SLOT;
+
+  return slots;
+}
+
+fs_fbmap_t* fs_fbmap_create(size_t size, size_t entry_size)
+{
+  fs_fbmap_t* map = calloc(1, sizeof(*map));
+  PASSERT(map, FS_ERR_MALLOC);
+
+  ASSERT(entry_size >= sizeof(uint32_t), "Entries start w/ their key");
+  map->mask = size - 1;
+  map->entry_size = entry_size;
+  map->slots = _alloc_slots(size, entry_size);
+
+  return map;
+}
+
+void fs_fbmap_destroy(fs_fbmap_t* map)
+{
+  free(map->slots);
+  free(map);
+}
+
+// slot of `fblock`, SIZE_MAX if missing
+static size_t _find(fs_fbmap_t* map, uint32_t fblock)
+{
+  for (size_t i = _slot(map, fblock);; i = (i + 1) & map->mask) {
+    if (*_key(map, i) == fblock)
+      return i;
+    if (*_key(map, i) == _EMPTY_SLOT)
+      return SIZE_MAX;
+  }
+}
+
+void* fs_fbmap_get(fs_fbmap_t* map, uint32_t fblock)
+{
+  size_t i = _find(map, fblock);
+
+  return i == SIZE_MAX ? NULL : _key(map, i);
+}
+
+// doubles the slots, reinserting every entry
+static void _grow(fs_fbmap_t* map)
+{
+  uint8_t* old = map->slots;
+  size_t size = map->mask + 1;
+  uint32_t fblock = 0;
+  size_t j = 0;
+
+  map->mask = size * 2 - 1;
+  map->slots = _alloc_slots(size * 2, map->entry_size);
+
+  for (size_t i = 0; i < size; i++) {
+    if ((fblock = *(uint32_t*)(old + i * map->entry_size)) == _EMPTY_SLOT)
+      continue;
+
+    for (j = _slot(map, fblock); *_key(map, j) != _EMPTY_SLOT;)
+      j = (j + 1) & map->mask;
+    memcpy(_key(map, j), old + i * map->entry_size, map->entry_size);
+  }
+
+  free(old);
+}
+
+void* fs_fbmap_put(fs_fbmap_t* map, uint32_t fblock)
+{
+  uint32_t* entry = fs_fbmap_get(map, fblock);
+  size_t i = 0;
+
+  if (entry)
+    return entry;
+
+  // at most half full: probes stay short
+  if (2 * (map->count + 1) > map->mask + 1)
+    _grow(map);
+
+  for (i = _slot(map, fblock); *_key(map, i) != _EMPTY_SLOT;)
+    i = (i + 1) & map->mask;
+
+  entry = _key(map, i);
+  memset(entry, 0, map->entry_size);
+  *entry = fblock;
+  map->count++;
+
+  return entry;
+}
+
+void fs_fbmap_remove(fs_fbmap_t* map, uint32_t fblock)
+{
+  size_t hole = _find(map, fblock);
+  size_t home = 0;
+
+  if (hole == SIZE_MAX)
+    return;
+
+  *_key(map, hole) = _EMPTY_SLOT;
+  map->count--;
+
+  // shifts back the entries that probed past the
+  // hole so that lookups don't stop short at it
+  for (size_t i = (hole + 1) & map->mask; *_key(map, i) != _EMPTY_SLOT;
+       i = (i + 1) & map->mask) {
+    home = _slot(map, *_key(map, i));
+
+    if (((i - home) & map->mask) >= ((i - hole) & map->mask)) {
+      memcpy(_key(map, hole), _key(map, i), map->entry_size);
+      *_key(map, i) = _EMPTY_SLOT;
+      hole = i;
+    }
+  }
+}
@@ -1,14 +1,164 @@
 #include "fssim/file.h"
+#include "fssim/dirblock.h"
+
+#define _HTABLE_MASK (FS_DIR_HTABLE_SIZE - 1)
+
+// FNV-1a over (at most) `length` characters
+static inline uint32_t _hash_fname(const char* fname, size_t length)
+{
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < length && fname[i]; i++)
+    hash = (hash ^ (uint8_t)fname[i]) * 16777619u;
+
+  return hash;
+}
+
+static inline char* _child_name(fs_file_t* dir, unsigned i)
+{
+  return (char*)fs_file_child_name(dir, i);
+}
+
+// stored names are only NUL-terminated when
+// shorter than FS_NAME_MAX
+static inline int _fname_eq(const char* stored, const char* fname,
+                            size_t length)
+{
+  return !memcmp(stored, fname, length) &&
+         (length == FS_NAME_MAX || !stored[length]);
+}
+
+static inline uint8_t* _htable(fs_file_t* dir)
+{
+  return fs_slab_at(dir->arena->htables, dir->htable - 1);
+}
+
+static void _htable_insert(fs_file_t* dir, unsigned i)
+{
+  uint8_t* htable = _htable(dir);
+  uint32_t pos = _hash_fname(_child_name(dir, i), FS_NAME_MAX) & _HTABLE_MASK;
+
+  while (htable[pos])
+    pos = (pos + 1) & _HTABLE_MASK;
+
+  htable[pos] = i + 1;
+}
+
+// removals shift children indexes around: the
+// index is small enough to just get rebuilt.
+static void _htable_fill(fs_file_t* dir)
+{
+  memset(_htable(dir), 0, FS_DIR_HTABLE_SIZE * sizeof(uint8_t));
+
+  for (unsigned i = 0; i < dir->children_count; i++)
+    _htable_insert(dir, i);
+}
+
+fs_file_arena_t* fs_file_arena_create()
+{
+  fs_file_arena_t* arena = malloc(sizeof(*arena));
+  PASSERT(arena, FS_ERR_MALLOC);
+
+  arena->files = fs_slab_create(sizeof(fs_file_t), FS_ARENA_CHUNK_FILES);
+  arena->htables = fs_slab_create(FS_DIR_HTABLE_SIZE * sizeof(uint8_t),
+                                  FS_ARENA_CHUNK_HTABLES);
+
+  for (int k = 0; k < FS_ARENA_DIRENTS_CLASSES; k++)
+    arena->dirents[k] =
+        fs_slab_create((FS_ARENA_DIRENTS_MIN << k) *
+                           (sizeof(uint32_t) + FS_NAME_MAX * sizeof(char)),
+                       FS_ARENA_CHUNK_DIRENTS);
+
+  return arena;
+}
+
+void fs_file_arena_destroy(fs_file_arena_t* arena)
+{
+  fs_slab_destroy(arena->files);
+  fs_slab_destroy(arena->htables);
+
+  for (int k = 0; k < FS_ARENA_DIRENTS_CLASSES; k++)
+    fs_slab_destroy(arena->dirents[k]);
+
+  free(arena);
+}
+
+size_t fs_file_arena_usage(fs_file_arena_t* arena)
+{
+  size_t usage = arena->files->live * arena->files->slotsize +
+                 arena->htables->live * arena->htables->slotsize;
+
+  for (int k = 0; k < FS_ARENA_DIRENTS_CLASSES; k++)
+    usage += arena->dirents[k]->live * arena->dirents[k]->slotsize;
+
+  return usage;
+}
+
+static inline int _dirents_class(uint8_t size)
+{
+  int k = 0;
+
+  while ((FS_ARENA_DIRENTS_MIN << k) < size)
+    k++;
+
+  return k;
+}
+
+static void _dirents_free(fs_file_t* dir)
+{
+  if (dir->children)
+    fs_slab_free(dir->arena->dirents[_dirents_class(dir->children_size)],
+                 dir->children);
+}
+
+// moves the children to a size class able to
+// hold at least `count` of them
+static void _dirents_reserve(fs_file_t* dir, unsigned count)
+{
+  int k = _dirents_class(count);
+  uint8_t size = FS_ARENA_DIRENTS_MIN << k;
+  uint32_t* children = NULL;
+
+  ASSERT(k < FS_ARENA_DIRENTS_CLASSES, "No size class for %d entries", size);
+  children = fs_slab_alloc(dir->arena->dirents[k]);
+
+  if (dir->children) {
+    memcpy(children, dir->children, dir->children_count * sizeof(uint32_t));
+    memcpy(children + size, fs_file_child_name(dir, 0),
+           dir->children_count * FS_NAME_MAX);
+    _dirents_free(dir);
+  }
+
+  dir->children = children;
+  dir->children_size = size;
+}
 
 fs_file_t* fs_file_create(const char* fname, fs_file_type type,
                           fs_file_t* parent)
+{
+  return fs_file_create_in(parent ? parent->arena : NULL, fname, type, parent);
+}
 
+static fs_file_t* _file_alloc(fs_file_arena_t* arena)
 {
-  fs_file_t* file = malloc(sizeof(*file));
-  PASSERT(file, FS_ERR_MALLOC);
+  uint8_t owns_arena = !arena;
+  fs_file_t* file = NULL;
+
+  if (owns_arena)
+    arena = fs_file_arena_create();
 
-  file->children = NULL;
-  file->children_count = 0;
+  file = fs_slab_alloc(arena->files);
+  *file = fs_zeroed_file;
+  file->arena = arena;
+  file->owns_arena = owns_arena;
+
+  return file;
+}
+
+fs_file_t* fs_file_create_in(fs_file_arena_t* arena, const char* fname,
+                             fs_file_type type, fs_file_t* parent)
+{
+  fs_file_t* file = _file_alloc(arena);
 
   // dealing w/ root case
   file->fblock = !parent ? 0 : UINT32_MAX;
@@ -22,30 +172,48 @@ fs_file_t* fs_file_create(const char* fname, fs_file_type type,
   return file;
 }
 
-static void _remove_dir_content(fs_llist_t* d)
+// returns the memory of `file` and of everything
+// below it to the arena
+static void _file_release(fs_file_t* file);
+
+static void _children_release(fs_file_t* dir)
 {
-  fs_llist_t* td = NULL;
-  fs_file_t* f = NULL;
+  for (unsigned i = 0; i < dir->children_count; i++)
+    _file_release(fs_file_child(dir, i));
 
-  while (d) {
-    f = (fs_file_t*)d->data;
+  _dirents_free(dir);
+  if (dir->htable)
+    fs_slab_free(dir->arena->htables, _htable(dir));
+}
 
-    if (f->attrs.is_directory && f->children)
-      _remove_dir_content(f->children);
+static void _file_release(fs_file_t* file)
+{
+  _children_release(file);
+  fs_slab_free(file->arena->files, file);
+}
 
-    td = d;
-    d = d->next;
-    td->next = NULL;
-    fs_llist_destroy(td, NULL);
-    free(f);
-  }
+void fs_file_evict(fs_file_t* dir)
+{
+  ASSERT(dir->attrs.is_directory == 1,
+         "File `%s` must be of type FS_FILE_DIRECTORY", dir->attrs.fname);
+
+  _children_release(dir);
+  dir->children = NULL;
+  dir->children_count = 0;
+  dir->children_size = 0;
+  dir->htable = 0;
+  dir->residency = FS_FILE_EVICTED;
 }
 
 void fs_file_destroy(fs_file_t* file)
 {
-  if (file->children)
-    _remove_dir_content(file->children);
-  free(file);
+  // the whole tree goes away w/ the arena
+  if (file->owns_arena) {
+    fs_file_arena_destroy(file->arena);
+    return;
+  }
+
+  _file_release(file);
 }
 
 int fs_file_serialize_dir(fs_file_t* file, unsigned char* buf, int n)
@@ -56,58 +224,139 @@ int fs_file_serialize_dir(fs_file_t* file, unsigned char* buf, int n)
   ASSERT(n >= to_write, "`buf` must at least have %u bytes remaining. Has %d",
          to_write, n);
 
-  fs_llist_t* tmp = file->children;
   fs_file_t* curr_file = NULL;
   unsigned counter = 0;
-  unsigned offset = 0;
 
+  // the rest of the header is reserved
+  memset(buf, 0, FS_OFFSET_FILE_ENTRY);
   serialize_uint8_t(buf, file->children_count);
   counter++;
 
-  while (tmp) {
-    offset = counter * FS_OFFSET_FILE_ENTRY;
-    curr_file = (fs_file_t*)tmp->data;
+  // newest first
+  for (int i = file->children_count - 1; i >= 0; i--) {
+    curr_file = fs_file_child(file, i);
+    fs_dirblock_encode(buf + counter * FS_OFFSET_FILE_ENTRY, curr_file->fblock,
+                       &curr_file->attrs);
 
-    serialize_uint8_t(buf + offset, curr_file->attrs.is_directory);
-    memcpy(buf + offset + 1, curr_file->attrs.fname, 11);
-    serialize_uint32_t(buf + offset + 12, curr_file->fblock);
-    serialize_int32_t(buf + offset + 16, curr_file->attrs.ctime);
-    serialize_int32_t(buf + offset + 20, curr_file->attrs.mtime);
-    serialize_int32_t(buf + offset + 24, curr_file->attrs.atime);
-    serialize_uint32_t(buf + offset + 28, curr_file->attrs.size);
-
-    tmp = tmp->next;
     counter++;
   }
 
   return to_write;
 }
 
+size_t fs_file_tree_size(fs_file_t* dir)
+{
+  size_t size = 1;
+  fs_file_t* f = NULL;
+
+  for (unsigned i = 0; i < dir->children_count; i++) {
+    f = fs_file_child(dir, i);
+    size += FS_OFFSET_FILE_ENTRY;
+
+    if (f->attrs.is_directory)
+      size += fs_file_tree_size(f);
+  }
+
+  return size;
+}
+
+size_t fs_file_serialize_tree(fs_file_t* dir, unsigned char* buf, size_t n)
+{
+  size_t written = 1;
+  fs_file_t* f = NULL;
+
+  ASSERT(n >= 1, "`buf` must at least have 1 byte remaining");
+
+  if (dir->residency == FS_FILE_EVICTED) {
+    serialize_uint8_t(buf, FS_TREE_EVICTED);
+    return written;
+  }
+
+  serialize_uint8_t(buf, dir->children_count);
+
+  // insertion order
+  for (unsigned i = 0; i < dir->children_count; i++) {
+    f = fs_file_child(dir, i);
+
+    ASSERT(n - written >= FS_OFFSET_FILE_ENTRY,
+           "`buf` must at least have %d bytes remaining. Has %lu",
+           FS_OFFSET_FILE_ENTRY, n - written);
+    fs_dirblock_encode(buf + written, f->fblock, &f->attrs);
+    written += FS_OFFSET_FILE_ENTRY;
+
+    if (f->attrs.is_directory)
+      written += fs_file_serialize_tree(f, buf + written, n - written);
+  }
+
+  return written;
+}
+
+size_t fs_file_load_tree(fs_file_t* dir, unsigned char* buf, size_t n)
+{
+  size_t read = 1;
+  size_t subtree = 0;
+  unsigned count = 0;
+  fs_dirent_t entry;
+
+  if (n < 1)
+    return 0;
+
+  if ((count = deserialize_uint8_t(buf)) == FS_TREE_EVICTED) {
+    dir->residency = FS_FILE_EVICTED;
+    return read;
+  }
+
+  if (count > FS_DIR_MAX_CHILDREN)
+    return 0;
+
+  if (count > dir->children_size)
+    _dirents_reserve(dir, count);
+
+  while (count--) {
+    fs_file_t* f = NULL;
+
+    if (n - read < FS_OFFSET_FILE_ENTRY)
+      return 0;
+
+    fs_dirblock_decode(buf + read, &entry);
+    read += FS_OFFSET_FILE_ENTRY;
+
+    f = _file_alloc(dir->arena);
+    f->fblock = entry.fblock;
+    f->attrs = entry.attrs;
+    fs_file_addchild(dir, f);
+
+    if (!f->attrs.is_directory)
+      continue;
+
+    if (!(subtree = fs_file_load_tree(f, buf + read, n - read)))
+      return 0;
+    read += subtree;
+  }
+
+  return read;
+}
+
 void fs_file_load_dir(fs_file_t* file, unsigned char* buf)
 {
-  unsigned offset = 0;
-  unsigned counter = 1;
-  unsigned children_count = deserialize_uint8_t(buf);
+  unsigned counter = fs_dirblock_count(buf);
+  fs_dirent_t entry;
 
-  while (counter <= children_count) {
-    fs_file_t* new_file = malloc(sizeof(*new_file));
-    PASSERT(new_file, FS_ERR_MALLOC);
-    *new_file = fs_zeroed_file;
-    new_file->attrs = fs_zeroed_file_attrs;
+  file->residency = FS_FILE_RESIDENT;
+  if (counter > file->children_size)
+    _dirents_reserve(file, counter);
 
-    offset = counter * FS_OFFSET_FILE_ENTRY;
+  // entries are stored newest first
+  while (counter >= 1) {
+    fs_file_t* new_file = _file_alloc(file->arena);
 
-    new_file->attrs.is_directory = deserialize_uint8_t(buf + offset);
-    memcpy(new_file->attrs.fname, buf + offset + 1, 11);
-    new_file->fblock = deserialize_uint32_t(buf + offset + 12);
-    new_file->attrs.ctime = deserialize_int32_t(buf + offset + 16);
-    new_file->attrs.mtime = deserialize_int32_t(buf + offset + 20);
-    new_file->attrs.atime = deserialize_int32_t(buf + offset + 24);
-    new_file->attrs.size = deserialize_uint32_t(buf + offset + 28);
+    fs_dirblock_entry(buf, counter - 1, &entry);
+    new_file->fblock = entry.fblock;
+    new_file->attrs = entry.attrs;
 
     fs_file_addchild(file, new_file);
 
-    counter++;
+    counter--;
   }
 }
 
@@ -115,12 +364,85 @@ void fs_file_addchild(fs_file_t* dir, fs_file_t* other)
 {
   ASSERT(dir->attrs.is_directory == 1,
          "File `%s` must be of type FS_FILE_DIRECTORY", dir->attrs.fname);
+  ASSERT(dir->children_count < FS_DIR_MAX_CHILDREN,
+         "Directory `%s` can't hold more than %d entries", dir->attrs.fname,
+         FS_DIR_MAX_CHILDREN);
+  ASSERT(dir->arena == other->arena, "`%s` and `%s` live in different arenas",
+         dir->attrs.fname, other->attrs.fname);
   other->parent = dir;
 
-  if (!dir->children)
-    dir->children = fs_llist_create(other);
-  else
-    dir->children = fs_llist_append(fs_llist_create(other), dir->children);
+  if (dir->children_count == dir->children_size)
+    _dirents_reserve(dir, dir->children_count + 1);
 
+  dir->children[dir->children_count] = fs_file_id(other);
+  memcpy(_child_name(dir, dir->children_count), other->attrs.fname,
+         FS_NAME_MAX);
   dir->children_count++;
+
+  if (dir->htable)
+    _htable_insert(dir, dir->children_count - 1);
+}
+
+void fs_file_removechild(fs_file_t* dir, fs_file_t* child)
+{
+  uint32_t id = fs_file_id(child);
+  unsigned i = 0;
+  unsigned after = 0;
+
+  while (i < dir->children_count && dir->children[i] != id)
+    i++;
+
+  ASSERT(i < dir->children_count, "`%s` is not a child of `%s`",
+         child->attrs.fname, dir->attrs.fname);
+
+  after = dir->children_count - i - 1;
+  memmove(dir->children + i, dir->children + i + 1, after * sizeof(uint32_t));
+  memmove(_child_name(dir, i), _child_name(dir, i + 1), after * FS_NAME_MAX);
+  dir->children_count--;
+
+  if (dir->htable)
+    _htable_fill(dir);
+}
+
+fs_file_t* fs_file_lookup(fs_file_t* dir, const char* fname)
+{
+  return fs_file_lookupn(dir, fname, strnlen(fname, FS_NAME_MAX));
+}
+
+fs_file_t* fs_file_lookupn(fs_file_t* dir, const char* fname, size_t length)
+{
+  uint8_t* htable = NULL;
+  uint32_t pos = 0;
+  unsigned i = 0;
+
+  if (!dir->children_count)
+    return NULL;
+
+  // names are truncated to FS_NAME_MAX on creation
+  if (length > FS_NAME_MAX)
+    length = FS_NAME_MAX;
+
+  if (!dir->htable && dir->children_count > FS_DIR_HTABLE_THRESHOLD) {
+    dir->htable = fs_slab_id(fs_slab_alloc(dir->arena->htables)) + 1;
+    _htable_fill(dir);
+  }
+
+  if (!dir->htable) {
+    for (i = 0; i < dir->children_count; i++)
+      if (_fname_eq(fs_file_child_name(dir, i), fname, length))
+        return fs_file_child(dir, i);
+
+    return NULL;
+  }
+
+  htable = _htable(dir);
+  pos = _hash_fname(fname, length) & _HTABLE_MASK;
+  while ((i = htable[pos])) {
+    if (_fname_eq(fs_file_child_name(dir, i - 1), fname, length))
+      return fs_file_child(dir, i - 1);
+
+    pos = (pos + 1) & _HTABLE_MASK;
+  }
+
+  return NULL;
 }
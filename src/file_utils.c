@@ -1,5 +1,9 @@
 #include "fssim/file_utils.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 int fs_utils_fsize(FILE* file)
 {
   int size;
@@ -24,6 +28,35 @@ FILE* fs_utils_mkfile(const char* fname, size_t size)
   return file;
 }
 
+int fs_utils_iszero(const uint8_t* buf, size_t n)
+{
+#ifdef __SSE2__
+  const __m128i* v = (const __m128i*)buf;
+  __m128i acc;
+
+  // ORs 64B per step, checking once per step so
+  // that data is rejected early
+  for (size_t i = 0; i < n / 16; i += 4) {
+    acc = _mm_or_si128(
+        _mm_or_si128(_mm_loadu_si128(v + i), _mm_loadu_si128(v + i + 1)),
+        _mm_or_si128(_mm_loadu_si128(v + i + 2), _mm_loadu_si128(v + i + 3)));
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xffff)
+      return 0;
+  }
+#else
+  uint64_t word = 0;
+
+  for (size_t i = 0; i < n; i += 8) {
+    memcpy(&word, buf + i, 8);
+    if (word)
+      return 0;
+  }
+#endif
+
+  return 1;
+}
+
 char** fs_utils_splitpath(const char* input, unsigned* size)
 {
   const char delimiter = '/';
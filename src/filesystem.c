@@ -1,3 +1,6 @@
+// SEEK_DATA/SEEK_HOLE
+#define _GNU_SOURCE
+
 #include "fssim/filesystem.h"
 
 fs_filesystem_t* fs_filesystem_create(size_t blocks)
@@ -9,6 +12,11 @@ fs_filesystem_t* fs_filesystem_create(size_t blocks)
 
   fs->blocks_num = blocks;
   fs->block_size = FS_BLOCK_SIZE;
+  fs->dcache = fs_dcache_create(FS_DCACHE_SIZE);
+  fs->scratch = fs_scratch_create(FS_SCRATCH_SIZE);
+  fs->dirblocks = fs_dirblock_cache_create(FS_DIRBLOCK_CACHE_SIZE);
+  fs->blooms = fs_bloom_map_create(FS_BLOOM_MAP_SIZE);
+  fs->usage = fs_fsinfo_map_create(FS_FSINFO_MAP_SIZE);
 
   return fs;
 }
@@ -20,9 +28,13 @@ void fs_filesystem_destroy(fs_filesystem_t* fs)
     fs->fat = NULL;
   }
 
-  if (fs->root) {
-    fs_file_destroy(fs->root);
-    fs->root = NULL;
+  // every node of the tree lives in the arena:
+  // no need to walk it.
+  fs->root = NULL;
+
+  if (fs->arena) {
+    fs_file_arena_destroy(fs->arena);
+    fs->arena = NULL;
   }
 
   if (fs->file) {
@@ -35,9 +47,228 @@ void fs_filesystem_destroy(fs_filesystem_t* fs)
     fs->buf = NULL;
   }
 
+  if (fs->names) {
+    fs_nameidx_destroy(fs->names);
+    fs->names = NULL;
+  }
+
+  if (fs->dedup) {
+    fs_dedup_destroy(fs->dedup);
+    fs->dedup = NULL;
+  }
+
+  if (fs->crcs) {
+    free(fs->crcs);
+    fs->crcs = NULL;
+  }
+
+  fs_dcache_destroy(fs->dcache);
+  fs_scratch_destroy(fs->scratch);
+  fs_dirblock_cache_destroy(fs->dirblocks);
+  fs_bloom_map_destroy(fs->blooms);
+  fs_fsinfo_map_destroy(fs->usage);
   free(fs);
 }
 
+static inline off_t _block_offset(fs_filesystem_t* fs, uint32_t block)
+{
+  return fs->blocks_offset + (off_t)block * FS_BLOCK_SIZE;
+}
+
+// blocks taken by the checksum table of an image
+// of `blocks`
+static inline uint32_t _csum_blocks(size_t blocks)
+{
+  return (FS_CSUM_HEADER_SIZE + 4 * blocks - 1) / FS_BLOCK_SIZE + 1;
+}
+
+static inline off_t _csum_offset(fs_filesystem_t* fs, uint32_t block)
+{
+  return _block_offset(fs, fs->crcs_first) + FS_CSUM_HEADER_SIZE +
+         (off_t)block * 4;
+}
+
+// reserves the last blocks of a new image for the
+// checksum table. Every block starts as zeros.
+static void _csum_create(fs_filesystem_t* fs)
+{
+  static const uint8_t zeros[FS_BLOCK_SIZE] = { 0 };
+  uint32_t count = _csum_blocks(fs->blocks_num);
+  uint32_t last = fs->fat->bmp->last_block;
+  uint32_t zero = fs_crc32c(0, zeros, FS_BLOCK_SIZE);
+  size_t size = (size_t)count * FS_BLOCK_SIZE;
+  uint8_t* table = calloc(size, 1);
+
+  fs->crcs = malloc(fs->blocks_num * sizeof(*fs->crcs));
+  PASSERT(table && fs->crcs, FS_ERR_MALLOC);
+
+  // the allocator is next-fit: point it at them
+  fs->crcs_first = fs->blocks_num - count;
+  fs->fat->bmp->last_block = fs->crcs_first;
+  ASSERT(fs_fat_allocfile(fs->fat, count) == fs->crcs_first,
+         "Checksum table must take the last %u blocks", count);
+  fs->fat->bmp->last_block = last;
+
+  serialize_uint32_t(table, FS_CSUM_MAGIC);
+  for (size_t i = 0; i < fs->blocks_num; i++) {
+    fs->crcs[i] = zero;
+    serialize_uint32_t(table + FS_CSUM_HEADER_SIZE + 4 * i, zero);
+  }
+
+  PASSERT(pwrite(fileno(fs->file), table, size,
+                 _block_offset(fs, fs->crcs_first)) == (ssize_t)size,
+          "pwrite: ");
+  free(table);
+}
+
+// reads the checksum table of an image (if its
+// root directory says it has one), checking the
+// superblock, FAT and BMP in `fs->buf` against it
+static void _csum_load(fs_filesystem_t* fs)
+{
+  uint32_t count = _csum_blocks(fs->blocks_num);
+  size_t size = (size_t)count * FS_BLOCK_SIZE;
+  uint8_t* table = NULL;
+  uint8_t flags = 0;
+
+  // the root directory is always block 0
+  PASSERT(pread(fileno(fs->file), &flags, 1,
+                _block_offset(fs, 0) + FS_ROOT_FLAGS_OFFSET) == 1,
+          "pread: ");
+  if (!(flags & FS_ROOT_FLAG_CSUM))
+    return;
+
+  table = malloc(size);
+  PASSERT(table, FS_ERR_MALLOC);
+  fs->crcs_first = fs->blocks_num - count;
+  PASSERT(pread(fileno(fs->file), table, size,
+                _block_offset(fs, fs->crcs_first)) == (ssize_t)size,
+          "pread: ");
+
+  if (deserialize_uint32_t(table) != FS_CSUM_MAGIC) {
+    fprintf(stderr, "Checksum table is corrupt\n");
+    fs->corrupt++;
+    free(table);
+    return;
+  }
+
+  fs->crcs = malloc(fs->blocks_num * sizeof(*fs->crcs));
+  PASSERT(fs->crcs, FS_ERR_MALLOC);
+  for (size_t i = 0; i < fs->blocks_num; i++)
+    fs->crcs[i] = deserialize_uint32_t(table + FS_CSUM_HEADER_SIZE + 4 * i);
+
+  if (deserialize_uint32_t(table + 4) !=
+      fs_crc32c(0, fs->buf, fs->blocks_offset)) {
+    fprintf(stderr, "Checksum mismatch on the FAT/BMP\n");
+    fs->corrupt++;
+  }
+
+  free(table);
+}
+
+void fs_filesystem_checksum(fs_filesystem_t* fs, uint32_t block,
+                            const uint8_t* buf, uint32_t count)
+{
+  uint8_t entries[4 * FS_READ_BLOCKS];
+  uint32_t n = 0;
+
+  if (!fs->crcs)
+    return;
+
+  // entries of contiguous blocks are contiguous
+  for (; count; count -= n, block += n) {
+    n = count < FS_READ_BLOCKS ? count : FS_READ_BLOCKS;
+
+    for (uint32_t i = 0; i < n; i++, buf += FS_BLOCK_SIZE) {
+      fs->crcs[block + i] = fs_crc32c(0, buf, FS_BLOCK_SIZE);
+      serialize_uint32_t(entries + 4 * i, fs->crcs[block + i]);
+    }
+
+    PASSERT(pwrite(fileno(fs->file), entries, 4 * n,
+                   _csum_offset(fs, block)) == 4 * n,
+            "pwrite: ");
+  }
+}
+
+// flags the entries of the `count` blocks from
+// `block` on as FS_CSUM_UNWRITTEN: the blocks
+// only get a checksum once written
+static void _csum_unwritten(fs_filesystem_t* fs, uint32_t block,
+                            uint32_t count)
+{
+  uint8_t entries[FS_BLOCK_SIZE];
+  uint32_t n = 0;
+
+  if (!fs->crcs)
+    return;
+
+  for (uint32_t i = 0; i < FS_BLOCK_SIZE / 4; i++)
+    serialize_uint32_t(entries + 4 * i, FS_CSUM_UNWRITTEN);
+
+  for (; count; count -= n, block += n) {
+    n = count < FS_BLOCK_SIZE / 4 ? count : FS_BLOCK_SIZE / 4;
+
+    for (uint32_t i = 0; i < n; i++)
+      fs->crcs[block + i] = FS_CSUM_UNWRITTEN;
+
+    PASSERT(pwrite(fileno(fs->file), entries, 4 * n,
+                   _csum_offset(fs, block)) == 4 * n,
+            "pwrite: ");
+  }
+}
+
+void fs_filesystem_checksum_meta(fs_filesystem_t* fs, const uint8_t* buf,
+                                 size_t n)
+{
+  uint8_t crc[4];
+
+  if (!fs->crcs)
+    return;
+
+  serialize_uint32_t(crc, fs_crc32c(0, buf, n));
+  PASSERT(pwrite(fileno(fs->file), crc, 4,
+                 _block_offset(fs, fs->crcs_first) + 4) == 4,
+          "pwrite: ");
+}
+
+// how many of the `count` blocks at `buf` (read
+// from `block` on) match their checksums before
+// the first that doesn't, which gets reported
+static uint32_t _csum_verify(fs_filesystem_t* fs, uint32_t block,
+                             const uint8_t* buf, uint32_t count)
+{
+  if (!fs->crcs)
+    return count;
+
+  for (uint32_t i = 0; i < count; i++, buf += FS_BLOCK_SIZE) {
+    if (fs->crcs[block + i] != FS_CSUM_UNWRITTEN &&
+        fs_crc32c(0, buf, FS_BLOCK_SIZE) != fs->crcs[block + i]) {
+      fprintf(stderr, "Checksum mismatch on block %u\n", block + i);
+      fs->corrupt++;
+      return i;
+    }
+  }
+
+  return count;
+}
+
+void fs_filesystem_write_dirblock(fs_filesystem_t* fs, uint32_t fblock,
+                                  const uint8_t* buf)
+{
+  uint8_t* cached = NULL;
+
+  PASSERT(~fseek(fs->file, _block_offset(fs, fblock), SEEK_SET), "fseek: ");
+  PASSERT(fwrite(buf, sizeof(uint8_t), FS_BLOCK_SIZE, fs->file) ==
+              FS_BLOCK_SIZE,
+          "fwrite: ");
+
+  if ((cached = fs_dirblock_cache_get(fs->dirblocks, fblock)))
+    memcpy(cached, buf, FS_BLOCK_SIZE);
+  PASSERT(fflush(fs->file) != EOF, "fflush: ");
+
+  fs_filesystem_checksum(fs, fblock, buf, 1);
+}
+
 static inline void fs_filesystem_mount_new(fs_filesystem_t* fs,
                                            const char* fname)
 {
@@ -47,14 +278,18 @@ static inline void fs_filesystem_mount_new(fs_filesystem_t* fs,
   // bcount | bsize | fat | bmp
   fs->file = fs_utils_mkfile(fname, fs->blocks_num * fs->block_size);
   fs->fat = fs_fat_create(fs->blocks_num);
-  fs->root = fs_file_create("/", FS_FILE_DIRECTORY, parent);
+  fs->arena = fs_file_arena_create();
+  fs->root = fs_file_create_in(fs->arena, "/", FS_FILE_DIRECTORY, parent);
   fs->cwd = fs->root;
   fs->root->fblock = fs_fat_addfile(fs->fat);
+  fs->names = fs_nameidx_create(fs->root->fblock);
+  fs->dedup = fs_dedup_create(FS_DEDUP_MAP_SIZE, fs->blocks_num);
   fs->blocks_offset = 8 + 4 * fs->blocks_num + fs->fat->bmp->size;
 
   fs->buf = calloc(fs->blocks_offset, sizeof(*fs->buf));
   PASSERT(fs->buf, FS_ERR_MALLOC);
 
+  _csum_create(fs);
   fs_filesystem_persist_sbfatbmp(fs);
   fs_filesystem_persist_cwd(fs);
 
@@ -89,6 +324,7 @@ static inline void fs_filesystem_mount_existing(fs_filesystem_t* fs,
     n += fread(fs->buf + n, sizeof(uint8_t), fs->blocks_offset, fs->file);
   PASSERT(~n && n == fs->blocks_offset, "fread error: ");
 
+  _csum_load(fs);
   fs_filesystem_load(fs);
 }
 
@@ -125,402 +361,3127 @@ int fs_filesystem_serialize(fs_filesystem_t* fs, unsigned char* buf, int n)
   return written;
 }
 
-static void _load_fs_files(fs_filesystem_t* fs, fs_file_t* file)
+// raw directory block `fblock`, read through the
+// block cache
+static uint8_t* _filesystem_dirblock(fs_filesystem_t* fs, uint32_t fblock)
 {
-  fs_llist_t* child = NULL;
-  fs_file_t* f = NULL;
+  uint8_t* block = fs_dirblock_cache_get(fs->dirblocks, fblock);
   int n = 0;
 
-  fseek(fs->file, fs->blocks_offset + (file->fblock * FS_BLOCK_SIZE), SEEK_SET);
-  while (n < FS_BLOCK_SIZE)
-    n += fread(fs->block_buf, sizeof(uint8_t), FS_BLOCK_SIZE - n, fs->file);
-  fs_file_load_dir(file, fs->block_buf);
-
-  n = file->children_count;
-  child = file->children;
+  if (block)
+    return block;
 
-  while (child) {
-    f = (fs_file_t*)child->data;
+  block = fs_dirblock_cache_slot(fs->dirblocks, fblock);
+  fseek(fs->file, fs->blocks_offset + (fblock * FS_BLOCK_SIZE), SEEK_SET);
+  while (n < FS_BLOCK_SIZE)
+    n += fread(block + n, sizeof(uint8_t), FS_BLOCK_SIZE - n, fs->file);
 
-    if (f->attrs.is_directory)
-      _load_fs_files(fs, f);
+  // a corrupt directory is still read: only
+  // reported
+  _csum_verify(fs, fblock, block, 1);
 
-    child = child->next;
-  }
+  return block;
 }
 
-void fs_filesystem_load(fs_filesystem_t* fs)
+// reads the entries of `file` from its directory
+// block. With a metadata budget only one level is
+// read: subdirectories start evicted and are
+// brought back by _filesystem_loaddir().
+static void _load_fs_files(fs_filesystem_t* fs, fs_file_t* file)
 {
-  fs->block_size = deserialize_uint32_t(fs->buf);
-  fs->blocks_num = deserialize_uint32_t(fs->buf + 4);
-  fs->fat = fs_fat_load(fs->buf + 8, fs->blocks_num);
-  fs->root = fs_file_create("/", FS_FILE_DIRECTORY, NULL);
-  fs->cwd = fs->root;
+  fs_file_t* f = NULL;
 
-  _load_fs_files(fs, fs->root);
-}
+  fs_file_load_dir(file, _filesystem_dirblock(fs, file->fblock));
 
-static fs_llist_t* _find_file_in_layer(fs_llist_t* child, const char* fname)
-{
-  ASSERT(child != NULL, "");
+  for (unsigned i = 0; i < file->children_count; i++) {
+    f = fs_file_child(file, i);
 
-  while (child) {
-    if (!strcmp(((fs_file_t*)child->data)->attrs.fname, fname))
-      return child;
+    if (!f->attrs.is_directory)
+      continue;
 
-    child = child->next;
+    if (fs->budget)
+      f->residency = FS_FILE_EVICTED;
+    else
+      _load_fs_files(fs, f);
   }
-
-  return NULL;
 }
 
-static fs_llist_t* _traverse_to_dir(fs_filesystem_t* fs, char** argv,
-                                    unsigned argc)
+static void _filesystem_reclaim(fs_filesystem_t* fs, fs_file_t* keep);
+
+// reads (or writes) `size` bytes of the chain
+// starting at `block`: one request per run of
+// contiguous blocks. Blocks are written whole
+// (the last one padded w/ zeros) so that their
+// checksums hold, and verified when read back.
+// Returns 0 if one of them is corrupt.
+static int _filesystem_chain_io(fs_filesystem_t* fs, uint32_t block,
+                                uint8_t* buf, size_t size, int write)
 {
-  fs_llist_t* f = fs->root->children;
+  uint8_t tail[FS_BLOCK_SIZE];
+  uint32_t* next = fs->fat->blocks;
+  uint32_t run = 0;
+  uint32_t whole = 0;
+  size_t n = 0;
+  size_t rest = 0;
+  off_t offset = 0;
 
-  if (!argc) { // '/'
-    fs->cwd = fs->root;
-    return fs->root->children;
+  PASSERT(fflush(fs->file) != EOF, "fflush: ");
+
+  while (size) {
+    ASSERT(block < fs->blocks_num, "Block %u out of bounds", block);
+
+    for (run = 1; run * FS_BLOCK_SIZE < size && block + run < fs->blocks_num &&
+                  next[block + run - 1] == block + run;
+         run++)
+      ;
+
+    n = run * FS_BLOCK_SIZE < size ? run * FS_BLOCK_SIZE : size;
+    whole = n / FS_BLOCK_SIZE;
+    rest = n % FS_BLOCK_SIZE;
+    offset = _block_offset(fs, block);
+
+    if (write) {
+      PASSERT(pwrite(fileno(fs->file), buf, whole * FS_BLOCK_SIZE, offset) ==
+                  whole * FS_BLOCK_SIZE,
+              "pwrite: ");
+      fs_filesystem_checksum(fs, block, buf, whole);
+    } else {
+      PASSERT(pread(fileno(fs->file), buf, whole * FS_BLOCK_SIZE, offset) ==
+                  whole * FS_BLOCK_SIZE,
+              "pread: ");
+      if (_csum_verify(fs, block, buf, whole) != whole)
+        return 0;
+    }
+
+    // the partial last block goes through `tail`
+    if (rest && write) {
+      memcpy(tail, buf + n - rest, rest);
+      memset(tail + rest, 0, FS_BLOCK_SIZE - rest);
+      PASSERT(pwrite(fileno(fs->file), tail, FS_BLOCK_SIZE,
+                     offset + whole * FS_BLOCK_SIZE) == FS_BLOCK_SIZE,
+              "pwrite: ");
+      fs_filesystem_checksum(fs, block + whole, tail, 1);
+    } else if (rest) {
+      PASSERT(pread(fileno(fs->file), tail, FS_BLOCK_SIZE,
+                    offset + whole * FS_BLOCK_SIZE) == FS_BLOCK_SIZE,
+              "pread: ");
+      if (!_csum_verify(fs, block + whole, tail, 1))
+        return 0;
+      memcpy(buf + n - rest, tail, rest);
+    }
+
+    buf += n;
+    size -= n;
+    block = next[block + run - 1];
   }
 
-  for (int i = 0; i < argc; i++) { // '/something[/others ...]'
-    if (!(f = _find_file_in_layer(f, argv[i]))) {
-      fs->cwd = NULL;
-      return NULL;
+  return 1;
+}
+
+// logical to physical blocks of a regular file.
+// NULL if its block table is unreadable (or
+// corrupt).
+static fs_blockmap_t* _filesystem_blockmap(fs_filesystem_t* fs,
+                                           uint32_t fblock, uint32_t size)
+{
+  int compressed = fs_fblock_is_compressed(fblock);
+  uint32_t count = compressed ? fs_blockmap_clusters_for(size)
+                              : fs_blockmap_count_for(size);
+  size_t entry = compressed ? 8 : 4;
+  size_t table = FS_BLOCKMAP_HEADER_SIZE + (size_t)count * entry;
+  uint32_t* next = fs->fat->blocks;
+  uint32_t first = fs_fblock_chain(fblock);
+  fs_blockmap_t* map = NULL;
+  unsigned char* buf = NULL;
+  size_t room = FS_BLOCK_SIZE;
+  size_t n = 0;
+  int ok = 0;
+
+  if (!fs_fblock_is_mapped(fblock))
+    return fs_blockmap_from_chain(fs->fat, fblock, count);
+
+  buf = malloc(table);
+  PASSERT(buf, FS_ERR_MALLOC);
+  ok = _filesystem_chain_io(fs, first, buf, table, 0);
+
+  // blocks reserved past the end (`fallocate -k`)
+  // make for a longer table: as long as its chain
+  if (ok && (n = FS_BLOCKMAP_HEADER_SIZE +
+                 deserialize_uint32_t(buf + 4) * (uint64_t)entry) > table) {
+    for (uint32_t b = first; next[b] != b && room < n; b = next[b])
+      room += FS_BLOCK_SIZE;
+
+    if ((ok = room >= n)) {
+      buf = realloc(buf, n);
+      PASSERT(buf, FS_ERR_MALLOC);
+      ok = _filesystem_chain_io(fs, first, buf, table = n, 0);
     }
   }
 
-  fs->cwd = (fs_file_t*)f->data;
+  if (ok)
+    map = fs_blockmap_load(buf, table);
+  free(buf);
 
-  return f;
+  if (map && !map->lengths != !compressed) {
+    fs_blockmap_destroy(map);
+    return NULL;
+  }
+
+  return map;
 }
 
-//  - if a path to the last component exist:
-//    - set fs->cwd to the location
-//    - return the file (llist) if found
-//    - return the directory where the file does not exist
-static fs_llist_t* _traverse_to_file(fs_filesystem_t* fs, char** argv,
-                                     unsigned argc)
+// last block of the plain chain at `first`
+static uint32_t _tail_get(fs_filesystem_t* fs, uint32_t first)
 {
-  fs_llist_t root_f = {.next = NULL, .data = fs->root };
-  fs_llist_t* f = &root_f;
-  int i = 0;
+  uint32_t* next = fs->fat->blocks;
+  uint32_t tail = first;
 
-  fs->cwd = fs->root;
+  if (fs->tails[first % FS_TAILS_SIZE].first == first)
+    return fs->tails[first % FS_TAILS_SIZE].tail;
 
-  for (; i < argc - 1; i++) { // '[/others ...]/last'
-    f = ((fs_file_t*)f->data)->children;
+  while (next[tail] != tail)
+    tail = next[tail];
 
-    if (!f)
-      return NULL;
+  fs->tails[first % FS_TAILS_SIZE].first = first;
+  fs->tails[first % FS_TAILS_SIZE].tail = tail;
 
-    if (!(f = _find_file_in_layer(f, argv[i])))
-      return NULL;
-  }
+  return tail;
+}
 
-  // if we got somewhere
-  if (argc > 1) {
-    fs->cwd = (fs_file_t*)f->data;
-  }
+static inline void _tail_set(fs_filesystem_t* fs, uint32_t first,
+                             uint32_t tail)
+{
+  fs->tails[first % FS_TAILS_SIZE].first = first;
+  fs->tails[first % FS_TAILS_SIZE].tail = tail;
+}
 
-  // last component - check if we can find it
-  if (f && argc > 1) {
-    f = ((fs_file_t*)f->data)->children;
-    if (!f)
-      return NULL;
+// the chain at `first` is about to change (or to
+// be freed)
+static inline void _tail_forget(fs_filesystem_t* fs, uint32_t first)
+{
+  if (fs->tails[first % FS_TAILS_SIZE].first == first)
+    fs->tails[first % FS_TAILS_SIZE].first = 0;
+}
 
-    return _find_file_in_layer(f, argv[i]);
+// whether a handle w/ (at least) `flags` is open
+// on `file` or, for a directory, below it
+static int _handle_busy(fs_filesystem_t* fs, fs_file_t* file, int flags)
+{
+  for (fs_handle_t* h = fs->handles; h; h = h->next) {
+    if ((h->flags & flags) != flags)
+      continue;
+
+    if (!file->attrs.is_directory && h->fblock == file->fblock)
+      return 1;
+    for (uint32_t i = 0; file->attrs.is_directory && i < h->ndirs; i++)
+      if (h->dirs[i] == file->fblock)
+        return 1;
   }
 
-  if (fs->root->children)
-    return _find_file_in_layer(fs->root->children, argv[i]);
-  return NULL;
+  return 0;
 }
 
-// DFS
-fs_file_t* fs_filesystem_find(fs_filesystem_t* fs, const char* root,
-                              const char* fname)
+// releases the blocks holding the data of a
+// regular file (for compressed ones, each entry
+// starts the chain of a cluster)
+static void _filesystem_freedata(fs_filesystem_t* fs, uint32_t fblock,
+                                 uint32_t size)
 {
-  if (!fs->root->children)
-    return NULL;
+  fs_blockmap_t* map = NULL;
+
+  _tail_forget(fs, fblock);
 
-  unsigned argc = 0;
-  char** argv = fs_utils_splitpath(root, &argc);
+  if (fs_fblock_is_mapped(fblock) &&
+      (map = _filesystem_blockmap(fs, fblock, size))) {
+    for (uint32_t i = 0; i < map->count; i++) {
+      if (map->blocks[i] == FS_BLOCKMAP_HOLE)
+        continue;
 
-  fs_llist_t* dir = _traverse_to_dir(fs, argv, argc);
-  fs_llist_t* file = _find_file_in_layer(fs->cwd->children, fname);
+      if (!fs->fat->refs[map->blocks[i]])
+        fs_dedup_forget(fs->dedup, map->blocks[i]);
+      fs_fat_removefile(fs->fat, map->blocks[i]);
+    }
 
-  FREE_ARR(argv, argc);
+    fs_blockmap_destroy(map);
+  }
 
-  return file ? (fs_file_t*)file->data : NULL;
+  fs_fat_removefile(fs->fat, fs_fblock_chain(fblock));
 }
 
-static fs_file_t* _filesystem_mkfile(fs_filesystem_t* fs, const char* fname,
-                                     fs_file_type type)
+// brings back the directories a partial snapshot
+// left on disk
+static void _load_evicted(fs_filesystem_t* fs, fs_file_t* dir)
 {
-  unsigned n = 0;
-  unsigned argc = 0;
-  char** argv = fs_utils_splitpath(fname, &argc);
+  fs_file_t* f = NULL;
 
-  _traverse_to_file(fs, argv, argc);
+  for (unsigned i = 0; i < dir->children_count; i++) {
+    f = fs_file_child(dir, i);
 
-  fs_file_t* f = fs_file_create(argv[argc - 1], type, fs->cwd);
-  fs_file_addchild(fs->cwd, f);
-  f->parent = fs->cwd;
-  f->fblock = fs_fat_addfile(fs->fat);
+    if (!f->attrs.is_directory)
+      continue;
 
-  fs_filesystem_persist_cwd(fs);
-  FREE_ARR(argv, argc);
+    if (f->residency == FS_FILE_EVICTED)
+      _load_fs_files(fs, f);
+    else
+      _load_evicted(fs, f);
+  }
+}
 
-  return f;
+// releases the chain at `first` left behind by an
+// unmount, if it's still allocated (a torn one may
+// not have gotten to persist the FAT). 0 is the
+// root directory: no chain.
+static void _release_chain(fs_filesystem_t* fs, uint32_t first)
+{
+  if (first && first < fs->blocks_num && FS_BMP_IS_ON_(fs->fat->bmp, first))
+    fs_fat_removefile(fs->fat, first);
 }
 
-void fs_filesystem_ls(fs_filesystem_t* fs, const char* abspath, char* buf,
-                      size_t n)
+// fast path: one sequential read of the tree as
+// left by a clean unmount. The snapshot is
+// released right after.
+static int _load_snapshot(fs_filesystem_t* fs, uint32_t first, uint32_t size)
 {
-  int written = 0;
-  char mtime_buf[FS_DATE_FORMAT_SIZE] = { 0 };
-  char fsize_buf[FS_FSIZE_FORMAT_SIZE] = { 0 };
-  unsigned argc = 0;
-  fs_llist_t* child = NULL;
-  char** argv = fs_utils_splitpath(abspath, &argc);
-  _traverse_to_dir(fs, argv, argc);
+  unsigned char* buf = NULL;
+  uint32_t tree_end = 0;
+  uint32_t dedup_size = 0;
+  int loaded = 0;
 
-  if (!fs->cwd) {
-    fprintf(stderr, "\nDirectory `%s` not found.\n", abspath);
-    FREE_ARR(argv, argc);
-    fs->cwd = fs->root;
+  if (first >= fs->blocks_num || size <= FS_SNAPSHOT_HEADER_SIZE)
+    return 0;
 
-    return;
+  buf = malloc(size);
+  PASSERT(buf, FS_ERR_MALLOC);
+  loaded = _filesystem_chain_io(fs, first, buf, size, 0) &&
+           deserialize_uint32_t(buf) == FS_SNAPSHOT_MAGIC &&
+           deserialize_uint32_t(buf + 4) == size;
+  if (loaded) {
+    tree_end = deserialize_uint32_t(buf + 16);
+    dedup_size = deserialize_uint32_t(buf + 20);
+    loaded = tree_end > FS_SNAPSHOT_HEADER_SIZE &&
+             (uint64_t)tree_end + dedup_size == size &&
+             fs_file_load_tree(fs->root, buf + FS_SNAPSHOT_HEADER_SIZE,
+                               tree_end - FS_SNAPSHOT_HEADER_SIZE) ==
+                 tree_end - FS_SNAPSHOT_HEADER_SIZE;
   }
 
-  fs_utils_fsize2str(fs->cwd->attrs.size, fsize_buf, FS_FSIZE_FORMAT_SIZE);
-  fs_utils_secs2str(fs->cwd->attrs.mtime, mtime_buf, FS_DATE_FORMAT_SIZE);
-
-  written += snprintf(buf + written, n - written, FS_LS_FORMAT,
-                      fs->cwd->attrs.is_directory == 1 ? 'd' : 'f', fsize_buf,
-                      mtime_buf, ".");
-
-  written += snprintf(buf + written, n - written, FS_LS_FORMAT,
-                      fs->cwd->attrs.is_directory == 1 ? 'd' : 'f', fsize_buf,
-                      mtime_buf, "..");
-
-  child = fs->cwd->children;
+  if (!loaded) {
+    fs_file_arena_destroy(fs->arena);
+    fs->arena = fs_file_arena_create();
+    fs->root = fs_file_create_in(fs->arena, "/", FS_FILE_DIRECTORY, NULL);
+    fs->cwd = fs->root;
+    free(buf);
 
-  while (child) {
-    fs_file_t* file = (fs_file_t*)child->data;
+    return 0;
+  }
 
-    fs_utils_fsize2str(file->attrs.size, fsize_buf, FS_FSIZE_FORMAT_SIZE);
-    fs_utils_secs2str(file->attrs.mtime, mtime_buf, FS_DATE_FORMAT_SIZE);
+  fs_fat_removefile(fs->fat, first);
+  fs->fat->bmp->last_block = deserialize_uint32_t(buf + 8);
 
-    written += snprintf(buf + written, n, FS_LS_FORMAT,
-                        file->attrs.is_directory == 1 ? 'd' : 'f', fsize_buf,
-                        mtime_buf, file->attrs.fname);
+  if (deserialize_uint32_t(buf + 12) && !fs->budget)
+    _load_evicted(fs, fs->root);
 
-    child = child->next;
-  }
+  fs->dedup = fs_dedup_load(fs->fat, buf + tree_end, dedup_size);
 
-  FREE_ARR(argv, argc);
-}
+  free(buf);
 
-fs_file_t* fs_filesystem_touch(fs_filesystem_t* fs, const char* fname)
-{
-  return _filesystem_mkfile(fs, fname, FS_FILE_REGULAR);
+  return 1;
 }
 
-fs_file_t* fs_filesystem_mkdir(fs_filesystem_t* fs, const char* fname)
+// indexes the subtree of the evicted directory
+// `fblock` straight from its blocks
+static void _nameidx_build_raw(fs_filesystem_t* fs, uint32_t fblock)
 {
-  return _filesystem_mkfile(fs, fname, FS_FILE_DIRECTORY);
+  fs_dirent_t entry;
+
+  // recursing may recycle the cached block: get
+  // it again for every entry
+  for (unsigned i = 0;
+       i < fs_dirblock_count(_filesystem_dirblock(fs, fblock)); i++) {
+    fs_dirblock_entry(_filesystem_dirblock(fs, fblock), i, &entry);
+    fs_nameidx_add(fs->names, entry.attrs.fname, entry.fblock, fblock,
+                   entry.attrs.is_directory);
+
+    if (entry.attrs.is_directory)
+      _nameidx_build_raw(fs, entry.fblock);
+  }
 }
 
-fs_file_t* fs_filesystem_cp(fs_filesystem_t* fs, const char* src,
-                            const char* dest)
+static void _nameidx_build(fs_filesystem_t* fs, fs_file_t* dir)
 {
-  off_t offset = 0;
-  int32_t remaining = 0;
-  int32_t written = 0;
-  int32_t size = 0;
-  int32_t blocks_needed = 0;
-  FILE* f = NULL;
-  fs_file_t* file = NULL;
-  uint32_t block = UINT32_MAX;
+  fs_file_t* f = NULL;
 
-  ASSERT(!fs_filesystem_find(fs, fs->cwd->attrs.fname, dest),
-         "File already exists");
-  PASSERT(f = fopen(src, "r"), "fopen");
+  if (dir->residency == FS_FILE_EVICTED) {
+    _nameidx_build_raw(fs, dir->fblock);
+    return;
+  }
 
-  size = fs_utils_fsize(f);
-  blocks_needed = ((size - 1) / FS_BLOCK_SIZE | 0) + 1;
-  remaining = size;
+  for (unsigned i = 0; i < dir->children_count; i++) {
+    f = fs_file_child(dir, i);
+    fs_nameidx_add(fs->names, f->attrs.fname, f->fblock, dir->fblock,
+                   f->attrs.is_directory);
 
-  // TODO assert that we have space [issue 14]
-  // TODO how to properly notify the error? [ issue 13 ]
+    if (f->attrs.is_directory)
+      _nameidx_build(fs, f);
+  }
+}
 
-  file = fs_filesystem_touch(fs, dest);
-  file->attrs.size = size;
-  file->attrs.ctime = fs_utils_gettime();
-  file->attrs.mtime = file->attrs.ctime;
-  file->attrs.atime = file->attrs.ctime;
-  block = file->fblock;
+static inline void _refs_add(fs_filesystem_t* fs, uint8_t* seen,
+                             uint32_t block)
+{
+  if (block >= fs->blocks_num)
+    return;
 
-  fflush(fs->file);
-  fflush(f);
+  if (CHECK_LBIT(seen[block / 8], block % 8))
+    fs_fat_share(fs->fat, block);
+  else
+    SET_LBIT(seen[block / 8], block % 8);
+}
 
-  for (int i = 0; i < blocks_needed; i++) {
-    uint32_t to_write = remaining >= FS_BLOCK_SIZE ? FS_BLOCK_SIZE : remaining;
+// counts the references of a regular file to
+// its chains
+static void _refs_count(fs_filesystem_t* fs, uint8_t* seen, uint32_t fblock,
+                        uint32_t size)
+{
+  fs_blockmap_t* map = NULL;
 
-    remaining -= to_write;
-    offset = lseek(fileno(fs->file),
-                   fs->blocks_offset + (FS_BLOCK_SIZE * block), SEEK_SET);
+  if (!fs_fblock_is_mapped(fblock)) {
+    _refs_add(fs, seen, fblock);
+    return;
+  }
 
-    while (to_write)
-      to_write -= sendfile(fileno(fs->file), fileno(f), NULL, to_write);
+  if (!(map = _filesystem_blockmap(fs, fblock, size)))
+    return;
 
-    // we might endup w/ a surplus of 1 block
-    // FIXME there's a linear scan happening every time.
-    //       change the start to the last block.
-    if (i + 1 < blocks_needed)
-      block = fs_fat_addblock(fs->fat, file->fblock);
-  }
+  for (uint32_t i = 0; i < map->count; i++)
+    if (map->blocks[i] != FS_BLOCKMAP_HOLE)
+      _refs_add(fs, seen, map->blocks[i]);
 
-  fseek(fs->file, offset, SEEK_SET);
+  fs_blockmap_destroy(map);
+}
 
-  ASSERT(remaining == 0, "Didn't copy everything. Remaining = %d", remaining);
-  PASSERT(fclose(f) == 0, "fclose");
+static void _refs_build_raw(fs_filesystem_t* fs, uint8_t* seen,
+                            uint32_t fblock)
+{
+  fs_dirent_t entry;
 
-  // persist FAT and BMP
-  fs_filesystem_persist_sbfatbmp(fs);
-  fs_filesystem_persist_cwd(fs);
+  for (unsigned i = 0;
+       i < fs_dirblock_count(_filesystem_dirblock(fs, fblock)); i++) {
+    fs_dirblock_entry(_filesystem_dirblock(fs, fblock), i, &entry);
 
-  return file;
+    if (entry.attrs.is_directory)
+      _refs_build_raw(fs, seen, entry.fblock);
+    else
+      _refs_count(fs, seen, entry.fblock, entry.attrs.size);
+  }
 }
 
-void fs_filesystem_cat(fs_filesystem_t* fs, const char* src, int fd)
+// reference counts of shared blocks, from the
+// tables of the files below `dir`
+static void _refs_build(fs_filesystem_t* fs, uint8_t* seen, fs_file_t* dir)
 {
-  fs_file_t* file = NULL;
-  int remaining = 0;
-  int n = 0;
-  off_t offset = 0;
-  uint32_t to_write = 0;
-  int32_t written = 0;
-  unsigned argc = 0;
-  char** argv = fs_utils_splitpath(src, &argc);
-
-  ASSERT((file = fs_filesystem_find(fs, fs->root->attrs.fname, argv[0])),
-         "File not found");
+  fs_file_t* f = NULL;
 
-  if (file->attrs.is_directory) {
-    fprintf(stderr, "Can't `cat` a directory.\n"
-                    "Enter `help` if you need help\n");
+  if (dir->residency == FS_FILE_EVICTED) {
+    _refs_build_raw(fs, seen, dir->fblock);
     return;
   }
 
-  remaining = file->attrs.size;
+  for (unsigned i = 0; i < dir->children_count; i++) {
+    f = fs_file_child(dir, i);
+
+    if (f->attrs.is_directory)
+      _refs_build(fs, seen, f);
+    else
+      _refs_count(fs, seen, f->fblock, f->attrs.size);
+  }
+}
 
-  fflush(fs->file);
+// usage of everything below the directory
+// `fblock` (`dir`: its node, NULL if evicted).
+// Rollups missing on the way get computed and
+// kept.
+static fs_fsinfo_t _usage_build(fs_filesystem_t* fs, fs_file_t* dir,
+                                uint32_t fblock)
+{
+  fs_fsinfo_t* cached = fs_fsinfo_map_get(fs->usage, fblock);
+  fs_fsinfo_t info = { 0 };
+  fs_fsinfo_t sub;
+  fs_dirent_t entry;
+  fs_file_t* f = NULL;
 
-  for (int block = file->fblock;; n++) {
-    to_write = remaining >= FS_BLOCK_SIZE ? FS_BLOCK_SIZE : remaining;
-    offset = lseek(fileno(fs->file),
-                   fs->blocks_offset + (FS_BLOCK_SIZE * block), SEEK_SET);
-    PASSERT(written += sendfile(fd, fileno(fs->file), NULL, to_write),
-            "sendfile: ");
+  if (cached)
+    return *cached;
 
-    if (fs->fat->blocks[block] == block)
-      break;
+  if (dir) {
+    for (unsigned i = 0; i < dir->children_count; i++) {
+      f = fs_file_child(dir, i);
+      fs_fsinfo_add(&info, f);
 
-    block = fs->fat->blocks[block];
-    remaining -= to_write;
+      if (f->attrs.is_directory) {
+        sub = _usage_build(fs, f->residency == FS_FILE_EVICTED ? NULL : f,
+                           f->fblock);
+        fs_fsinfo_merge(&info, &sub);
+      }
+    }
+  } else {
+    for (unsigned i = 0;
+         i < fs_dirblock_count(_filesystem_dirblock(fs, fblock)); i++) {
+      fs_dirblock_entry(_filesystem_dirblock(fs, fblock), i, &entry);
+      fs_fsinfo_add_attrs(&info, &entry.attrs);
+
+      if (entry.attrs.is_directory) {
+        sub = _usage_build(fs, NULL, entry.fblock);
+        fs_fsinfo_merge(&info, &sub);
+      }
+    }
   }
 
-  PASSERT(~fseek(fs->file, offset, SEEK_SET), "lseek: ");
-  PASSERT(written == file->attrs.size, "Should've written %d. Wrote %d ",
-          file->attrs.size, written);
+  *fs_fsinfo_map_put(fs->usage, fblock) = info;
 
-  FREE_ARR(argv, argc);
+  return info;
 }
 
-static void _filesystem_rmfile(fs_filesystem_t* fs, fs_llist_t* file)
+// adds `delta` to (`sign` > 0) or takes it off
+// the rollups of `dir` and of its ancestors
+static void _usage_update(fs_filesystem_t* fs, fs_file_t* dir,
+                          const fs_fsinfo_t* delta, int sign)
 {
-  fs_file_t* cwd = fs->cwd;
-  fs_file_t* f = (fs_file_t*)file->data;
+  fs_fsinfo_t* info = NULL;
+
+  for (;; dir = dir->parent) {
+    if ((info = fs_fsinfo_map_get(fs->usage, dir->fblock))) {
+      if (sign > 0)
+        fs_fsinfo_merge(info, delta);
+      else
+        fs_fsinfo_unmerge(info, delta);
+    }
 
-  while (f->children) {
-    fs->cwd = f;
-    _filesystem_rmfile(fs, f->children);
+    if (dir->parent == dir)
+      break;
   }
+}
 
-  fs->cwd = cwd;
+// sets the size of `file` w/ the rollups above
+// it following
+static void _filesystem_resize(fs_filesystem_t* fs, fs_file_t* file,
+                               uint32_t size)
+{
+  fs_fsinfo_t delta = { 0 };
 
-  fs_fat_removefile(fs->fat, f->fblock);
-  fs->cwd->children = fs_llist_remove(fs->cwd->children, file);
-  fs_llist_destroy(file, fs_file_destructor);
+  fs_fsinfo_add(&delta, file);
+  _usage_update(fs, file->parent, &delta, -1);
 
-  fs->cwd->children_count--;
-  if (!fs->cwd->children_count)
-    fs->cwd->children = NULL;
+  file->attrs.size = size;
+  memset(&delta, 0, sizeof(delta));
+  fs_fsinfo_add(&delta, file);
+  _usage_update(fs, file->parent, &delta, 1);
 }
 
-int fs_filesystem_rm(fs_filesystem_t* fs, const char* path)
+static int _load_nameidx(fs_filesystem_t* fs, uint32_t first, uint32_t size)
 {
-  int n = 0;
-  unsigned argc = 0;
-  char** argv = fs_utils_splitpath(path, &argc);
-  fs_llist_t* file = _traverse_to_file(fs, argv, argc);
+  unsigned char* buf = NULL;
 
-  if (!file) {
-    FREE_ARR(argv, argc);
+  if (first >= fs->blocks_num || size < 4)
     return 0;
-  }
 
-  _filesystem_rmfile(fs, file);
-  fs_filesystem_persist_cwd(fs);
-  FREE_ARR(argv, argc);
+  buf = malloc(size);
+  PASSERT(buf, FS_ERR_MALLOC);
+  if (_filesystem_chain_io(fs, first, buf, size, 0) &&
+      deserialize_uint32_t(buf) == FS_NAMEIDX_MAGIC &&
+      (fs->names = fs_nameidx_load(fs->root->fblock, buf + 4, size - 4)))
+    fs_fat_removefile(fs->fat, first);
 
-  return 1;
+  free(buf);
+
+  return !!fs->names;
 }
 
-int fs_filesystem_rmdir(fs_filesystem_t* fs, const char* path)
+void fs_filesystem_load(fs_filesystem_t* fs)
 {
-  int n = 0;
-  unsigned argc = 0;
-  char** argv = fs_utils_splitpath(path, &argc);
-  fs_llist_t* dir = _traverse_to_file(fs, argv, argc);
-  fs_file_t* file = NULL;
+  const uint8_t* header = NULL;
+  uint32_t snapshot = 0;
+  uint32_t snapshot_size = 0;
+  uint32_t index = 0;
+  uint32_t index_size = 0;
+  fs_fsinfo_t usage = { 0 };
+  uint8_t* seen = NULL;
+  int clean = 0;
 
-  if (!dir) {
-    FREE_ARR(argv, argc);
-    return 0;
+  fs->block_size = deserialize_uint32_t(fs->buf);
+  fs->blocks_num = deserialize_uint32_t(fs->buf + 4);
+  fs->fat = fs_fat_load(fs->buf + 8, fs->blocks_num);
+  fs->arena = fs_file_arena_create();
+  fs->root = fs_file_create_in(fs->arena, "/", FS_FILE_DIRECTORY, NULL);
+  fs->cwd = fs->root;
+
+  header = _filesystem_dirblock(fs, fs->root->fblock);
+  clean = header[FS_ROOT_FLAGS_OFFSET] & FS_ROOT_FLAG_CLEAN;
+  snapshot = deserialize_uint32_t((uint8_t*)header + FS_ROOT_SNAPSHOT_OFFSET);
+  snapshot_size =
+      deserialize_uint32_t((uint8_t*)header + FS_ROOT_SNAPSHOT_SIZE_OFFSET);
+  index = deserialize_uint32_t((uint8_t*)header + FS_ROOT_NAMEIDX_OFFSET);
+  index_size =
+      deserialize_uint32_t((uint8_t*)header + FS_ROOT_NAMEIDX_SIZE_OFFSET);
+  fs_fsinfo_deserialize(&usage, header + FS_ROOT_USAGE_OFFSET);
+
+  // what isn't taken in (or was left by a torn
+  // unmount) is released
+  if (!clean || !_load_snapshot(fs, snapshot, snapshot_size)) {
+    _release_chain(fs, snapshot);
+    _load_fs_files(fs, fs->root);
   }
 
-  file = (fs_file_t*)dir->data;
+  if (!clean || !_load_nameidx(fs, index, index_size)) {
+    _release_chain(fs, index);
+    fs->names = fs_nameidx_create(fs->root->fblock);
+    _nameidx_build(fs, fs->root);
+  }
 
-  if (!file->attrs.is_directory) {
-    fprintf(stderr, "File `%s` is not a directory.\n"
-                    "Enter `help` if you need help.\n",
-            file->attrs.fname);
-    return 0;
+  // the fingerprints are only hints: they start
+  // over. Counts are rebuilt from the files.
+  if (!fs->dedup) {
+    fs->dedup = fs_dedup_create(FS_DEDUP_MAP_SIZE, fs->blocks_num);
+    seen = calloc(fs->blocks_num / 8 + 1, 1);
+    PASSERT(seen, FS_ERR_MALLOC);
+    _refs_build(fs, seen, fs->root);
+    free(seen);
   }
 
-  _filesystem_rmfile(fs, dir);
-  fs_filesystem_persist_cwd(fs);
-  FREE_ARR(argv, argc);
+  if (clean)
+    *fs_fsinfo_map_put(fs->usage, fs->root->fblock) = usage;
 
-  return 1;
+  // from now on the image is being modified:
+  // persist the released chains, then drop the
+  // flag and what points at them (rewriting the
+  // root block does).
+  fs_filesystem_persist_sbfatbmp(fs);
+  fs_filesystem_persist_cwd(fs);
+  _filesystem_reclaim(fs, fs->root);
 }
 
-int fs_filesystem_df(fs_filesystem_t* fs, char* buf, size_t n)
+void fs_filesystem_unmount(fs_filesystem_t* fs)
 {
-  fs_fsinfo_t info = { 0 };
-  char freespace_buf[FS_FSIZE_FORMAT_SIZE] = { 0 };
-  char wastedspace_buf[FS_FSIZE_FORMAT_SIZE] = { 0 };
-  int written = 0;
+  size_t tree_end = FS_SNAPSHOT_HEADER_SIZE + fs_file_tree_size(fs->root);
+  size_t dedup_size = fs_dedup_serialized_size(fs->dedup, fs->fat);
+  size_t size = tree_end + dedup_size;
+  size_t index_size = 4 + fs_nameidx_serialized_size(fs->names);
+  uint32_t blocks = (size - 1) / FS_BLOCK_SIZE + 1;
+  uint32_t index_blocks = (index_size - 1) / FS_BLOCK_SIZE + 1;
+  uint32_t last_block = fs->fat->bmp->last_block;
+  uint32_t first = 0;
+  uint32_t index = 0;
+  unsigned char* buf = NULL;
+  unsigned char* header = NULL;
+  fs_fsinfo_t usage = { 0 };
+  int n = 0;
 
-  fs_fsinfo_calculate(&info, fs->root);
+  // no room for the snapshot: the next mount
+  // takes the slow path
+  if (fs_bmp_free_count(fs->fat->bmp) < blocks + index_blocks) {
+    fs_filesystem_persist_sbfatbmp(fs);
+    return;
+  }
 
-  fs_utils_fsize2str(fs->blocks_num * fs->block_size - info.usedspace,
-                     freespace_buf, FS_FSIZE_FORMAT_SIZE);
+  buf = malloc(size > index_size ? size : index_size);
+  PASSERT(buf, FS_ERR_MALLOC);
+
+  serialize_uint32_t(buf, FS_SNAPSHOT_MAGIC);
+  serialize_uint32_t(buf + 4, size);
+  serialize_uint32_t(buf + 8, last_block);
+  serialize_uint32_t(buf + 12, fs->budget || fs->evictions);
+  serialize_uint32_t(buf + 16, tree_end);
+  serialize_uint32_t(buf + 20, dedup_size);
+  fs_file_serialize_tree(fs->root, buf + FS_SNAPSHOT_HEADER_SIZE,
+                         tree_end - FS_SNAPSHOT_HEADER_SIZE);
+  fs_dedup_serialize(fs->dedup, fs->fat, buf + tree_end, dedup_size);
+
+  first = fs_fat_allocfile(fs->fat, blocks);
+  _filesystem_chain_io(fs, first, buf, size, 1);
+
+  serialize_uint32_t(buf, FS_NAMEIDX_MAGIC);
+  fs_nameidx_serialize(fs->names, buf + 4, index_size - 4);
+
+  index = fs_fat_allocfile(fs->fat, index_blocks);
+  _filesystem_chain_io(fs, index, buf, index_size, 1);
+  free(buf);
+
+  // the root block points at the chains before
+  // the FAT has them, so that the next mount
+  // releases them whatever happens. The flag goes
+  // last: a torn unmount is just a dirty one.
+  fs->cwd = fs->root;
+  usage = _usage_build(fs, fs->root, fs->root->fblock);
+  n = fs_file_serialize_dir(fs->root, fs->block_buf, FS_BLOCK_SIZE);
+  memset(fs->block_buf + n, 0, FS_BLOCK_SIZE - n);
+
+  header = fs->block_buf + FS_ROOT_FLAGS_OFFSET;
+  serialize_uint8_t(header, fs->crcs ? FS_ROOT_FLAG_CSUM : 0);
+  serialize_uint32_t(header + 1, first);
+  serialize_uint32_t(header + 5, size);
+  serialize_uint32_t(header + 9, index);
+  serialize_uint32_t(header + 13, index_size);
+  fs_fsinfo_serialize(&usage, header + 17);
+  fs_filesystem_write_dirblock(fs, fs->root->fblock, fs->block_buf);
+
+  fs_filesystem_persist_sbfatbmp(fs);
+
+  *header |= FS_ROOT_FLAG_CLEAN;
+  fs_filesystem_write_dirblock(fs, fs->root->fblock, fs->block_buf);
+}
+
+static void _filesystem_evict(fs_filesystem_t* fs, fs_file_t* dir)
+{
+  fs_file_evict(dir);
+  fs->evictions++;
+
+  // cached paths may point below `dir`
+  fs_dcache_invalidate(fs->dcache);
+}
+
+static void _pin_chain(fs_filesystem_t* fs, fs_file_t* file, uint8_t residency)
+{
+  for (;; file = file->parent) {
+    file->residency = residency;
+    if (file == fs->root)
+      break;
+  }
+}
+
+// second chance: resident subtrees not used since
+// the last sweep get evicted; the others are
+// marked cold.
+static void _filesystem_sweep(fs_filesystem_t* fs, fs_file_t* dir,
+                              size_t target)
+{
+  fs_file_t* f = NULL;
+
+  for (unsigned i = 0; i < dir->children_count; i++) {
+    if (fs_file_arena_usage(fs->arena) <= target)
+      return;
+
+    f = fs_file_child(dir, i);
+    if (!f->attrs.is_directory)
+      continue;
+
+    switch (f->residency) {
+      case FS_FILE_EVICTED:
+        break;
+      case FS_FILE_COLD:
+        _filesystem_evict(fs, f);
+        break;
+      case FS_FILE_RESIDENT:
+        f->residency = FS_FILE_COLD; // fall through
+      case FS_FILE_PINNED:
+        _filesystem_sweep(fs, f, target);
+        break;
+    }
+  }
+}
+
+// brings metadata usage back under the budget.
+// `keep` (which is about to be used), `fs->cwd`
+// and their ancestors are left alone.
+static void _filesystem_reclaim(fs_filesystem_t* fs, fs_file_t* keep)
+{
+  size_t target = fs->budget - fs->budget / 4;
+
+  if (!fs->budget || fs_file_arena_usage(fs->arena) <= fs->budget)
+    return;
+
+  _pin_chain(fs, keep, FS_FILE_PINNED);
+  _pin_chain(fs, fs->cwd, FS_FILE_PINNED);
+
+  for (int pass = 0; pass < 2; pass++)
+    _filesystem_sweep(fs, fs->root, target);
+
+  _pin_chain(fs, fs->cwd, FS_FILE_RESIDENT);
+  _pin_chain(fs, keep, FS_FILE_RESIDENT);
+}
+
+// makes the children of `dir` resident, reading
+// them back from its directory block if they were
+// evicted.
+static void _filesystem_loaddir(fs_filesystem_t* fs, fs_file_t* dir)
+{
+  if (dir->residency != FS_FILE_EVICTED) {
+    dir->residency = FS_FILE_RESIDENT;
+    return;
+  }
+
+  _filesystem_reclaim(fs, dir);
+  _load_fs_files(fs, dir);
+  fs->reloads++;
+}
+
+static fs_file_t* _lookup(fs_filesystem_t* fs, fs_file_t* dir,
+                          const char* fname, size_t length)
+{
+  if (!dir->attrs.is_directory)
+    return NULL;
+
+  _filesystem_loaddir(fs, dir);
+
+  return fs_file_lookupn(dir, fname, length);
+}
+
+void fs_filesystem_set_budget(fs_filesystem_t* fs, size_t bytes)
+{
+  fs->budget = bytes;
+
+  if (fs->root)
+    _filesystem_reclaim(fs, fs->root);
+}
+
+// resolves every component of `path` starting at
+// the root. Does not touch `fs->cwd`.
+static fs_file_t* _resolve(fs_filesystem_t* fs, const char* path)
+{
+  fs_file_t* file = fs->root;
+  fs_path_iter_t it;
+
+  fs_utils_pathiter(&it, path);
+  while (fs_utils_pathnext(&it))
+    if (!(file = _lookup(fs, file, it.name, it.length)))
+      return NULL;
+
+  return file;
+}
+
+// resolves every component of `path` but the last
+// one, which is left in `it`. Returns the directory
+// that should hold it (NULL if some component is
+// missing or if `path` is the root).
+static fs_file_t* _resolve_parent(fs_filesystem_t* fs, const char* path,
+                                  fs_path_iter_t* it)
+{
+  fs_file_t* dir = fs->root;
+  fs_path_iter_t next;
+
+  fs_utils_pathiter(it, path);
+  if (!fs_utils_pathnext(it))
+    return NULL;
+
+  next = *it;
+  while (fs_utils_pathnext(&next)) {
+    if (!(dir = _lookup(fs, dir, it->name, it->length)))
+      return NULL;
+    *it = next;
+  }
+
+  return dir;
+}
+
+//  - if a path to the last component exist:
+//    - set fs->cwd to the location
+//    - return the file if found
+//    - return the directory where the file does not exist
+static fs_file_t* _traverse_to_file(fs_filesystem_t* fs, const char* path)
+{
+  fs_path_iter_t it;
+  fs_file_t* dir = NULL;
+
+  fs->cwd = fs->root;
+
+  if (!(dir = _resolve_parent(fs, path, &it)))
+    return NULL;
+
+  // we got somewhere. Last component - check if we can find it
+  fs->cwd = dir;
+
+  return _lookup(fs, dir, it.name, it.length);
+}
+
+fs_file_t* fs_filesystem_lookup(fs_filesystem_t* fs, const char* path)
+{
+  fs_file_t* file = NULL;
+
+  if (fs_dcache_get(fs->dcache, path, &file))
+    return file;
+
+  file = _resolve(fs, path);
+  fs_dcache_put(fs->dcache, path, file);
+
+  return file;
+}
+
+int fs_filesystem_stat(fs_filesystem_t* fs, const char* path,
+                       fs_dirent_t* entry)
+{
+  fs_file_t* file = NULL;
+  const uint8_t* block = NULL;
+  fs_path_iter_t it;
+  int evicted = 0;
+  int i = 0;
+
+  if (fs_dcache_get(fs->dcache, path, &file)) {
+    if (!file)
+      return 0;
+
+    entry->fblock = file->fblock;
+    entry->attrs = file->attrs;
+
+    return 1;
+  }
+
+  // resident part of the path: walk the tree
+  file = fs->root;
+  fs_utils_pathiter(&it, path);
+  while (fs_utils_pathnext(&it)) {
+    if ((evicted = file->residency == FS_FILE_EVICTED))
+      break;
+    if (!(file = fs_file_lookupn(file, it.name, it.length)))
+      return 0;
+  }
+
+  entry->fblock = file->fblock;
+  entry->attrs = file->attrs;
+
+  if (!evicted)
+    return 1;
+
+  // the rest: straight from directory blocks
+  for (;;) {
+    block = _filesystem_dirblock(fs, entry->fblock);
+    if (!~(i = fs_dirblock_find(block, it.name, it.length)))
+      return 0;
+
+    fs_dirblock_entry(block, i, entry);
+
+    if (!fs_utils_pathnext(&it))
+      return 1;
+    if (!entry->attrs.is_directory)
+      return 0;
+  }
+}
+
+// absolute path of an index entry, in scratch
+static char* _nameidx_path(fs_filesystem_t* fs, fs_nameidx_entry_t* entry)
+{
+  int length = fs_nameidx_path(fs->names, entry, NULL, 0);
+  char* path = NULL;
+
+  if (length < 0)
+    return NULL;
+
+  path = fs_scratch_alloc(fs->scratch, length + 1);
+  fs_nameidx_path(fs->names, entry, path, length + 1);
+
+  return path;
+}
+
+// exact names: a probe of the name index plus an
+// ancestor check for each file carrying it
+static uint64_t _search_indexed(fs_filesystem_t* fs, fs_file_t* dir,
+                                const fs_find_query_t* query, fs_find_cb cb,
+                                void* ctx)
+{
+  size_t mark = fs_scratch_mark(fs->scratch);
+  size_t length = strlen(query->glob);
+  fs_nameidx_entry_t* entry = NULL;
+  fs_dirent_t dirent;
+  uint64_t matches = 0;
+  char* path = NULL;
+
+  while ((entry = fs_nameidx_next(fs->names, query->glob, length, entry))) {
+    if (!fs_nameidx_is_below(fs->names, entry, dir->fblock) ||
+        !(path = _nameidx_path(fs, entry)))
+      continue;
+
+    if (fs_filesystem_stat(fs, path, &dirent) &&
+        fs_find_match(query, &dirent.attrs)) {
+      matches++;
+
+      if (cb && cb(path, &dirent, ctx))
+        break;
+    }
+
+    fs_scratch_release(fs->scratch, mark);
+  }
+
+  fs_scratch_release(fs->scratch, mark);
+
+  return matches;
+}
+
+// ORs into `bits` every name below the directory
+// `fblock` (`dir`: its node, NULL if evicted),
+// (re)building the filters missing or stale on
+// the way
+static void _bloom_build(fs_filesystem_t* fs, fs_file_t* dir, uint32_t fblock,
+                         uint8_t* bits)
+{
+  uint8_t own[FS_BLOOM_SIZE] = { 0 };
+  fs_bloom_t* bloom = fs_bloom_get(fs->blooms, fblock);
+  fs_dirent_t entry;
+  fs_file_t* f = NULL;
+
+  if (bloom && !bloom->stale) {
+    fs_bloom_merge(bits, bloom->bits);
+    return;
+  }
+
+  if (dir) {
+    for (unsigned i = 0; i < dir->children_count; i++) {
+      f = fs_file_child(dir, i);
+      fs_bloom_add(own, f->attrs.fname);
+
+      if (f->attrs.is_directory)
+        _bloom_build(fs, f->residency == FS_FILE_EVICTED ? NULL : f,
+                     f->fblock, own);
+    }
+  } else {
+    // recursing may recycle the cached block: get
+    // it again for every entry
+    for (unsigned i = 0;
+         i < fs_dirblock_count(_filesystem_dirblock(fs, fblock)); i++) {
+      fs_dirblock_entry(_filesystem_dirblock(fs, fblock), i, &entry);
+      fs_bloom_add(own, entry.attrs.fname);
+
+      if (entry.attrs.is_directory)
+        _bloom_build(fs, NULL, entry.fblock, own);
+    }
+  }
+
+  bloom = fs_bloom_put(fs->blooms, fblock);
+  memcpy(bloom->bits, own, FS_BLOOM_SIZE);
+  bloom->stale = 0;
+  fs_bloom_merge(bits, own);
+}
+
+uint64_t fs_filesystem_search(fs_filesystem_t* fs, const char* root,
+                              const fs_find_query_t* query, unsigned threads,
+                              fs_find_cb cb, void* ctx)
+{
+  uint8_t bits[FS_BLOOM_SIZE] = { 0 };
+  uint32_t keys[FS_BLOOM_KEYS_MAX];
+  fs_find_t find = { 0 };
+  fs_file_t* dir = fs_filesystem_lookup(fs, root);
+
+  if (!dir || !dir->attrs.is_directory) {
+    fprintf(stderr, "\nDirectory `%s` not found.\n", root);
+
+    return 0;
+  }
+
+  if (query->glob && fs_find_is_literal(query->glob))
+    return _search_indexed(fs, dir, query, cb, ctx);
+
+  // globs w/ literal parts prune by subtree filters
+  if (fs_bloom_glob_keys(query->glob, keys, FS_BLOOM_KEYS_MAX)) {
+    _bloom_build(fs, dir->residency == FS_FILE_EVICTED ? NULL : dir,
+                 dir->fblock, bits);
+    find.blooms = fs->blooms;
+  }
+
+  // evicted directories are read from the image
+  PASSERT(fflush(fs->file) != EOF, "fflush: ");
+
+  find.query = query;
+  find.cb = cb;
+  find.ctx = ctx;
+  find.fd = fileno(fs->file);
+  find.blocks_offset = fs->blocks_offset;
+  find.threads = threads;
+
+  return fs_find_run(&find, dir, root);
+}
+
+static int _find_first(const char* path, const fs_dirent_t* entry, void* ctx)
+{
+  (void)entry;
+
+  *(char**)ctx = strdup(path);
+
+  return 1;
+}
+
+fs_file_t* fs_filesystem_find(fs_filesystem_t* fs, const char* root,
+                              const char* fname)
+{
+  fs_find_query_t query = fs_find_any;
+  fs_file_t* dir = NULL;
+  fs_file_t* file = NULL;
+  char* path = NULL;
+
+  if (!fs->root->children_count)
+    return NULL;
+
+  if (!(dir = fs_filesystem_lookup(fs, root)) || !dir->attrs.is_directory)
+    return NULL;
+
+  fs->cwd = dir;
+
+  // most often right below `root`
+  if ((file = _lookup(fs, dir, fname, strlen(fname))))
+    return file;
+
+  query.glob = fname;
+  if (!fs_filesystem_search(fs, root, &query, 0, _find_first, &path))
+    return NULL;
+
+  PASSERT(path, FS_ERR_MALLOC);
+  file = fs_filesystem_lookup(fs, path);
+  fs->cwd = dir;
+  free(path);
+
+  return file;
+}
+
+// new names just get added to the filters of
+// the ancestors that have one
+static void _bloom_insert(fs_filesystem_t* fs, fs_file_t* dir,
+                          const char* fname)
+{
+  fs_bloom_t* bloom = NULL;
+
+  // the root is its own parent
+  for (;; dir = dir->parent) {
+    if ((bloom = fs_bloom_get(fs->blooms, dir->fblock)))
+      fs_bloom_add(bloom->bits, fname);
+    if (dir->parent == dir)
+      break;
+  }
+}
+
+static fs_file_t* _filesystem_mkfile(fs_filesystem_t* fs, const char* fname,
+                                     fs_file_type type)
+{
+  size_t mark = fs_scratch_mark(fs->scratch);
+  fs_fsinfo_t delta = { 0 };
+  fs_path_iter_t it;
+  fs_file_t* parent = NULL;
+  fs_file_t* f = NULL;
+
+  if (!(parent = _resolve_parent(fs, fname, &it)) ||
+      !parent->attrs.is_directory) {
+    fprintf(stderr, "Parent directory of `%s` not found.\n", fname);
+    return NULL;
+  }
+
+  if (_lookup(fs, parent, it.name, it.length)) {
+    fprintf(stderr, "File `%s` already exists.\n", fname);
+    return NULL;
+  }
+
+  if (parent->attrs.readonly) {
+    fprintf(stderr, "Parent directory of `%s` is read-only.\n", fname);
+    return NULL;
+  }
+
+  // names get truncated to FS_NAME_MAX anyway
+  if (it.length > FS_NAME_MAX)
+    it.length = FS_NAME_MAX;
+
+  fs->cwd = parent;
+  f = fs_file_create(fs_scratch_strndup(fs->scratch, it.name, it.length), type,
+                     fs->cwd);
+  fs_file_addchild(fs->cwd, f);
+  f->parent = fs->cwd;
+  f->fblock = fs_fat_addfile(fs->fat);
+  fs_nameidx_add(fs->names, f->attrs.fname, f->fblock, parent->fblock,
+                 f->attrs.is_directory);
+  _bloom_insert(fs, parent, f->attrs.fname);
+  fs_fsinfo_add(&delta, f);
+  _usage_update(fs, parent, &delta, 1);
+  if (type == FS_FILE_DIRECTORY)
+    *fs_fsinfo_map_put(fs->usage, f->fblock) = (fs_fsinfo_t){ 0 };
+
+  fs_filesystem_persist_cwd(fs);
+
+  // its block may hold anything from a previous
+  // owner: start it empty.
+  if (type == FS_FILE_DIRECTORY) {
+    fs->cwd = f;
+    fs_filesystem_persist_cwd(fs);
+    fs->cwd = parent;
+  }
+
+  fs_dcache_put(fs->dcache, fname, f);
+  fs_scratch_release(fs->scratch, mark);
+
+  return f;
+}
+
+int fs_filesystem_opendir(fs_filesystem_t* fs, const char* path,
+                          fs_readdir_t* cursor)
+{
+  if (!fs_filesystem_stat(fs, path, &cursor->dir) ||
+      !cursor->dir.attrs.is_directory)
+    return 0;
+
+  cursor->pos = 0;
+
+  return 1;
+}
+
+unsigned fs_filesystem_readdir(fs_filesystem_t* fs, fs_readdir_t* cursor,
+                               fs_dirent_t* batch, unsigned n)
+{
+  const uint8_t* block = _filesystem_dirblock(fs, cursor->dir.fblock);
+  unsigned count = fs_dirblock_count(block);
+  unsigned i = 0;
+
+  // blocks are kept newest first
+  for (; i < n && cursor->pos < count; i++)
+    fs_dirblock_entry(block, cursor->pos++, &batch[i]);
+
+  return i;
+}
+
+// dates of a listing mostly repeat (files are
+// created in bulk): only format them when they
+// change.
+typedef struct _ls_dates_t {
+  int32_t secs;
+  char buf[FS_DATE_FORMAT_SIZE];
+} _ls_dates_t;
+
+static void _ls_entry(FILE* out, _ls_dates_t* dates,
+                      const fs_file_attr_t* attrs, const char* fname)
+{
+  char fsize_buf[FS_FSIZE_FORMAT_SIZE] = { 0 };
+
+  if (attrs->mtime != dates->secs || !dates->buf[0]) {
+    fs_utils_secs2str(attrs->mtime, dates->buf, FS_DATE_FORMAT_SIZE);
+    dates->secs = attrs->mtime;
+  }
+
+  fs_utils_fsize2str(attrs->size, fsize_buf, FS_FSIZE_FORMAT_SIZE);
+  fprintf(out, FS_LS_FORMAT, attrs->is_directory == 1 ? 'd' : 'f', fsize_buf,
+          dates->buf, fname);
+}
+
+void fs_filesystem_ls(fs_filesystem_t* fs, const char* abspath, FILE* out)
+{
+  fs_dirent_t batch[FS_READDIR_BATCH];
+  _ls_dates_t dates = { 0 };
+  fs_readdir_t cursor;
+  unsigned n = 0;
+
+  if (!fs_filesystem_opendir(fs, abspath, &cursor)) {
+    fprintf(stderr, "\nDirectory `%s` not found.\n", abspath);
+
+    return;
+  }
+
+  _ls_entry(out, &dates, &cursor.dir.attrs, ".");
+  _ls_entry(out, &dates, &cursor.dir.attrs, "..");
+
+  while ((n = fs_filesystem_readdir(fs, &cursor, batch, FS_READDIR_BATCH)))
+    for (unsigned i = 0; i < n; i++)
+      _ls_entry(out, &dates, &batch[i].attrs, batch[i].attrs.fname);
+}
+
+fs_file_t* fs_filesystem_touch(fs_filesystem_t* fs, const char* fname)
+{
+  fs_file_t* file = fs_filesystem_lookup(fs, fname);
+
+  if (!file)
+    return _filesystem_mkfile(fs, fname, FS_FILE_REGULAR);
+
+  if (file->attrs.readonly) {
+    fprintf(stderr, "File `%s` is read-only.\n", fname);
+    return NULL;
+  }
+
+  file->attrs.atime = fs_utils_gettime();
+  fs->cwd = file->parent;
+  fs_filesystem_persist_cwd(fs);
+
+  return file;
+}
+
+fs_file_t* fs_filesystem_mkdir(fs_filesystem_t* fs, const char* fname)
+{
+  return _filesystem_mkfile(fs, fname, FS_FILE_DIRECTORY);
+}
+
+// block w/ the same content as `data`: a shared
+// one if there's one already, a fresh one
+// otherwise
+static uint32_t _dedup_block(fs_filesystem_t* fs, const uint8_t* data)
+{
+  uint8_t stored[FS_BLOCK_SIZE];
+  uint64_t hash = fs_dedup_hash(data);
+  uint32_t block = fs_dedup_get(fs->dedup, hash);
+  off_t offset = fs->blocks_offset + (off_t)block * FS_BLOCK_SIZE;
+
+  if (block != UINT32_MAX &&
+      pread(fileno(fs->file), stored, FS_BLOCK_SIZE, offset) ==
+          FS_BLOCK_SIZE &&
+      !memcmp(stored, data, FS_BLOCK_SIZE) && fs_fat_share(fs->fat, block))
+    return block;
+
+  block = fs_fat_addfile(fs->fat);
+  offset = fs->blocks_offset + (off_t)block * FS_BLOCK_SIZE;
+  PASSERT(pwrite(fileno(fs->file), data, FS_BLOCK_SIZE, offset) ==
+              FS_BLOCK_SIZE,
+          "pwrite: ");
+  fs_filesystem_checksum(fs, block, data, 1);
+  fs_dedup_put(fs->dedup, hash, block);
+
+  return block;
+}
+
+typedef enum _cp_mode { _CP_PLAIN, _CP_COMPRESSED, _CP_DEDUP } _cp_mode;
+
+// writes the `count` blocks at `buf` as blocks
+// `i` onwards of `map`. Blocks of zeros are left
+// as holes; w/ `dedup`, blocks already in the
+// image are shared.
+static void _ingest_blocks(fs_filesystem_t* fs, fs_blockmap_t* map,
+                           uint8_t* buf, uint32_t i, uint32_t count,
+                           int dedup)
+{
+  uint32_t* blocks = map->blocks;
+  uint32_t run = 0;
+  uint32_t nzero = 0;
+  uint32_t next = 0;
+
+  if (dedup) {
+    for (uint32_t j = 0; j < count; j++)
+      if (!fs_utils_iszero(buf + j * FS_BLOCK_SIZE, FS_BLOCK_SIZE))
+        blocks[i + j] = _dedup_block(fs, buf + j * FS_BLOCK_SIZE);
+    return;
+  }
+
+  // the blocks w/ data take one extent when
+  // there's room for it
+  for (uint32_t j = 0; j < count; j++)
+    if (!fs_utils_iszero(buf + j * FS_BLOCK_SIZE, FS_BLOCK_SIZE))
+      blocks[i + j] = ++nzero;
+  if (nzero)
+    next = fs_bmp_alloc_run(fs->fat->bmp, nzero);
+
+  for (uint32_t j = 0; j < count; j++) {
+    if (blocks[i + j] == FS_BLOCKMAP_HOLE)
+      continue;
+    if (next == UINT32_MAX) {
+      blocks[i + j] = fs_fat_addfile(fs->fat);
+      continue;
+    }
+    blocks[i + j] = next++;
+    fs->fat->blocks[blocks[i + j]] = blocks[i + j];
+  }
+
+  // one write per run of contiguous blocks
+  for (uint32_t j = 0; j < count; j += run) {
+    for (run = 1; j + run < count && blocks[i + j] != FS_BLOCKMAP_HOLE &&
+                  blocks[i + j + run] == blocks[i + j] + run;
+         run++)
+      ;
+
+    if (blocks[i + j] == FS_BLOCKMAP_HOLE)
+      continue;
+
+    PASSERT(pwrite(fileno(fs->file), buf + j * FS_BLOCK_SIZE,
+                   run * FS_BLOCK_SIZE,
+                   _block_offset(fs, blocks[i + j])) == run * FS_BLOCK_SIZE,
+            "pwrite: ");
+    fs_filesystem_checksum(fs, blocks[i + j], buf + j * FS_BLOCK_SIZE, run);
+  }
+}
+
+// writes the blocks `first` up to `end` (exclusive)
+// of `fd`, one request of FS_INGEST_BLOCKS at a
+// time (see _ingest_blocks())
+static void _ingest_range(fs_filesystem_t* fs, int fd, fs_blockmap_t* map,
+                          uint8_t* buf, uint32_t first, uint32_t end,
+                          int dedup)
+{
+  const size_t request = FS_INGEST_BLOCKS * FS_BLOCK_SIZE;
+  uint32_t count = 0;
+  ssize_t n = 0;
+  size_t got = 0;
+
+  for (uint32_t i = first; i < end; i += count) {
+    count = end - i < FS_INGEST_BLOCKS ? end - i : FS_INGEST_BLOCKS;
+
+    for (got = 0; got < count * FS_BLOCK_SIZE; got += n) {
+      n = pread(fd, buf + got, count * FS_BLOCK_SIZE - got,
+                (off_t)i * FS_BLOCK_SIZE + got);
+      PASSERT(n >= 0, "pread: ");
+      if (!n)
+        break;
+    }
+    memset(buf + got, 0, request - got);
+
+    _ingest_blocks(fs, map, buf, i, count, dedup);
+  }
+}
+
+// copies the `size` bytes of `fd` into fresh
+// blocks, only going over the ranges that have
+// data (SEEK_DATA/SEEK_HOLE). Returns their map.
+static fs_blockmap_t* _filesystem_ingest(fs_filesystem_t* fs, int fd,
+                                         off_t size, int dedup)
+{
+  fs_blockmap_t* map = fs_blockmap_create(fs_blockmap_count_for(size));
+  uint8_t* buf = malloc(FS_INGEST_BLOCKS * FS_BLOCK_SIZE);
+  uint32_t next = 0;
+  uint32_t first = 0;
+  off_t data = 0;
+  off_t hole = 0;
+
+  PASSERT(buf, FS_ERR_MALLOC);
+
+  for (off_t pos = 0; pos < size; pos = hole) {
+    if ((data = lseek(fd, pos, SEEK_DATA)) < 0) {
+      // nothing but a hole left
+      if (errno == ENXIO)
+        break;
+
+      // no support for holes: it's all data
+      data = pos;
+      hole = size;
+    } else if ((hole = lseek(fd, data, SEEK_HOLE)) < 0 || hole > size) {
+      hole = size;
+    }
+
+    // ranges may share a block at their edges
+    first = data / FS_BLOCK_SIZE;
+    if (first < next)
+      first = next;
+    next = fs_blockmap_count_for(hole);
+
+    _ingest_range(fs, fd, map, buf, first, next, dedup);
+  }
+
+  free(buf);
+
+  return map;
+}
+
+int fs_filesystem_fallocate(fs_filesystem_t* fs, const char* path,
+                            uint32_t size, int flags)
+{
+  fs_handle_t* h = fs_filesystem_open(fs, path, FS_OPEN_WRITE | FS_OPEN_CREATE);
+  uint32_t count = fs_blockmap_count_for(size);
+  fs_blockmap_t* map = NULL;
+  uint32_t missing = 0;
+  uint32_t first = 0;
+  uint32_t block = 0;
+
+  if (!h)
+    return -1;
+
+  map = h->map;
+  for (uint32_t i = 0; i < count; i++)
+    missing += i >= map->count || map->blocks[i] == FS_BLOCKMAP_HOLE;
+
+  if (missing > fs_bmp_free_count(fs->fat->bmp)) {
+    fprintf(stderr, "Not enough space for `%s`.\n", path);
+    fs_filesystem_close(h);
+    return -1;
+  }
+
+  if (count > map->count)
+    fs_blockmap_resize(map, count);
+
+  // one run if there's one that long, block by
+  // block otherwise
+  if (missing && (first = fs_bmp_alloc_run(fs->fat->bmp, missing)) !=
+                     UINT32_MAX) {
+    for (block = first; block < first + missing; block++)
+      fs->fat->blocks[block] = block;
+    _csum_unwritten(fs, first, missing);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (map->blocks[i] != FS_BLOCKMAP_HOLE)
+      continue;
+
+    if (first == UINT32_MAX) {
+      block = fs_fat_addfile(fs->fat);
+      _csum_unwritten(fs, block, 1);
+    } else
+      block = first++;
+
+    map->blocks[i] = block;
+    fs_blockmap_set_unwritten(map, i, 1);
+    h->dirty = 1;
+  }
+
+  if (!(flags & FS_FALLOC_KEEP_SIZE) && size > h->size) {
+    h->size = size;
+    h->dirty = 1;
+  }
+
+  return fs_filesystem_close(h);
+}
+
+// reads up to `n` bytes of `fd`, coming short
+// only at its end
+static size_t _read_upto(int fd, uint8_t* buf, size_t n)
+{
+  ssize_t got = 0;
+  size_t done = 0;
+
+  for (; done < n; done += got) {
+    PASSERT((got = read(fd, buf + done, n - done)) >= 0, "read: ");
+    if (!got)
+      break;
+  }
+
+  return done;
+}
+
+// reads up to `n` bytes at `offset` of `fd`,
+// zeroing what's past its end
+static void _read_full(int fd, uint8_t* buf, size_t n, off_t offset)
+{
+  ssize_t got = 0;
+
+  for (size_t done = 0; done < n; done += got) {
+    PASSERT((got = pread(fd, buf + done, n - done, offset + done)) >= 0,
+            "pread: ");
+    if (!got) {
+      memset(buf + done, 0, n - done);
+      break;
+    }
+  }
+}
+
+// writes the cluster `i` of `map` from the `n`
+// bytes at `raw` (zeroed up to a whole block):
+// compressed into `packed` if that saves at least
+// a block. Left as a hole if it's all zeros.
+static void _ingest_cluster(fs_filesystem_t* fs, fs_blockmap_t* map,
+                            uint32_t i, uint8_t* raw, uint8_t* packed,
+                            size_t n)
+{
+  uint32_t blocks = fs_blockmap_count_for(n);
+  uint8_t* data = packed;
+  size_t length = 0;
+
+  if (fs_utils_iszero(raw, blocks * FS_BLOCK_SIZE))
+    return;
+
+  // only worth it if it takes fewer blocks
+  if (!(length =
+            fs_lz_compress(raw, n, packed, (blocks - 1) * FS_BLOCK_SIZE))) {
+    data = raw;
+    length = n;
+  }
+
+  map->blocks[i] = fs_fat_allocfile(fs->fat, fs_blockmap_count_for(length));
+  map->lengths[i] = length;
+  _filesystem_chain_io(fs, map->blocks[i], data, length, 1);
+}
+
+// copies the `size` bytes of `fd` into fresh
+// blocks, a cluster at a time (see
+// _ingest_cluster()). Clusters w/out data are
+// skipped.
+static fs_blockmap_t* _filesystem_ingest_compressed(fs_filesystem_t* fs,
+                                                    int fd, off_t size)
+{
+  fs_blockmap_t* map =
+      fs_blockmap_create_compressed(fs_blockmap_clusters_for(size));
+  uint8_t* raw = malloc(FS_CLUSTER_SIZE);
+  uint8_t* packed = malloc(FS_CLUSTER_SIZE);
+  size_t n = 0;
+  off_t offset = 0;
+  off_t next = 0;
+
+  PASSERT(raw && packed, FS_ERR_MALLOC);
+
+  for (uint32_t i = 0; i < map->count; i++) {
+    offset = (off_t)i * FS_CLUSTER_SIZE;
+    n = size - offset < FS_CLUSTER_SIZE ? size - offset : FS_CLUSTER_SIZE;
+
+    if ((next = lseek(fd, offset, SEEK_DATA)) < 0 && errno == ENXIO)
+      break;
+    if (next >= offset + (off_t)n)
+      continue;
+
+    _read_full(fd, raw, fs_blockmap_count_for(n) * FS_BLOCK_SIZE, offset);
+    _ingest_cluster(fs, map, i, raw, packed, n);
+  }
+
+  free(raw);
+  free(packed);
+
+  return map;
+}
+
+// copies what's left of `fd` (a pipe, a socket,
+// ..: its size isn't known until it ends) into
+// blocks taken as it arrives, setting `size`.
+// Stops short of 4GB.
+static fs_blockmap_t* _filesystem_ingest_stream(fs_filesystem_t* fs, int fd,
+                                                _cp_mode mode, uint64_t* size)
+{
+  const size_t request = mode == _CP_COMPRESSED
+                             ? FS_CLUSTER_SIZE
+                             : FS_INGEST_BLOCKS * FS_BLOCK_SIZE;
+  fs_blockmap_t* map = mode == _CP_COMPRESSED
+                           ? fs_blockmap_create_compressed(0)
+                           : fs_blockmap_create(0);
+  uint8_t* buf = malloc(request);
+  uint8_t* packed = mode == _CP_COMPRESSED ? malloc(request) : buf;
+  uint32_t count = 0;
+  size_t n = 0;
+
+  PASSERT(buf && packed, FS_ERR_MALLOC);
+
+  for (*size = 0; (n = _read_upto(fd, buf, request)); *size += n) {
+    if (*size + n > UINT32_MAX) {
+      fprintf(stderr, "File is too big (4GB at most): stopped at %llu.\n",
+              (unsigned long long)*size);
+      break;
+    }
+
+    memset(buf + n, 0, request - n);
+    if (mode == _CP_COMPRESSED) {
+      fs_blockmap_resize(map, map->count + 1);
+      _ingest_cluster(fs, map, map->count - 1, buf, packed, n);
+      continue;
+    }
+
+    count = fs_blockmap_count_for(n);
+    fs_blockmap_resize(map, map->count + count);
+    _ingest_blocks(fs, map, buf, map->count - count, count,
+                   mode == _CP_DEDUP);
+  }
+
+  if (packed != buf)
+    free(packed);
+  free(buf);
+
+  return map;
+}
+
+// writes `map` to the image, returning the
+// `fblock` of a file holding its blocks: a plain
+// chain if it has no holes (and isn't
+// compressed), a block table otherwise. Blocks
+// that may be shared (`table`) can't be linked
+// into a chain either.
+static uint32_t _filesystem_storemap(fs_filesystem_t* fs, fs_blockmap_t* map,
+                                     int table)
+{
+  size_t size = fs_blockmap_serialized_size(map);
+  unsigned char* buf = NULL;
+  uint32_t fblock = 0;
+
+  if (!map->count)
+    return fs_fat_addfile(fs->fat);
+
+  if (!table && !map->lengths && !fs_blockmap_is_sparse(map))
+    return fs_blockmap_chain(map, fs->fat);
+
+  buf = malloc(size);
+  PASSERT(buf, FS_ERR_MALLOC);
+  fs_blockmap_serialize(map, buf, size);
+
+  fblock = fs_fat_allocfile(fs->fat, (size - 1) / FS_BLOCK_SIZE + 1);
+  _filesystem_chain_io(fs, fblock, buf, size, 1);
+  free(buf);
+
+  return fblock | FS_FBLOCK_MAPPED | (map->lengths ? FS_FBLOCK_COMPRESSED : 0);
+}
+
+// replaces the data of `file` w/ the blocks in
+// `map` (see _filesystem_storemap())
+static void _filesystem_setdata(fs_filesystem_t* fs, fs_file_t* file,
+                                fs_blockmap_t* map, int table)
+{
+  _filesystem_freedata(fs, file->fblock, file->attrs.size);
+  fs_nameidx_remove(fs->names, file->fblock);
+
+  file->fblock = _filesystem_storemap(fs, map, table);
+  fs_nameidx_add(fs->names, file->attrs.fname, file->fblock,
+                 file->parent->fblock, 0);
+}
+
+static fs_file_t* _filesystem_cp(fs_filesystem_t* fs, const char* src,
+                                 const char* dest, _cp_mode mode)
+{
+  fs_blockmap_t* map = NULL;
+  fs_file_t* file = NULL;
+  uint64_t size = 0;
+  struct stat st;
+  int fd = -1;
+
+  ASSERT(!fs_filesystem_lookup(fs, dest), "File already exists");
+  PASSERT((fd = open(src, O_RDONLY)) >= 0, "open");
+  PASSERT(!fstat(fd, &st), "fstat");
+  size = st.st_size;
+
+  // TODO assert that we have space [issue 14]
+  // TODO how to properly notify the error? [ issue 13 ]
+
+  if (st.st_size > UINT32_MAX) {
+    fprintf(stderr, "File `%s` is too big (4GB at most).\n", src);
+    PASSERT(close(fd) == 0, "close");
+    return NULL;
+  }
+
+  if (!(file = fs_filesystem_touch(fs, dest))) {
+    PASSERT(close(fd) == 0, "close");
+    return NULL;
+  }
+
+  // w/out a size to go by (pipes, ..) blocks are
+  // taken as data comes in
+  PASSERT(fflush(fs->file) != EOF, "fflush: ");
+  if (!S_ISREG(st.st_mode))
+    map = _filesystem_ingest_stream(fs, fd, mode, &size);
+  else if (mode == _CP_COMPRESSED)
+    map = _filesystem_ingest_compressed(fs, fd, size);
+  else
+    map = _filesystem_ingest(fs, fd, size, mode == _CP_DEDUP);
+  _filesystem_setdata(fs, file, map, mode == _CP_DEDUP);
+  fs_blockmap_destroy(map);
+  PASSERT(close(fd) == 0, "close");
+
+  _filesystem_resize(fs, file, size);
+  file->attrs.ctime = fs_utils_gettime();
+  file->attrs.mtime = file->attrs.ctime;
+  file->attrs.atime = file->attrs.ctime;
+
+  // persist FAT and BMP
+  fs_filesystem_persist_sbfatbmp(fs);
+  fs_filesystem_persist_cwd(fs);
+
+  return file;
+}
+
+fs_file_t* fs_filesystem_cp(fs_filesystem_t* fs, const char* src,
+                            const char* dest)
+{
+  return _filesystem_cp(fs, src, dest, _CP_PLAIN);
+}
+
+fs_file_t* fs_filesystem_cp_compressed(fs_filesystem_t* fs, const char* src,
+                                       const char* dest)
+{
+  return _filesystem_cp(fs, src, dest, _CP_COMPRESSED);
+}
+
+fs_file_t* fs_filesystem_cp_dedup(fs_filesystem_t* fs, const char* src,
+                                  const char* dest)
+{
+  return _filesystem_cp(fs, src, dest, _CP_DEDUP);
+}
+
+// turns a plain file into a mapped one (w/ the
+// same blocks) so that they may be shared: each
+// one becomes a chain of its own. Its directory
+// is left to be persisted.
+static void _filesystem_tableize(fs_filesystem_t* fs, fs_file_t* file)
+{
+  fs_blockmap_t* map = NULL;
+
+  if (fs_fblock_is_mapped(file->fblock) || !file->attrs.size)
+    return;
+
+  _tail_forget(fs, file->fblock);
+  map = fs_blockmap_from_chain(fs->fat, file->fblock,
+                               fs_blockmap_count_for(file->attrs.size));
+  for (uint32_t i = 0; i < map->count; i++)
+    fs->fat->blocks[map->blocks[i]] = map->blocks[i];
+
+  fs_nameidx_remove(fs->names, file->fblock);
+  file->fblock = _filesystem_storemap(fs, map, 1);
+  fs_nameidx_add(fs->names, file->attrs.fname, file->fblock,
+                 file->parent->fblock, 0);
+  fs_blockmap_destroy(map);
+}
+
+// a copy of the `size` bytes of the chain at
+// `first`, for blocks that can't take another
+// reference
+static uint32_t _copy_chain(fs_filesystem_t* fs, uint32_t first, size_t size)
+{
+  uint8_t* buf = malloc(size);
+  uint32_t copy = fs_fat_allocfile(fs->fat, (size - 1) / FS_BLOCK_SIZE + 1);
+
+  PASSERT(buf, FS_ERR_MALLOC);
+  if (!_filesystem_chain_io(fs, first, buf, size, 0))
+    memset(buf, 0, size);
+  _filesystem_chain_io(fs, copy, buf, size, 1);
+  free(buf);
+
+  return copy;
+}
+
+// map of the data of `file` w/ a new reference
+// to each of its blocks (clusters), to be stored
+// w/ _filesystem_storemap(). NULL if its table is
+// unreadable.
+static fs_blockmap_t* _filesystem_sharemap(fs_filesystem_t* fs,
+                                           fs_file_t* file)
+{
+  fs_blockmap_t* map = NULL;
+  uint32_t* blocks = NULL;
+
+  _filesystem_tableize(fs, file);
+  if (!(map = _filesystem_blockmap(fs, file->fblock, file->attrs.size)))
+    return NULL;
+
+  // what's reserved past the end stays w/ `file`
+  if (!map->lengths)
+    fs_blockmap_resize(map, fs_blockmap_count_for(file->attrs.size));
+
+  blocks = map->blocks;
+  for (uint32_t i = 0; i < map->count; i++)
+    if (blocks[i] != FS_BLOCKMAP_HOLE && !fs_fat_share(fs->fat, blocks[i]))
+      blocks[i] = _copy_chain(fs, blocks[i],
+                              map->lengths ? map->lengths[i] : FS_BLOCK_SIZE);
+
+  return map;
+}
+
+// drops the references taken by
+// _filesystem_sharemap()
+static void _filesystem_unshare(fs_filesystem_t* fs, fs_blockmap_t* map)
+{
+  for (uint32_t i = 0; i < map->count; i++)
+    if (map->blocks[i] != FS_BLOCKMAP_HOLE)
+      fs_fat_removefile(fs->fat, map->blocks[i]);
+}
+
+fs_file_t* fs_filesystem_reflink(fs_filesystem_t* fs, const char* src,
+                                 const char* dest)
+{
+  fs_blockmap_t* map = NULL;
+  fs_file_t* file = NULL;
+  fs_dirent_t entry;
+  uint32_t size = 0;
+
+  if (fs_filesystem_stat(fs, dest, &entry)) {
+    fprintf(stderr, "File `%s` already exists.\n", dest);
+    return NULL;
+  }
+
+  if (!(file = fs_filesystem_lookup(fs, src)) || file->attrs.is_directory) {
+    fprintf(stderr, "File `%s` not found.\n", src);
+    return NULL;
+  }
+
+  // its table may change under the handle (and a
+  // plain chain gets one: a new fblock)
+  if (_handle_busy(fs, file, 0)) {
+    fprintf(stderr, "File `%s` is open.\n", src);
+    return NULL;
+  }
+
+  if (!(map = _filesystem_sharemap(fs, file))) {
+    fprintf(stderr, "Corrupt block table\n");
+    return NULL;
+  }
+
+  size = file->attrs.size;
+  fs->cwd = file->parent;
+  fs_filesystem_persist_cwd(fs);
+
+  if (!(file = fs_filesystem_touch(fs, dest))) {
+    _filesystem_unshare(fs, map);
+    fs_blockmap_destroy(map);
+    fs_filesystem_persist_sbfatbmp(fs);
+    return NULL;
+  }
+
+  _filesystem_setdata(fs, file, map, 1);
+  fs_blockmap_destroy(map);
+
+  _filesystem_resize(fs, file, size);
+  file->attrs.ctime = fs_utils_gettime();
+  file->attrs.mtime = file->attrs.ctime;
+  file->attrs.atime = file->attrs.ctime;
+
+  fs_filesystem_persist_sbfatbmp(fs);
+  fs->cwd = file->parent;
+  fs_filesystem_persist_cwd(fs);
+
+  return file;
+}
+
+// fills `copy` w/ a read-only copy of what's
+// below `dir` (but `skip` and older snapshots),
+// accounting for it in `total`
+static void _snapshot_dir(fs_filesystem_t* fs, fs_file_t* dir,
+                          fs_file_t* copy, fs_file_t* skip,
+                          fs_fsinfo_t* total)
+{
+  fs_blockmap_t* map = NULL;
+  fs_file_t* f = NULL;
+  fs_file_t* c = NULL;
+  int dirty = 0;
+
+  fs->cwd = copy;
+  _filesystem_loaddir(fs, dir);
+
+  for (unsigned i = 0; i < dir->children_count; i++) {
+    f = fs_file_child(dir, i);
+    if (f == skip || (f->attrs.is_directory && f->attrs.readonly))
+      continue;
+
+    c = fs_file_create("", f->attrs.is_directory ? FS_FILE_DIRECTORY
+                                                 : FS_FILE_REGULAR,
+                       copy);
+    c->attrs = f->attrs;
+    c->attrs.readonly = 1;
+    fs_file_addchild(copy, c);
+
+    if (f->attrs.is_directory) {
+      c->fblock = fs_fat_addfile(fs->fat);
+      _snapshot_dir(fs, f, c, skip, total);
+      fs->cwd = copy;
+    } else {
+      dirty |= !fs_fblock_is_mapped(f->fblock) && f->attrs.size;
+      if (!(map = _filesystem_sharemap(fs, f))) {
+        fprintf(stderr, "Corrupt block table: `%.*s` left empty\n",
+                FS_NAME_MAX, f->attrs.fname);
+        map = fs_blockmap_create(0);
+        c->attrs.size = 0;
+      }
+      c->fblock = _filesystem_storemap(fs, map, 1);
+      fs_blockmap_destroy(map);
+    }
+
+    fs_nameidx_add(fs->names, c->attrs.fname, c->fblock, copy->fblock,
+                   c->attrs.is_directory);
+    _bloom_insert(fs, copy, c->attrs.fname);
+    fs_fsinfo_add(total, c);
+  }
+
+  // files that just got a block table
+  if (dirty) {
+    fs->cwd = dir;
+    fs_filesystem_persist_cwd(fs);
+  }
+
+  fs->cwd = copy;
+  fs_filesystem_persist_cwd(fs);
+}
+
+fs_file_t* fs_filesystem_snapshot(fs_filesystem_t* fs, const char* path)
+{
+  fs_fsinfo_t total = { 0 };
+  fs_file_t* snap = NULL;
+
+  if (_handle_busy(fs, fs->root, 0)) {
+    fprintf(stderr, "Can't take a snapshot w/ files open.\n");
+    return NULL;
+  }
+
+  if (!(snap = fs_filesystem_mkdir(fs, path)))
+    return NULL;
+
+  _snapshot_dir(fs, fs->root, snap, snap, &total);
+  _usage_update(fs, snap, &total, 1);
+  fs_dcache_invalidate(fs->dcache);
+
+  snap->attrs.readonly = 1;
+  fs->cwd = snap->parent;
+  fs_filesystem_persist_cwd(fs);
+  fs_filesystem_persist_sbfatbmp(fs);
+
+  return snap;
+}
+
+// writes `n` zeros (a hole) to `fd`
+static void _write_zeros(int fd, size_t n)
+{
+  static const uint8_t zeros[FS_BLOCK_SIZE] = { 0 };
+  ssize_t written = 0;
+  size_t chunk = 0;
+
+  for (; n; n -= written) {
+    chunk = n < FS_BLOCK_SIZE ? n : FS_BLOCK_SIZE;
+    PASSERT((written = write(fd, zeros, chunk)) > 0, "write: ");
+  }
+}
+
+// whether block `i` of the map reads as zeros
+// w/out going to the image: a hole or a block
+// that's never been written
+static inline int _reads_zeros(fs_blockmap_t* map, uint32_t i)
+{
+  return map->blocks[i] == FS_BLOCKMAP_HOLE ||
+         fs_blockmap_is_unwritten(map, i);
+}
+
+// in the map of a handle: a block buffered in
+// `pending` (at the slot in the low bits)
+#define _PENDING 0x80000000u
+
+// whether block `i` of the map continues the run
+// of block `i - 1`: both zeros or contiguous data
+static inline int _same_run(fs_blockmap_t* map, uint32_t i)
+{
+  if (_reads_zeros(map, i - 1))
+    return _reads_zeros(map, i);
+
+  return !_reads_zeros(map, i) && map->blocks[i] == map->blocks[i - 1] + 1;
+}
+
+// hints the kernel (POSIX_FADV_WILLNEED) at the
+// blocks a stream of reads is going to want next:
+// `ra->window` of them past the `n` bytes at
+// `offset`, a hint per run of contiguous blocks.
+// The window doubles (up to FS_READAHEAD_MAX)
+// while reads follow each other and is dropped on
+// a seek
+static void _readahead(fs_filesystem_t* fs, fs_blockmap_t* map,
+                       fs_readahead_t* ra, uint64_t offset, size_t n)
+{
+  uint32_t from = (offset + n + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+  uint32_t to = 0;
+  uint32_t run = 0;
+
+  if (offset != ra->next) {
+    ra->next = offset + n;
+    ra->window = 0;
+    ra->end = 0;
+    return;
+  }
+
+  ra->next = offset + n;
+  ra->window = !ra->window                    ? FS_READAHEAD_MIN
+               : ra->window < FS_READAHEAD_MAX ? 2 * ra->window
+                                               : FS_READAHEAD_MAX;
+
+  to = from + ra->window < map->count ? from + ra->window : map->count;
+  if (from < ra->end)
+    from = ra->end;
+
+  // only a hint: errors don't matter
+  for (uint32_t b = from; b < to; b += run) {
+    for (run = 1; b + run < to && _same_run(map, b + run); run++)
+      ;
+    if (!_reads_zeros(map, b) && !(map->blocks[b] & _PENDING))
+      posix_fadvise(fileno(fs->file), _block_offset(fs, map->blocks[b]),
+                    (off_t)run * FS_BLOCK_SIZE, POSIX_FADV_WILLNEED);
+  }
+
+  if (to > ra->end)
+    ra->end = to;
+}
+
+static void _write_all(int fd, const uint8_t* buf, size_t n)
+{
+  ssize_t written = 0;
+
+  for (; n; n -= written, buf += written)
+    PASSERT((written = write(fd, buf, n)) > 0, "write: ");
+}
+
+// sends the first `size` bytes of a plain map to
+// `fd`, verifying every block on the way: one
+// request per run of contiguous blocks (up to
+// FS_READ_BLOCKS) or of holes. Stops at a
+// corrupt block. Returns what's left.
+static uint64_t _cat_blocks(fs_filesystem_t* fs, fs_blockmap_t* map,
+                            uint64_t size, int fd)
+{
+  uint8_t* buf = malloc(FS_READ_BLOCKS * FS_BLOCK_SIZE);
+  fs_readahead_t ra = { 0 };
+  uint32_t end = 0;
+  uint32_t good = 0;
+  size_t n = 0;
+
+  PASSERT(buf, FS_ERR_MALLOC);
+
+  for (uint32_t i = 0; i < map->count && size; i = end) {
+    for (end = i + 1; end < map->count && end - i < FS_READ_BLOCKS &&
+                      _same_run(map, end);
+         end++)
+      ;
+
+    n = (uint64_t)(end - i) * FS_BLOCK_SIZE < size ? (end - i) * FS_BLOCK_SIZE
+                                                  : size;
+    _readahead(fs, map, &ra, (uint64_t)i * FS_BLOCK_SIZE,
+               (size_t)(end - i) * FS_BLOCK_SIZE);
+
+    if (_reads_zeros(map, i)) {
+      _write_zeros(fd, n);
+      size -= n;
+      continue;
+    }
+
+    PASSERT(pread(fileno(fs->file), buf, (end - i) * FS_BLOCK_SIZE,
+                  _block_offset(fs, map->blocks[i])) ==
+                (end - i) * FS_BLOCK_SIZE,
+            "pread: ");
+
+    // what comes before a corrupt block still goes
+    good = _csum_verify(fs, map->blocks[i], buf, end - i);
+    if (good < end - i)
+      n = (size_t)good * FS_BLOCK_SIZE;
+
+    _write_all(fd, buf, n);
+    size -= n;
+
+    if (good < end - i)
+      break;
+  }
+
+  free(buf);
+
+  return size;
+}
+
+// same, decompressing a cluster at a time
+static uint64_t _cat_clusters(fs_filesystem_t* fs, fs_blockmap_t* map,
+                              uint64_t size, int fd)
+{
+  uint8_t* raw = malloc(FS_CLUSTER_SIZE);
+  uint8_t* packed = malloc(FS_CLUSTER_SIZE);
+  uint32_t length = 0;
+  size_t n = 0;
+
+  PASSERT(raw && packed, FS_ERR_MALLOC);
+
+  for (uint32_t i = 0; i < map->count && size; i++, size -= n) {
+    n = size < FS_CLUSTER_SIZE ? size : FS_CLUSTER_SIZE;
+
+    if (!(length = map->lengths[i])) {
+      _write_zeros(fd, n);
+      continue;
+    }
+
+    ASSERT(length <= n, "Corrupt cluster %u: %u bytes stored", i, length);
+
+    if (length == n) {
+      if (!_filesystem_chain_io(fs, map->blocks[i], raw, n, 0))
+        break;
+    } else {
+      if (!_filesystem_chain_io(fs, map->blocks[i], packed, length, 0))
+        break;
+      ASSERT(fs_lz_decompress(packed, length, raw, FS_CLUSTER_SIZE) ==
+                 (ssize_t)n,
+             "Corrupt cluster %u", i);
+    }
+
+    _write_all(fd, raw, n);
+  }
+
+  free(raw);
+  free(packed);
+
+  return size;
+}
+
+void fs_filesystem_cat(fs_filesystem_t* fs, const char* src, int fd)
+{
+  fs_blockmap_t* map = NULL;
+  fs_dirent_t file;
+  uint64_t remaining = 0;
+  uint64_t corrupt = fs->corrupt;
+
+  ASSERT(fs_filesystem_stat(fs, src, &file), "File not found");
+
+  if (file.attrs.is_directory) {
+    fprintf(stderr, "Can't `cat` a directory.\n"
+                    "Enter `help` if you need help\n");
+    return;
+  }
+
+  if (!(map = _filesystem_blockmap(fs, file.fblock, file.attrs.size))) {
+    fprintf(stderr, "Corrupt block table for `%s`\n", src);
+    return;
+  }
+  PASSERT(fflush(fs->file) != EOF, "fflush: ");
+
+  remaining = map->lengths ? _cat_clusters(fs, map, file.attrs.size, fd)
+                           : _cat_blocks(fs, map, file.attrs.size, fd);
+
+  fs_blockmap_destroy(map);
+
+  if (remaining && fs->corrupt != corrupt) {
+    fprintf(stderr, "`%s` is corrupt: stopped %llu bytes short\n", src,
+            (unsigned long long)remaining);
+    return;
+  }
+
+  PASSERT(!remaining, "Should've written %u. %llu left", file.attrs.size,
+          (unsigned long long)remaining);
+}
+
+fs_handle_t* fs_filesystem_open(fs_filesystem_t* fs, const char* path,
+                                int flags)
+{
+  fs_file_t* file = fs_filesystem_lookup(fs, path);
+  fs_handle_t* h = NULL;
+  uint32_t depth = 0;
+  int created = 0;
+
+  if (!file && flags & FS_OPEN_CREATE) {
+    if (!(file = _filesystem_mkfile(fs, path, FS_FILE_REGULAR)))
+      return NULL;
+
+    // starts empty, unlike a `touch`ed one
+    _filesystem_resize(fs, file, 0);
+    created = 1;
+  }
+
+  if (!file || file->attrs.is_directory) {
+    fprintf(stderr, "File `%s` not found.\n", path);
+    return NULL;
+  }
+
+  if (flags & FS_OPEN_WRITE && file->attrs.readonly) {
+    fprintf(stderr, "File `%s` is read-only.\n", path);
+    return NULL;
+  }
+
+  if (flags & FS_OPEN_WRITE && fs_fblock_is_compressed(file->fblock)) {
+    fprintf(stderr, "File `%s` is compressed: it can only be read.\n", path);
+    return NULL;
+  }
+
+  // a writer has the file to itself: other maps
+  // would go stale
+  if (_handle_busy(fs, file, FS_OPEN_WRITE) ||
+      (flags & FS_OPEN_WRITE && _handle_busy(fs, file, 0))) {
+    fprintf(stderr, "File `%s` is already open.\n", path);
+    return NULL;
+  }
+
+  h = calloc(1, sizeof(*h));
+  PASSERT(h, FS_ERR_MALLOC);
+
+  if (!(h->map = _filesystem_blockmap(fs, file->fblock, file->attrs.size))) {
+    fprintf(stderr, "Corrupt block table for `%s`\n", path);
+    free(h);
+    return NULL;
+  }
+
+  h->fs = fs;
+  h->file = file;
+  h->size = file->attrs.size;
+  h->chained = fs_fblock_is_mapped(file->fblock) ? 0 : h->map->count;
+  h->cluster = UINT32_MAX;
+  h->flags = flags;
+  h->dirty = created;
+  h->path = strdup(path);
+  h->buf = malloc(FS_READ_BLOCKS * FS_BLOCK_SIZE);
+  h->fblock = file->fblock;
+
+  // what it's below, for _handle_busy()
+  for (fs_file_t* dir = file; dir->parent != dir; dir = dir->parent)
+    h->ndirs++;
+  h->dirs = malloc(h->ndirs * sizeof(*h->dirs));
+  PASSERT(h->path && h->buf && h->dirs, FS_ERR_MALLOC);
+  for (fs_file_t* dir = file; dir->parent != dir; dir = dir->parent)
+    h->dirs[depth++] = dir->parent->fblock;
+
+  h->next = fs->handles;
+  fs->handles = h;
+
+  return h;
+}
+
+// brings cluster `i` (decompressed) to `h->buf`;
+// the stored bytes go right after it
+static int _handle_cluster(fs_handle_t* h, uint32_t i)
+{
+  fs_blockmap_t* map = h->map;
+  uint8_t* packed = h->buf + FS_CLUSTER_SIZE;
+  uint32_t length = map->lengths[i];
+  size_t n = h->size - (size_t)i * FS_CLUSTER_SIZE;
+
+  if (h->cluster == i)
+    return 1;
+
+  h->cluster = UINT32_MAX;
+  if (n > FS_CLUSTER_SIZE)
+    n = FS_CLUSTER_SIZE;
+
+  ASSERT(length <= n, "Corrupt cluster %u: %u bytes stored", i, length);
+
+  if (!length)
+    memset(h->buf, 0, n);
+  else if (length == n) {
+    if (!_filesystem_chain_io(h->fs, map->blocks[i], h->buf, n, 0))
+      return 0;
+  } else {
+    if (!_filesystem_chain_io(h->fs, map->blocks[i], packed, length, 0))
+      return 0;
+    ASSERT(fs_lz_decompress(packed, length, h->buf, FS_CLUSTER_SIZE) ==
+               (ssize_t)n,
+           "Corrupt cluster %u", i);
+  }
+
+  h->cluster = i;
+
+  return 1;
+}
+
+static ssize_t _pread_clusters(fs_handle_t* h, uint8_t* out, size_t n,
+                               uint64_t offset)
+{
+  size_t done = 0;
+  size_t at = 0;
+  size_t len = 0;
+
+  for (; done < n; done += len) {
+    at = (offset + done) % FS_CLUSTER_SIZE;
+    len = FS_CLUSTER_SIZE - at < n - done ? FS_CLUSTER_SIZE - at : n - done;
+
+    if (!_handle_cluster(h, (offset + done) / FS_CLUSTER_SIZE))
+      return done ? (ssize_t)done : -1;
+    memcpy(out + done, h->buf + at, len);
+  }
+
+  return done;
+}
+
+ssize_t fs_filesystem_pread(fs_handle_t* h, void* buf, size_t n,
+                            uint64_t offset)
+{
+  fs_filesystem_t* fs = h->fs;
+  uint32_t* blocks = h->map->blocks;
+  uint8_t* out = buf;
+  uint32_t block = 0;
+  uint32_t need = 0;
+  uint32_t run = 0;
+  uint32_t good = 0;
+  size_t done = 0;
+  size_t at = 0;
+  size_t len = 0;
+  uint32_t i = 0;
+
+  if (offset >= h->size)
+    return 0;
+  if (n > h->size - offset)
+    n = h->size - offset;
+
+  PASSERT(fflush(fs->file) != EOF, "fflush: ");
+  if (h->map->lengths)
+    return _pread_clusters(h, out, n, offset);
+  _readahead(fs, h->map, &h->ra, offset, n);
+
+  for (; done < n; done += len) {
+    i = (offset + done) / FS_BLOCK_SIZE;
+    at = (offset + done) % FS_BLOCK_SIZE;
+    need = (at + n - done - 1) / FS_BLOCK_SIZE + 1;
+    block = blocks[i];
+
+    // not in the image yet
+    if (block & _PENDING) {
+      len = FS_BLOCK_SIZE - at < n - done ? FS_BLOCK_SIZE - at : n - done;
+      memcpy(out + done,
+             h->pending_buf + (size_t)(block & ~_PENDING) * FS_BLOCK_SIZE + at,
+             len);
+      continue;
+    }
+
+    // a run of zeros or of contiguous blocks
+    for (run = 1; run < need && run < FS_READ_BLOCKS &&
+                  _same_run(h->map, i + run);
+         run++)
+      ;
+
+    len = run * FS_BLOCK_SIZE - at;
+    if (len > n - done)
+      len = n - done;
+
+    if (_reads_zeros(h->map, i)) {
+      memset(out + done, 0, len);
+      continue;
+    }
+
+    PASSERT(pread(fileno(fs->file), h->buf, run * FS_BLOCK_SIZE,
+                  _block_offset(fs, block)) == run * FS_BLOCK_SIZE,
+            "pread: ");
+
+    // what comes before a corrupt block is fine
+    if ((good = _csum_verify(fs, block, h->buf, run)) < run &&
+        good * FS_BLOCK_SIZE < at + len) {
+      len = good * FS_BLOCK_SIZE > at ? good * FS_BLOCK_SIZE - at : 0;
+      memcpy(out + done, h->buf + at, len);
+      done += len;
+      return done ? (ssize_t)done : -1;
+    }
+
+    memcpy(out + done, h->buf + at, len);
+  }
+
+  return done;
+}
+
+static int _cmp_pending(const void* a, const void* b, void* arg)
+{
+  const uint32_t* pending = arg;
+  uint32_t x = pending[*(const uint32_t*)a];
+  uint32_t y = pending[*(const uint32_t*)b];
+
+  return (x > y) - (x < y);
+}
+
+// takes room for the buffered blocks of `h`, a
+// single run if there's one that long, in the
+// order of the file, and writes them w/ a request
+// per run that's also contiguous in the buffer
+static void _handle_flush(fs_handle_t* h)
+{
+  fs_filesystem_t* fs = h->fs;
+  uint32_t* blocks = h->map->blocks;
+  uint32_t order[FS_DELALLOC_BLOCKS];
+  uint32_t first = 0;
+  uint32_t run = 0;
+  uint32_t n = h->npending;
+
+  if (!n)
+    return;
+
+  for (uint32_t k = 0; k < n; k++)
+    order[k] = k;
+  qsort_r(order, n, sizeof(*order), _cmp_pending, h->pending);
+
+  first = fs_bmp_alloc_run(fs->fat->bmp, n);
+  for (uint32_t k = 0; k < n; k++) {
+    blocks[h->pending[order[k]]] =
+        first == UINT32_MAX ? fs_fat_addfile(fs->fat) : first + k;
+    fs->fat->blocks[blocks[h->pending[order[k]]]] =
+        blocks[h->pending[order[k]]];
+  }
+
+  for (uint32_t k = 0; k < n; k += run) {
+    for (run = 1; k + run < n && order[k + run] == order[k] + run &&
+                  blocks[h->pending[order[k + run]]] ==
+                      blocks[h->pending[order[k]]] + run;
+         run++)
+      ;
+
+    PASSERT(pwrite(fileno(fs->file),
+                   h->pending_buf + (size_t)order[k] * FS_BLOCK_SIZE,
+                   run * FS_BLOCK_SIZE,
+                   _block_offset(fs, blocks[h->pending[order[k]]])) ==
+                run * FS_BLOCK_SIZE,
+            "pwrite: ");
+    fs_filesystem_checksum(fs, blocks[h->pending[order[k]]],
+                           h->pending_buf + (size_t)order[k] * FS_BLOCK_SIZE,
+                           run);
+  }
+
+  h->npending = 0;
+}
+
+// the buffer for block `i` of `h`, which needs
+// room of its own: buffered (holding what the
+// block had) until _handle_flush()
+static uint8_t* _handle_pend(fs_handle_t* h, uint32_t i)
+{
+  fs_filesystem_t* fs = h->fs;
+  fs_blockmap_t* map = h->map;
+  uint32_t block = map->blocks[i];
+  uint8_t* data = NULL;
+
+  if (block & _PENDING)
+    return h->pending_buf + (size_t)(block & ~_PENDING) * FS_BLOCK_SIZE;
+
+  if (h->npending == FS_DELALLOC_BLOCKS)
+    _handle_flush(h);
+
+  if (!h->pending_buf) {
+    h->pending = malloc(FS_DELALLOC_BLOCKS * sizeof(*h->pending));
+    h->pending_buf = malloc(FS_DELALLOC_BLOCKS * FS_BLOCK_SIZE);
+    PASSERT(h->pending && h->pending_buf, FS_ERR_MALLOC);
+  }
+
+  data = h->pending_buf + (size_t)h->npending * FS_BLOCK_SIZE;
+  if (_reads_zeros(map, i))
+    memset(data, 0, FS_BLOCK_SIZE);
+  else {
+    PASSERT(pread(fileno(fs->file), data, FS_BLOCK_SIZE,
+                  _block_offset(fs, block)) == FS_BLOCK_SIZE,
+            "pread: ");
+    if (!_csum_verify(fs, block, data, 1))
+      return NULL;
+  }
+
+  // the other files keep theirs (copy on write)
+  if (block != FS_BLOCKMAP_HOLE)
+    fs_fat_removefile(fs->fat, block);
+  fs_blockmap_set_unwritten(map, i, 0);
+
+  h->pending[h->npending] = i;
+  map->blocks[i] = _PENDING | h->npending++;
+  h->dirty = 1;
+
+  return data;
+}
+
+ssize_t fs_filesystem_pwrite(fs_handle_t* h, const void* buf, size_t n,
+                             uint64_t offset)
+{
+  fs_filesystem_t* fs = h->fs;
+  fs_blockmap_t* map = h->map;
+  const uint8_t* in = buf;
+  const uint8_t* data = NULL;
+  uint8_t* pending = NULL;
+  uint32_t block = 0;
+  size_t done = 0;
+  size_t at = 0;
+  size_t len = 0;
+  uint32_t i = 0;
+
+  if (!(h->flags & FS_OPEN_WRITE)) {
+    fprintf(stderr, "`%s` isn't open for writing.\n", h->path);
+    return -1;
+  }
+
+  if (offset + n > UINT32_MAX) {
+    fprintf(stderr, "File `%s` would be too big (4GB at most).\n", h->path);
+    return -1;
+  }
+
+  if (!n)
+    return 0;
+
+  if (fs_blockmap_count_for(offset + n) > map->count) {
+    fs_blockmap_resize(map, fs_blockmap_count_for(offset + n));
+    h->dirty = 1;
+  }
+
+  PASSERT(fflush(fs->file) != EOF, "fflush: ");
+
+  for (; done < n; done += len) {
+    i = (offset + done) / FS_BLOCK_SIZE;
+    at = (offset + done) % FS_BLOCK_SIZE;
+    len = FS_BLOCK_SIZE - at < n - done ? FS_BLOCK_SIZE - at : n - done;
+    block = map->blocks[i];
+    data = in + done;
+
+    // blocks that need room of their own (holes,
+    // shared ones) wait for it in memory
+    if (block & _PENDING || block == FS_BLOCKMAP_HOLE || fs->fat->refs[block]) {
+      if (!(pending = _handle_pend(h, i)))
+        return -1;
+      memcpy(pending + at, data, len);
+      continue;
+    }
+
+    // partial blocks get merged w/ what's there
+    if (len < FS_BLOCK_SIZE) {
+      if (_reads_zeros(map, i))
+        memset(h->buf, 0, FS_BLOCK_SIZE);
+      else {
+        PASSERT(pread(fileno(fs->file), h->buf, FS_BLOCK_SIZE,
+                      _block_offset(fs, block)) == FS_BLOCK_SIZE,
+                "pread: ");
+        if (!_csum_verify(fs, block, h->buf, 1))
+          return -1;
+      }
+
+      memcpy(h->buf + at, data, len);
+      data = h->buf;
+    }
+
+    // reserved ones are filled in place
+    if (fs_blockmap_is_unwritten(map, i)) {
+      fs_blockmap_set_unwritten(map, i, 0);
+      h->dirty = 1;
+    }
+
+    PASSERT(pwrite(fileno(fs->file), data, FS_BLOCK_SIZE,
+                   _block_offset(fs, block)) == FS_BLOCK_SIZE,
+            "pwrite: ");
+    fs_filesystem_checksum(fs, block, data, 1);
+  }
+
+  if (offset + n > h->size) {
+    h->size = offset + n;
+    h->dirty = 1;
+  }
+  h->written = 1;
+
+  return n;
+}
+
+// the node of `h`, which may have been evicted
+static fs_file_t* _handle_file(fs_handle_t* h)
+{
+  if (!h->fs->budget)
+    return h->file;
+
+  return h->file = fs_filesystem_lookup(h->fs, h->path);
+}
+
+// writes the map of `h` back as the data of
+// `file`: the old chain (or table) goes, the data
+// blocks being all in the map
+static void _handle_storemap(fs_handle_t* h, fs_file_t* file)
+{
+  fs_filesystem_t* fs = h->fs;
+  fs_blockmap_t* map = h->map;
+  int shared = 0;
+
+  _tail_forget(fs, file->fblock);
+  if (fs_fblock_is_mapped(file->fblock))
+    fs_fat_removefile(fs->fat, fs_fblock_chain(file->fblock));
+  else if (!h->chained)
+    fs_fat_removefile(fs->fat, file->fblock);
+  for (uint32_t i = 0; i < h->chained; i++)
+    fs->fat->blocks[map->blocks[i]] = map->blocks[i];
+
+  for (uint32_t i = 0; i < map->count && !shared; i++)
+    shared = map->blocks[i] != FS_BLOCKMAP_HOLE &&
+             fs->fat->refs[map->blocks[i]];
+
+  fs_nameidx_remove(fs->names, file->fblock);
+  file->fblock = _filesystem_storemap(fs, map, shared);
+  fs_nameidx_add(fs->names, file->attrs.fname, file->fblock,
+                 file->parent->fblock, 0);
+  h->chained = fs_fblock_is_mapped(file->fblock) ? 0 : map->count;
+  h->fblock = file->fblock;
+}
+
+int fs_filesystem_fsync(fs_handle_t* h)
+{
+  fs_filesystem_t* fs = h->fs;
+  fs_blockmap_t* map = h->map;
+  fs_file_t* file = NULL;
+
+  if (!h->dirty && !h->written)
+    return 0;
+
+  if (!(file = _handle_file(h))) {
+    fprintf(stderr, "File `%s` not found.\n", h->path);
+    return -1;
+  }
+
+  _handle_flush(h);
+
+  if (h->dirty) {
+    // a plain chain that was only cut short (or
+    // written in place) is linked as it is
+    if (!fs_fblock_is_mapped(file->fblock) && map->count &&
+        h->chained == map->count && !fs_blockmap_is_sparse(map))
+      _tail_set(fs, file->fblock, map->blocks[map->count - 1]);
+    else
+      _handle_storemap(h, file);
+
+    _filesystem_resize(fs, file, h->size);
+    fs_filesystem_persist_sbfatbmp(fs);
+  }
+
+  if (h->written) {
+    file->attrs.mtime = fs_utils_gettime();
+    file->attrs.atime = file->attrs.mtime;
+  }
+
+  fs->cwd = file->parent;
+  fs_filesystem_persist_cwd(fs);
+  h->dirty = 0;
+  h->written = 0;
+
+  return 0;
+}
+
+int fs_filesystem_close(fs_handle_t* h)
+{
+  int err = fs_filesystem_fsync(h);
+
+  for (fs_handle_t** p = &h->fs->handles; *p; p = &(*p)->next) {
+    if (*p == h) {
+      *p = h->next;
+      break;
+    }
+  }
+
+  fs_blockmap_destroy(h->map);
+  free(h->dirs);
+  free(h->path);
+  free(h->buf);
+  free(h->pending);
+  free(h->pending_buf);
+  free(h);
+
+  return err;
+}
+
+int fs_filesystem_ftruncate(fs_handle_t* h, uint32_t size)
+{
+  static const uint8_t zeros[FS_BLOCK_SIZE] = { 0 };
+  fs_filesystem_t* fs = h->fs;
+  fs_blockmap_t* map = h->map;
+  uint32_t keep = fs_blockmap_count_for(size);
+  uint32_t cut = keep ? keep : 1;
+  uint32_t chained = h->chained;
+  uint32_t at = size % FS_BLOCK_SIZE;
+  int shrink = size < h->size;
+
+  if (!(h->flags & FS_OPEN_WRITE)) {
+    fprintf(stderr, "`%s` isn't open for writing.\n", h->path);
+    return -1;
+  }
+
+  _handle_flush(h);
+
+  // what's linked of a plain chain goes w/ a
+  // single cut. Its first block stays until the
+  // map is written back.
+  if (cut < chained) {
+    fs->fat->blocks[map->blocks[cut - 1]] = map->blocks[cut - 1];
+    fs_fat_removefile(fs->fat, map->blocks[cut]);
+    h->chained = cut;
+  }
+  if (!keep)
+    h->chained = 0;
+
+  for (uint32_t i = keep > chained ? keep : chained; i < map->count; i++) {
+    if (map->blocks[i] == FS_BLOCKMAP_HOLE)
+      continue;
+
+    if (!fs->fat->refs[map->blocks[i]])
+      fs_dedup_forget(fs->dedup, map->blocks[i]);
+    fs_fat_removefile(fs->fat, map->blocks[i]);
+  }
+
+  fs_blockmap_resize(map, keep);
+  h->size = size;
+  h->dirty = 1;
+  h->written = 1;
+
+  // what's past the end has to read back as
+  // zeros if it grows again
+  if (shrink && at && !_reads_zeros(map, keep - 1)) {
+    if (fs_filesystem_pwrite(h, zeros, FS_BLOCK_SIZE - at, size) < 0)
+      return -1;
+    h->size = size;
+  }
+
+  return 0;
+}
+
+int fs_filesystem_truncate(fs_filesystem_t* fs, const char* path,
+                           uint32_t size)
+{
+  fs_handle_t* h = fs_filesystem_open(fs, path, FS_OPEN_WRITE);
+  int err = 0;
+
+  if (!h)
+    return -1;
+
+  err = fs_filesystem_ftruncate(h, size);
+
+  return fs_filesystem_close(h) || err ? -1 : 0;
+}
+
+// grows the plain file `file` w/ the rest of
+// `fd`: the slack of its last block first, then
+// new chains linked after it. Returns its size.
+static uint64_t _append_chain(fs_filesystem_t* fs, fs_file_t* file, int fd,
+                              uint8_t* buf)
+{
+  uint64_t size = file->attrs.size;
+  uint32_t tail = _tail_get(fs, file->fblock);
+  uint32_t at = size % FS_BLOCK_SIZE;
+  uint32_t first = 0;
+  size_t n = 0;
+
+  PASSERT(fflush(fs->file) != EOF, "fflush: ");
+
+  // an empty file already has its block
+  if (at || !size) {
+    memset(buf, 0, FS_BLOCK_SIZE);
+    if (size) {
+      PASSERT(pread(fileno(fs->file), buf, FS_BLOCK_SIZE,
+                    _block_offset(fs, tail)) == FS_BLOCK_SIZE,
+              "pread: ");
+      if (!_csum_verify(fs, tail, buf, 1))
+        return size;
+    }
+
+    n = _read_upto(fd, buf + at, FS_BLOCK_SIZE - at);
+    PASSERT(pwrite(fileno(fs->file), buf, FS_BLOCK_SIZE,
+                   _block_offset(fs, tail)) == FS_BLOCK_SIZE,
+            "pwrite: ");
+    fs_filesystem_checksum(fs, tail, buf, 1);
+
+    size += n;
+    if (at + n < FS_BLOCK_SIZE)
+      return size;
+  }
+
+  while ((n = _read_upto(fd, buf, FS_INGEST_BLOCKS * FS_BLOCK_SIZE))) {
+    if (size + n > UINT32_MAX) {
+      fprintf(stderr, "File is too big (4GB at most): stopped at %llu.\n",
+              (unsigned long long)size);
+      break;
+    }
+
+    first = fs_fat_allocfile(fs->fat, fs_blockmap_count_for(n));
+    _filesystem_chain_io(fs, first, buf, n, 1);
+    fs->fat->blocks[tail] = first;
+    for (tail = first; fs->fat->blocks[tail] != tail;
+         tail = fs->fat->blocks[tail])
+      ;
+
+    size += n;
+  }
+
+  _tail_set(fs, file->fblock, tail);
+
+  return size;
+}
+
+fs_file_t* fs_filesystem_append(fs_filesystem_t* fs, const char* src,
+                                const char* dest)
+{
+  fs_file_t* file = fs_filesystem_lookup(fs, dest);
+  fs_handle_t* h = NULL;
+  uint8_t* buf = NULL;
+  size_t n = 0;
+  int fd = -1;
+
+  if (!file)
+    return fs_filesystem_cp(fs, src, dest);
+
+  if (file->attrs.is_directory) {
+    fprintf(stderr, "File `%s` is a directory.\n", dest);
+    return NULL;
+  }
+
+  if (_handle_busy(fs, file, FS_OPEN_WRITE)) {
+    fprintf(stderr, "File `%s` is already open for writing.\n", dest);
+    return NULL;
+  }
+
+  // tables get rewritten anyway: through a handle
+  // (which turns away what can't be written)
+  if (fs_fblock_is_mapped(file->fblock) || file->attrs.readonly) {
+    if (!(h = fs_filesystem_open(fs, dest, FS_OPEN_WRITE)))
+      return NULL;
+  }
+
+  PASSERT((fd = open(src, O_RDONLY)) >= 0, "open");
+  buf = malloc(FS_INGEST_BLOCKS * FS_BLOCK_SIZE);
+  PASSERT(buf, FS_ERR_MALLOC);
+
+  if (h) {
+    while ((n = _read_upto(fd, buf, FS_INGEST_BLOCKS * FS_BLOCK_SIZE)) &&
+           fs_filesystem_pwrite(h, buf, n, h->size) >= 0)
+      ;
+    fs_filesystem_close(h);
+    file = fs_filesystem_lookup(fs, dest);
+  } else {
+    _filesystem_resize(fs, file, _append_chain(fs, file, fd, buf));
+    file->attrs.mtime = fs_utils_gettime();
+    file->attrs.atime = file->attrs.mtime;
+
+    fs_filesystem_persist_sbfatbmp(fs);
+    fs->cwd = file->parent;
+    fs_filesystem_persist_cwd(fs);
+  }
+
+  free(buf);
+  PASSERT(close(fd) == 0, "close");
+
+  return file;
+}
+
+// frees the blocks of `file` and of everything
+// below it, accounting for them in `freed`
+static void _filesystem_freeblocks(fs_filesystem_t* fs, fs_file_t* file,
+                                   fs_fsinfo_t* freed)
+{
+  if (file->attrs.is_directory) {
+    _filesystem_loaddir(fs, file);
+    fs_dirblock_cache_forget(fs->dirblocks, file->fblock);
+  }
+
+  for (unsigned i = 0; i < file->children_count; i++)
+    _filesystem_freeblocks(fs, fs_file_child(file, i), freed);
+
+  if (file->attrs.is_directory) {
+    fs_bloom_remove(fs->blooms, file->fblock);
+    fs_fsinfo_map_remove(fs->usage, file->fblock);
+  }
+
+  fs_fsinfo_add(freed, file);
+
+  fs_nameidx_remove(fs->names, file->fblock);
+  if (file->attrs.is_directory)
+    fs_fat_removefile(fs->fat, file->fblock);
+  else
+    _filesystem_freedata(fs, file->fblock, file->attrs.size);
+}
+
+// names can't be taken out of a filter: those of
+// `dir` and its ancestors get rebuilt by the next
+// search
+static void _bloom_unlink(fs_filesystem_t* fs, fs_file_t* dir)
+{
+  fs_bloom_t* bloom = NULL;
+
+  for (;; dir = dir->parent) {
+    if ((bloom = fs_bloom_get(fs->blooms, dir->fblock)))
+      bloom->stale = 1;
+    if (dir->parent == dir)
+      break;
+  }
+}
+
+// removes `file` (and what's below it) from `dir`
+static void _filesystem_rmfile(fs_filesystem_t* fs, fs_file_t* dir,
+                               fs_file_t* file)
+{
+  fs_fsinfo_t freed = { 0 };
+
+  _bloom_unlink(fs, dir);
+  _filesystem_freeblocks(fs, file, &freed);
+  _usage_update(fs, dir, &freed, -1);
+  fs_file_removechild(dir, file);
+  fs_file_destroy(file);
+}
+
+// keeps the path cache coherent w/ the removal of
+// `file`: every cached path below a directory
+// would be left dangling.
+static void _dcache_unlink(fs_filesystem_t* fs, const char* path,
+                           fs_file_t* file)
+{
+  if (file->attrs.is_directory)
+    fs_dcache_invalidate(fs->dcache);
+
+  fs_dcache_put(fs->dcache, path, NULL);
+}
+
+int fs_filesystem_rm(fs_filesystem_t* fs, const char* path)
+{
+  fs_file_t* file = _traverse_to_file(fs, path);
+
+  if (!file)
+    return 0;
+
+  if (file->parent->attrs.readonly) {
+    fprintf(stderr, "File `%s` is read-only.\n", path);
+    return 0;
+  }
+
+  if (_handle_busy(fs, file, 0)) {
+    fprintf(stderr, "File `%s` is open.\n", path);
+    return 0;
+  }
+
+  _dcache_unlink(fs, path, file);
+  _filesystem_rmfile(fs, fs->cwd, file);
+  fs_filesystem_persist_cwd(fs);
+
+  return 1;
+}
+
+int fs_filesystem_rmdir(fs_filesystem_t* fs, const char* path)
+{
+  fs_file_t* file = _traverse_to_file(fs, path);
+
+  if (!file)
+    return 0;
+
+  if (!file->attrs.is_directory) {
+    fprintf(stderr, "File `%s` is not a directory.\n"
+                    "Enter `help` if you need help.\n",
+            file->attrs.fname);
+    return 0;
+  }
+
+  // a whole snapshot may go, not parts of it
+  if (file->parent->attrs.readonly) {
+    fprintf(stderr, "Directory `%s` is read-only.\n", path);
+    return 0;
+  }
+
+  if (_handle_busy(fs, file, 0)) {
+    fprintf(stderr, "Directory `%s` has files open.\n", path);
+    return 0;
+  }
+
+  _dcache_unlink(fs, path, file);
+  _filesystem_rmfile(fs, fs->cwd, file);
+  fs_filesystem_persist_cwd(fs);
+
+  return 1;
+}
+
+// the names below `file`, which was just linked
+// into `dir`, go to the filters above it. W/out a
+// filter of its own to take them from, those get
+// rebuilt by the next search instead.
+static void _bloom_link(fs_filesystem_t* fs, fs_file_t* dir, fs_file_t* file)
+{
+  fs_bloom_t* sub = fs_bloom_get(fs->blooms, file->fblock);
+  fs_bloom_t* bloom = NULL;
+
+  _bloom_insert(fs, dir, file->attrs.fname);
+  if (!file->attrs.is_directory)
+    return;
+
+  for (;; dir = dir->parent) {
+    if ((bloom = fs_bloom_get(fs->blooms, dir->fblock))) {
+      if (sub)
+        fs_bloom_merge(bloom->bits, sub->bits);
+      else
+        fs_bloom_remove(fs->blooms, dir->fblock);
+    }
+    if (dir->parent == dir)
+      break;
+  }
+}
+
+// whether `file` may take the place of `target`
+static int _replaceable(fs_filesystem_t* fs, fs_file_t* file,
+                        fs_file_t* target, const char* dest)
+{
+  if (file->attrs.is_directory && !target->attrs.is_directory) {
+    fprintf(stderr, "File `%s` is not a directory.\n", dest);
+    return 0;
+  }
+
+  if (!file->attrs.is_directory && target->attrs.is_directory) {
+    fprintf(stderr, "File `%s` is a directory.\n", dest);
+    return 0;
+  }
+
+  if (target->attrs.is_directory &&
+      fs_dirblock_count(_filesystem_dirblock(fs, target->fblock))) {
+    fprintf(stderr, "Directory `%s` is not empty.\n", dest);
+    return 0;
+  }
+
+  return 1;
+}
+
+fs_file_t* fs_filesystem_rename(fs_filesystem_t* fs, const char* src,
+                                const char* dest)
+{
+  fs_fsinfo_t delta = { 0 };
+  fs_fsinfo_t sub;
+  fs_path_iter_t it;
+  fs_file_t* file = NULL;
+  fs_file_t* from = NULL;
+  fs_file_t* to = NULL;
+  fs_file_t* target = NULL;
+
+  if (!(file = fs_filesystem_lookup(fs, src)) || file == fs->root) {
+    fprintf(stderr, "File `%s` not found.\n", src);
+    return NULL;
+  }
+
+  // `from` stays resident while resolving `dest`
+  from = fs->cwd = file->parent;
+  if (!(to = _resolve_parent(fs, dest, &it)) || !to->attrs.is_directory) {
+    fprintf(stderr, "Parent directory of `%s` not found.\n", dest);
+    return NULL;
+  }
+
+  if (from->attrs.readonly || to->attrs.readonly) {
+    fprintf(stderr, "Can't move `%s` to `%s`: read-only.\n", src, dest);
+    return NULL;
+  }
+
+  if (_handle_busy(fs, file, 0)) {
+    fprintf(stderr, "Can't move `%s`: it's open.\n", src);
+    return NULL;
+  }
+
+  for (fs_file_t* dir = to;; dir = dir->parent) {
+    if (dir == file) {
+      fprintf(stderr, "Can't move `%s` below itself.\n", src);
+      return NULL;
+    }
+    if (dir->parent == dir)
+      break;
+  }
+
+  if ((target = _lookup(fs, to, it.name, it.length)) == file)
+    return file;
+
+  if (target && !_replaceable(fs, file, target, dest))
+    return NULL;
+
+  if (target && _handle_busy(fs, target, 0)) {
+    fprintf(stderr, "Can't replace `%s`: it's open.\n", dest);
+    return NULL;
+  }
+
+  if (!target && to != from && to->children_count == FS_DIR_MAX_CHILDREN) {
+    fprintf(stderr, "Directory of `%s` is full.\n", dest);
+    return NULL;
+  }
+
+  if (target) {
+    _dcache_unlink(fs, dest, target);
+    _filesystem_rmfile(fs, to, target);
+  }
+
+  // the rollups of the whole subtree go along
+  fs_fsinfo_add(&delta, file);
+  if (file->attrs.is_directory) {
+    sub = _usage_build(fs, file->residency == FS_FILE_EVICTED ? NULL : file,
+                       file->fblock);
+    fs_fsinfo_merge(&delta, &sub);
+  }
+
+  if (it.length > FS_NAME_MAX)
+    it.length = FS_NAME_MAX;
+
+  _usage_update(fs, from, &delta, -1);
+  _bloom_unlink(fs, from);
+  fs_file_removechild(from, file);
+
+  memset(file->attrs.fname, 0, FS_NAME_MAX);
+  memcpy(file->attrs.fname, it.name, it.length);
+  fs_file_addchild(to, file);
+
+  _usage_update(fs, to, &delta, 1);
+  _bloom_link(fs, to, file);
+  fs_nameidx_remove(fs->names, file->fblock);
+  fs_nameidx_add(fs->names, file->attrs.fname, file->fblock, to->fblock,
+                 file->attrs.is_directory);
+
+  // paths below a directory (or negative ones
+  // below `dest`) go stale
+  _dcache_unlink(fs, src, file);
+  fs_dcache_put(fs->dcache, dest, file);
+
+  // data and subtree stay where they are: only
+  // the two directory blocks change. The new one
+  // goes first, so a crash in between leaves the
+  // entry in both rather than in neither
+  if (to != from) {
+    fs->cwd = to;
+    fs_filesystem_persist_cwd(fs);
+  }
+  fs->cwd = from;
+  fs_filesystem_persist_cwd(fs);
+  if (target)
+    fs_filesystem_persist_sbfatbmp(fs);
+
+  return file;
+}
+
+int fs_filesystem_stats(fs_filesystem_t* fs, char* buf, size_t n)
+{
+  int written = fs_dcache_stats(fs->dcache, buf, n);
+
+  written += snprintf(buf + written, n - written, FS_META_STATS_FORMAT,
+                      (unsigned long long)fs_file_arena_usage(fs->arena),
+                      (unsigned long long)fs->budget,
+                      (unsigned long long)fs->evictions,
+                      (unsigned long long)fs->reloads);
+
+  return written;
+}
+
+int fs_filesystem_df(fs_filesystem_t* fs, char* buf, size_t n)
+{
+  fs_fsinfo_t info = _usage_build(fs, fs->root, fs->root->fblock);
+  char freespace_buf[FS_FSIZE_FORMAT_SIZE] = { 0 };
+  char wastedspace_buf[FS_FSIZE_FORMAT_SIZE] = { 0 };
+  int written = 0;
+
+  // sizes aren't allocations (holes): ask the bitmap
+  fs_utils_fsize2str(fs_bmp_free_count(fs->fat->bmp) * fs->block_size,
+                     freespace_buf, FS_FSIZE_FORMAT_SIZE);
   fs_utils_fsize2str(info.wastedspace, wastedspace_buf, FS_FSIZE_FORMAT_SIZE);
 
   written += snprintf(buf + written, n - written, FS_DF_FORMAT, info.files,
@@ -528,3 +3489,138 @@ int fs_filesystem_df(fs_filesystem_t* fs, char* buf, size_t n)
 
   return written;
 }
+
+int fs_filesystem_du(fs_filesystem_t* fs, const char* path, char* buf,
+                     size_t n)
+{
+  fs_fsinfo_t info;
+  fs_dirent_t dir;
+  char usedspace_buf[FS_FSIZE_FORMAT_SIZE] = { 0 };
+  char wastedspace_buf[FS_FSIZE_FORMAT_SIZE] = { 0 };
+
+  if (!fs_filesystem_stat(fs, path, &dir) || !dir.attrs.is_directory) {
+    fprintf(stderr, "\nDirectory `%s` not found.\n", path);
+
+    return 0;
+  }
+
+  // read from its blocks the first time only:
+  // kept up to date from then on
+  info = _usage_build(fs, NULL, dir.fblock);
+
+  fs_utils_fsize2str(info.usedspace, usedspace_buf, FS_FSIZE_FORMAT_SIZE);
+  fs_utils_fsize2str(info.wastedspace, wastedspace_buf, FS_FSIZE_FORMAT_SIZE);
+
+  return snprintf(buf, n, FS_DU_FORMAT, info.files, info.directories,
+                  usedspace_buf, wastedspace_buf);
+}
+
+typedef struct _scrub_t {
+  fs_filesystem_t* fs;
+  uint64_t next; // first block of the next batch
+  uint64_t bad;
+  fs_scrub_cb cb;
+  void* ctx;
+  pthread_mutex_t cb_lock;
+} _scrub_t;
+
+static void _scrub_report(_scrub_t* scrub, uint32_t block)
+{
+  pthread_mutex_lock(&scrub->cb_lock);
+  scrub->bad++;
+  if (scrub->cb)
+    scrub->cb(block, scrub->ctx);
+  pthread_mutex_unlock(&scrub->cb_lock);
+}
+
+static inline int _in_use(fs_bmp_t* bmp, uint32_t block)
+{
+  return !!FS_BMP_IS_ON_(bmp, block);
+}
+
+// takes FS_READ_BLOCKS blocks at a time, reading
+// all of them from the first to the last in use
+// w/ a single request: big sequential reads keep
+// the disk busy
+static void* _scrub_worker(void* arg)
+{
+  _scrub_t* scrub = arg;
+  fs_filesystem_t* fs = scrub->fs;
+  fs_bmp_t* bmp = fs->fat->bmp;
+  uint8_t* buf = malloc(FS_READ_BLOCKS * FS_BLOCK_SIZE);
+  uint64_t first = 0;
+  uint64_t last = 0;
+  uint64_t end = 0;
+  size_t n = 0;
+
+  PASSERT(buf, FS_ERR_MALLOC);
+
+  // the table itself has no checksums
+  while ((first = __atomic_fetch_add(&scrub->next, FS_READ_BLOCKS,
+                                     __ATOMIC_RELAXED)) < fs->crcs_first) {
+    end = first + FS_READ_BLOCKS < fs->crcs_first ? first + FS_READ_BLOCKS
+                                                  : fs->crcs_first;
+
+    for (; first < end && !_in_use(bmp, first); first++)
+      ;
+    for (last = end; last > first && !_in_use(bmp, last - 1); last--)
+      ;
+    if (first == last)
+      continue;
+
+    n = (last - first) * FS_BLOCK_SIZE;
+    PASSERT(pread(fileno(fs->file), buf, n, _block_offset(fs, first)) ==
+                (ssize_t)n,
+            "pread: ");
+
+    for (uint64_t b = first; b < last; b++)
+      if (_in_use(bmp, b) && fs->crcs[b] != FS_CSUM_UNWRITTEN &&
+          fs_crc32c(0, buf + (b - first) * FS_BLOCK_SIZE, FS_BLOCK_SIZE) !=
+              fs->crcs[b])
+        _scrub_report(scrub, b);
+  }
+
+  free(buf);
+
+  return NULL;
+}
+
+uint64_t fs_filesystem_scrub(fs_filesystem_t* fs, unsigned threads,
+                             fs_scrub_cb cb, void* ctx)
+{
+  pthread_t tids[FS_FIND_THREADS_MAX];
+  _scrub_t scrub = { .fs = fs, .cb = cb, .ctx = ctx };
+  uint8_t crc[4];
+  uint8_t* meta = NULL;
+
+  if (!fs->crcs)
+    return 0;
+
+  threads = fs_find_threads(threads);
+  PASSERT(fflush(fs->file) != EOF, "fflush: ");
+  PASSERT(!pthread_mutex_init(&scrub.cb_lock, NULL), "pthread_mutex_init: ");
+
+  // the caller is a worker too
+  for (unsigned i = 1; i < threads; i++)
+    PASSERT(!pthread_create(&tids[i], NULL, _scrub_worker, &scrub),
+            "pthread_create: ");
+  _scrub_worker(&scrub);
+  for (unsigned i = 1; i < threads; i++)
+    pthread_join(tids[i], NULL);
+
+  meta = malloc(fs->blocks_offset);
+  PASSERT(meta, FS_ERR_MALLOC);
+  PASSERT(pread(fileno(fs->file), meta, fs->blocks_offset, 0) ==
+                  fs->blocks_offset &&
+              pread(fileno(fs->file), crc, 4,
+                    _block_offset(fs, fs->crcs_first) + 4) == 4,
+          "pread: ");
+  if (deserialize_uint32_t(crc) != fs_crc32c(0, meta, fs->blocks_offset))
+    _scrub_report(&scrub, UINT32_MAX);
+  free(meta);
+
+  pthread_mutex_destroy(&scrub.cb_lock);
+  fs->corrupt += scrub.bad;
+
+  return scrub.bad;
+}
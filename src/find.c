@@ -0,0 +1,294 @@
+#include "fssim/find.h"
+
+#include <fnmatch.h>
+#include <sched.h>
+
+typedef struct _find_worker_t {
+  fs_find_t* find;
+  unsigned id;
+  size_t path_size;
+  char* path;
+  uint8_t block[FS_BLOCK_SIZE];
+} _find_worker_t;
+
+static int _match_name(const fs_find_query_t* query, const char* fname)
+{
+  return !query->glob || !fnmatch(query->glob, fname, 0);
+}
+
+static int _match_attrs(const fs_find_query_t* query,
+                        const fs_file_attr_t* attrs)
+{
+  return attrs->size >= query->min_size && attrs->size <= query->max_size &&
+         attrs->mtime >= query->min_mtime && attrs->mtime <= query->max_mtime;
+}
+
+int fs_find_match(const fs_find_query_t* query, const fs_file_attr_t* attrs)
+{
+  char fname[FS_NAME_MAX + 1] = { 0 };
+
+  memcpy(fname, attrs->fname, FS_NAME_MAX);
+
+  return _match_attrs(query, attrs) && _match_name(query, fname);
+}
+
+static void _deque_push(fs_find_deque_t* deque, fs_find_item_t* item)
+{
+  pthread_mutex_lock(&deque->lock);
+
+  if (deque->tail == deque->size) {
+    if (deque->head) {
+      memmove(deque->items, deque->items + deque->head,
+              (deque->tail - deque->head) * sizeof(*deque->items));
+      deque->tail -= deque->head;
+      deque->head = 0;
+    } else {
+      deque->size = deque->size ? deque->size * 2 : FS_FIND_DEQUE_SIZE;
+      deque->items =
+          realloc(deque->items, deque->size * sizeof(*deque->items));
+      PASSERT(deque->items, FS_ERR_MALLOC);
+    }
+  }
+
+  deque->items[deque->tail++] = *item;
+  pthread_mutex_unlock(&deque->lock);
+}
+
+// the owner takes the newest, thieves the oldest
+static int _deque_take(fs_find_deque_t* deque, fs_find_item_t* item,
+                       int steal)
+{
+  int taken = 0;
+
+  pthread_mutex_lock(&deque->lock);
+
+  if ((taken = deque->tail > deque->head)) {
+    *item = steal ? deque->items[deque->head++] : deque->items[--deque->tail];
+
+    if (deque->head == deque->tail)
+      deque->head = deque->tail = 0;
+  }
+
+  pthread_mutex_unlock(&deque->lock);
+
+  return taken;
+}
+
+// whether the subtree of `fblock` may hold a match
+static int _find_may_match(fs_find_t* find, uint32_t fblock)
+{
+  fs_bloom_t* bloom = NULL;
+
+  if (!find->keys_count || !(bloom = fs_bloom_get(find->blooms, fblock)) ||
+      fs_bloom_has_keys(bloom->bits, find->keys, find->keys_count))
+    return 1;
+
+  __atomic_add_fetch(&find->pruned, 1, __ATOMIC_RELAXED);
+
+  return 0;
+}
+
+static void _find_push(_find_worker_t* worker, fs_file_t* dir,
+                       uint32_t fblock, const char* path)
+{
+  fs_find_item_t item = { dir, fblock, NULL };
+
+  if (!_find_may_match(worker->find, fblock))
+    return;
+
+  PASSERT((item.path = strdup(path)), FS_ERR_MALLOC);
+  __atomic_add_fetch(&worker->find->pending, 1, __ATOMIC_ACQ_REL);
+  _deque_push(&worker->find->deques[worker->id], &item);
+}
+
+static int _find_take(_find_worker_t* worker, fs_find_item_t* item)
+{
+  fs_find_t* find = worker->find;
+  unsigned victim = 0;
+
+  if (_deque_take(&find->deques[worker->id], item, 0))
+    return 1;
+
+  for (unsigned i = 1; i < find->threads; i++) {
+    victim = (worker->id + i) % find->threads;
+
+    if (_deque_take(&find->deques[victim], item, 1)) {
+      __atomic_add_fetch(&find->steals, 1, __ATOMIC_RELAXED);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static void _find_emit(fs_find_t* find, const char* path,
+                       const fs_dirent_t* entry)
+{
+  pthread_mutex_lock(&find->cb_lock);
+
+  if (!find->stop) {
+    find->matches++;
+
+    if (find->cb && find->cb(path, entry, find->ctx))
+      __atomic_store_n(&find->stop, 1, __ATOMIC_RELEASE);
+  }
+
+  pthread_mutex_unlock(&find->cb_lock);
+}
+
+// `dir` is the node of `entry` if it's a
+// resident directory
+static void _find_visit(_find_worker_t* worker, size_t parent_len,
+                        const fs_dirent_t* entry, fs_file_t* dir)
+{
+  size_t len = strnlen(entry->attrs.fname, FS_NAME_MAX);
+  char* name = worker->path + parent_len;
+
+  // the parent's path is already in place
+  if (parent_len != 1)
+    *name++ = '/';
+
+  memcpy(name, entry->attrs.fname, len);
+  name[len] = '\0';
+
+  if (_match_attrs(worker->find->query, &entry->attrs) &&
+      _match_name(worker->find->query, name))
+    _find_emit(worker->find, worker->path, entry);
+
+  if (entry->attrs.is_directory)
+    _find_push(worker, dir, entry->fblock, worker->path);
+}
+
+static void _find_expand(_find_worker_t* worker, fs_find_item_t* item)
+{
+  fs_find_t* find = worker->find;
+  size_t parent_len = strlen(item->path);
+  fs_dirent_t entry;
+  fs_file_t* f = NULL;
+  ssize_t n = 0;
+
+  if (worker->path_size < parent_len + FS_NAME_MAX + 2) {
+    worker->path_size = 2 * (parent_len + FS_NAME_MAX + 2);
+    worker->path = realloc(worker->path, worker->path_size);
+    PASSERT(worker->path, FS_ERR_MALLOC);
+  }
+
+  memcpy(worker->path, item->path, parent_len);
+
+  if (item->dir) {
+    for (unsigned i = 0; i < item->dir->children_count; i++) {
+      f = fs_file_child(item->dir, i);
+      entry.fblock = f->fblock;
+      entry.attrs = f->attrs;
+
+      _find_visit(worker, parent_len, &entry,
+                  f->residency == FS_FILE_EVICTED ? NULL : f);
+    }
+
+    return;
+  }
+
+  n = pread(find->fd, worker->block, FS_BLOCK_SIZE,
+            find->blocks_offset + (off_t)item->fblock * FS_BLOCK_SIZE);
+  PASSERT(n >= 0, "pread: ");
+  memset(worker->block + n, 0, FS_BLOCK_SIZE - n);
+
+  for (unsigned i = 0; i < fs_dirblock_count(worker->block); i++) {
+    fs_dirblock_entry(worker->block, i, &entry);
+    _find_visit(worker, parent_len, &entry, NULL);
+  }
+}
+
+static void* _find_worker(void* arg)
+{
+  _find_worker_t* worker = arg;
+  fs_find_t* find = worker->find;
+  fs_find_item_t item;
+
+  while (__atomic_load_n(&find->pending, __ATOMIC_ACQUIRE)) {
+    if (!_find_take(worker, &item)) {
+      sched_yield();
+      continue;
+    }
+
+    // once stopped, just drain
+    if (!__atomic_load_n(&find->stop, __ATOMIC_ACQUIRE))
+      _find_expand(worker, &item);
+
+    free(item.path);
+    __atomic_sub_fetch(&find->pending, 1, __ATOMIC_ACQ_REL);
+  }
+
+  return NULL;
+}
+
+unsigned fs_find_threads(unsigned threads)
+{
+  long cores = 0;
+
+  if (!threads)
+    threads = (cores = sysconf(_SC_NPROCESSORS_ONLN)) > 0 ? cores : 1;
+
+  return threads < FS_FIND_THREADS_MAX ? threads : FS_FIND_THREADS_MAX;
+}
+
+uint64_t fs_find_run(fs_find_t* find, fs_file_t* dir, const char* path)
+{
+  pthread_t tids[FS_FIND_THREADS_MAX];
+  _find_worker_t* workers = NULL;
+  size_t len = strlen(path);
+
+  find->threads = fs_find_threads(find->threads);
+  find->pending = 0;
+  find->stop = 0;
+  find->matches = 0;
+  find->steals = 0;
+  find->pruned = 0;
+  find->keys_count =
+      find->blooms && find->query->glob
+          ? fs_bloom_glob_keys(find->query->glob, find->keys, FS_BLOOM_KEYS_MAX)
+          : 0;
+
+  find->deques = calloc(find->threads, sizeof(*find->deques));
+  PASSERT(find->deques, FS_ERR_MALLOC);
+  workers = calloc(find->threads, sizeof(*workers));
+  PASSERT(workers, FS_ERR_MALLOC);
+  PASSERT(!pthread_mutex_init(&find->cb_lock, NULL), "pthread_mutex_init: ");
+
+  for (unsigned i = 0; i < find->threads; i++) {
+    PASSERT(!pthread_mutex_init(&find->deques[i].lock, NULL),
+            "pthread_mutex_init: ");
+    workers[i].find = find;
+    workers[i].id = i;
+  }
+
+  // "/d/" -> "/d": children get "/d/name"
+  while (len > 1 && path[len - 1] == '/')
+    len--;
+
+  workers[0].path = strndup(path, len);
+  PASSERT(workers[0].path, FS_ERR_MALLOC);
+  _find_push(&workers[0], dir->residency == FS_FILE_EVICTED ? NULL : dir,
+             dir->fblock, workers[0].path);
+  FREE(workers[0].path);
+
+  // the caller is worker 0
+  for (unsigned i = 1; i < find->threads; i++)
+    PASSERT(!pthread_create(&tids[i], NULL, _find_worker, &workers[i]),
+            "pthread_create: ");
+  _find_worker(&workers[0]);
+  for (unsigned i = 1; i < find->threads; i++)
+    pthread_join(tids[i], NULL);
+
+  for (unsigned i = 0; i < find->threads; i++) {
+    pthread_mutex_destroy(&find->deques[i].lock);
+    free(find->deques[i].items);
+    free(workers[i].path);
+  }
+
+  pthread_mutex_destroy(&find->cb_lock);
+  FREE(find->deques);
+  free(workers);
+
+  return find->matches;
+}
@@ -0,0 +1,28 @@
+#include "fssim/fsinfo.h"
+
+fs_fsinfo_map_t* fs_fsinfo_map_create(size_t size)
+{
+  return fs_fbmap_create(size, sizeof(fs_fsinfo_entry_t));
+}
+
+void fs_fsinfo_map_destroy(fs_fsinfo_map_t* map)
+{
+  fs_fbmap_destroy(map);
+}
+
+fs_fsinfo_t* fs_fsinfo_map_get(fs_fsinfo_map_t* map, uint32_t fblock)
+{
+  fs_fsinfo_entry_t* entry = fs_fbmap_get(map, fblock);
+
+  return entry ? &entry->info : NULL;
+}
+
+fs_fsinfo_t* fs_fsinfo_map_put(fs_fsinfo_map_t* map, uint32_t fblock)
+{
+  return &((fs_fsinfo_entry_t*)fs_fbmap_put(map, fblock))->info;
+}
+
+void fs_fsinfo_map_remove(fs_fsinfo_map_t* map, uint32_t fblock)
+{
+  fs_fbmap_remove(map, fblock);
+}
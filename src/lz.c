@@ -0,0 +1,222 @@
+#include "fssim/lz.h"
+
+#define _HASH_SIZE (1 << FS_LZ_HASH_BITS)
+#define _OFFSET_MAX 65535
+
+// matches can't start in the last bytes: they're
+// always literals (as in LZ4, so that the decoder
+// may copy in words)
+#define _LAST_LITERALS 5
+#define _MATCH_LIMIT 12
+
+static inline uint32_t _read32(const uint8_t* p)
+{
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t _read64(const uint8_t* p)
+{
+  uint64_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t _hash(uint32_t seq)
+{
+  return (seq * 2654435761u) >> (32 - FS_LZ_HASH_BITS);
+}
+
+// bytes in common at `a` and `b`, up to `end`
+static inline size_t _common(const uint8_t* a, const uint8_t* b,
+                             const uint8_t* end)
+{
+  const uint8_t* start = b;
+  uint64_t diff = 0;
+
+  while (b + 8 <= end) {
+    if ((diff = _read64(a) ^ _read64(b)))
+      return b - start + (__builtin_ctzll(diff) >> 3);
+    a += 8;
+    b += 8;
+  }
+
+  while (b < end && *a == *b) {
+    a++;
+    b++;
+  }
+
+  return b - start;
+}
+
+static inline uint8_t* _put_length(uint8_t* op, size_t length)
+{
+  for (; length >= 255; length -= 255)
+    *op++ = 255;
+  *op++ = length;
+
+  return op;
+}
+
+// one sequence: literals [anchor, anchor+lits)
+// and, if `match` > 0, a match of that length
+static uint8_t* _put_sequence(uint8_t* op, uint8_t* end, const uint8_t* anchor,
+                              size_t lits, size_t offset, size_t match)
+{
+  size_t ml = match ? match - FS_LZ_MIN_MATCH : 0;
+
+  if ((size_t)(end - op) < 1 + lits / 255 + 1 + lits + 2 + ml / 255 + 1)
+    return NULL;
+
+  *op++ = (lits < 15 ? lits : 15) << 4 | (ml < 15 ? ml : 15);
+  if (lits >= 15)
+    op = _put_length(op, lits - 15);
+  memcpy(op, anchor, lits);
+  op += lits;
+
+  if (!match)
+    return op;
+
+  *op++ = offset & 0xff;
+  *op++ = offset >> 8;
+  if (ml >= 15)
+    op = _put_length(op, ml - 15);
+
+  return op;
+}
+
+size_t fs_lz_compress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap)
+{
+  uint32_t table[_HASH_SIZE] = { 0 };
+  const uint8_t* ip = src;
+  const uint8_t* anchor = src;
+  const uint8_t* ref = NULL;
+  const uint8_t* limit = src + (n > _MATCH_LIMIT ? n - _MATCH_LIMIT : 0);
+  const uint8_t* match_end =
+      src + (n > _LAST_LITERALS ? n - _LAST_LITERALS : 0);
+  uint8_t* op = dst;
+  uint8_t* end = dst + cap;
+  uint32_t h = 0;
+  size_t length = 0;
+
+  while (ip < limit) {
+    h = _hash(_read32(ip));
+    ref = src + table[h];
+    table[h] = ip - src;
+
+    if (ref >= ip || ip - ref > _OFFSET_MAX || _read32(ref) != _read32(ip)) {
+      // the longer w/out a match, the bigger the
+      // steps (incompressible data is skipped fast)
+      ip += 1 + ((ip - anchor) >> 6);
+      continue;
+    }
+
+    // catch up w/ matching bytes right before
+    while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+      ip--;
+      ref--;
+    }
+
+    length = FS_LZ_MIN_MATCH +
+             _common(ref + FS_LZ_MIN_MATCH, ip + FS_LZ_MIN_MATCH, match_end);
+    if (!(op = _put_sequence(op, end, anchor, ip - anchor, ip - ref, length)))
+      return 0;
+
+    ip += length;
+    anchor = ip;
+    if (ip - 2 >= src && ip < limit)
+      table[_hash(_read32(ip - 2))] = ip - 2 - src;
+  }
+
+  if (!(op = _put_sequence(op, end, anchor, src + n - anchor, 0, 0)))
+    return 0;
+
+  return op - dst;
+}
+
+// reads an extended length into `length`.
+// NULL if the input ends first.
+static inline const uint8_t* _get_length(const uint8_t* ip, const uint8_t* end,
+                                         size_t* length)
+{
+  uint8_t b = 0;
+
+  do {
+    if (ip == end)
+      return NULL;
+    b = *ip++;
+    *length += b;
+  } while (b == 255);
+
+  return ip;
+}
+
+ssize_t fs_lz_decompress(const uint8_t* src, size_t n, uint8_t* dst,
+                         size_t cap)
+{
+  const uint8_t* ip = src;
+  const uint8_t* end = src + n;
+  uint8_t* op = dst;
+  uint8_t* op_end = dst + cap;
+  size_t lits = 0;
+  size_t length = 0;
+  size_t offset = 0;
+  uint8_t token = 0;
+
+  while (ip < end) {
+    token = *ip++;
+
+    lits = token >> 4;
+    if (lits == 15 && !(ip = _get_length(ip, end, &lits)))
+      return -1;
+    if ((size_t)(end - ip) < lits || (size_t)(op_end - op) < lits)
+      return -1;
+
+    // short runs are copied in a fixed 16B step
+    // when there's room (the excess is
+    // overwritten)
+    if (lits <= 16 && end - ip >= 16 && op_end - op >= 16)
+      memcpy(op, ip, 16);
+    else
+      memcpy(op, ip, lits);
+    ip += lits;
+    op += lits;
+
+    // the last sequence has no match
+    if (ip == end)
+      break;
+
+    if (end - ip < 2)
+      return -1;
+    offset = ip[0] | ip[1] << 8;
+    ip += 2;
+
+    length = token & 0x0f;
+    if (length == 15 && !(ip = _get_length(ip, end, &length)))
+      return -1;
+    length += FS_LZ_MIN_MATCH;
+
+    if (!offset || offset > (size_t)(op - dst) ||
+        (size_t)(op_end - op) < length)
+      return -1;
+
+    if (offset >= 8 && (size_t)(op_end - op) >= length + 8) {
+      // 8B at a time: never reads what it writes
+      for (size_t i = 0; i < length; i += 8)
+        memcpy(op + i, op + i - offset, 8);
+      op += length;
+    } else if (offset >= length) {
+      memcpy(op, op - offset, length);
+      op += length;
+    } else {
+      // overlapping: repeats the last `offset` bytes
+      for (; length; length--, op++)
+        *op = op[-offset];
+    }
+  }
+
+  return op - dst;
+}
@@ -0,0 +1,283 @@
+#include "fssim/nameidx.h"
+
+// marks unused slots (chained by `next_name`)
+#define _FREE_SLOT UINT32_MAX
+#define _SERIALIZED_ENTRY (FS_NAME_MAX + 1 + 4 + 4)
+
+static inline uint32_t _hash_name(const char* fname, size_t length)
+{
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < length && fname[i]; i++)
+    hash = (hash ^ (uint8_t)fname[i]) * 16777619u;
+
+  return hash;
+}
+
+static inline uint32_t _hash_block(uint32_t fblock)
+{
+  return fblock * 2654435761u;
+}
+
+static inline int _name_eq(const char* stored, const char* fname,
+                           size_t length)
+{
+  return !strncmp(stored, fname, length) &&
+         (length == FS_NAME_MAX || !stored[length]);
+}
+
+static void _link(fs_nameidx_t* idx, uint32_t i)
+{
+  fs_nameidx_entry_t* entry = &idx->entries[i];
+  uint32_t* name = &idx->names[_hash_name(entry->fname, FS_NAME_MAX) &
+                               idx->mask];
+  uint32_t* block = &idx->blocks[_hash_block(entry->fblock) & idx->mask];
+
+  entry->next_name = *name;
+  entry->next_block = *block;
+  *name = *block = i + 1;
+}
+
+// doubles the buckets, rechaining every entry
+static void _rehash(fs_nameidx_t* idx)
+{
+  idx->mask = idx->mask * 2 + 1;
+  free(idx->names);
+  free(idx->blocks);
+  idx->names = calloc(idx->mask + 1, sizeof(*idx->names));
+  idx->blocks = calloc(idx->mask + 1, sizeof(*idx->blocks));
+  PASSERT(idx->names && idx->blocks, FS_ERR_MALLOC);
+
+  for (uint32_t i = 0; i < idx->top; i++)
+    if (idx->entries[i].fblock != _FREE_SLOT)
+      _link(idx, i);
+}
+
+static uint32_t _alloc_slot(fs_nameidx_t* idx)
+{
+  uint32_t slot = 0;
+
+  if (idx->free) {
+    slot = idx->free - 1;
+    idx->free = idx->entries[slot].next_name;
+
+    return slot;
+  }
+
+  if (idx->top == idx->size) {
+    idx->size *= 2;
+    idx->entries = realloc(idx->entries, idx->size * sizeof(*idx->entries));
+    PASSERT(idx->entries, FS_ERR_MALLOC);
+  }
+
+  return idx->top++;
+}
+
+fs_nameidx_t* fs_nameidx_create(uint32_t root)
+{
+  fs_nameidx_t* idx = calloc(1, sizeof(*idx));
+  PASSERT(idx, FS_ERR_MALLOC);
+
+  idx->root = root;
+  idx->size = FS_NAMEIDX_SIZE;
+  idx->mask = FS_NAMEIDX_SIZE - 1;
+  idx->entries = malloc(idx->size * sizeof(*idx->entries));
+  idx->names = calloc(idx->mask + 1, sizeof(*idx->names));
+  idx->blocks = calloc(idx->mask + 1, sizeof(*idx->blocks));
+  PASSERT(idx->entries && idx->names && idx->blocks, FS_ERR_MALLOC);
+
+  return idx;
+}
+
+void fs_nameidx_destroy(fs_nameidx_t* idx)
+{
+  free(idx->entries);
+  free(idx->names);
+  free(idx->blocks);
+  free(idx);
+}
+
+void fs_nameidx_add(fs_nameidx_t* idx, const char* fname, uint32_t fblock,
+                    uint32_t parent, uint8_t is_directory)
+{
+  uint32_t slot = _alloc_slot(idx);
+  fs_nameidx_entry_t* entry = &idx->entries[slot];
+
+  // fixed width, zero-padded, not terminated
+  memset(entry->fname, 0, FS_NAME_MAX);
+  memcpy(entry->fname, fname, strnlen(fname, FS_NAME_MAX));
+  entry->is_directory = is_directory;
+  entry->fblock = fblock;
+  entry->parent = parent;
+  idx->count++;
+
+  if (idx->count > idx->mask + 1)
+    _rehash(idx);
+  else
+    _link(idx, slot);
+}
+
+fs_nameidx_entry_t* fs_nameidx_get(fs_nameidx_t* idx, uint32_t fblock)
+{
+  uint32_t i = idx->blocks[_hash_block(fblock) & idx->mask];
+
+  for (; i; i = idx->entries[i - 1].next_block)
+    if (idx->entries[i - 1].fblock == fblock)
+      return &idx->entries[i - 1];
+
+  return NULL;
+}
+
+int fs_nameidx_remove(fs_nameidx_t* idx, uint32_t fblock)
+{
+  fs_nameidx_entry_t* entry = fs_nameidx_get(idx, fblock);
+  uint32_t slot = 0;
+  uint32_t* link = NULL;
+
+  if (!entry)
+    return 0;
+
+  slot = entry - idx->entries + 1;
+
+  link = &idx->blocks[_hash_block(fblock) & idx->mask];
+  while (*link != slot)
+    link = &idx->entries[*link - 1].next_block;
+  *link = entry->next_block;
+
+  link = &idx->names[_hash_name(entry->fname, FS_NAME_MAX) & idx->mask];
+  while (*link != slot)
+    link = &idx->entries[*link - 1].next_name;
+  *link = entry->next_name;
+
+  entry->fblock = _FREE_SLOT;
+  entry->next_name = idx->free;
+  idx->free = slot;
+  idx->count--;
+
+  return 1;
+}
+
+fs_nameidx_entry_t* fs_nameidx_next(fs_nameidx_t* idx, const char* fname,
+                                    size_t length, fs_nameidx_entry_t* prev)
+{
+  uint32_t i = 0;
+
+  if (length > FS_NAME_MAX)
+    length = FS_NAME_MAX;
+
+  i = prev ? prev->next_name
+           : idx->names[_hash_name(fname, length) & idx->mask];
+
+  for (; i; i = idx->entries[i - 1].next_name)
+    if (_name_eq(idx->entries[i - 1].fname, fname, length))
+      return &idx->entries[i - 1];
+
+  return NULL;
+}
+
+int fs_nameidx_is_below(fs_nameidx_t* idx, fs_nameidx_entry_t* entry,
+                        uint32_t dir)
+{
+  uint32_t parent = entry->parent;
+
+  if (dir == idx->root)
+    return 1;
+
+  // bounded: a corrupt index can't loop forever
+  for (uint32_t depth = 0; depth <= idx->count; depth++) {
+    if (parent == dir)
+      return 1;
+    if (parent == idx->root || !(entry = fs_nameidx_get(idx, parent)))
+      return 0;
+
+    parent = entry->parent;
+  }
+
+  return 0;
+}
+
+int fs_nameidx_path(fs_nameidx_t* idx, fs_nameidx_entry_t* entry, char* buf,
+                    size_t n)
+{
+  fs_nameidx_entry_t* e = entry;
+  size_t length = 0;
+  size_t pos = 0;
+  size_t l = 0;
+  uint32_t depth = 0;
+
+  for (;;) {
+    length += 1 + strnlen(e->fname, FS_NAME_MAX);
+
+    if (e->parent == idx->root)
+      break;
+    if (++depth > idx->count || !(e = fs_nameidx_get(idx, e->parent)))
+      return -1;
+  }
+
+  if (length >= n)
+    return length;
+
+  buf[pos = length] = '\0';
+  for (e = entry;; e = fs_nameidx_get(idx, e->parent)) {
+    l = strnlen(e->fname, FS_NAME_MAX);
+    pos -= l;
+    memcpy(buf + pos, e->fname, l);
+    buf[--pos] = '/';
+
+    if (!pos)
+      break;
+  }
+
+  return length;
+}
+
+size_t fs_nameidx_serialized_size(fs_nameidx_t* idx)
+{
+  return 4 + (size_t)idx->count * _SERIALIZED_ENTRY;
+}
+
+size_t fs_nameidx_serialize(fs_nameidx_t* idx, unsigned char* buf, size_t n)
+{
+  size_t to_write = fs_nameidx_serialized_size(idx);
+  fs_nameidx_entry_t* entry = NULL;
+
+  ASSERT(n >= to_write, "`buf` must at least have %lu bytes remaining. Has %lu",
+         to_write, n);
+
+  buf = serialize_uint32_t(buf, idx->count);
+
+  for (uint32_t i = 0; i < idx->top; i++) {
+    entry = &idx->entries[i];
+
+    if (entry->fblock == _FREE_SLOT)
+      continue;
+
+    memcpy(buf, entry->fname, FS_NAME_MAX);
+    buf = serialize_uint8_t(buf + FS_NAME_MAX, entry->is_directory);
+    buf = serialize_uint32_t(buf, entry->fblock);
+    buf = serialize_uint32_t(buf, entry->parent);
+  }
+
+  return to_write;
+}
+
+fs_nameidx_t* fs_nameidx_load(uint32_t root, unsigned char* buf, size_t n)
+{
+  fs_nameidx_t* idx = NULL;
+  uint32_t count = 0;
+
+  if (n < 4 || (n - 4) / _SERIALIZED_ENTRY !=
+                   (count = deserialize_uint32_t(buf)) ||
+      (n - 4) % _SERIALIZED_ENTRY)
+    return NULL;
+
+  idx = fs_nameidx_create(root);
+  buf += 4;
+
+  for (uint32_t i = 0; i < count; i++, buf += _SERIALIZED_ENTRY)
+    fs_nameidx_add(idx, (char*)buf, deserialize_uint32_t(buf + 12),
+                   deserialize_uint32_t(buf + 16),
+                   deserialize_uint8_t(buf + FS_NAME_MAX));
+
+  return idx;
+}
@@ -0,0 +1,45 @@
+#include "fssim/scratch.h"
+
+fs_scratch_t* fs_scratch_create(size_t size)
+{
+  ASSERT(size, "Size must be at least > 0");
+
+  fs_scratch_t* scratch = malloc(sizeof(*scratch));
+  PASSERT(scratch, FS_ERR_MALLOC);
+
+  scratch->size = size;
+  scratch->used = 0;
+  scratch->buf = malloc(size);
+  PASSERT(scratch->buf, FS_ERR_MALLOC);
+
+  return scratch;
+}
+
+void fs_scratch_destroy(fs_scratch_t* scratch)
+{
+  free(scratch->buf);
+  free(scratch);
+}
+
+void* fs_scratch_alloc(fs_scratch_t* scratch, size_t n)
+{
+  // keep every allocation pointer-aligned
+  size_t start = (scratch->used + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  ASSERT(start + n <= scratch->size,
+         "Scratch exhausted: %lu bytes requested, %lu available", n,
+         scratch->size - start);
+  scratch->used = start + n;
+
+  return scratch->buf + start;
+}
+
+char* fs_scratch_strndup(fs_scratch_t* scratch, const char* str, size_t n)
+{
+  char* dup = fs_scratch_alloc(scratch, n + 1);
+
+  memcpy(dup, str, n);
+  dup[n] = '\0';
+
+  return dup;
+}
@@ -0,0 +1,86 @@
+#include "fssim/slab.h"
+
+fs_slab_t* fs_slab_create(size_t objsize, size_t per_chunk)
+{
+  ASSERT(objsize && per_chunk, "Sizes must be at least > 0");
+
+  fs_slab_t* slab = malloc(sizeof(*slab));
+  PASSERT(slab, FS_ERR_MALLOC);
+
+  // free objects store the free list's next
+  // pointer; keep them pointer-aligned.
+  if (objsize < sizeof(void*))
+    objsize = sizeof(void*);
+  objsize = (objsize + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  slab->objsize = objsize;
+  slab->slotsize = objsize + FS_SLAB_HEADER_SIZE;
+  slab->per_chunk = per_chunk;
+  slab->live = 0;
+  slab->chunks = NULL;
+  slab->chunks_count = 0;
+  slab->chunks_size = 0;
+  slab->bump = per_chunk;
+  slab->freelist = NULL;
+
+  return slab;
+}
+
+void fs_slab_destroy(fs_slab_t* slab)
+{
+  while (slab->chunks_count-- > 0)
+    free(slab->chunks[slab->chunks_count]);
+
+  free(slab->chunks);
+  free(slab);
+}
+
+static void _slab_grow(fs_slab_t* slab)
+{
+  if (slab->chunks_count == slab->chunks_size) {
+    slab->chunks_size = slab->chunks_size ? slab->chunks_size * 2 : 8;
+    slab->chunks =
+        realloc(slab->chunks, slab->chunks_size * sizeof(*slab->chunks));
+    PASSERT(slab->chunks, FS_ERR_MALLOC);
+  }
+
+  slab->chunks[slab->chunks_count] = malloc(slab->slotsize * slab->per_chunk);
+  PASSERT(slab->chunks[slab->chunks_count], FS_ERR_MALLOC);
+
+  slab->chunks_count++;
+  slab->bump = 0;
+}
+
+void* fs_slab_alloc(fs_slab_t* slab)
+{
+  uint8_t* slot = NULL;
+  void* obj = NULL;
+
+  slab->live++;
+
+  // free objects keep their header (id) intact
+  if (slab->freelist) {
+    obj = slab->freelist;
+    slab->freelist = *(void**)obj;
+
+    return obj;
+  }
+
+  if (slab->bump == slab->per_chunk)
+    _slab_grow(slab);
+
+  slot = slab->chunks[slab->chunks_count - 1] + slab->slotsize * slab->bump;
+  *(uint32_t*)slot =
+      (slab->chunks_count - 1) * slab->per_chunk + slab->bump++;
+
+  return slot + FS_SLAB_HEADER_SIZE;
+}
+
+void fs_slab_free(fs_slab_t* slab, void* obj)
+{
+  DASSERT(slab->live > 0, "double free");
+
+  *(void**)obj = slab->freelist;
+  slab->freelist = obj;
+  slab->live--;
+}
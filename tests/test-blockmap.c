@@ -0,0 +1,172 @@
+#include "fssim/blockmap.h"
+#include "fssim/common.h"
+
+void test1()
+{
+  fs_blockmap_t* map = fs_blockmap_create(3);
+
+  ASSERT(map->count == 3, "");
+  ASSERT(fs_blockmap_is_sparse(map), "starts w/ holes");
+
+  map->blocks[0] = 4;
+  map->blocks[1] = 5;
+  map->blocks[2] = 9;
+  ASSERT(!fs_blockmap_is_sparse(map), "");
+
+  fs_blockmap_resize(map, 40);
+  ASSERT(map->count == 40, "");
+  ASSERT(map->blocks[2] == 9, "must keep what it had");
+  ASSERT(map->blocks[39] == FS_BLOCKMAP_HOLE, "grows w/ holes");
+
+  fs_blockmap_resize(map, 2);
+  ASSERT(map->count == 2, "");
+  fs_blockmap_resize(map, 3);
+  ASSERT(map->blocks[2] == FS_BLOCKMAP_HOLE, "shrunk blocks are forgotten");
+
+  fs_blockmap_destroy(map);
+}
+
+void test2()
+{
+  fs_fat_t* fat = fs_fat_create(10);
+  fs_blockmap_t* map = NULL;
+  uint32_t first = 0;
+
+  fs_fat_addfile(fat); // root
+  first = fs_fat_allocfile(fat, 3);
+
+  map = fs_blockmap_from_chain(fat, first, 3);
+  ASSERT(map->count == 3, "");
+  ASSERT(map->blocks[0] == first, "");
+  ASSERT(map->blocks[1] == fat->blocks[first], "");
+  fs_blockmap_destroy(map);
+
+  // the chain ends before the size says it does
+  map = fs_blockmap_from_chain(fat, first, 5);
+  ASSERT(map->count == 3, "actually: %u", map->count);
+  fs_blockmap_destroy(map);
+
+  // single-block chains become a single one
+  map = fs_blockmap_create(3);
+  for (int i = 0; i < 3; i++)
+    map->blocks[i] = fs_fat_addfile(fat);
+  first = fs_blockmap_chain(map, fat);
+  ASSERT(first == map->blocks[0], "");
+  ASSERT(fat->blocks[map->blocks[0]] == map->blocks[1], "");
+  ASSERT(fat->blocks[map->blocks[1]] == map->blocks[2], "");
+  ASSERT(fat->blocks[map->blocks[2]] == map->blocks[2], "");
+  fs_blockmap_destroy(map);
+
+  fs_fat_destroy(fat);
+}
+
+void test3()
+{
+  unsigned char buf[FS_BLOCKMAP_HEADER_SIZE + 4 * 4] = { 0 };
+  fs_blockmap_t* map = fs_blockmap_create(4);
+  fs_blockmap_t* loaded = NULL;
+
+  map->blocks[1] = 7;
+  map->blocks[3] = 8;
+
+  ASSERT(fs_blockmap_serialized_size(map) == sizeof(buf), "");
+  ASSERT(fs_blockmap_serialize(map, buf, sizeof(buf)) == sizeof(buf), "");
+  ASSERT((loaded = fs_blockmap_load(buf, sizeof(buf))), "");
+  ASSERT(loaded->count == 4, "");
+  ASSERT(!memcmp(loaded->blocks, map->blocks, 4 * sizeof(uint32_t)), "");
+  fs_blockmap_destroy(loaded);
+
+  ASSERT(!fs_blockmap_load(buf, sizeof(buf) - 1), "truncated table");
+  buf[0] ^= 0xff;
+  ASSERT(!fs_blockmap_load(buf, sizeof(buf)), "bad magic");
+
+  fs_blockmap_destroy(map);
+}
+
+void test4()
+{
+  ASSERT(fs_blockmap_count_for(0) == 0, "");
+  ASSERT(fs_blockmap_count_for(1) == 1, "");
+  ASSERT(fs_blockmap_count_for(FS_BLOCK_SIZE) == 1, "");
+  ASSERT(fs_blockmap_count_for(FS_BLOCK_SIZE + 1) == 2, "");
+
+  ASSERT(fs_fblock_is_mapped(3 | FS_FBLOCK_MAPPED), "");
+  ASSERT(!fs_fblock_is_mapped(3), "");
+  ASSERT(fs_fblock_chain(3 | FS_FBLOCK_MAPPED) == 3, "");
+}
+
+void test5()
+{
+  unsigned char buf[FS_BLOCKMAP_HEADER_SIZE + 2 * 8] = { 0 };
+  fs_blockmap_t* map = fs_blockmap_create_compressed(1);
+  fs_blockmap_t* loaded = NULL;
+
+  fs_blockmap_resize(map, 2);
+  ASSERT(map->lengths[1] == 0, "grows w/ holes");
+  map->blocks[1] = 7;
+  map->lengths[1] = 1234;
+
+  ASSERT(fs_blockmap_serialized_size(map) == sizeof(buf), "");
+  fs_blockmap_serialize(map, buf, sizeof(buf));
+  ASSERT((loaded = fs_blockmap_load(buf, sizeof(buf))), "");
+  ASSERT(loaded->lengths, "must come back compressed");
+  ASSERT(loaded->count == 2, "");
+  ASSERT(loaded->blocks[1] == 7 && loaded->lengths[1] == 1234, "");
+  ASSERT(!fs_blockmap_load(buf, sizeof(buf) - 4), "truncated table");
+
+  ASSERT(fs_blockmap_clusters_for(FS_CLUSTER_SIZE + 1) == 2, "");
+  ASSERT(fs_fblock_chain(3 | FS_FBLOCK_MAPPED | FS_FBLOCK_COMPRESSED) == 3,
+         "");
+
+  fs_blockmap_destroy(loaded);
+  fs_blockmap_destroy(map);
+}
+
+void test6()
+{
+  unsigned char buf[FS_BLOCKMAP_HEADER_SIZE + 3 * 4] = { 0 };
+  fs_blockmap_t* map = fs_blockmap_create(3);
+  fs_blockmap_t* loaded = NULL;
+
+  map->blocks[0] = 5;
+  map->blocks[1] = 6;
+  map->blocks[2] = 9;
+  ASSERT(!fs_blockmap_is_unwritten(map, 1), "");
+  ASSERT(!fs_blockmap_is_sparse(map), "");
+
+  fs_blockmap_set_unwritten(map, 1, 1);
+  ASSERT(fs_blockmap_is_unwritten(map, 1), "");
+  ASSERT(fs_blockmap_is_sparse(map), "can't be a chain");
+
+  fs_blockmap_serialize(map, buf, sizeof(buf));
+  ASSERT((loaded = fs_blockmap_load(buf, sizeof(buf))), "");
+  ASSERT(loaded->blocks[1] == 6, "the flag isn't part of the block");
+  ASSERT(fs_blockmap_is_unwritten(loaded, 1), "");
+  ASSERT(!fs_blockmap_is_unwritten(loaded, 0), "");
+  ASSERT(!fs_blockmap_is_unwritten(loaded, 2), "");
+
+  // regrown entries don't keep the flag
+  fs_blockmap_resize(loaded, 1);
+  for (uint32_t i = 0; i < 40; i++)
+    fs_blockmap_resize(loaded, i + 2);
+  for (uint32_t i = 1; i < loaded->count; i++)
+    ASSERT(!fs_blockmap_is_unwritten(loaded, i), "%u", i);
+
+  fs_blockmap_set_unwritten(map, 1, 0);
+  ASSERT(!fs_blockmap_is_sparse(map), "");
+
+  fs_blockmap_destroy(loaded);
+  fs_blockmap_destroy(map);
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "create and resize");
+  TEST(test2, "from and to FAT chains");
+  TEST(test3, "table (de)serialization");
+  TEST(test4, "helpers");
+  TEST(test5, "compressed tables");
+  TEST(test6, "unwritten blocks");
+
+  return 0;
+}
@@ -0,0 +1,86 @@
+#include "fssim/bloom.h"
+#include "fssim/common.h"
+
+static int _may_match(const uint8_t* bits, const char* glob)
+{
+  uint32_t keys[FS_BLOOM_KEYS_MAX];
+
+  return fs_bloom_has_keys(bits, keys,
+                           fs_bloom_glob_keys(glob, keys, FS_BLOOM_KEYS_MAX));
+}
+
+void test1()
+{
+  uint32_t keys[FS_BLOOM_KEYS_MAX];
+  uint8_t bits[FS_BLOOM_SIZE] = { 0 };
+  uint8_t other[FS_BLOOM_SIZE] = { 0 };
+
+  ASSERT(fs_bloom_glob_keys(NULL, keys, FS_BLOOM_KEYS_MAX) == 0, "");
+  ASSERT(fs_bloom_glob_keys("*", keys, FS_BLOOM_KEYS_MAX) == 0, "");
+  ASSERT(fs_bloom_glob_keys("a?", keys, FS_BLOOM_KEYS_MAX) == 0, "");
+  ASSERT(fs_bloom_glob_keys("ab", keys, FS_BLOOM_KEYS_MAX) == 1, "name");
+  ASSERT(fs_bloom_glob_keys("abcd", keys, FS_BLOOM_KEYS_MAX) == 3, "");
+  ASSERT(fs_bloom_glob_keys("abcd", keys, 2) == 2, "must be bounded");
+  ASSERT(fs_bloom_glob_keys("*abc*d", keys, FS_BLOOM_KEYS_MAX) == 1, "");
+  ASSERT(fs_bloom_glob_keys("ab[]c]def", keys, FS_BLOOM_KEYS_MAX) == 1, "");
+  ASSERT(fs_bloom_glob_keys("\\*abc", keys, FS_BLOOM_KEYS_MAX) == 2, "");
+
+  // when unsure, no keys: never prune
+  ASSERT(fs_bloom_glob_keys("[[:alpha:]]abc", keys, FS_BLOOM_KEYS_MAX) == 0,
+         "");
+  ASSERT(fs_bloom_glob_keys("abc[d", keys, FS_BLOOM_KEYS_MAX) == 0, "");
+  ASSERT(fs_bloom_glob_keys("abc\\", keys, FS_BLOOM_KEYS_MAX) == 0, "");
+
+  fs_bloom_add(bits, "report.txt");
+  fs_bloom_add(other, "a");
+
+  ASSERT(_may_match(bits, "report.txt"), "");
+  ASSERT(_may_match(bits, "*port*"), "");
+  ASSERT(_may_match(bits, "rep?rt.t*"), "");
+  ASSERT(_may_match(bits, "*"), "");
+  ASSERT(!_may_match(bits, "*zzz*"), "");
+  ASSERT(!_may_match(bits, "a"), "");
+
+  fs_bloom_merge(bits, other);
+  ASSERT(_may_match(bits, "a"), "");
+  ASSERT(_may_match(bits, "*.txt"), "");
+}
+
+void test2()
+{
+  fs_bloom_map_t* map = fs_bloom_map_create(FS_BLOOM_MAP_SIZE);
+  fs_bloom_t* bloom = NULL;
+  const uint32_t n = 4 * FS_BLOOM_MAP_SIZE;
+
+  // grows past its initial slots
+  for (uint32_t i = 0; i < n; i++) {
+    bloom = fs_bloom_put(map, i);
+    ASSERT(bloom->fblock == i && !bloom->stale, "");
+    bloom->bits[0] = i & 0xff;
+  }
+  ASSERT(map->count == n, "");
+  ASSERT(fs_bloom_put(map, 7) == fs_bloom_get(map, 7), "must not duplicate");
+  ASSERT(map->count == n, "");
+
+  // removals keep every other probe chain whole
+  for (uint32_t i = 0; i < n; i += 3)
+    fs_bloom_remove(map, i);
+  fs_bloom_remove(map, n);
+
+  for (uint32_t i = 0; i < n; i++) {
+    bloom = fs_bloom_get(map, i);
+    ASSERT(!bloom == !(i % 3), "%u", i);
+    if (bloom)
+      ASSERT(bloom->bits[0] == (i & 0xff), "%u", i);
+  }
+
+  fs_bloom_map_destroy(map);
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "bloom - names, trigrams and glob keys");
+  TEST(test2, "bloom - map growth and removals");
+
+  return 0;
+}
@@ -209,6 +209,42 @@ void test7()
   free(buf);
 }
 
+void test8()
+{
+  fs_bmp_t* bmp = fs_bmp_create(40);
+  uint32_t first = 0;
+
+  // 0b11111111 0b11011110 0b00000000 ..
+  for (int i = 0; i < 16; i++)
+    fs_bmp_alloc(bmp);
+  fs_bmp_free(bmp, 10);
+  fs_bmp_free(bmp, 15);
+  bmp->last_block = 0;
+
+  ASSERT((first = fs_bmp_alloc_run(bmp, 1)) == 10, "%u", first);
+  ASSERT((first = fs_bmp_alloc_run(bmp, 10)) == 15, "%u", first);
+  ASSERT(bmp->last_block == 25, "");
+  for (uint32_t b = 15; b < 25; b++)
+    ASSERT(FS_BMP_IS_ON_(bmp, b), "%u", b);
+  ASSERT(!FS_BMP_IS_ON_(bmp, 25), "");
+
+  ASSERT(fs_bmp_alloc_run(bmp, 16) == UINT32_MAX, "only 15 left");
+  ASSERT(!FS_BMP_IS_ON_(bmp, 25), "nothing taken");
+
+  // wraps around, finding runs that cross the
+  // cursor
+  fs_bmp_free(bmp, 2);
+  fs_bmp_free(bmp, 3);
+  fs_bmp_free(bmp, 4);
+  ASSERT((first = fs_bmp_alloc_run(bmp, 3)) == 25, "%u", first);
+  ASSERT(fs_bmp_alloc_run(bmp, 12) == 28, "");
+  bmp->last_block = 3;
+  ASSERT((first = fs_bmp_alloc_run(bmp, 3)) == 2, "%u", first);
+  ASSERT(!fs_bmp_free_count(bmp), "");
+
+  fs_bmp_destroy(bmp);
+}
+
 int main(int argc, char* argv[])
 {
   TEST(test1, "creation and deletion");
@@ -218,6 +254,7 @@ int main(int argc, char* argv[])
   TEST(test5, "block alloc - multiple rows");
   TEST(test6, "persistence - serialize");
   TEST(test7, "persistence - load");
+  TEST(test8, "contiguous runs");
 
   return 0;
 }
@@ -0,0 +1,54 @@
+#include "fssim/common.h"
+#include "fssim/crc32c.h"
+
+void test1()
+{
+  const char* check = "123456789";
+  uint8_t zeros[32] = { 0 };
+  uint8_t ones[32];
+
+  memset(ones, 0xff, sizeof(ones));
+
+  // RFC 3720, B.4
+  ASSERT(fs_crc32c(0, check, 9) == 0xe3069283, "%08x",
+         fs_crc32c(0, check, 9));
+  ASSERT(fs_crc32c(0, zeros, 32) == 0x8a9136aa, "");
+  ASSERT(fs_crc32c(0, ones, 32) == 0x62a8ab43, "");
+  ASSERT(fs_crc32c(0, "", 0) == 0, "");
+
+  ASSERT(fs_crc32c_sw(0, check, 9) == 0xe3069283, "");
+  ASSERT(fs_crc32c_sw(0, zeros, 32) == 0x8a9136aa, "");
+}
+
+void test2()
+{
+  size_t n = 3 * FS_BLOCK_SIZE + 5;
+  uint8_t* buf = malloc(n + 1);
+  uint32_t whole = 0;
+
+  ASSERT(buf, "");
+  for (size_t i = 0; i < n + 1; i++)
+    buf[i] = rand();
+
+  whole = fs_crc32c(0, buf + 1, n);
+  ASSERT(fs_crc32c_sw(0, buf + 1, n) == whole, "both paths agree");
+
+  // may be computed in pieces, at any alignment
+  for (size_t cut = 0; cut < 24; cut++)
+    ASSERT(fs_crc32c(fs_crc32c(0, buf + 1, cut), buf + 1 + cut, n - cut) ==
+               whole,
+           "cut at %zu", cut);
+
+  buf[1 + n / 2] ^= 0x10;
+  ASSERT(fs_crc32c(0, buf + 1, n) != whole, "catches a flipped bit");
+
+  free(buf);
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "known values");
+  TEST(test2, "hardware and tables agree, incremental");
+
+  return 0;
+}
@@ -0,0 +1,52 @@
+#include "fssim/common.h"
+#include "fssim/dcache.h"
+
+void test1()
+{
+  char buf[FS_DCACHE_PATH_MAX] = { 0 };
+
+  ASSERT(fs_dcache_normalize("/", buf, FS_DCACHE_PATH_MAX) == 1, "");
+  STRNCMP(buf, "/");
+  ASSERT(fs_dcache_normalize("//tmp///hue/", buf, FS_DCACHE_PATH_MAX) == 8, "");
+  STRNCMP(buf, "/tmp/hue");
+  ASSERT(fs_dcache_normalize("/tmp/hue", buf, 4) == -1, "doesn't fit");
+}
+
+void test2()
+{
+  fs_dcache_t* cache = fs_dcache_create(16);
+  fs_file_t* file = fs_file_create("hue", FS_FILE_REGULAR, NULL);
+  fs_file_t* found = NULL;
+
+  ASSERT(!fs_dcache_get(cache, "/hue", &found), "empty cache");
+  ASSERT(cache->stats.misses == 1, "");
+
+  fs_dcache_put(cache, "/hue", file);
+  fs_dcache_put(cache, "/lol", NULL);
+
+  ASSERT(fs_dcache_get(cache, "//hue/", &found), "normalized hit");
+  ASSERT(found == file, "");
+  ASSERT(fs_dcache_get(cache, "/lol", &found), "negative hit");
+  ASSERT(found == NULL, "");
+  ASSERT(cache->stats.hits == 1, "");
+  ASSERT(cache->stats.negative_hits == 1, "");
+
+  fs_dcache_forget(cache, "/lol");
+  ASSERT(!fs_dcache_get(cache, "/lol", &found), "");
+  ASSERT(fs_dcache_get(cache, "/hue", &found), "");
+
+  fs_dcache_invalidate(cache);
+  ASSERT(!fs_dcache_get(cache, "/hue", &found), "");
+  ASSERT(cache->stats.invalidations == 1, "");
+
+  fs_dcache_destroy(cache);
+  fs_file_destroy(file);
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "path normalization");
+  TEST(test2, "positive and negative entries");
+
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include "fssim/common.h"
+#include "fssim/dedup.h"
+
+void test1()
+{
+  uint8_t a[FS_BLOCK_SIZE] = { 0 };
+  uint8_t b[FS_BLOCK_SIZE] = { 0 };
+  uint64_t hash = fs_dedup_hash(a);
+
+  ASSERT(fs_dedup_hash(b) == hash, "");
+
+  for (size_t i = 0; i < FS_BLOCK_SIZE; i += 509) {
+    b[i] = 1;
+    ASSERT(fs_dedup_hash(b) != hash, "byte %zu changed", i);
+    b[i] = 0;
+  }
+}
+
+void test2()
+{
+  fs_dedup_t* dedup = fs_dedup_create(4, 64);
+
+  ASSERT(fs_dedup_get(dedup, 42) == UINT32_MAX, "");
+
+  for (uint32_t i = 1; i <= 20; i++)
+    fs_dedup_put(dedup, i * 1000003ull, i);
+  ASSERT(dedup->count == 20, "");
+  ASSERT(dedup->mask + 1 >= 40, "must grow");
+
+  for (uint32_t i = 1; i <= 20; i++)
+    ASSERT(fs_dedup_get(dedup, i * 1000003ull) == i, "");
+
+  // replaced
+  fs_dedup_put(dedup, 1000003ull, 30);
+  ASSERT(fs_dedup_get(dedup, 1000003ull) == 30, "");
+  ASSERT(dedup->count == 20, "");
+
+  // forgotten blocks aren't handed out
+  fs_dedup_forget(dedup, 2);
+  ASSERT(!fs_dedup_owns(dedup, 2), "");
+  ASSERT(fs_dedup_get(dedup, 2 * 1000003ull) == UINT32_MAX, "");
+  fs_dedup_forget(dedup, 2);
+  ASSERT(!fs_dedup_owns(dedup, 2), "must be idempotent");
+
+  fs_dedup_destroy(dedup);
+}
+
+void test3()
+{
+  fs_fat_t* fat = fs_fat_create(64);
+  fs_dedup_t* dedup = fs_dedup_create(8, 64);
+  fs_dedup_t* loaded = NULL;
+  unsigned char* buf = NULL;
+  size_t size = 0;
+
+  fs_dedup_put(dedup, 7, 3);
+  fs_dedup_put(dedup, 8, 4);
+  fs_dedup_put(dedup, 9, 5);
+  fs_dedup_forget(dedup, 5);
+  fat->refs[3] = 2;
+  fat->refs[60] = 1;
+
+  size = fs_dedup_serialized_size(dedup, fat);
+  ASSERT(size == 12 + 2 * 12 + 2 * 6, "actually: %zu", size);
+  buf = malloc(size);
+  ASSERT(fs_dedup_serialize(dedup, fat, buf, size) == size, "");
+
+  memset(fat->refs, 0, 64 * sizeof(*fat->refs));
+  ASSERT(!fs_dedup_load(fat, buf, size - 1), "truncated");
+  ASSERT((loaded = fs_dedup_load(fat, buf, size)), "");
+  ASSERT(fs_dedup_get(loaded, 7) == 3, "");
+  ASSERT(fs_dedup_get(loaded, 8) == 4, "");
+  ASSERT(fs_dedup_get(loaded, 9) == UINT32_MAX, "");
+  ASSERT(fat->refs[3] == 2 && fat->refs[60] == 1, "");
+  ASSERT(fat->refs[4] == 0, "");
+
+  free(buf);
+  fs_dedup_destroy(loaded);
+  fs_dedup_destroy(dedup);
+  fs_fat_destroy(fat);
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "block hashes");
+  TEST(test2, "fingerprints");
+  TEST(test3, "(de)serialization w/ reference counts");
+
+  return 0;
+}
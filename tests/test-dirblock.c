@@ -0,0 +1,67 @@
+#include "fssim/common.h"
+#include "fssim/dirblock.h"
+
+void test1()
+{
+  const char* names[] = { "f1", "f10", "f100", "hello.txt", "abcdefghijk" };
+  unsigned char block[FS_BLOCK_SIZE] = { 0 };
+  fs_file_t* dir = fs_file_create("dir", FS_FILE_DIRECTORY, NULL);
+  fs_dirent_t entry;
+  int i = 0;
+
+  for (int k = 0; k < 5; k++) {
+    fs_file_t* f = fs_file_create(names[k], FS_FILE_REGULAR, dir);
+    f->fblock = 10 + k;
+    f->attrs.size = 100 * k;
+    f->attrs.readonly = k % 2;
+    fs_file_addchild(dir, f);
+  }
+  fs_file_serialize_dir(dir, block, FS_BLOCK_SIZE);
+
+  ASSERT(fs_dirblock_count(block) == 5, "");
+
+  for (int k = 0; k < 5; k++) {
+    ASSERT(~(i = fs_dirblock_find(block, names[k], strlen(names[k]))),
+           "`%s` not found", names[k]);
+    fs_dirblock_entry(block, i, &entry);
+    ASSERT(entry.fblock == 10 + k, "actually: %u", entry.fblock);
+    ASSERT(entry.attrs.size == 100 * k, "");
+    ASSERT(!entry.attrs.is_directory, "");
+    ASSERT(entry.attrs.readonly == k % 2, "");
+  }
+
+  ASSERT(!~fs_dirblock_find(block, "f", 1), "prefixes must not match");
+  ASSERT(!~fs_dirblock_find(block, "f1000", 5), "");
+  ASSERT(!~fs_dirblock_find(block, "f10/x", 5), "");
+  ASSERT(~fs_dirblock_find(block, "f10/x", 3), "slices must match");
+  ASSERT(~fs_dirblock_find(block, "abcdefghijklmn", 14),
+         "names are truncated to FS_NAME_MAX");
+
+  fs_file_destroy(dir);
+}
+
+void test2()
+{
+  fs_dirblock_cache_t* cache = fs_dirblock_cache_create(4);
+  uint8_t* slot = fs_dirblock_cache_slot(cache, 3);
+
+  ASSERT(!fs_dirblock_cache_get(cache, 2), "");
+  ASSERT(fs_dirblock_cache_get(cache, 3) == slot, "");
+  ASSERT(!fs_dirblock_cache_get(cache, 7), "same slot, different block");
+
+  fs_dirblock_cache_slot(cache, 7);
+  ASSERT(!fs_dirblock_cache_get(cache, 3), "must have been replaced");
+
+  fs_dirblock_cache_forget(cache, 7);
+  ASSERT(!fs_dirblock_cache_get(cache, 7), "");
+
+  fs_dirblock_cache_destroy(cache);
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "searches raw directory blocks");
+  TEST(test2, "raw directory block cache");
+
+  return 0;
+}
@@ -168,6 +168,52 @@ void test6()
   free(buf);
 }
 
+void test7()
+{
+  fs_fat_t* fat = fs_fat_create(8);
+  uint32_t first = 0;
+
+  fs_fat_addfile(fat);
+  first = fs_fat_allocfile(fat, 5);
+
+  // 1->2->3->4->5->NIL
+  ASSERT(first == 1, "actually: %u", first);
+  for (uint32_t b = 1; b < 5; b++)
+    ASSERT(fat->blocks[b] == b + 1, "");
+  ASSERT(fat->blocks[5] == 5, "must end the chain");
+  ASSERT(fs_bmp_free_count(fat->bmp) == 2, "");
+
+  fs_fat_removefile(fat, first);
+  ASSERT(fs_bmp_free_count(fat->bmp) == 7, "");
+
+  fs_fat_destroy(fat);
+}
+
+void test8()
+{
+  fs_fat_t* fat = fs_fat_create(8);
+  uint32_t first = 0;
+
+  fs_fat_addfile(fat);
+  first = fs_fat_allocfile(fat, 3);
+
+  ASSERT(fs_fat_share(fat, first), "");
+  ASSERT(fs_fat_share(fat, first), "");
+  ASSERT(fat->refs[first] == 2, "");
+
+  // the chain goes away w/ its last reference
+  fs_fat_removefile(fat, first);
+  fs_fat_removefile(fat, first);
+  ASSERT(fs_bmp_free_count(fat->bmp) == 4, "still referenced");
+  fs_fat_removefile(fat, first);
+  ASSERT(fs_bmp_free_count(fat->bmp) == 7, "");
+
+  fat->refs[first] = UINT16_MAX;
+  ASSERT(!fs_fat_share(fat, first), "must not overflow");
+
+  fs_fat_destroy(fat);
+}
+
 int main(int argc, char* argv[])
 {
   TEST(test1, "creation and deletion");
@@ -177,6 +223,8 @@ int main(int argc, char* argv[])
 
   TEST(test5, "persistence - serialize");
   TEST(test6, "persistence - load()");
+  TEST(test7, "allocating whole chains");
+  TEST(test8, "shared chains");
 
   return 0;
 }
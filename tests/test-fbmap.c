@@ -0,0 +1,66 @@
+#include "fssim/common.h"
+#include "fssim/fbmap.h"
+
+typedef struct _entry_t {
+  uint32_t fblock;
+  uint32_t value;
+  uint8_t pad[9];
+} _entry_t;
+
+void test1()
+{
+  fs_fbmap_t* map = fs_fbmap_create(4, sizeof(_entry_t));
+  _entry_t* entry = NULL;
+
+  ASSERT(!fs_fbmap_get(map, 3), "");
+  entry = fs_fbmap_put(map, 3);
+  ASSERT(entry->fblock == 3 && !entry->value && !entry->pad[8], "zeroed");
+  entry->value = 33;
+
+  ASSERT(fs_fbmap_put(map, 3) == entry, "must not duplicate");
+  ASSERT(map->count == 1, "");
+  ASSERT(((_entry_t*)fs_fbmap_get(map, 3))->value == 33, "");
+
+  fs_fbmap_remove(map, 3);
+  fs_fbmap_remove(map, 3);
+  ASSERT(!fs_fbmap_get(map, 3) && !map->count, "");
+
+  fs_fbmap_destroy(map);
+}
+
+void test2()
+{
+  fs_fbmap_t* map = fs_fbmap_create(4, sizeof(_entry_t));
+  _entry_t* entry = NULL;
+  const uint32_t n = 1000;
+
+  // grows past its initial slots, keys colliding
+  // (multiples of the size) included
+  for (uint32_t i = 0; i < n; i++)
+    ((_entry_t*)fs_fbmap_put(map, i * 64))->value = i;
+  ASSERT(map->count == n, "");
+  ASSERT(2 * map->count <= map->mask + 1, "at most half full");
+
+  // removals keep every other probe chain whole
+  for (uint32_t i = 0; i < n; i += 3)
+    fs_fbmap_remove(map, i * 64);
+  fs_fbmap_remove(map, n * 64);
+  ASSERT(map->count == n - (n + 2) / 3, "actually: %zu", map->count);
+
+  for (uint32_t i = 0; i < n; i++) {
+    entry = fs_fbmap_get(map, i * 64);
+    ASSERT(!entry == !(i % 3), "%u", i);
+    if (entry)
+      ASSERT(entry->value == i, "%u", i);
+  }
+
+  fs_fbmap_destroy(map);
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "put, get and remove");
+  TEST(test2, "growth and backward-shift deletion");
+
+  return 0;
+}
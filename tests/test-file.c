@@ -19,17 +19,18 @@ void test1()
 void test2()
 {
   fs_file_t* dir = fs_file_create("/", FS_FILE_DIRECTORY, NULL);
-  fs_file_t* file = fs_file_create("hue.scm", FS_FILE_REGULAR, NULL);
-  fs_file_t* file2 = fs_file_create("other.scm", FS_FILE_REGULAR, NULL);
+  fs_file_t* file = fs_file_create("hue.scm", FS_FILE_REGULAR, dir);
+  fs_file_t* file2 = fs_file_create("other.scm", FS_FILE_REGULAR, dir);
 
   fs_file_addchild(dir, file);
 
   ASSERT(dir->children != NULL, "");
-  ASSERT(dir->children->data == file, "");
+  ASSERT(fs_file_child(dir, 0) == file, "");
 
   fs_file_addchild(dir, file2);
-  ASSERT(dir->children->data == file2, "");
-  ASSERT(dir->children->next->data == file, "");
+  ASSERT(fs_file_child(dir, 0) == file, "");
+  ASSERT(fs_file_child(dir, 1) == file2, "");
+  ASSERT(!strcmp(fs_file_child_name(dir, 1), "other.scm"), "");
   ASSERT(dir->children_count == 2, "");
 
   fs_file_destroy(dir);
@@ -57,8 +58,8 @@ void test3()
 void test4()
 {
   fs_file_t* dir = fs_file_create("/", FS_FILE_DIRECTORY, NULL);
-  fs_file_t* file = fs_file_create("hue.scm", FS_FILE_REGULAR, NULL);
-  fs_file_t* file2 = fs_file_create("other.scm", FS_FILE_REGULAR, NULL);
+  fs_file_t* file = fs_file_create("hue.scm", FS_FILE_REGULAR, dir);
+  fs_file_t* file2 = fs_file_create("other.scm", FS_FILE_REGULAR, dir);
 
   file->attrs.size = 230;
   file->fblock = 32;
@@ -79,8 +80,9 @@ void test4()
 
   ASSERT(dir2->children_count == 2, "");
   ASSERT(dir2->children != NULL, "");
-  fs_file_t* dir2_child1 = (fs_file_t*)dir2->children->data;
-  fs_file_t* dir2_child2 = (fs_file_t*)dir2->children->next->data;
+  // insertion order is retained
+  fs_file_t* dir2_child1 = fs_file_child(dir2, 0);
+  fs_file_t* dir2_child2 = fs_file_child(dir2, 1);
 
   ASSERT(dir2_child1->fblock == 32, "actually: %d", dir2_child1->fblock);
   ASSERT(dir2_child1->attrs.size == 230, "actually: %d",
@@ -98,12 +100,131 @@ void test4()
   free(buf);
 }
 
+void test5()
+{
+  char fname[FS_NAME_MAX] = { 0 };
+  fs_file_t* dir = fs_file_create("/", FS_FILE_DIRECTORY, NULL);
+  fs_file_t* child = NULL;
+
+  ASSERT(fs_file_lookup(dir, "f000") == NULL, "empty dir");
+
+  for (int i = 0; i < FS_DIR_MAX_CHILDREN; i++) {
+    snprintf(fname, FS_NAME_MAX, "f%03d", i);
+    fs_file_addchild(dir, fs_file_create(fname, FS_FILE_REGULAR, dir));
+
+    // lookups before and after the index gets built
+    ASSERT((child = fs_file_lookup(dir, fname)), "%s must be found", fname);
+    ASSERT(!strcmp(child->attrs.fname, fname), "");
+  }
+
+  ASSERT(dir->htable != 0, "wide directories must be indexed");
+  ASSERT(fs_file_lookup(dir, "f999") == NULL, "");
+
+  // remove every other child
+  for (int i = 0; i < FS_DIR_MAX_CHILDREN; i += 2) {
+    snprintf(fname, FS_NAME_MAX, "f%03d", i);
+    ASSERT((child = fs_file_lookup(dir, fname)), "");
+    fs_file_removechild(dir, child);
+    fs_file_destroy(child);
+  }
+
+  ASSERT(dir->children_count == FS_DIR_MAX_CHILDREN / 2, "actually: %d",
+         dir->children_count);
+
+  for (int i = 0; i < FS_DIR_MAX_CHILDREN; i++) {
+    snprintf(fname, FS_NAME_MAX, "f%03d", i);
+    child = fs_file_lookup(dir, fname);
+    ASSERT(i % 2 ? child != NULL : child == NULL, "%s", fname);
+  }
+
+  fs_file_destroy(dir);
+}
+
+void test6()
+{
+  char fname[FS_NAME_MAX] = { 0 };
+  fs_file_arena_t* arena = fs_file_arena_create();
+  fs_file_t* root = fs_file_create_in(arena, "/", FS_FILE_DIRECTORY, NULL);
+  fs_file_t* dir = fs_file_create("d", FS_FILE_DIRECTORY, root);
+  fs_file_t* file = NULL;
+
+  ASSERT(root->arena == arena && dir->arena == arena, "");
+  fs_file_addchild(root, dir);
+
+  for (int i = 0; i < 32; i++) {
+    snprintf(fname, FS_NAME_MAX, "f%02d", i);
+    fs_file_addchild(dir, fs_file_create(fname, FS_FILE_REGULAR, dir));
+  }
+
+  ASSERT(arena->files->live == 34, "actually: %lu", arena->files->live);
+  ASSERT(dir->children_size == 32, "actually: %d", dir->children_size);
+  ASSERT(fs_file_node(arena, fs_file_id(dir)) == dir, "");
+
+  ASSERT((file = fs_file_lookup(dir, "f07")), "");
+  fs_file_removechild(dir, file);
+  fs_file_destroy(file);
+
+  ASSERT(arena->files->live == 33, "");
+  ASSERT(!fs_file_lookup(dir, "f07"), "");
+  ASSERT(fs_file_lookup(dir, "f08") == fs_file_child(dir, 7), "");
+
+  // freed nodes are reused
+  ASSERT(fs_file_create("new", FS_FILE_REGULAR, dir) == file, "");
+
+  // releases everything at once
+  fs_file_arena_destroy(arena);
+}
+
+void test7()
+{
+  unsigned char* buf = NULL;
+  size_t size = 0;
+  fs_file_arena_t* arena = fs_file_arena_create();
+  fs_file_t* root = fs_file_create_in(arena, "/", FS_FILE_DIRECTORY, NULL);
+  fs_file_t* dir = fs_file_create("d", FS_FILE_DIRECTORY, root);
+  fs_file_t* sub = fs_file_create("sub", FS_FILE_DIRECTORY, dir);
+  fs_file_t* file = fs_file_create("f", FS_FILE_REGULAR, root);
+  fs_file_t* copy = NULL;
+
+  fs_file_addchild(root, dir);
+  fs_file_addchild(root, file);
+  fs_file_addchild(dir, sub);
+  fs_file_addchild(dir, fs_file_create("g", FS_FILE_REGULAR, dir));
+  dir->fblock = 3;
+  file->attrs.size = 1234;
+
+  size = fs_file_tree_size(root);
+  ASSERT(size == 3 + 4 * FS_OFFSET_FILE_ENTRY, "actually: %lu", size);
+  buf = calloc(size, 1);
+  ASSERT(fs_file_serialize_tree(root, buf, size) == size, "");
+
+  copy = fs_file_create_in(arena, "/", FS_FILE_DIRECTORY, NULL);
+  ASSERT(fs_file_load_tree(copy, buf, size) == size, "");
+  ASSERT(copy->children_count == 2, "");
+  ASSERT((dir = fs_file_lookup(copy, "d")) && dir->fblock == 3, "");
+  ASSERT(fs_file_lookup(copy, "f")->attrs.size == 1234, "");
+  ASSERT(fs_file_lookup(dir, "g")->parent == dir, "");
+  ASSERT(fs_file_lookup(dir, "sub")->children_count == 0, "");
+
+  // truncated input is rejected
+  ASSERT(!fs_file_load_tree(fs_file_create_in(arena, "/", FS_FILE_DIRECTORY,
+                                              NULL),
+                            buf, size - 1),
+         "");
+
+  free(buf);
+  fs_file_arena_destroy(arena);
+}
+
 int main(int argc, char* argv[])
 {
   TEST(test1, "directory file - creation and deletion");
   TEST(test2, "directory file - addchild");
   TEST(test3, "directory file - (de)serialization - only root");
   TEST(test4, "directory file - (de)serialization - flat dir w/ files");
+  TEST(test5, "directory file - indexed lookup and removal");
+  TEST(test6, "directory file - arena-backed tree");
+  TEST(test7, "directory file - whole tree (de)serialization");
 
   return 0;
 }
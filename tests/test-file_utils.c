@@ -137,7 +137,7 @@ void test8()
 
 void test9()
 {
-  const char* FNAME = "test9-file";
+  const char* FNAME = "/tmp/test9-file";
 
   fs_utils_fdelete(FNAME);
   FILE* f = fs_utils_mkfile(FNAME, 100 * FS_MEGABYTE);
@@ -174,6 +174,48 @@ void test11()
   ASSERT(!strcmp(expected, buf), "%s != %s", expected, buf);
 }
 
+void test12()
+{
+  const char input[] = "//bin/ls//hue/lol.txt/";
+  const char* expected[] = { "bin", "ls", "hue", "lol.txt" };
+  fs_path_iter_t it;
+  unsigned count = 0;
+
+  fs_utils_pathiter(&it, input);
+  while (fs_utils_pathnext(&it)) {
+    ASSERT(count < 4, "too many components");
+    ASSERT(it.length == strlen(expected[count]), "%lu != %lu", it.length,
+           strlen(expected[count]));
+    ASSERT(!strncmp(it.name, expected[count], it.length), "");
+    ASSERT(it.name >= input && it.name < input + sizeof(input),
+           "must point into the original string");
+    count++;
+  }
+
+  ASSERT(count == 4, "actually: %u", count);
+
+  fs_utils_pathiter(&it, "/");
+  ASSERT(!fs_utils_pathnext(&it), "root has no components");
+}
+
+void test13()
+{
+  uint8_t buf[FS_BLOCK_SIZE] = { 0 };
+
+  ASSERT(fs_utils_iszero(buf, sizeof(buf)), "");
+  ASSERT(fs_utils_iszero(buf, 64), "");
+
+  for (size_t i = 0; i < sizeof(buf); i += 331) {
+    buf[i] = 1;
+    ASSERT(!fs_utils_iszero(buf, sizeof(buf)), "byte %zu set", i);
+    buf[i] = 0;
+  }
+
+  buf[sizeof(buf) - 1] = 0x80;
+  ASSERT(!fs_utils_iszero(buf, sizeof(buf)), "");
+  ASSERT(fs_utils_iszero(buf, sizeof(buf) - 64), "only looks at `n` bytes");
+}
+
 int main(int argc, char* argv[])
 {
   TEST(test1, "splits path accordingly");
@@ -187,6 +229,8 @@ int main(int argc, char* argv[])
   TEST(test9, "file allocation");
   TEST(test10, "splits path - trailing slash");
   TEST(test11, "human file size utilities - 0 Bytes");
+  TEST(test12, "iterates over path components w/o copying");
+  TEST(test13, "detects blocks of zeros");
 
   return 0;
 }
@@ -2,7 +2,21 @@
 #include "fssim/filesystem.h"
 #include "fssim/fsinfo.h"
 
+#include <sys/wait.h>
+
 #define FS_TEST_FNAME "/tmp/test-fssim"
+// scratch files on the host, out of the tree
+#define FS_TEST_DIR "/tmp/"
+
+// fs_filesystem_ls() into a buffer
+static void _ls(fs_filesystem_t* fs, const char* path, char* buf, size_t n)
+{
+  FILE* out = fmemopen(buf, n, "w");
+
+  PASSERT(out, "fmemopen: ");
+  fs_filesystem_ls(fs, path, out);
+  fclose(out);
+}
 
 void test1()
 {
@@ -40,7 +54,7 @@ void test3()
   fs_filesystem_t* fs = fs_filesystem_create(10);
   fs_utils_fdelete(FS_TEST_FNAME);
   fs_filesystem_mount(fs, FS_TEST_FNAME);
-  fs_filesystem_ls(fs, "/", buf, BUFSIZE);
+  _ls(fs, "/", buf, BUFSIZE);
 
   ASSERT(!strcmp(buf, expected), "\n`\n%s`\n != \n`\n%s`\n", buf, expected);
 
@@ -57,7 +71,7 @@ void test4()
   fs_filesystem_touch(fs, "/file.txt");
 
   ASSERT(
-      !strcmp(((fs_file_t*)fs->root->children->data)->attrs.fname, "file.txt"),
+      !strcmp(fs_file_child(fs->root, 0)->attrs.fname, "file.txt"),
       "Child file must have the correct filename");
 
   fs_filesystem_destroy(fs);
@@ -88,7 +102,7 @@ void test8()
                          "f   4.0KB 1969-12-31 21:00 lol.txt   \n"
                          "f   4.0KB 1969-12-31 21:00 hue.txt   \n";
   const unsigned BUFSIZE = FS_LS_FORMAT_SIZE * 4;
-  char buf[BUFSIZE] = { 0 };
+  char buf[FS_LS_FORMAT_SIZE * 4] = { 0 };
 
   fs_filesystem_t* fs = fs_filesystem_create(10);
   fs_utils_fdelete(FS_TEST_FNAME);
@@ -96,7 +110,7 @@ void test8()
   fs_filesystem_mount(fs, FS_TEST_FNAME);
   fs_filesystem_touch(fs, "/hue.txt");
   fs_filesystem_touch(fs, "/lol.txt");
-  fs_filesystem_ls(fs, "/", buf, BUFSIZE);
+  _ls(fs, "/", buf, BUFSIZE);
 
   ASSERT(!strcmp(buf, expected), "\n`\n%s`\n != \n`\n%s`\n", buf, expected);
 
@@ -245,7 +259,7 @@ static void _write_dumb_file(const char* fname, size_t size)
 void test14()
 {
   fs_file_t* file = NULL;
-  const char* FNAME = "test14f";
+  const char* FNAME = FS_TEST_DIR "test14f";
   const char* FNAME_FS = "/test14f";
   fs_filesystem_t* fs = fs_filesystem_create(10);
   _write_dumb_file(FNAME, 1 * FS_KILOBYTE);
@@ -254,7 +268,8 @@ void test14()
   fs_filesystem_mount(fs, FS_TEST_FNAME);
   fs_filesystem_cp(fs, FNAME, FNAME_FS);
 
-  ASSERT((file = fs_filesystem_find(fs, "/", FNAME)), "file must be present");
+  ASSERT((file = fs_filesystem_find(fs, "/", FNAME_FS + 1)),
+         "file must be present");
   ASSERT(file->fblock > 0, "0 reserved to root");
   ASSERT(fs->fat->blocks[file->fblock] == file->fblock,
          "single block - small file");
@@ -267,7 +282,7 @@ void test14()
 void test15()
 {
   fs_file_t* file = NULL;
-  const char* FNAME = "test15-f";
+  const char* FNAME = FS_TEST_DIR "test15-f";
   const char* FNAME_FS = "/test15-f";
   fs_filesystem_t* fs = fs_filesystem_create(300); // 300 blocks
   _write_dumb_file(FNAME, 1 * FS_MEGABYTE);
@@ -277,7 +292,8 @@ void test15()
   fs_filesystem_mount(fs, FS_TEST_FNAME);
   fs_filesystem_cp(fs, FNAME, FNAME_FS);
 
-  ASSERT((file = fs_filesystem_find(fs, "/", FNAME)), "file must be present");
+  ASSERT((file = fs_filesystem_find(fs, "/", FNAME_FS + 1)),
+         "file must be present");
   ASSERT(file->fblock > 0, "0 reserved to root");
   ASSERT(fs->fat->blocks[file->fblock] != file->fblock,
          "more than one block to the file");
@@ -302,7 +318,8 @@ void test15()
   fs_filesystem_mount(fs, FS_TEST_FNAME);
 
   ASSERT(fs->root->children_count == 1, "");
-  ASSERT((file = fs_filesystem_find(fs, "/", FNAME)), "file must be present");
+  ASSERT((file = fs_filesystem_find(fs, "/", FNAME_FS + 1)),
+         "file must be present");
   ASSERT(file->attrs.size == 1 * FS_MEGABYTE, "actual: %d", file->attrs.size);
   ASSERT(file->fblock > 0, "0 reserved to root");
   ASSERT(fs->fat->blocks[file->fblock] != file->fblock,
@@ -313,9 +330,9 @@ void test15()
 
 void test16()
 {
-  const char* FNAME_IN = "17-in";
+  const char* FNAME_IN = FS_TEST_DIR "17-in";
   const char* FNAME_IN_FS = "/17-in";
-  const char* FNAME_OUT = "17-out";
+  const char* FNAME_OUT = FS_TEST_DIR "17-out";
   uint8_t block_buf[FS_BLOCK_SIZE];
   int blocks = 1;
   FILE* fout = NULL;
@@ -359,7 +376,7 @@ void test17()
   fs_filesystem_mkdir(fs, "/tmp");
   ASSERT(fs->root->children_count == 1, "");
 
-  tmp_dir = (fs_file_t*)fs->root->children->data;
+  tmp_dir = fs_file_child(fs->root, 0);
   ASSERT(tmp_dir->attrs.is_directory == 1, "");
   ASSERT(tmp_dir->attrs.size == 4096, "");
   ASSERT(!strcmp(tmp_dir->attrs.fname, "tmp"), "%s is not the expected",
@@ -372,7 +389,7 @@ void test17()
   fs_filesystem_mount(fs, FS_TEST_FNAME);
   ASSERT(fs->root->children_count == 1, "");
 
-  tmp_dir = (fs_file_t*)fs->root->children->data;
+  tmp_dir = fs_file_child(fs->root, 0);
   ASSERT(!strcmp(tmp_dir->attrs.fname, "tmp"), "%s is not the expected",
          tmp_dir->attrs.fname);
 
@@ -397,7 +414,7 @@ void test18()
   ASSERT(!strcmp(tmp_dir->attrs.fname, "tmp"), "");
   ASSERT(tmp_dir->children_count == 1, "");
   ASSERT(
-      !strcmp(((fs_file_t*)(tmp_dir->children->data))->attrs.fname, "hue.br"),
+      !strcmp(fs_file_child(tmp_dir, 0)->attrs.fname, "hue.br"),
       "");
 
   ASSERT(fs_filesystem_find(fs, "/tmp", "hue.br"), "");
@@ -458,10 +475,11 @@ void test20()
 {
   const char* expected = "Files:              0\n"
                          "Directories:        4\n"
-                         "Free Space:     384.0KB\n"
+                         "Free Space:     376.0KB\n"
                          "Wasted Space:     0.0 B\n";
   char buf[FS_DF_FORMAT_SIZE] = { 0 };
-  // 100 blocks ==> 4KB * 100 ==> 400KB.
+  // 100 blocks ==> 4KB * 100 ==> 400KB. 6 in use
+  // (root, the 4 directories and the checksums).
   fs_filesystem_t* fs = fs_filesystem_create(100);
 
   fs_utils_fdelete(FS_TEST_FNAME);
@@ -481,7 +499,7 @@ void test20()
 void test21()
 {
   fs_file_t* file = NULL;
-  const char* FNAME = "test21f";
+  const char* FNAME = FS_TEST_DIR "test21f";
   const char* FNAME_FS = "/test21f";
   fs_filesystem_t* fs = fs_filesystem_create(10);
   _write_dumb_file(FNAME, 1 * FS_KILOBYTE);
@@ -491,7 +509,8 @@ void test21()
   fs_filesystem_cp(fs, FNAME, FNAME_FS);
   fs_filesystem_mkdir(fs, "/lol");
 
-  ASSERT((file = fs_filesystem_find(fs, "/", FNAME)), "file must be present");
+  ASSERT((file = fs_filesystem_find(fs, "/", FNAME_FS + 1)),
+         "file must be present");
   ASSERT(file->attrs.size == 1 * FS_KILOBYTE, "has the correct size");
 
   fs_filesystem_destroy(fs);
@@ -500,7 +519,8 @@ void test21()
   fs = fs_filesystem_create(0);
   fs_filesystem_mount(fs, FS_TEST_FNAME);
 
-  ASSERT((file = fs_filesystem_find(fs, "/", FNAME)), "file must be present");
+  ASSERT((file = fs_filesystem_find(fs, "/", FNAME_FS + 1)),
+         "file must be present");
   ASSERT(file->attrs.size == 1 * FS_KILOBYTE, "has the correct size");
   ASSERT((file = fs_filesystem_find(fs, "/", "lol")), "dir must be present");
   ASSERT(file->attrs.is_directory, "dir must be dir");
@@ -524,7 +544,7 @@ void test22()
   fs_filesystem_mount(fs, FS_TEST_FNAME);
   fs_filesystem_mkdir(fs, "/lol");
   fs_filesystem_mkdir(fs, "/lol/hue");
-  fs_filesystem_ls(fs, "/lol", buf, BUFSIZE);
+  _ls(fs, "/lol", buf, BUFSIZE);
 
   STRNCMP(buf, expected);
 
@@ -546,8 +566,7 @@ void test23()
   fs_filesystem_touch(fs, "/d00/f98");
   fs_filesystem_touch(fs, "/d00/f97");
   fs_filesystem_mkdir(fs, "/d00/d01");
-  LOGERR("%s", ((fs_file_t*)(((fs_file_t*)fs->root->children->data)
-                                 ->children->data))->attrs.fname);
+  LOGERR("%s", fs_file_child(fs_file_child(fs->root, 0), 0)->attrs.fname);
   fs_filesystem_touch(fs, "/d00/d01/f02");
   fs_filesystem_mkdir(fs, "/d00/d01/d02");
   fs_filesystem_touch(fs, "/d00/d01/d02/f03");
@@ -570,6 +589,1901 @@ void test23()
   fs_filesystem_destroy(fs);
 }
 
+void test24()
+{
+  char path[32] = { 0 };
+  fs_filesystem_t* fs = fs_filesystem_create(300); // 300 blocks
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+
+  fs_filesystem_mkdir(fs, "/a");
+  fs_filesystem_mkdir(fs, "/a/b");
+  for (int i = 0; i < 64; i++) {
+    snprintf(path, 32, "/a/b/f%02d", i);
+    fs_filesystem_touch(fs, path);
+  }
+
+  ASSERT(fs_filesystem_find(fs, "/a/b", "f00"), "");
+  ASSERT(fs_filesystem_find(fs, "/a/b", "f63"), "");
+  ASSERT(!fs_filesystem_find(fs, "/a/b", "f64"), "");
+  ASSERT(!fs_filesystem_find(fs, "/a/c", "f00"), "");
+
+  ASSERT(fs_filesystem_rm(fs, "/a/b/f10"), "");
+  ASSERT(!fs_filesystem_find(fs, "/a/b", "f10"), "");
+  ASSERT(fs_filesystem_find(fs, "/a/b", "f11"), "");
+  fs_filesystem_destroy(fs);
+
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+
+  ASSERT(fs_filesystem_find(fs, "/a/b", "f63"), "");
+  ASSERT(!fs_filesystem_find(fs, "/a/b", "f10"), "");
+  ASSERT(fs_filesystem_rmdir(fs, "/a"), "");
+  ASSERT(fs->root->children_count == 0, "");
+
+  fs_filesystem_destroy(fs);
+}
+
+void test25()
+{
+  char buf[FS_STATS_FORMAT_SIZE] = { 0 };
+  fs_filesystem_t* fs = fs_filesystem_create(300); // 300 blocks
+  fs_file_t* file = NULL;
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+
+  ASSERT(!fs_filesystem_lookup(fs, "/tmp/hue"), "");
+  ASSERT(!fs_filesystem_lookup(fs, "/tmp/hue"), "");
+  ASSERT(fs->dcache->stats.negative_hits == 1, "");
+
+  fs_filesystem_mkdir(fs, "/tmp");
+  ASSERT(!fs_filesystem_touch(fs, "/nope/hue"), "parent must exist");
+  ASSERT(!fs_filesystem_mkdir(fs, "/tmp"), "already there");
+  file = fs_filesystem_touch(fs, "/tmp/hue");
+
+  ASSERT(fs_filesystem_lookup(fs, "/tmp/hue") == file, "negative entry dropped");
+  ASSERT(fs_filesystem_touch(fs, "/tmp/hue") == file, "touch doesn't dup");
+  ASSERT(fs_filesystem_lookup(fs, "/tmp")->children_count == 1, "");
+
+  ASSERT(fs_filesystem_rmdir(fs, "/tmp"), "");
+  ASSERT(!fs_filesystem_lookup(fs, "/tmp"), "");
+  ASSERT(!fs_filesystem_lookup(fs, "/tmp/hue"), "no dangling entries");
+
+  fs_filesystem_stats(fs, buf, FS_STATS_FORMAT_SIZE);
+  ASSERT(strstr(buf, "Hit rate"), "%s", buf);
+
+  fs_filesystem_destroy(fs);
+}
+
+static unsigned _used_blocks(fs_filesystem_t* fs)
+{
+  unsigned used = 0;
+
+  for (unsigned i = 0; i < fs->fat->bmp->num_blocks; i++)
+    used += !!CHECK_LBIT(fs->fat->bmp->mapping[i / 8], i % 8);
+
+  return used;
+}
+
+void test26()
+{
+  char path[32] = { 0 };
+  char df_full[FS_DF_FORMAT_SIZE] = { 0 };
+  char df[FS_DF_FORMAT_SIZE] = { 0 };
+  fs_fsinfo_t info = { 0 };
+  size_t full = 0;
+  size_t slack = 0;
+  unsigned used = 0;
+  fs_filesystem_t* fs = fs_filesystem_create(600);
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  for (int i = 0; i < 16; i++) {
+    snprintf(path, 32, "/d%02d", i);
+    fs_filesystem_mkdir(fs, path);
+    for (int j = 0; j < 30; j++) {
+      snprintf(path, 32, "/d%02d/f%02d", i, j);
+      fs_filesystem_touch(fs, path);
+    }
+  }
+  full = fs_file_arena_usage(fs->arena);
+  slack = full / 8; // a couple of directories
+  fs_filesystem_df(fs, df_full, FS_DF_FORMAT_SIZE);
+  used = _used_blocks(fs);
+  fs_filesystem_persist_sbfatbmp(fs); // touch/mkdir only persist the dir
+  fs_filesystem_destroy(fs);
+
+  fs = fs_filesystem_create(0);
+  fs_filesystem_set_budget(fs, full / 4);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+
+  ASSERT(fs_file_arena_usage(fs->arena) < full / 4, "must load lazily");
+  ASSERT(fs_file_child(fs->root, 0)->residency == FS_FILE_EVICTED, "");
+
+  for (int r = 0; r < 2; r++) {
+    for (int i = 0; i < 16; i++) {
+      snprintf(path, 32, "/d%02d", i);
+      ASSERT(fs_filesystem_find(fs, path, "f29"), "%s/f29", path);
+      ASSERT(fs_file_arena_usage(fs->arena) <= full / 4 + slack,
+             "%lu over budget", fs_file_arena_usage(fs->arena) - full / 4);
+    }
+  }
+
+  ASSERT(fs->evictions > 0, "");
+  ASSERT(fs->reloads >= 16, "actually: %llu", (unsigned long long)fs->reloads);
+
+  fs_filesystem_df(fs, df, FS_DF_FORMAT_SIZE);
+  ASSERT(!strcmp(df, df_full), "\n%s\n!=\n%s", df, df_full);
+  ASSERT(fs_file_arena_usage(fs->arena) <= full / 4 + slack, "");
+
+  // d00 (evicted by now) must keep its entries
+  ASSERT(fs_file_child(fs->root, 0)->residency == FS_FILE_EVICTED, "");
+  ASSERT(fs_filesystem_touch(fs, "/d00/new"), "");
+  ASSERT(fs_file_child(fs->root, 1)->residency == FS_FILE_EVICTED, "");
+  ASSERT(fs_filesystem_rmdir(fs, "/d01"), "");
+  ASSERT(_used_blocks(fs) == used + 1 - 31, "blocks of d01 must be freed");
+  fs_filesystem_destroy(fs);
+
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  fs_fsinfo_calculate(&info, fs->root);
+
+  ASSERT(fs_filesystem_lookup(fs, "/d00")->children_count == 31, "");
+  ASSERT(fs_filesystem_lookup(fs, "/d00/f00"), "");
+  ASSERT(!fs_filesystem_lookup(fs, "/d01"), "");
+  ASSERT(info.files == 15 * 30 + 1, "actually: %d", info.files);
+  ASSERT(info.directories == 15, "actually: %d", info.directories);
+
+  fs_filesystem_destroy(fs);
+}
+
+void test27()
+{
+  fs_filesystem_t* fs = fs_filesystem_create(300);
+  fs_dirent_t entry;
+  size_t usage = 0;
+  uint64_t reloads = 0;
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  fs_filesystem_mkdir(fs, "/a");
+  fs_filesystem_mkdir(fs, "/a/b");
+  fs_filesystem_mkdir(fs, "/a/b/empty");
+  fs_filesystem_touch(fs, "/a/b/file");
+  fs_filesystem_destroy(fs);
+
+  fs = fs_filesystem_create(0);
+  fs_filesystem_set_budget(fs, 1 << 20);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  usage = fs_file_arena_usage(fs->arena);
+
+  ASSERT(fs_filesystem_stat(fs, "/a/b/file", &entry), "");
+  ASSERT(!entry.attrs.is_directory, "");
+  ASSERT(!strcmp(entry.attrs.fname, "file"), "");
+  ASSERT(fs_filesystem_stat(fs, "/a/b", &entry), "");
+  ASSERT(entry.attrs.is_directory, "");
+  ASSERT(fs_filesystem_stat(fs, "/", &entry), "");
+  ASSERT(!fs_filesystem_stat(fs, "/a/b/nope", &entry), "");
+  ASSERT(!fs_filesystem_stat(fs, "/a/b/file/x", &entry), "");
+  ASSERT(!fs_filesystem_stat(fs, "/a/b/empty/x", &entry), "");
+
+  ASSERT(fs->reloads == 0, "must not materialize evicted directories");
+  ASSERT(fs_file_arena_usage(fs->arena) == usage, "");
+
+  // once resident, the tree answers
+  ASSERT(fs_filesystem_lookup(fs, "/a/b/file"), "");
+  reloads = fs->reloads;
+  ASSERT(fs_filesystem_stat(fs, "/a/b/file", &entry), "");
+  ASSERT(fs->reloads == reloads, "");
+
+  // raw blocks are kept coherent w/ writes
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_set_budget(fs, 1 << 20);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+
+  ASSERT(!fs_filesystem_stat(fs, "/a/b/new", &entry), "");
+  ASSERT(fs_filesystem_touch(fs, "/a/b/new"), "");
+  fs_filesystem_set_budget(fs, 1); // evicts everything it can
+  ASSERT(fs_filesystem_stat(fs, "/a/b/new", &entry), "");
+  ASSERT(fs_filesystem_rmdir(fs, "/a/b"), "");
+  fs_filesystem_set_budget(fs, 1);
+  ASSERT(!fs_filesystem_stat(fs, "/a/b/new", &entry), "");
+
+  fs_filesystem_destroy(fs);
+}
+
+// reads the flags, first block and size of the
+// snapshot straight from the root block header
+static int _root_header(off_t blocks_offset, uint32_t* first, uint32_t* size)
+{
+  uint8_t header[9] = { 0 };
+  FILE* f = fopen(FS_TEST_FNAME, "rb");
+
+  ASSERT(f, "");
+  fseek(f, blocks_offset + FS_ROOT_FLAGS_OFFSET, SEEK_SET);
+  ASSERT(fread(header, 1, 9, f) == 9, "");
+  fclose(f);
+  *first = deserialize_uint32_t(header + 1);
+  *size = deserialize_uint32_t(header + 5);
+
+  return header[0] & FS_ROOT_FLAG_CLEAN;
+}
+
+void test28()
+{
+  char path[32] = { 0 };
+  char ls[FS_LS_FORMAT_SIZE * 32] = { 0 };
+  char ls_before[FS_LS_FORMAT_SIZE * 32] = { 0 };
+  char df[FS_DF_FORMAT_SIZE] = { 0 };
+  char df_before[FS_DF_FORMAT_SIZE] = { 0 };
+  unsigned used = 0;
+  uint32_t first = 0;
+  uint32_t size = 0;
+  off_t blocks_offset = 0;
+  FILE* f = NULL;
+  int c = 0;
+  fs_filesystem_t* fs = fs_filesystem_create(300);
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  blocks_offset = fs->blocks_offset;
+  for (int i = 0; i < 8; i++) {
+    snprintf(path, 32, "/d%d", i);
+    fs_filesystem_mkdir(fs, path);
+    for (int j = 0; j < 20; j++) {
+      snprintf(path, 32, "/d%d/f%02d", i, j);
+      fs_filesystem_touch(fs, path);
+    }
+  }
+  fs_filesystem_mkdir(fs, "/d0/deep");
+  fs_filesystem_touch(fs, "/d0/deep/leaf");
+  _ls(fs, "/d0", ls_before, FS_LS_FORMAT_SIZE * 32);
+  fs_filesystem_df(fs, df_before, FS_DF_FORMAT_SIZE);
+  used = _used_blocks(fs);
+  fs_filesystem_unmount(fs);
+  ASSERT(_used_blocks(fs) > used, "snapshot must take blocks");
+  fs_filesystem_destroy(fs);
+  ASSERT(_root_header(blocks_offset, &first, &size), "must be clean");
+  ASSERT(size > 9 * FS_OFFSET_FILE_ENTRY, "actually: %u", size);
+
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  _ls(fs, "/d0", ls, FS_LS_FORMAT_SIZE * 32);
+  fs_filesystem_df(fs, df, FS_DF_FORMAT_SIZE);
+
+  ASSERT(!strcmp(ls, ls_before), "\n%s\n!=\n%s", ls, ls_before);
+  ASSERT(!strcmp(df, df_before), "\n%s\n!=\n%s", df, df_before);
+  ASSERT(fs_filesystem_lookup(fs, "/d0/deep/leaf"), "");
+  ASSERT(_used_blocks(fs) == used, "snapshot blocks must be released");
+  ASSERT(!_root_header(blocks_offset, &first, &size), "mounted is dirty");
+
+  // w/out unmount the next mount walks the blocks
+  fs_filesystem_touch(fs, "/d7/new");
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs_filesystem_lookup(fs, "/d7/new"), "");
+
+  // a bogus snapshot is ignored
+  used = _used_blocks(fs);
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+  ASSERT(_root_header(blocks_offset, &first, &size), "");
+  f = fopen(FS_TEST_FNAME, "r+b");
+  fseek(f, blocks_offset + (off_t)first * FS_BLOCK_SIZE, SEEK_SET);
+  fputc(0, f);
+  fclose(f);
+
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  _ls(fs, "/d0", ls, FS_LS_FORMAT_SIZE * 32);
+  ASSERT(!strcmp(ls, ls_before), "\n%s\n!=\n%s", ls, ls_before);
+  ASSERT(fs_filesystem_lookup(fs, "/d7/new"), "");
+  ASSERT(!_root_header(blocks_offset, &first, &size), "");
+  ASSERT(_used_blocks(fs) == used, "but still released");
+
+  // so is a torn unmount's: the FAT has the chains
+  // but the flag never made it
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+  ASSERT(_root_header(blocks_offset, &first, &size), "");
+  f = fopen(FS_TEST_FNAME, "r+b");
+  fseek(f, blocks_offset + FS_ROOT_FLAGS_OFFSET, SEEK_SET);
+  c = fgetc(f);
+  fseek(f, blocks_offset + FS_ROOT_FLAGS_OFFSET, SEEK_SET);
+  fputc(c & ~FS_ROOT_FLAG_CLEAN, f);
+  fclose(f);
+
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs_filesystem_lookup(fs, "/d7/new"), "");
+  ASSERT(_used_blocks(fs) == used, "chains must be released");
+  fs_filesystem_destroy(fs);
+}
+
+void test29()
+{
+  char path[32] = { 0 };
+  char* buf = calloc(FS_LS_FORMAT_SIZE * 128, 1);
+  fs_dirent_t batch[7];
+  fs_readdir_t cursor;
+  unsigned n = 0;
+  unsigned total = 0;
+  unsigned lines = 0;
+  size_t usage = 0;
+  fs_filesystem_t* fs = fs_filesystem_create(300);
+
+  PASSERT(buf, FS_ERR_MALLOC);
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  fs_filesystem_mkdir(fs, "/big");
+  for (int i = 0; i < 100; i++) {
+    snprintf(path, 32, "/big/f%02d", i);
+    fs_filesystem_touch(fs, path);
+  }
+
+  ASSERT(!fs_filesystem_opendir(fs, "/nope", &cursor), "");
+  ASSERT(!fs_filesystem_opendir(fs, "/big/f00", &cursor), "");
+  ASSERT(fs_filesystem_opendir(fs, "/big", &cursor), "");
+  ASSERT(!strcmp(cursor.dir.attrs.fname, "big"), "");
+
+  // newest first, in batches
+  while ((n = fs_filesystem_readdir(fs, &cursor, batch, 7))) {
+    ASSERT(n == 7 || total + n == 100, "actually: %u", n);
+    snprintf(path, 32, "f%02d", 99 - total);
+    ASSERT(!strcmp(batch[0].attrs.fname, path), "%s", batch[0].attrs.fname);
+    total += n;
+  }
+  ASSERT(total == 100, "actually: %u", total);
+  ASSERT(!fs_filesystem_readdir(fs, &cursor, batch, 7), "");
+
+  // listings are no longer capped
+  _ls(fs, "/big", buf, FS_LS_FORMAT_SIZE * 128);
+  for (char* c = buf; *c; c++)
+    lines += *c == '\n';
+  ASSERT(lines == 102, "actually: %u", lines);
+
+  // removals while iterating just end it sooner
+  ASSERT(fs_filesystem_opendir(fs, "/big", &cursor), "");
+  ASSERT(fs_filesystem_readdir(fs, &cursor, batch, 7) == 7, "");
+  for (int i = 0; i < 95; i++) {
+    snprintf(path, 32, "/big/f%02d", i);
+    fs_filesystem_rm(fs, path);
+  }
+  ASSERT(!fs_filesystem_readdir(fs, &cursor, batch, 7), "");
+  fs_filesystem_destroy(fs);
+
+  // evicted directories are listed w/out being loaded
+  fs = fs_filesystem_create(0);
+  fs_filesystem_set_budget(fs, 1 << 20);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  usage = fs_file_arena_usage(fs->arena);
+  _ls(fs, "/big", buf, FS_LS_FORMAT_SIZE * 128);
+
+  ASSERT(strstr(buf, "f99"), "");
+  ASSERT(fs->reloads == 0, "");
+  ASSERT(fs_file_arena_usage(fs->arena) == usage, "");
+
+  fs_filesystem_destroy(fs);
+  free(buf);
+}
+
+static int _count(const char* path, const fs_dirent_t* entry, void* ctx)
+{
+  (void)path;
+  (void)entry;
+
+  (*(unsigned*)ctx)++;
+
+  return 0;
+}
+
+void test30()
+{
+  char path[32] = { 0 };
+  fs_find_query_t query = fs_find_any;
+  unsigned count = 0;
+  fs_file_t* file = NULL;
+  fs_filesystem_t* fs = fs_filesystem_create(300);
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  for (int i = 0; i < 4; i++) {
+    snprintf(path, 32, "/d%d", i);
+    fs_filesystem_mkdir(fs, path);
+    snprintf(path, 32, "/d%d/sub", i);
+    fs_filesystem_mkdir(fs, path);
+    for (int j = 0; j < 10; j++) {
+      snprintf(path, 32, "/d%d/sub/f%d.%s", i, j, j % 2 ? "c" : "h");
+      fs_filesystem_touch(fs, path);
+    }
+  }
+
+  // recursive now
+  ASSERT((file = fs_filesystem_find(fs, "/", "f3.c")), "");
+  ASSERT(!strcmp(file->attrs.fname, "f3.c"), "");
+  ASSERT(fs->cwd == fs->root, "");
+  ASSERT(!fs_filesystem_find(fs, "/d0", "f3.h"), "");
+  fs_filesystem_destroy(fs);
+
+  fs = fs_filesystem_create(0);
+  fs_filesystem_set_budget(fs, 1 << 20);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+
+  query.glob = "*.c";
+  ASSERT(fs_filesystem_search(fs, "/", &query, 4, _count, &count) == 20, "");
+  ASSERT(count == 20, "actually: %u", count);
+  ASSERT(fs_filesystem_search(fs, "/d2/", &query, 2, NULL, NULL) == 5, "");
+  ASSERT(fs->reloads == 0, "must walk evicted directories on disk");
+
+  query.glob = NULL;
+  query.min_mtime = fs_utils_gettime() + 60;
+  ASSERT(!fs_filesystem_search(fs, "/", &query, 0, NULL, NULL), "");
+  ASSERT(!fs_filesystem_search(fs, "/nope", &query, 0, NULL, NULL), "");
+
+  fs_filesystem_destroy(fs);
+}
+
+void test31()
+{
+  char path[32] = { 0 };
+  fs_find_query_t query = fs_find_any;
+  unsigned count = 0;
+  unsigned used = 0;
+  fs_file_t* file = NULL;
+  fs_filesystem_t* fs = fs_filesystem_create(300);
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  for (int i = 0; i < 4; i++) {
+    snprintf(path, 32, "/d%d", i);
+    fs_filesystem_mkdir(fs, path);
+    snprintf(path, 32, "/d%d/sub", i);
+    fs_filesystem_mkdir(fs, path);
+    snprintf(path, 32, "/d%d/sub/target", i);
+    fs_filesystem_touch(fs, path);
+  }
+  ASSERT(fs->names->count == 12, "actually: %u", fs->names->count);
+
+  query.glob = "target";
+  ASSERT(fs_filesystem_search(fs, "/", &query, 0, _count, &count) == 4, "");
+  ASSERT(count == 4, "");
+  ASSERT(fs_filesystem_search(fs, "/d1", &query, 0, NULL, NULL) == 1, "");
+
+  fs_filesystem_rm(fs, "/d1/sub/target");
+  fs_filesystem_rmdir(fs, "/d2");
+  ASSERT(fs->names->count == 8, "actually: %u", fs->names->count);
+  ASSERT(fs_filesystem_search(fs, "/", &query, 0, NULL, NULL) == 2, "");
+  ASSERT(!fs_filesystem_find(fs, "/d1", "target"), "");
+  ASSERT((file = fs_filesystem_find(fs, "/d3", "target")), "");
+  ASSERT(file->parent == fs_filesystem_lookup(fs, "/d3/sub"), "");
+
+  used = _used_blocks(fs);
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+
+  // loaded from the image on a clean mount...
+  fs = fs_filesystem_create(0);
+  fs_filesystem_set_budget(fs, 1 << 20);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs->names->count == 8, "actually: %u", fs->names->count);
+  ASSERT(_used_blocks(fs) == used, "index blocks must be released");
+  ASSERT(fs_filesystem_search(fs, "/", &query, 0, NULL, NULL) == 2, "");
+  fs_filesystem_touch(fs, "/d1/target");
+  fs_filesystem_destroy(fs);
+
+  // ...rebuilt otherwise, w/out loading evicted dirs
+  fs = fs_filesystem_create(0);
+  fs_filesystem_set_budget(fs, 1 << 20);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs->names->count == 9, "actually: %u", fs->names->count);
+  ASSERT(fs->reloads == 0, "");
+  query.max_size = FS_BLOCK_SIZE;
+  ASSERT(fs_filesystem_search(fs, "/d1", &query, 0, NULL, NULL) == 1, "");
+
+  fs_filesystem_destroy(fs);
+}
+
+static int _bloom_may_match(fs_filesystem_t* fs, const char* dir,
+                            const char* glob)
+{
+  uint32_t keys[FS_BLOOM_KEYS_MAX];
+  unsigned n = fs_bloom_glob_keys(glob, keys, FS_BLOOM_KEYS_MAX);
+  fs_bloom_t* bloom =
+      fs_bloom_get(fs->blooms, fs_filesystem_lookup(fs, dir)->fblock);
+
+  ASSERT(bloom && !bloom->stale, "`%s` must have an up to date filter", dir);
+
+  return fs_bloom_has_keys(bloom->bits, keys, n);
+}
+
+void test32()
+{
+  char path[32] = { 0 };
+  fs_find_query_t query = fs_find_any;
+  fs_filesystem_t* fs = fs_filesystem_create(300);
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  for (int i = 0; i < 4; i++) {
+    snprintf(path, 32, "/d%d", i);
+    fs_filesystem_mkdir(fs, path);
+    snprintf(path, 32, "/d%d/sub", i);
+    fs_filesystem_mkdir(fs, path);
+    snprintf(path, 32, "/d%d/sub/f%d.log", i, i);
+    fs_filesystem_touch(fs, path);
+  }
+  fs_filesystem_touch(fs, "/d2/sub/report");
+
+  query.glob = "*port*";
+  ASSERT(fs_filesystem_search(fs, "/", &query, 0, NULL, NULL) == 1, "");
+  ASSERT(_bloom_may_match(fs, "/", "*port*"), "");
+  ASSERT(_bloom_may_match(fs, "/d2", "*port*"), "");
+  ASSERT(!_bloom_may_match(fs, "/d0", "*port*"), "");
+  ASSERT(!_bloom_may_match(fs, "/d1/sub", "*port*"), "");
+
+  // inserts reach every ancestor right away
+  fs_filesystem_touch(fs, "/d1/sub/export");
+  ASSERT(_bloom_may_match(fs, "/d1", "*port*"), "");
+  ASSERT(_bloom_may_match(fs, "/d1/sub", "*port*"), "");
+  ASSERT(fs_filesystem_search(fs, "/", &query, 0, NULL, NULL) == 2, "");
+
+  // deletes leave a superset until the next search
+  fs_filesystem_rm(fs, "/d2/sub/report");
+  ASSERT(fs_bloom_get(fs->blooms, fs_filesystem_lookup(fs, "/d2")->fblock)
+             ->stale,
+         "");
+  ASSERT(fs_filesystem_search(fs, "/", &query, 0, NULL, NULL) == 1, "");
+  ASSERT(!_bloom_may_match(fs, "/d2", "*port*"), "");
+  ASSERT(_bloom_may_match(fs, "/", "*port*"), "");
+
+  fs_filesystem_rmdir(fs, "/d1");
+  ASSERT(fs->blooms->count == 7, "actually: %zu", fs->blooms->count);
+  ASSERT(fs_filesystem_search(fs, "/", &query, 0, NULL, NULL) == 0, "");
+  ASSERT(!_bloom_may_match(fs, "/", "*port*"), "");
+  query.glob = "f?.log";
+  ASSERT(fs_filesystem_search(fs, "/", &query, 0, NULL, NULL) == 3, "");
+  ASSERT(fs_filesystem_find(fs, "/", "*3.l*"), "");
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+
+  // evicted directories are summarized from their
+  // blocks, w/out loading them
+  fs = fs_filesystem_create(0);
+  fs_filesystem_set_budget(fs, 1 << 20);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs_filesystem_search(fs, "/", &query, 0, NULL, NULL) == 3, "");
+  query.glob = "*port*";
+  ASSERT(fs_filesystem_search(fs, "/", &query, 0, NULL, NULL) == 0, "");
+  ASSERT(fs->reloads == 0, "");
+  ASSERT(fs->blooms->count == 7, "actually: %zu", fs->blooms->count);
+
+  fs_filesystem_destroy(fs);
+}
+
+// rollup of `path` vs. a walk of its subtree
+static void _assert_usage(fs_filesystem_t* fs, const char* path)
+{
+  fs_file_t* dir = fs_filesystem_lookup(fs, path);
+  fs_fsinfo_t walked = { 0 };
+  fs_fsinfo_t* kept = fs_fsinfo_map_get(fs->usage, dir->fblock);
+
+  fs_fsinfo_calculate(&walked, dir);
+  ASSERT(kept, "`%s` must have a rollup", path);
+  ASSERT(!memcmp(kept, &walked, sizeof(walked)),
+         "`%s`: %u files, %u dirs, %u B kept; %u files, %u dirs, %u B walked",
+         path, kept->files, kept->directories, kept->usedspace, walked.files,
+         walked.directories, walked.usedspace);
+}
+
+void test33()
+{
+  const char* FNAME = FS_TEST_DIR "test33f";
+  const char* expected = "Files:              2\n"
+                         "Directories:        1\n"
+                         "Used Space:      13.0KB\n"
+                         "Wasted Space:     1.0KB\n";
+  char buf[FS_DU_FORMAT_SIZE] = { 0 };
+  fs_filesystem_t* fs = fs_filesystem_create(100);
+
+  _write_dumb_file(FNAME, 5 * FS_KILOBYTE);
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  fs_filesystem_mkdir(fs, "/a");
+  fs_filesystem_mkdir(fs, "/a/b");
+  fs_filesystem_mkdir(fs, "/a/b/c");
+  fs_filesystem_touch(fs, "/a/b/f");
+  fs_filesystem_cp(fs, FNAME, "/a/b/c/g");
+  fs_filesystem_touch(fs, "/h");
+
+  ASSERT(fs_filesystem_du(fs, "/a/b", buf, FS_DU_FORMAT_SIZE), "");
+  ASSERT(!strcmp(buf, expected), "`\n%s\n` != `\n%s\n`", buf, expected);
+  ASSERT(!fs_filesystem_du(fs, "/h", buf, FS_DU_FORMAT_SIZE), "");
+  ASSERT(!fs_filesystem_du(fs, "/nope", buf, FS_DU_FORMAT_SIZE), "");
+  fs_filesystem_df(fs, buf, FS_DF_FORMAT_SIZE);
+  _assert_usage(fs, "/");
+  _assert_usage(fs, "/a");
+  _assert_usage(fs, "/a/b/c");
+
+  // deltas go up the parent chain
+  fs_filesystem_rm(fs, "/a/b/f");
+  fs_filesystem_mkdir(fs, "/a/d");
+  fs_filesystem_touch(fs, "/a/d/i");
+  _assert_usage(fs, "/");
+  _assert_usage(fs, "/a");
+  _assert_usage(fs, "/a/b");
+  _assert_usage(fs, "/a/d");
+
+  fs_filesystem_rmdir(fs, "/a/b");
+  ASSERT(!fs_filesystem_du(fs, "/a/b", buf, FS_DU_FORMAT_SIZE), "");
+  _assert_usage(fs, "/");
+  _assert_usage(fs, "/a");
+
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+
+  // the root's comes back w/ a clean mount...
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs->usage->count == 1, "actually: %zu", fs->usage->count);
+  _assert_usage(fs, "/");
+  fs_filesystem_touch(fs, "/a/j");
+  _assert_usage(fs, "/");
+  fs_filesystem_destroy(fs);
+
+  // ...and is recomputed after a dirty one
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs->usage->count == 0, "actually: %zu", fs->usage->count);
+  fs_filesystem_df(fs, buf, FS_DF_FORMAT_SIZE);
+  _assert_usage(fs, "/");
+  _assert_usage(fs, "/a/d");
+
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME);
+}
+
+static void _write_at(int fd, off_t offset, int c, size_t n)
+{
+  uint8_t buf[FS_BLOCK_SIZE];
+
+  memset(buf, c, n);
+  PASSERT(pwrite(fd, buf, n, offset) == (ssize_t)n, "pwrite:");
+}
+
+static void _assert_same_file(const char* a, const char* b)
+{
+  uint8_t buf_a[FS_BLOCK_SIZE];
+  uint8_t buf_b[FS_BLOCK_SIZE];
+  FILE* file_a = NULL;
+  FILE* file_b = NULL;
+  size_t n = 0;
+
+  PASSERT((file_a = fopen(a, "rb")), "fopen:");
+  PASSERT((file_b = fopen(b, "rb")), "fopen:");
+
+  do {
+    n = fread(buf_a, 1, FS_BLOCK_SIZE, file_a);
+    ASSERT(fread(buf_b, 1, FS_BLOCK_SIZE, file_b) == n, "sizes differ");
+    ASSERT(!memcmp(buf_a, buf_b, n), "contents differ");
+  } while (n);
+
+  fclose(file_a);
+  fclose(file_b);
+}
+
+void test34()
+{
+  const char* FNAME_IN = FS_TEST_DIR "test34-in";
+  const char* FNAME_OUT = FS_TEST_DIR "test34-out";
+  char buf[FS_DF_FORMAT_SIZE] = { 0 };
+  fs_file_t* file = NULL;
+  FILE* fout = NULL;
+  unsigned used = 0;
+  int fd = -1;
+  fs_filesystem_t* fs = fs_filesystem_create(100);
+
+  // data in blocks 0, 10 and 40 (partial). Block 20
+  // is written but all zeros.
+  PASSERT((fd = open(FNAME_IN, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  PASSERT(!ftruncate(fd, 40 * FS_BLOCK_SIZE + 100), "ftruncate:");
+  _write_at(fd, 0, 0xab, FS_BLOCK_SIZE);
+  _write_at(fd, 10 * FS_BLOCK_SIZE + 5, 0xcd, 100);
+  _write_at(fd, 20 * FS_BLOCK_SIZE, 0, FS_BLOCK_SIZE);
+  _write_at(fd, 40 * FS_BLOCK_SIZE, 0xef, 100);
+  PASSERT(!close(fd), "close:");
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  used = _used_blocks(fs);
+
+  ASSERT((file = fs_filesystem_cp(fs, FNAME_IN, "/s")), "");
+  ASSERT(fs_fblock_is_mapped(file->fblock), "must be stored as a table");
+  ASSERT(file->attrs.size == 40 * FS_BLOCK_SIZE + 100, "");
+  ASSERT(_used_blocks(fs) == used + 3 + 1,
+         "3 data blocks + 1 for the table. Actually: %u",
+         _used_blocks(fs) - used);
+
+  PASSERT((fout = fopen(FNAME_OUT, "w+b")), "");
+  fs_filesystem_cat(fs, "/s", fileno(fout));
+  PASSERT(fclose(fout) == 0, "fclose:");
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  // sizes go to the rollups; free space is what
+  // the bitmap says (holes don't take any)
+  fs_filesystem_df(fs, buf, FS_DF_FORMAT_SIZE);
+  _assert_usage(fs, "/");
+  ASSERT(strstr(buf, "Free Space:     376.0KB"), "actually:\n%s", buf);
+  ASSERT(fs_filesystem_rm(fs, "/s"), "");
+  ASSERT(_used_blocks(fs) == used, "must free the data and the table");
+
+  // w/out holes it's a plain chain
+  _write_dumb_file(FNAME_IN, 3 * FS_BLOCK_SIZE);
+  ASSERT((file = fs_filesystem_cp(fs, FNAME_IN, "/p")), "");
+  ASSERT(!fs_fblock_is_mapped(file->fblock), "");
+  ASSERT(_used_blocks(fs) == used + 3, "");
+
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  PASSERT((fout = fopen(FNAME_OUT, "w+b")), "");
+  fs_filesystem_cat(fs, "/p", fileno(fout));
+  PASSERT(fclose(fout) == 0, "fclose:");
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_IN);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
+void test35()
+{
+  const char* FNAME_IN = FS_TEST_DIR "test35-in";
+  const char* FNAME_OUT = FS_TEST_DIR "test35-out";
+  const char* line = "2016-05-01 12:00:01 INFO request served in 12ms\n";
+  uint8_t* buf = malloc(FS_CLUSTER_SIZE);
+  fs_file_t* file = NULL;
+  FILE* fout = NULL;
+  unsigned used = 0;
+  int fd = -1;
+  fs_filesystem_t* fs = fs_filesystem_create(100);
+
+  // text | text | hole | noise | 1000B of text
+  for (int i = 0; i < FS_CLUSTER_SIZE; i++)
+    buf[i] = line[i % strlen(line)];
+  PASSERT((fd = open(FNAME_IN, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  PASSERT(pwrite(fd, buf, FS_CLUSTER_SIZE, 0) == FS_CLUSTER_SIZE, "");
+  PASSERT(pwrite(fd, buf, FS_CLUSTER_SIZE, FS_CLUSTER_SIZE) == FS_CLUSTER_SIZE,
+          "");
+  PASSERT(pwrite(fd, buf, 1000, 4 * FS_CLUSTER_SIZE) == 1000, "");
+  for (int i = 0; i < FS_CLUSTER_SIZE; i++)
+    buf[i] = rand();
+  PASSERT(pwrite(fd, buf, FS_CLUSTER_SIZE, 3 * FS_CLUSTER_SIZE) ==
+              FS_CLUSTER_SIZE,
+          "");
+  PASSERT(!close(fd), "close:");
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  used = _used_blocks(fs);
+
+  ASSERT((file = fs_filesystem_cp_compressed(fs, FNAME_IN, "/z")), "");
+  ASSERT(fs_fblock_is_compressed(file->fblock), "");
+  ASSERT(file->attrs.size == 4 * FS_CLUSTER_SIZE + 1000, "");
+  ASSERT(_used_blocks(fs) == used + 1 + 1 + 16 + 1 + 1,
+         "a block per text cluster, noise and the tail as they are, and "
+         "the table. Actually: %u",
+         _used_blocks(fs) - used);
+
+  PASSERT((fout = fopen(FNAME_OUT, "w+b")), "");
+  fs_filesystem_cat(fs, "/z", fileno(fout));
+  PASSERT(fclose(fout) == 0, "fclose:");
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  ASSERT(fs_filesystem_rm(fs, "/z"), "");
+  ASSERT(_used_blocks(fs) == used, "must free the clusters and the table");
+
+  ASSERT((file = fs_filesystem_cp_compressed(fs, FNAME_IN, "/z")), "");
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  PASSERT((fout = fopen(FNAME_OUT, "w+b")), "");
+  fs_filesystem_cat(fs, "/z", fileno(fout));
+  PASSERT(fclose(fout) == 0, "fclose:");
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  fs_filesystem_destroy(fs);
+  free(buf);
+  fs_utils_fdelete(FNAME_IN);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
+static void _cat_to(fs_filesystem_t* fs, const char* path, const char* fname)
+{
+  FILE* fout = NULL;
+
+  PASSERT((fout = fopen(fname, "w+b")), "");
+  fs_filesystem_cat(fs, path, fileno(fout));
+  PASSERT(fclose(fout) == 0, "fclose:");
+}
+
+void test36()
+{
+  const char* FNAME_IN = FS_TEST_DIR "test36-in";
+  const char* FNAME_OUT = FS_TEST_DIR "test36-out";
+  fs_file_t* file = NULL;
+  unsigned used = 0;
+  int fd = -1;
+  fs_filesystem_t* fs = fs_filesystem_create(100);
+
+  // 8 blocks, the 3rd and the 6th alike
+  PASSERT((fd = open(FNAME_IN, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  for (int i = 0; i < 8; i++)
+    _write_at(fd, i * FS_BLOCK_SIZE, i == 5 ? 3 : i + 1, FS_BLOCK_SIZE);
+  PASSERT(!close(fd), "close:");
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  used = _used_blocks(fs);
+
+  ASSERT((file = fs_filesystem_cp_dedup(fs, FNAME_IN, "/a")), "");
+  ASSERT(fs_fblock_is_mapped(file->fblock), "shared blocks need a table");
+  ASSERT(_used_blocks(fs) == used + 7 + 1, "actually: %u",
+         _used_blocks(fs) - used);
+
+  // only the table gets written
+  ASSERT(fs_filesystem_cp_dedup(fs, FNAME_IN, "/b"), "");
+  ASSERT(_used_blocks(fs) == used + 7 + 2, "actually: %u",
+         _used_blocks(fs) - used);
+
+  // plain copies don't take part
+  ASSERT(fs_filesystem_cp(fs, FNAME_IN, "/p"), "");
+  ASSERT(_used_blocks(fs) == used + 7 + 2 + 8, "");
+  ASSERT(fs_filesystem_rm(fs, "/p"), "");
+
+  ASSERT(fs_filesystem_rm(fs, "/a"), "");
+  ASSERT(_used_blocks(fs) == used + 7 + 1, "data still in use by /b");
+  _cat_to(fs, "/b", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  // fingerprints and counts survive a clean
+  // unmount...
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs_filesystem_cp_dedup(fs, FNAME_IN, "/c"), "");
+  ASSERT(_used_blocks(fs) == used + 7 + 2, "actually: %u",
+         _used_blocks(fs) - used);
+  fs_filesystem_destroy(fs);
+
+  // ...and counts are rebuilt after a dirty one
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs_filesystem_rm(fs, "/b"), "");
+  _cat_to(fs, "/c", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+  ASSERT(fs_filesystem_rm(fs, "/c"), "");
+  ASSERT(_used_blocks(fs) == used, "must free all the data");
+
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_IN);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
+static void _scrub_collect(uint32_t block, void* ctx)
+{
+  *(uint32_t*)ctx = block;
+}
+
+// flips a byte of the image at `offset`
+static void _corrupt_at(off_t offset)
+{
+  uint8_t c = 0;
+  int fd = -1;
+
+  PASSERT((fd = open(FS_TEST_FNAME, O_RDWR)) >= 0, "open:");
+  PASSERT(pread(fd, &c, 1, offset) == 1, "pread:");
+  c ^= 0x5a;
+  PASSERT(pwrite(fd, &c, 1, offset) == 1, "pwrite:");
+  PASSERT(!close(fd), "close:");
+}
+
+void test37()
+{
+  const char* FNAME_IN = FS_TEST_DIR "test37-in";
+  const char* FNAME_OUT = FS_TEST_DIR "test37-out";
+  fs_file_t* file = NULL;
+  uint32_t bad = 0;
+  uint32_t second = 0;
+  off_t blocks_offset = 0;
+  struct stat st;
+  int fd = -1;
+  fs_filesystem_t* fs = fs_filesystem_create(100);
+
+  PASSERT((fd = open(FNAME_IN, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  for (int i = 0; i < 3; i++)
+    _write_at(fd, i * FS_BLOCK_SIZE, i + 1, FS_BLOCK_SIZE);
+  PASSERT(!close(fd), "close:");
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs->crcs, "new images get checksums");
+  fs_filesystem_mkdir(fs, "/d");
+  ASSERT((file = fs_filesystem_cp(fs, FNAME_IN, "/d/f")), "");
+  ASSERT(fs_filesystem_cp_compressed(fs, FNAME_IN, "/z"), "");
+  ASSERT(!fs_filesystem_scrub(fs, 4, NULL, NULL), "all blocks are good");
+
+  // a flipped byte in the middle of the data
+  second = fs->fat->blocks[file->fblock];
+  _corrupt_at(fs->blocks_offset + (off_t)second * FS_BLOCK_SIZE + 100);
+  ASSERT(fs_filesystem_scrub(fs, 0, _scrub_collect, &bad) == 1, "");
+  ASSERT(bad == second, "must point at it. Got %u", bad);
+
+  // `cat` only gives what comes before it
+  _cat_to(fs, "/d/f", FNAME_OUT);
+  PASSERT(!stat(FNAME_OUT, &st), "stat:");
+  ASSERT(st.st_size == FS_BLOCK_SIZE, "actually %ld", (long)st.st_size);
+  ASSERT(fs->corrupt == 2, "");
+
+  _cat_to(fs, "/z", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  // checksums survive a remount. The FAT and the
+  // directory blocks are checked on the way in.
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(!fs->corrupt, "");
+  ASSERT(fs_filesystem_scrub(fs, 1, NULL, NULL) == 1, "still there");
+  second = fs_filesystem_lookup(fs, "/d")->fblock;
+  blocks_offset = fs->blocks_offset;
+  fs_filesystem_destroy(fs);
+
+  // harmless spots (a free block's FAT entry, the
+  // unused end of /d) but still caught
+  _corrupt_at(8 + 4 * 90);
+  _corrupt_at(blocks_offset + (off_t)(second + 1) * FS_BLOCK_SIZE - 1);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs->corrupt == 2, "FAT and /d. Actually %llu",
+         (unsigned long long)fs->corrupt);
+  ASSERT(fs->crcs, "the root directory kept its flag");
+  fs_filesystem_destroy(fs);
+
+  // w/out the flag there's no table, whatever the
+  // last blocks hold
+  PASSERT((fd = open(FS_TEST_FNAME, O_RDWR)) >= 0, "open:");
+  PASSERT(pwrite(fd, "", 1, blocks_offset + FS_ROOT_FLAGS_OFFSET) == 1,
+          "pwrite:");
+  PASSERT(!close(fd), "close:");
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(!fs->crcs, "");
+  ASSERT(!fs->corrupt, "");
+
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_IN);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
+void test38()
+{
+  const char* FNAME_IN = FS_TEST_DIR "test38-in";
+  const char* FNAME_OUT = FS_TEST_DIR "test38-out";
+  fs_file_t* file = NULL;
+  unsigned used = 0;
+  unsigned base = 0;
+  int fd = -1;
+  fs_filesystem_t* fs = fs_filesystem_create(100);
+
+  PASSERT((fd = open(FNAME_IN, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  for (int i = 0; i < 8; i++)
+    _write_at(fd, i * FS_BLOCK_SIZE, i + 1, FS_BLOCK_SIZE);
+  _write_at(fd, 8 * FS_BLOCK_SIZE, 9, 100);
+  PASSERT(!close(fd), "close:");
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  base = _used_blocks(fs);
+  fs_filesystem_mkdir(fs, "/d");
+  ASSERT((file = fs_filesystem_cp(fs, FNAME_IN, "/d/f")), "");
+  ASSERT(!fs_fblock_is_mapped(file->fblock), "");
+  used = _used_blocks(fs);
+
+  // both end up w/ a table of the same blocks
+  ASSERT((file = fs_filesystem_reflink(fs, "/d/f", "/g")), "");
+  ASSERT(fs_fblock_is_mapped(file->fblock), "");
+  ASSERT(fs_fblock_is_mapped(fs_filesystem_lookup(fs, "/d/f")->fblock), "");
+  ASSERT(_used_blocks(fs) == used + 2, "actually: %u", _used_blocks(fs) - used);
+  ASSERT(file->attrs.size == 8 * FS_BLOCK_SIZE + 100, "");
+  _cat_to(fs, "/g", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  ASSERT(!fs_filesystem_reflink(fs, "/d/f", "/g"), "already exists");
+  ASSERT(!fs_filesystem_reflink(fs, "/d", "/e"), "not a regular file");
+
+  ASSERT(fs_filesystem_rm(fs, "/d/f"), "");
+  ASSERT(_used_blocks(fs) == used + 1, "data still in use by /g");
+  _cat_to(fs, "/g", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  // a snapshot: /s, /s/d and a table for each of
+  // /s/g, /s/d/h and /d/h
+  ASSERT(fs_filesystem_cp(fs, FNAME_IN, "/d/h"), "");
+  used = _used_blocks(fs);
+  ASSERT(fs_filesystem_snapshot(fs, "/s"), "");
+  ASSERT(_used_blocks(fs) == used + 5, "actually: %u", _used_blocks(fs) - used);
+  ASSERT(!fs_filesystem_lookup(fs, "/s/s"), "doesn't hold itself");
+  ASSERT(fs_filesystem_lookup(fs, "/s/d/h")->attrs.readonly, "");
+  _assert_usage(fs, "/s");
+  ASSERT(!fs_filesystem_scrub(fs, 2, NULL, NULL), "");
+
+  ASSERT(!fs_filesystem_touch(fs, "/s/x"), "read-only");
+  ASSERT(!fs_filesystem_touch(fs, "/s/g"), "read-only");
+  ASSERT(!fs_filesystem_mkdir(fs, "/s/d/y"), "read-only");
+  ASSERT(!fs_filesystem_rm(fs, "/s/g"), "read-only");
+  ASSERT(!fs_filesystem_rmdir(fs, "/s/d"), "read-only");
+  ASSERT(!fs_filesystem_reflink(fs, "/g", "/s/d/g"), "read-only");
+
+  // the tree goes on; the snapshot doesn't change
+  ASSERT(fs_filesystem_rm(fs, "/g"), "");
+  _cat_to(fs, "/s/g", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  // it all survives a clean unmount...
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs_filesystem_lookup(fs, "/s/g")->attrs.readonly, "");
+  ASSERT(!fs_filesystem_touch(fs, "/s/x"), "still read-only");
+  ASSERT(fs_filesystem_snapshot(fs, "/t"), "");
+  ASSERT(!fs_filesystem_lookup(fs, "/t/s"), "older snapshots are left out");
+  fs_filesystem_destroy(fs);
+
+  // ...and counts are rebuilt after a dirty one
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs_filesystem_rmdir(fs, "/s"), "a whole snapshot may go");
+  _cat_to(fs, "/t/d/h", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+  ASSERT(fs_filesystem_rmdir(fs, "/t"), "");
+  ASSERT(fs_filesystem_rmdir(fs, "/d"), "");
+  ASSERT(_used_blocks(fs) == base, "must free all the data. Actually %d",
+         (int)(_used_blocks(fs) - base));
+
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_IN);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
+void test39()
+{
+  const char* FNAME_IN = FS_TEST_DIR "test39-in";
+  const char* FNAME_OUT = FS_TEST_DIR "test39-out";
+  fs_find_query_t query = fs_find_any;
+  fs_file_t* file = NULL;
+  fs_file_t* found = NULL;
+  unsigned count = 0;
+  unsigned used = 0;
+  fs_filesystem_t* fs = fs_filesystem_create(100);
+
+  _write_dumb_file(FNAME_IN, 3 * FS_BLOCK_SIZE + 10);
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  fs_filesystem_mkdir(fs, "/a");
+  fs_filesystem_mkdir(fs, "/a/b");
+  fs_filesystem_mkdir(fs, "/c");
+  ASSERT((file = fs_filesystem_cp(fs, FNAME_IN, "/a/b/report")), "");
+  fs_filesystem_touch(fs, "/a/x");
+
+  // filters, cached paths
+  query.glob = "*port*";
+  ASSERT(fs_filesystem_search(fs, "/", &query, 1, _count, &count) == 1, "");
+  ASSERT(fs_filesystem_lookup(fs, "/a/b/report") == file, "");
+  ASSERT(!fs_filesystem_lookup(fs, "/c/b2/report"), "");
+  used = _used_blocks(fs);
+
+  ASSERT(fs_filesystem_rename(fs, "/a/b", "/c/b2"), "");
+  ASSERT(_used_blocks(fs) == used, "no blocks taken or freed");
+  ASSERT(!fs_filesystem_lookup(fs, "/a/b"), "");
+  ASSERT(!fs_filesystem_lookup(fs, "/a/b/report"), "");
+  ASSERT(fs_filesystem_lookup(fs, "/c/b2/report") == file, "");
+  _cat_to(fs, "/c/b2/report", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  _assert_usage(fs, "/a");
+  _assert_usage(fs, "/c");
+  ASSERT(_bloom_may_match(fs, "/c", "*port*"), "");
+  ASSERT((found = fs_filesystem_find(fs, "/c", "report")) == file,
+         "the name index follows");
+  ASSERT(!fs_filesystem_find(fs, "/a", "report"), "");
+
+  // renames in place and replaces files
+  ASSERT(fs_filesystem_rename(fs, "/a/x", "/a/y"), "");
+  ASSERT(fs_filesystem_rename(fs, "/a/y", "/a/y") ==
+             fs_filesystem_lookup(fs, "/a/y"),
+         "");
+  ASSERT(fs_filesystem_rename(fs, "/c/b2/report", "/a/y") == file, "");
+  ASSERT(fs_filesystem_lookup(fs, "/a")->children_count == 1, "");
+  ASSERT(_used_blocks(fs) == used - 1, "the old /a/y is gone");
+  _assert_usage(fs, "/a");
+  _assert_usage(fs, "/c");
+
+  // but not everything
+  ASSERT(!fs_filesystem_rename(fs, "/nope", "/a/z"), "");
+  ASSERT(!fs_filesystem_rename(fs, "/c", "/c/b2/c"), "below itself");
+  ASSERT(!fs_filesystem_rename(fs, "/a/y", "/c"), "a directory");
+  ASSERT(!fs_filesystem_rename(fs, "/c", "/a/y"), "a file");
+  ASSERT(!fs_filesystem_rename(fs, "/c/b2", "/a"), "not empty");
+  ASSERT(fs_filesystem_rename(fs, "/c/b2", "/a2"), "");
+  ASSERT(fs_filesystem_rename(fs, "/c", "/a2"), "an empty directory");
+  ASSERT(_used_blocks(fs) == used - 2, "");
+
+  // only the directory blocks had to change
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(100);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs_filesystem_lookup(fs, "/a2"), "");
+  ASSERT(!fs_filesystem_lookup(fs, "/c"), "");
+  _cat_to(fs, "/a/y", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+  ASSERT(_used_blocks(fs) == used - 2, "");
+
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_IN);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
+void test40()
+{
+  const char* FNAME_IN = FS_TEST_DIR "test40-in";
+  const char* FNAME_EXP = FS_TEST_DIR "test40-exp";
+  const char* FNAME_OUT = FS_TEST_DIR "test40-out";
+  const uint64_t AT = 2 * FS_BLOCK_SIZE + 100;
+  uint8_t buf[2 * FS_BLOCK_SIZE];
+  uint8_t chunk[FS_BLOCK_SIZE];
+  fs_handle_t* h = NULL;
+  unsigned used = 0;
+  int fd = -1;
+  int exp = -1;
+  fs_filesystem_t* fs = fs_filesystem_create(100);
+
+  PASSERT((fd = open(FNAME_IN, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  PASSERT((exp = open(FNAME_EXP, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  for (int i = 0; i < 8; i++) {
+    _write_at(fd, i * FS_BLOCK_SIZE, i + 1, FS_BLOCK_SIZE);
+    _write_at(exp, i * FS_BLOCK_SIZE, i + 1, FS_BLOCK_SIZE);
+  }
+  PASSERT(!close(fd), "close:");
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs_filesystem_cp(fs, FNAME_IN, "/f"), "");
+  ASSERT(fs_filesystem_cp_compressed(fs, FNAME_IN, "/z"), "");
+  used = _used_blocks(fs);
+
+  // in place: no blocks taken
+  ASSERT((h = fs_filesystem_open(fs, "/f", FS_OPEN_WRITE)), "");
+  memset(chunk, 0xab, sizeof(chunk));
+  ASSERT(fs_filesystem_pwrite(h, chunk, 10, AT) == 10, "");
+  _write_at(exp, AT, 0xab, 10);
+  ASSERT(_used_blocks(fs) == used, "");
+  ASSERT(fs_filesystem_pread(h, buf, 2 * FS_BLOCK_SIZE, AT - 1) ==
+             2 * FS_BLOCK_SIZE,
+         "");
+  ASSERT(buf[0] == 3 && buf[1] == 0xab && buf[10] == 0xab && buf[11] == 3,
+         "");
+  ASSERT(buf[2 * FS_BLOCK_SIZE - 1] == 5, "");
+  ASSERT(fs_filesystem_pread(h, buf, 10, 8 * FS_BLOCK_SIZE) == 0, "EOF");
+  ASSERT(fs_filesystem_pread(h, buf, 10, 8 * FS_BLOCK_SIZE - 4) == 4, "");
+  ASSERT(!fs_filesystem_close(h), "");
+  ASSERT(!fs_fblock_is_mapped(fs_filesystem_lookup(fs, "/f")->fblock),
+         "still a plain chain");
+  _cat_to(fs, "/f", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+
+  // shared blocks get copied on write
+  ASSERT(fs_filesystem_reflink(fs, "/f", "/g"), "");
+  used = _used_blocks(fs);
+  ASSERT((h = fs_filesystem_open(fs, "/g", FS_OPEN_WRITE)), "");
+  ASSERT(fs_filesystem_pwrite(h, chunk, FS_BLOCK_SIZE, 5 * FS_BLOCK_SIZE) ==
+             FS_BLOCK_SIZE,
+         "");
+  ASSERT(_used_blocks(fs) == used, "taken on fsync");
+  ASSERT(!fs_filesystem_fsync(h), "");
+  ASSERT(_used_blocks(fs) == used + 1, "actually: %u", _used_blocks(fs) - used);
+
+  // past the end, w/ a hole in between
+  ASSERT(fs_filesystem_pwrite(h, chunk, 100, 12 * FS_BLOCK_SIZE) == 100, "");
+  ASSERT(!fs_filesystem_fsync(h), "");
+  ASSERT(_used_blocks(fs) == used + 2, "");
+  ASSERT(fs_filesystem_pread(h, buf, FS_BLOCK_SIZE, 10 * FS_BLOCK_SIZE) ==
+             FS_BLOCK_SIZE,
+         "");
+  ASSERT(!buf[0] && !buf[FS_BLOCK_SIZE - 1], "holes read as zeros");
+  ASSERT(!fs_filesystem_close(h), "");
+  ASSERT(fs_filesystem_lookup(fs, "/g")->attrs.size ==
+             12 * FS_BLOCK_SIZE + 100,
+         "");
+
+  _cat_to(fs, "/f", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+  _write_at(exp, 5 * FS_BLOCK_SIZE, 0xab, FS_BLOCK_SIZE);
+  _write_at(exp, 12 * FS_BLOCK_SIZE, 0xab, 100);
+  _cat_to(fs, "/g", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+
+  // reads only; compressed files a cluster at a time
+  ASSERT((h = fs_filesystem_open(fs, "/z", 0)), "");
+  ASSERT(fs_filesystem_pwrite(h, chunk, 1, 0) == -1, "not for writing");
+  ASSERT(fs_filesystem_pread(h, buf, 2 * FS_BLOCK_SIZE, AT) ==
+             2 * FS_BLOCK_SIZE,
+         "");
+  ASSERT(buf[0] == 3 && buf[2 * FS_BLOCK_SIZE - 1] == 5, "");
+  ASSERT(!fs_filesystem_close(h), "");
+  ASSERT(!fs_filesystem_open(fs, "/z", FS_OPEN_WRITE), "compressed");
+  ASSERT(!fs_filesystem_open(fs, "/", 0), "a directory");
+  ASSERT(!fs_filesystem_open(fs, "/nope", 0), "");
+
+  // new files, written back on close only
+  ASSERT((h = fs_filesystem_open(fs, "/n", FS_OPEN_WRITE | FS_OPEN_CREATE)),
+         "");
+  ASSERT(fs_filesystem_pwrite(h, chunk, 3000, 0) == 3000, "");
+  ASSERT(fs_filesystem_lookup(fs, "/n")->attrs.size == 0, "");
+  ASSERT(!fs_filesystem_fsync(h), "");
+  ASSERT(fs_filesystem_lookup(fs, "/n")->attrs.size == 3000, "");
+  ASSERT(fs_filesystem_pwrite(h, chunk, 3000, 3000) == 3000, "");
+  ASSERT(!fs_filesystem_close(h), "");
+
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(!fs->corrupt, "");
+  ASSERT((h = fs_filesystem_open(fs, "/n", 0)), "");
+  ASSERT(fs_filesystem_pread(h, buf, 2 * FS_BLOCK_SIZE, 0) == 6000, "");
+  ASSERT(buf[0] == 0xab && buf[5999] == 0xab, "");
+  ASSERT(!fs_filesystem_close(h), "");
+  _cat_to(fs, "/g", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+  ASSERT(!fs_filesystem_scrub(fs, 1, NULL, NULL), "");
+
+  PASSERT(!close(exp), "close:");
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_IN);
+  fs_utils_fdelete(FNAME_EXP);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
+void test41()
+{
+  const char* FNAME_IN = FS_TEST_DIR "test41-in";
+  const char* FNAME_EXP = FS_TEST_DIR "test41-exp";
+  const char* FNAME_OUT = FS_TEST_DIR "test41-out";
+  uint8_t buf[FS_BLOCK_SIZE];
+  uint8_t cut[100];
+  uint32_t* fat = NULL;
+  uint32_t fblock = 0;
+  uint32_t last = 0;
+  fs_file_t* file = NULL;
+  unsigned used = 0;
+  int fd = -1;
+  int exp = -1;
+  fs_filesystem_t* fs = fs_filesystem_create(100);
+
+  PASSERT((fd = open(FNAME_IN, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  _write_at(fd, 0, 1, 100);
+  PASSERT(!close(fd), "close:");
+  PASSERT((exp = open(FNAME_EXP, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+
+  // missing: a copy
+  ASSERT(fs_filesystem_append(fs, FNAME_IN, "/log"), "");
+  _write_at(exp, 0, 1, 100);
+  used = _used_blocks(fs);
+
+  // fits in the slack of the last block
+  ASSERT((file = fs_filesystem_append(fs, FNAME_IN, "/log")), "");
+  _write_at(exp, 100, 1, 100);
+  ASSERT(file->attrs.size == 200, "");
+  ASSERT(_used_blocks(fs) == used, "");
+
+  // the slack first, then new blocks
+  PASSERT((fd = open(FNAME_IN, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  for (int i = 0; i < 3; i++)
+    _write_at(fd, i * FS_BLOCK_SIZE, 2, FS_BLOCK_SIZE);
+  PASSERT(!close(fd), "close:");
+  for (int i = 0; i < 3; i++)
+    ASSERT((file = fs_filesystem_append(fs, FNAME_IN, "/log")), "");
+  for (int i = 0; i < 9; i++)
+    _write_at(exp, 200 + i * FS_BLOCK_SIZE, 2, FS_BLOCK_SIZE);
+  ASSERT(file->attrs.size == 200 + 9 * FS_BLOCK_SIZE, "");
+  ASSERT(_used_blocks(fs) == used + 9, "actually: %u", _used_blocks(fs) - used);
+  ASSERT(!fs_fblock_is_mapped(file->fblock), "still a plain chain");
+  _cat_to(fs, "/log", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+
+  // a single cut: only the FAT entries of the new
+  // last block and of what's past it change. The
+  // rest of the new last block reads back as
+  // zeros when it grows again
+  ASSERT(fs->blocks_num <= sizeof(cut), "");
+  fblock = file->fblock;
+  fat = malloc(fs->blocks_num * sizeof(*fat));
+  PASSERT(fat, FS_ERR_MALLOC);
+  memcpy(fat, fs->fat->blocks, fs->blocks_num * sizeof(*fat));
+  memset(cut, 0, sizeof(cut));
+  for (uint32_t b = fblock, i = 0;; b = fat[b], i++) {
+    cut[b] = i >= 3;
+    if (fat[b] == b)
+      break;
+  }
+  ASSERT(!fs_filesystem_truncate(fs, "/log", 2 * FS_BLOCK_SIZE + 10), "");
+  file = fs_filesystem_lookup(fs, "/log");
+  ASSERT(file->attrs.size == 2 * FS_BLOCK_SIZE + 10, "");
+  ASSERT(_used_blocks(fs) == used + 2, "actually: %u", _used_blocks(fs) - used);
+  ASSERT(file->fblock == fblock, "kept");
+  last = fat[fat[fblock]];
+  ASSERT(fs->fat->blocks[last] == last, "the new last block");
+  for (uint32_t b = 0; b < fs->blocks_num; b++)
+    ASSERT(cut[b] || b == last || fs->fat->blocks[b] == fat[b], "block %u", b);
+  free(fat);
+  ASSERT(!fs_filesystem_truncate(fs, "/log", 4 * FS_BLOCK_SIZE), "");
+  file = fs_filesystem_lookup(fs, "/log");
+  ASSERT(file->attrs.size == 4 * FS_BLOCK_SIZE, "");
+  ASSERT(_used_blocks(fs) == used + 3, "a hole, and its table");
+  PASSERT(!ftruncate(exp, 2 * FS_BLOCK_SIZE + 10), "ftruncate:");
+  PASSERT(!ftruncate(exp, 4 * FS_BLOCK_SIZE), "ftruncate:");
+  _cat_to(fs, "/log", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+
+  // w/ a table now: through a handle
+  ASSERT(fs_fblock_is_mapped(file->fblock), "");
+  ASSERT(fs_filesystem_append(fs, FNAME_IN, "/log"), "");
+  for (int i = 4; i < 7; i++)
+    _write_at(exp, i * FS_BLOCK_SIZE, 2, FS_BLOCK_SIZE);
+  _cat_to(fs, "/log", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+
+  ASSERT(!fs_filesystem_truncate(fs, "/log", 0), "");
+  ASSERT(fs_filesystem_lookup(fs, "/log")->attrs.size == 0, "");
+  ASSERT(fs_filesystem_truncate(fs, "/nope", 0) == -1, "");
+  ASSERT(!fs_filesystem_append(fs, FNAME_IN, "/"), "a directory");
+
+  ASSERT(fs_filesystem_append(fs, FNAME_IN, "/log"), "");
+  ASSERT(fs_filesystem_snapshot(fs, "/s"), "");
+  ASSERT(!fs_filesystem_append(fs, FNAME_IN, "/s/log"), "read-only");
+  ASSERT(fs_filesystem_truncate(fs, "/s/log", 0), "read-only");
+
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(!fs->corrupt, "");
+  ASSERT(fs_filesystem_append(fs, FNAME_IN, "/log"), "");
+  ASSERT(fs_filesystem_lookup(fs, "/log")->attrs.size == 6 * FS_BLOCK_SIZE,
+         "");
+  ASSERT(fs_filesystem_lookup(fs, "/s/log")->attrs.size == 3 * FS_BLOCK_SIZE,
+         "");
+  ASSERT(!fs_filesystem_scrub(fs, 1, NULL, NULL), "");
+  _cat_to(fs, "/log", FNAME_OUT);
+  PASSERT((fd = open(FNAME_OUT, O_RDONLY)) >= 0, "open:");
+  PASSERT(pread(fd, buf, FS_BLOCK_SIZE, 5 * FS_BLOCK_SIZE) == FS_BLOCK_SIZE,
+          "pread:");
+  ASSERT(buf[0] == 2 && buf[FS_BLOCK_SIZE - 1] == 2, "");
+  PASSERT(!close(fd), "close:");
+
+  PASSERT(!close(exp), "close:");
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_IN);
+  fs_utils_fdelete(FNAME_EXP);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
+// a pipe w/ the contents of `fname` (written by
+// a child) as a path, in `path`
+static pid_t _pipe_from(const char* fname, char* path, size_t n)
+{
+  uint8_t buf[FS_BLOCK_SIZE];
+  ssize_t got = 0;
+  pid_t pid = 0;
+  int fds[2];
+  int fd = -1;
+
+  PASSERT(!pipe(fds), "pipe:");
+  PASSERT((pid = fork()) >= 0, "fork:");
+
+  if (!pid) {
+    close(fds[0]);
+    PASSERT((fd = open(fname, O_RDONLY)) >= 0, "open:");
+    // short writes, to have the reader wait on it
+    while ((got = read(fd, buf, 1000)) > 0)
+      PASSERT(write(fds[1], buf, got) == got, "write:");
+    _exit(0);
+  }
+
+  PASSERT(!close(fds[1]), "close:");
+  snprintf(path, n, "/dev/fd/%d", fds[0]);
+
+  return pid;
+}
+
+static void _pipe_close(const char* path, pid_t pid)
+{
+  int status = 0;
+
+  PASSERT(!close(atoi(path + strlen("/dev/fd/"))), "close:");
+  PASSERT(waitpid(pid, &status, 0) == pid, "waitpid:");
+  ASSERT(WIFEXITED(status) && !WEXITSTATUS(status), "");
+}
+
+void test42()
+{
+  const char* FNAME_IN = FS_TEST_DIR "test42-in";
+  const char* FNAME_OUT = FS_TEST_DIR "test42-out";
+  const uint32_t SIZE = 40 * FS_BLOCK_SIZE + 100;
+  char path[32];
+  fs_file_t* file = NULL;
+  unsigned used = 0;
+  pid_t pid = 0;
+  int fd = -1;
+  fs_filesystem_t* fs = fs_filesystem_create(400);
+
+  // w/ a block of zeros in the middle and a
+  // repeated one
+  PASSERT((fd = open(FNAME_IN, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  for (uint32_t i = 0; i < 41; i++)
+    _write_at(fd, i * FS_BLOCK_SIZE, i == 7 ? 0 : i == 9 ? 3 : i + 1,
+              i == 40 ? 100 : FS_BLOCK_SIZE);
+  PASSERT(!close(fd), "close:");
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  used = _used_blocks(fs);
+
+  pid = _pipe_from(FNAME_IN, path, sizeof(path));
+  ASSERT((file = fs_filesystem_cp(fs, path, "/a")), "");
+  _pipe_close(path, pid);
+  ASSERT(file->attrs.size == SIZE, "actually: %u", file->attrs.size);
+  ASSERT(fs_fblock_is_mapped(file->fblock), "a hole");
+  ASSERT(_used_blocks(fs) == used + 40 + 1, "40 blocks, a table");
+  _cat_to(fs, "/a", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  used = _used_blocks(fs);
+  pid = _pipe_from(FNAME_IN, path, sizeof(path));
+  ASSERT((file = fs_filesystem_cp_dedup(fs, path, "/d")), "");
+  _pipe_close(path, pid);
+  ASSERT(file->attrs.size == SIZE, "");
+  ASSERT(_used_blocks(fs) == used + 39 + 1, "one block less");
+  _cat_to(fs, "/d", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  pid = _pipe_from(FNAME_IN, path, sizeof(path));
+  ASSERT((file = fs_filesystem_cp_compressed(fs, path, "/z")), "");
+  _pipe_close(path, pid);
+  ASSERT(file->attrs.size == SIZE, "");
+  ASSERT(fs_fblock_is_compressed(file->fblock), "");
+  _cat_to(fs, "/z", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+
+  // empty, and appended to
+  PASSERT((fd = open(FNAME_OUT, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  PASSERT(!close(fd), "close:");
+  pid = _pipe_from(FNAME_OUT, path, sizeof(path));
+  ASSERT((file = fs_filesystem_cp(fs, path, "/e")), "");
+  _pipe_close(path, pid);
+  ASSERT(file->attrs.size == 0, "");
+  pid = _pipe_from(FNAME_IN, path, sizeof(path));
+  ASSERT((file = fs_filesystem_append(fs, path, "/e")), "");
+  _pipe_close(path, pid);
+  ASSERT(file->attrs.size == SIZE, "");
+
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(!fs->corrupt, "");
+  _cat_to(fs, "/a", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+  _cat_to(fs, "/e", FNAME_OUT);
+  _assert_same_file(FNAME_IN, FNAME_OUT);
+  ASSERT(!fs_filesystem_scrub(fs, 1, NULL, NULL), "");
+
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_IN);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
+void test43()
+{
+  const char* FNAME_IN = FS_TEST_DIR "test43-in";
+  const char* FNAME_EXP = FS_TEST_DIR "test43-exp";
+  const char* FNAME_OUT = FS_TEST_DIR "test43-out";
+  uint8_t chunk[FS_BLOCK_SIZE];
+  fs_handle_t* h = NULL;
+  fs_file_t* file = NULL;
+  unsigned used = 0;
+  uint32_t block = 0;
+  int fd = -1;
+  int exp = -1;
+  fs_filesystem_t* fs = fs_filesystem_create(400);
+
+  PASSERT((fd = open(FNAME_IN, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  _write_at(fd, 0, 1, FS_BLOCK_SIZE);
+  _write_at(fd, FS_BLOCK_SIZE, 2, FS_BLOCK_SIZE);
+  PASSERT(!close(fd), "close:");
+  PASSERT((exp = open(FNAME_EXP, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+
+  // free space in bits and pieces, then a run
+  for (int i = 0; i < 6; i++) {
+    char name[8];
+    snprintf(name, sizeof(name), "/t%d", i);
+    ASSERT(fs_filesystem_touch(fs, name), "");
+  }
+  fs_filesystem_rm(fs, "/t1");
+  fs_filesystem_rm(fs, "/t3");
+  used = _used_blocks(fs);
+
+  ASSERT(!fs_filesystem_fallocate(fs, "/f", 20 * FS_BLOCK_SIZE, 0), "");
+  ASSERT(_used_blocks(fs) == used + 20 + 1, "20 blocks, a table");
+  ASSERT((h = fs_filesystem_open(fs, "/f", 0)), "");
+  ASSERT(h->size == 20 * FS_BLOCK_SIZE, "");
+  for (uint32_t i = 0; i < 20; i++) {
+    ASSERT(h->map->blocks[i] == h->map->blocks[0] + i, "contiguous");
+    ASSERT(fs_blockmap_is_unwritten(h->map, i), "");
+    ASSERT(fs->crcs[h->map->blocks[i]] == FS_CSUM_UNWRITTEN, "not read");
+  }
+  block = h->map->blocks[3];
+
+  // whatever the blocks hold doesn't matter
+  memset(chunk, 0x5a, sizeof(chunk));
+  PASSERT(pwrite(fileno(fs->file), chunk, sizeof(chunk),
+                 fs->blocks_offset +
+                     (off_t)h->map->blocks[7] * FS_BLOCK_SIZE) ==
+              sizeof(chunk),
+          "pwrite:");
+  ASSERT(!fs_filesystem_close(h), "");
+  ASSERT(!fs_filesystem_scrub(fs, 1, NULL, NULL), "");
+  PASSERT(!ftruncate(exp, 20 * FS_BLOCK_SIZE), "ftruncate:");
+  _cat_to(fs, "/f", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+
+  // filled in place
+  used = _used_blocks(fs);
+  memset(chunk, 0xab, sizeof(chunk));
+  ASSERT((h = fs_filesystem_open(fs, "/f", FS_OPEN_WRITE)), "");
+  ASSERT(fs_filesystem_pwrite(h, chunk, 10, 3 * FS_BLOCK_SIZE + 5) == 10, "");
+  _write_at(exp, 3 * FS_BLOCK_SIZE + 5, 0xab, 10);
+  ASSERT(!fs_filesystem_close(h), "");
+  ASSERT(_used_blocks(fs) == used, "");
+  ASSERT(fs->crcs[block] != FS_CSUM_UNWRITTEN, "taken once written");
+  _cat_to(fs, "/f", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+  ASSERT(!fs_filesystem_scrub(fs, 1, NULL, NULL), "");
+
+  // a plain (contiguous) chain once it's all
+  // written
+  ASSERT((h = fs_filesystem_open(fs, "/f", FS_OPEN_WRITE)), "");
+  for (uint32_t i = 0; i < 20; i++)
+    ASSERT(fs_filesystem_pwrite(h, chunk, FS_BLOCK_SIZE, i * FS_BLOCK_SIZE) ==
+               FS_BLOCK_SIZE,
+           "");
+  ASSERT(!fs_filesystem_close(h), "");
+  file = fs_filesystem_lookup(fs, "/f");
+  ASSERT(!fs_fblock_is_mapped(file->fblock), "");
+  ASSERT(_used_blocks(fs) == used - 1, "no table");
+  for (uint32_t b = file->fblock; fs->fat->blocks[b] != b; b++)
+    ASSERT(fs->fat->blocks[b] == b + 1, "");
+
+  // w/out growing: appends take the blocks
+  ASSERT(!fs_filesystem_fallocate(fs, "/log", 8 * FS_BLOCK_SIZE,
+                                  FS_FALLOC_KEEP_SIZE),
+         "");
+  ASSERT(fs_filesystem_lookup(fs, "/log")->attrs.size == 0, "");
+  used = _used_blocks(fs);
+  ASSERT(fs_filesystem_append(fs, FNAME_IN, "/log"), "");
+  ASSERT(fs_filesystem_append(fs, FNAME_IN, "/log"), "");
+  ASSERT(fs_filesystem_lookup(fs, "/log")->attrs.size == 4 * FS_BLOCK_SIZE,
+         "");
+  ASSERT(_used_blocks(fs) == used, "actually: %u", _used_blocks(fs) - used);
+
+  // not for copies
+  ASSERT(fs_filesystem_reflink(fs, "/log", "/copy"), "");
+  ASSERT(_used_blocks(fs) == used + 1, "just a table");
+
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(!fs->corrupt, "");
+  ASSERT(_used_blocks(fs) == used + 1, "");
+  ASSERT(!fs_filesystem_scrub(fs, 1, NULL, NULL), "");
+
+  PASSERT(!ftruncate(exp, 0), "ftruncate:");
+  for (int i = 0; i < 6; i++)
+    _write_at(exp, i * FS_BLOCK_SIZE, i % 2 + 1, FS_BLOCK_SIZE);
+  for (int i = 0; i < 3; i++)
+    ASSERT(fs_filesystem_append(fs, FNAME_IN, "/log"), "");
+  ASSERT(_used_blocks(fs) == used + 1 + 2, "past what was reserved");
+  _write_at(exp, 6 * FS_BLOCK_SIZE, 1, FS_BLOCK_SIZE);
+  _write_at(exp, 7 * FS_BLOCK_SIZE, 2, FS_BLOCK_SIZE);
+  _write_at(exp, 8 * FS_BLOCK_SIZE, 1, FS_BLOCK_SIZE);
+  _write_at(exp, 9 * FS_BLOCK_SIZE, 2, FS_BLOCK_SIZE);
+  _cat_to(fs, "/log", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+  PASSERT(!ftruncate(exp, 4 * FS_BLOCK_SIZE), "ftruncate:");
+  _cat_to(fs, "/copy", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+
+  ASSERT(fs_filesystem_fallocate(fs, "/big", 1000 * FS_BLOCK_SIZE, 0) == -1,
+         "not enough space");
+  ASSERT(!fs_filesystem_truncate(fs, "/big", 0), "created anyway");
+  ASSERT(!fs_filesystem_fallocate(fs, "/copy", 4 * FS_BLOCK_SIZE, 0),
+         "nothing to do");
+  ASSERT(!fs_filesystem_scrub(fs, 1, NULL, NULL), "");
+
+  PASSERT(!close(exp), "close:");
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_IN);
+  fs_utils_fdelete(FNAME_EXP);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
+void test44()
+{
+  const char* FNAME_EXP = FS_TEST_DIR "test44-exp";
+  const char* FNAME_OUT = FS_TEST_DIR "test44-out";
+  const uint32_t MANY = FS_DELALLOC_BLOCKS + 44;
+  uint8_t chunk[FS_BLOCK_SIZE];
+  uint8_t buf[FS_BLOCK_SIZE];
+  fs_handle_t* a = NULL;
+  fs_handle_t* b = NULL;
+  unsigned used = 0;
+  int exp = -1;
+  fs_filesystem_t* fs = fs_filesystem_create(1000);
+
+  PASSERT((exp = open(FNAME_EXP, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT((a = fs_filesystem_open(fs, "/a", FS_OPEN_WRITE | FS_OPEN_CREATE)),
+         "");
+  ASSERT((b = fs_filesystem_open(fs, "/b", FS_OPEN_WRITE | FS_OPEN_CREATE)),
+         "");
+  used = _used_blocks(fs);
+
+  // interleaved writers: nothing taken until
+  // fsync, then an extent each
+  for (uint32_t i = 0; i < 8; i++) {
+    memset(chunk, i + 1, sizeof(chunk));
+    ASSERT(fs_filesystem_pwrite(a, chunk, FS_BLOCK_SIZE, i * FS_BLOCK_SIZE) ==
+               FS_BLOCK_SIZE,
+           "");
+    memset(chunk, 0x80 + i, sizeof(chunk));
+    ASSERT(fs_filesystem_pwrite(b, chunk, FS_BLOCK_SIZE, i * FS_BLOCK_SIZE) ==
+               FS_BLOCK_SIZE,
+           "");
+    _write_at(exp, i * FS_BLOCK_SIZE, i + 1, FS_BLOCK_SIZE);
+  }
+  ASSERT(_used_blocks(fs) == used, "");
+
+  // read back from memory
+  ASSERT(fs_filesystem_pread(a, buf, FS_BLOCK_SIZE, 5 * FS_BLOCK_SIZE) ==
+             FS_BLOCK_SIZE,
+         "");
+  memset(chunk, 6, sizeof(chunk));
+  ASSERT(!memcmp(buf, chunk, FS_BLOCK_SIZE), "");
+
+  ASSERT(!fs_filesystem_fsync(a), "");
+  ASSERT(!fs_filesystem_fsync(b), "");
+  // (block 0 came w/ the file, written in place)
+  ASSERT(_used_blocks(fs) == used + 2 * 7, "");
+  for (uint32_t i = 2; i < 8; i++) {
+    ASSERT(a->map->blocks[i] == a->map->blocks[1] + i - 1, "contiguous");
+    ASSERT(b->map->blocks[i] == b->map->blocks[1] + i - 1, "contiguous");
+  }
+  ASSERT(!fs_filesystem_close(a), "");
+  ASSERT(!fs_filesystem_close(b), "");
+  _cat_to(fs, "/a", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+
+  // a full buffer is flushed on its own, in
+  // logical order even when written backwards
+  ASSERT((a = fs_filesystem_open(fs, "/c", FS_OPEN_WRITE | FS_OPEN_CREATE)),
+         "");
+  PASSERT(!ftruncate(exp, 0), "ftruncate:");
+  used = _used_blocks(fs);
+  for (uint32_t i = MANY; i-- > 0;) {
+    memset(chunk, i % 251 + 1, sizeof(chunk));
+    ASSERT(fs_filesystem_pwrite(a, chunk, FS_BLOCK_SIZE, i * FS_BLOCK_SIZE) ==
+               FS_BLOCK_SIZE,
+           "");
+    _write_at(exp, i * FS_BLOCK_SIZE, i % 251 + 1, FS_BLOCK_SIZE);
+  }
+  ASSERT(_used_blocks(fs) >= used + FS_DELALLOC_BLOCKS, "");
+  ASSERT(a->npending == MANY - FS_DELALLOC_BLOCKS, "");
+  for (uint32_t i = MANY - FS_DELALLOC_BLOCKS + 1; i < MANY; i++)
+    ASSERT(a->map->blocks[i] == a->map->blocks[i - 1] + 1, "at %u", i);
+  ASSERT(!fs_filesystem_close(a), "");
+
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(!fs->corrupt, "");
+  _cat_to(fs, "/c", FNAME_OUT);
+  _assert_same_file(FNAME_EXP, FNAME_OUT);
+  ASSERT(!fs_filesystem_scrub(fs, 1, NULL, NULL), "");
+
+  PASSERT(!close(exp), "close:");
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_EXP);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
+void test45()
+{
+  const char* FNAME_IN = FS_TEST_DIR "test45-in";
+  uint8_t buf[FS_BLOCK_SIZE];
+  uint8_t chunk[FS_BLOCK_SIZE];
+  fs_handle_t* h = NULL;
+  uint32_t window = 0;
+  int fd = -1;
+  fs_filesystem_t* fs = fs_filesystem_create(400);
+
+  PASSERT((fd = open(FNAME_IN, O_CREAT | O_TRUNC | O_WRONLY, 0644)) >= 0,
+          "open:");
+  for (int i = 0; i < 40; i++)
+    _write_at(fd, i * FS_BLOCK_SIZE, i + 1, FS_BLOCK_SIZE);
+  PASSERT(!close(fd), "close:");
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs_filesystem_cp(fs, FNAME_IN, "/f"), "");
+  ASSERT((h = fs_filesystem_open(fs, "/f", 0)), "");
+
+  // the window grows while reads follow each
+  // other, hints never go past the end
+  for (uint32_t i = 0; i < 40; i++) {
+    ASSERT(fs_filesystem_pread(h, buf, FS_BLOCK_SIZE, i * FS_BLOCK_SIZE) ==
+               FS_BLOCK_SIZE,
+           "");
+    memset(chunk, i + 1, sizeof(chunk));
+    ASSERT(!memcmp(buf, chunk, FS_BLOCK_SIZE), "block %u", i);
+
+    window = !window ? FS_READAHEAD_MIN
+                     : window < FS_READAHEAD_MAX ? 2 * window
+                                                 : FS_READAHEAD_MAX;
+    ASSERT(h->ra.window == window, "%u", h->ra.window);
+    ASSERT(h->ra.end == (i + 1 + window < 40 ? i + 1 + window : 40), "");
+  }
+
+  // a seek starts over, small reads keep it
+  ASSERT(fs_filesystem_pread(h, buf, 10, 5 * FS_BLOCK_SIZE) == 10, "");
+  ASSERT(h->ra.window == 0 && h->ra.end == 0, "");
+  ASSERT(fs_filesystem_pread(h, buf, 10, 5 * FS_BLOCK_SIZE + 10) == 10, "");
+  ASSERT(h->ra.window == FS_READAHEAD_MIN, "");
+  ASSERT(h->ra.end == 6 + FS_READAHEAD_MIN, "");
+  memset(chunk, 6, sizeof(chunk));
+  ASSERT(!memcmp(buf, chunk, 10), "");
+  ASSERT(!fs_filesystem_close(h), "");
+
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_IN);
+}
+
+void test46()
+{
+  const char* FNAME_OUT = FS_TEST_DIR "test46-out";
+  uint8_t chunk[FS_BLOCK_SIZE];
+  fs_handle_t* h = NULL;
+  fs_handle_t* r = NULL;
+  fs_file_t* file = NULL;
+  fs_filesystem_t* fs = fs_filesystem_create(400);
+
+  fs_utils_fdelete(FS_TEST_FNAME);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(fs_filesystem_mkdir(fs, "/d"), "");
+  ASSERT(fs_filesystem_mkdir(fs, "/d/e"), "");
+  ASSERT((h = fs_filesystem_open(fs, "/d/e/f", FS_OPEN_WRITE | FS_OPEN_CREATE)),
+         "");
+  memset(chunk, 7, sizeof(chunk));
+  ASSERT(fs_filesystem_pwrite(h, chunk, 100, 0) == 100, "");
+
+  // neither it nor what it's below may go
+  ASSERT(!fs_filesystem_rm(fs, "/d/e/f"), "");
+  ASSERT(!fs_filesystem_rm(fs, "/d"), "");
+  ASSERT(!fs_filesystem_rmdir(fs, "/d/e"), "");
+  ASSERT(fs_filesystem_lookup(fs, "/d/e/f"), "");
+
+  // nor move, nor be replaced
+  ASSERT(!fs_filesystem_rename(fs, "/d/e/f", "/g"), "");
+  ASSERT(!fs_filesystem_rename(fs, "/d", "/x"), "");
+  ASSERT(fs_filesystem_touch(fs, "/g"), "");
+  ASSERT(!fs_filesystem_rename(fs, "/g", "/d/e/f"), "");
+  ASSERT(fs_filesystem_lookup(fs, "/d/e/f") && fs_filesystem_lookup(fs, "/g"),
+         "");
+
+  // a writer has it to itself
+  ASSERT(!fs_filesystem_open(fs, "/d/e/f", FS_OPEN_WRITE), "");
+  ASSERT(!fs_filesystem_open(fs, "/d/e/f", 0), "");
+  ASSERT(fs_filesystem_truncate(fs, "/d/e/f", 0) == -1, "");
+  ASSERT(!fs_filesystem_reflink(fs, "/d/e/f", "/copy"), "");
+  ASSERT(!fs_filesystem_snapshot(fs, "/s"), "");
+
+  // the rest of the tree isn't affected
+  ASSERT(fs_filesystem_rename(fs, "/g", "/d/g"), "");
+  ASSERT(fs_filesystem_rm(fs, "/d/g"), "");
+
+  ASSERT(fs_filesystem_pwrite(h, chunk, FS_BLOCK_SIZE, 2 * FS_BLOCK_SIZE) ==
+             FS_BLOCK_SIZE,
+         "");
+  ASSERT(!fs_filesystem_close(h), "");
+
+  // readers share it
+  ASSERT((r = fs_filesystem_open(fs, "/d/e/f", 0)), "");
+  ASSERT((h = fs_filesystem_open(fs, "/d/e/f", 0)), "");
+  ASSERT(!fs_filesystem_open(fs, "/d/e/f", FS_OPEN_WRITE), "");
+  ASSERT(!fs_filesystem_close(h), "");
+  ASSERT(!fs_filesystem_rm(fs, "/d/e/f"), "still being read");
+
+  // sharing would give it a new table (and fblock)
+  ASSERT(!fs_filesystem_reflink(fs, "/d/e/f", "/copy"), "");
+  ASSERT(!fs_filesystem_snapshot(fs, "/s"), "");
+  ASSERT(!fs_filesystem_close(r), "");
+  file = fs_filesystem_lookup(fs, "/d/e/f");
+  ASSERT(file && file->attrs.size == 3 * FS_BLOCK_SIZE, "");
+
+  ASSERT(fs_filesystem_rename(fs, "/d", "/x"), "");
+  ASSERT((h = fs_filesystem_open(fs, "/x/e/f", FS_OPEN_WRITE)), "");
+  ASSERT(!fs_filesystem_close(h), "");
+  _cat_to(fs, "/x/e/f", FNAME_OUT);
+  ASSERT(fs_filesystem_rm(fs, "/x"), "");
+  ASSERT(!fs->handles, "");
+
+  fs_filesystem_unmount(fs);
+  fs_filesystem_destroy(fs);
+  fs = fs_filesystem_create(0);
+  fs_filesystem_mount(fs, FS_TEST_FNAME);
+  ASSERT(!fs->corrupt, "");
+  ASSERT(!fs_filesystem_lookup(fs, "/x"), "");
+  ASSERT(!fs_filesystem_scrub(fs, 1, NULL, NULL), "");
+
+  fs_filesystem_destroy(fs);
+  fs_utils_fdelete(FNAME_OUT);
+}
+
 int main(int argc, char* argv[])
 {
   TEST(test1, "creation and deletion");
@@ -593,6 +2507,29 @@ int main(int argc, char* argv[])
   TEST(test21, "restore `fs` after `cp`");
   TEST(test22, "ls - nested fs");
   TEST(test23, "rmdir - recursively remove directories");
+  TEST(test24, "wide and nested directories");
+  TEST(test25, "path cache - negative entries and invalidation");
+  TEST(test26, "metadata budget - lazy loading and eviction");
+  TEST(test27, "stat - resolving paths on raw directory blocks");
+  TEST(test28, "unmount - tree snapshot for a fast remount");
+  TEST(test29, "readdir - listing w/ a cursor, in batches");
+  TEST(test30, "find - recursive search w/ predicates");
+  TEST(test31, "find - persistent name index");
+  TEST(test32, "find - subtree bloom filters");
+  TEST(test33, "df/du - subtree usage rollups");
+  TEST(test34, "cp/cat - sparse files");
+  TEST(test35, "cp/cat - compressed files");
+  TEST(test36, "cp - block deduplication");
+  TEST(test37, "scrub - block checksums");
+  TEST(test38, "cp --reflink/snapshot - shared blocks");
+  TEST(test39, "mv - moving entries");
+  TEST(test40, "open/pread/pwrite - random access");
+  TEST(test41, "append/truncate - growing and cutting files");
+  TEST(test42, "cp - streaming from a pipe");
+  TEST(test43, "fallocate - reserving blocks");
+  TEST(test44, "pwrite - delayed allocation");
+  TEST(test45, "pread - readahead");
+  TEST(test46, "open - removing and moving open files");
 
   return 0;
 }
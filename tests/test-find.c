@@ -0,0 +1,116 @@
+#include "fssim/common.h"
+#include "fssim/find.h"
+
+void test1()
+{
+  fs_find_query_t query = fs_find_any;
+  fs_file_attr_t attrs = { 0 };
+
+  strcpy(attrs.fname, "notes.txt");
+  attrs.size = 2048;
+  attrs.mtime = 1000;
+
+  ASSERT(fs_find_match(&query, &attrs), "");
+
+  query.glob = "*.txt";
+  ASSERT(fs_find_match(&query, &attrs), "");
+  query.glob = "n?tes.*";
+  ASSERT(fs_find_match(&query, &attrs), "");
+  query.glob = "*.c";
+  ASSERT(!fs_find_match(&query, &attrs), "");
+
+  query.glob = NULL;
+  query.min_size = 2049;
+  ASSERT(!fs_find_match(&query, &attrs), "");
+  query.min_size = 2048;
+  query.max_size = 2048;
+  ASSERT(fs_find_match(&query, &attrs), "bounds are inclusive");
+
+  query.min_mtime = 1001;
+  ASSERT(!fs_find_match(&query, &attrs), "");
+  query.min_mtime = 0;
+  query.max_mtime = 999;
+  ASSERT(!fs_find_match(&query, &attrs), "");
+}
+
+typedef struct _found_t {
+  unsigned count;
+  unsigned stop_at;
+  char last[64];
+} _found_t;
+
+static int _collect(const char* path, const fs_dirent_t* entry, void* ctx)
+{
+  _found_t* found = ctx;
+
+  (void)entry;
+
+  strncpy(found->last, path, 63);
+
+  return ++found->count == found->stop_at;
+}
+
+void test2()
+{
+  char fname[FS_NAME_MAX] = { 0 };
+  fs_file_arena_t* arena = fs_file_arena_create();
+  fs_file_t* root = fs_file_create_in(arena, "/", FS_FILE_DIRECTORY, NULL);
+  fs_file_t* dir = NULL;
+  fs_file_t* sub = NULL;
+  fs_find_query_t query = fs_find_any;
+  fs_find_t find = { 0 };
+  _found_t found = { 0 };
+
+  // /dN/sM/fK
+  for (int i = 0; i < 8; i++) {
+    snprintf(fname, FS_NAME_MAX, "d%d", i);
+    fs_file_addchild(root, dir = fs_file_create(fname, FS_FILE_DIRECTORY, root));
+
+    for (int j = 0; j < 8; j++) {
+      snprintf(fname, FS_NAME_MAX, "s%d", j);
+      fs_file_addchild(dir, sub = fs_file_create(fname, FS_FILE_DIRECTORY, dir));
+
+      for (int k = 0; k < 16; k++) {
+        snprintf(fname, FS_NAME_MAX, "f%02d", k);
+        fs_file_addchild(sub, fs_file_create(fname, FS_FILE_REGULAR, sub));
+        fs_file_child(sub, k)->attrs.size = k;
+      }
+    }
+  }
+
+  find.query = &query;
+  find.cb = _collect;
+  find.ctx = &found;
+  find.threads = 4;
+
+  ASSERT(fs_find_run(&find, root, "/") == 8 + 64 + 1024, "");
+  ASSERT(found.count == 8 + 64 + 1024, "actually: %u", found.count);
+
+  query.glob = "f1?";
+  query.min_size = 12;
+  found.count = 0;
+  ASSERT(fs_find_run(&find, root, "/") == 64 * 4, "");
+
+  found.count = 0;
+  ASSERT(fs_find_run(&find, fs_file_child(root, 3), "/d3/") == 8 * 4, "");
+  ASSERT(!strncmp(found.last, "/d3/s", 5), "actually: %s", found.last);
+
+  // stops as soon as the callback says so
+  query = fs_find_any;
+  query.glob = "f07";
+  found.count = 0;
+  found.stop_at = 1;
+  ASSERT(fs_find_run(&find, root, "/") == 1, "");
+  ASSERT(!strcmp(found.last + strlen(found.last) - 4, "/f07"), "%s",
+         found.last);
+
+  fs_file_arena_destroy(arena);
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "find - predicates");
+  TEST(test2, "find - parallel walk of a resident tree");
+
+  return 0;
+}
@@ -6,11 +6,11 @@ void test1()
   fs_fsinfo_t info = { 0 };
 
   fs_file_t* dir = fs_file_create("/", FS_FILE_DIRECTORY, NULL);
-  fs_file_t* file = fs_file_create("hue.scm", FS_FILE_REGULAR, NULL);
-  fs_file_t* file2 = fs_file_create("other.scm", FS_FILE_REGULAR, NULL);
-  fs_file_t* dir_tmp = fs_file_create("/tmp", FS_FILE_DIRECTORY, NULL);
-  fs_file_t* dir_whoa = fs_file_create("/whoa", FS_FILE_DIRECTORY, NULL);
-  fs_file_t* file3 = fs_file_create("file3.scm", FS_FILE_REGULAR, NULL);
+  fs_file_t* file = fs_file_create("hue.scm", FS_FILE_REGULAR, dir);
+  fs_file_t* file2 = fs_file_create("other.scm", FS_FILE_REGULAR, dir);
+  fs_file_t* dir_tmp = fs_file_create("/tmp", FS_FILE_DIRECTORY, dir);
+  fs_file_t* dir_whoa = fs_file_create("/whoa", FS_FILE_DIRECTORY, dir_tmp);
+  fs_file_t* file3 = fs_file_create("file3.scm", FS_FILE_REGULAR, dir_tmp);
 
   fs_file_addchild(dir, file);
   fs_file_addchild(dir, file2);
@@ -26,9 +26,42 @@ void test1()
   fs_file_destroy(dir);
 }
 
+void test2()
+{
+  fs_fsinfo_map_t* map = fs_fsinfo_map_create(FS_FSINFO_MAP_SIZE);
+  fs_fsinfo_t info = { 5 * FS_KILOBYTE, FS_KILOBYTE, 2, 1 };
+  fs_fsinfo_t loaded = { 0 };
+  unsigned char buf[FS_FSINFO_SERIALIZED_SIZE] = { 0 };
+  const uint32_t n = 4 * FS_FSINFO_MAP_SIZE;
+
+  fs_fsinfo_serialize(&info, buf);
+  fs_fsinfo_deserialize(&loaded, buf);
+  ASSERT(!memcmp(&info, &loaded, sizeof(info)), "");
+
+  fs_fsinfo_merge(&loaded, &info);
+  ASSERT(loaded.files == 4 && loaded.usedspace == 10 * FS_KILOBYTE, "");
+  fs_fsinfo_unmerge(&loaded, &info);
+  ASSERT(!memcmp(&info, &loaded, sizeof(info)), "");
+
+  for (uint32_t i = 0; i < n; i++)
+    fs_fsinfo_map_put(map, i)->files = i;
+  for (uint32_t i = 0; i < n; i += 3)
+    fs_fsinfo_map_remove(map, i);
+  ASSERT(map->count == n - n / 3 - 1, "actually: %zu", map->count);
+
+  for (uint32_t i = 0; i < n; i++) {
+    ASSERT(!fs_fsinfo_map_get(map, i) == !(i % 3), "%u", i);
+    if (i % 3)
+      ASSERT(fs_fsinfo_map_get(map, i)->files == i, "%u", i);
+  }
+
+  fs_fsinfo_map_destroy(map);
+}
+
 int main(int argc, char* argv[])
 {
   TEST(test1, "calculates files and directories ok");
+  TEST(test2, "rollups - (de)serialization and map");
 
   return 0;
 }
@@ -0,0 +1,81 @@
+#include "fssim/common.h"
+#include "fssim/lz.h"
+
+static void _roundtrip(const uint8_t* src, size_t n, size_t* packed)
+{
+  uint8_t* dst = malloc(n + n / 255 + 16);
+  uint8_t* back = malloc(n + 1);
+
+  ASSERT(dst && back, "");
+  ASSERT((*packed = fs_lz_compress(src, n, dst, n + n / 255 + 16)) > 0,
+         "must fit in its worst case");
+  ASSERT(fs_lz_decompress(dst, *packed, back, n) == (ssize_t)n, "");
+  ASSERT(!memcmp(src, back, n), "");
+
+  free(dst);
+  free(back);
+}
+
+void test1()
+{
+  const char* line = "2016-05-01 12:00:01 INFO request served in 12ms\n";
+  size_t n = FS_CLUSTER_SIZE;
+  uint8_t* text = malloc(n);
+  uint8_t* noise = malloc(n);
+  size_t packed = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    text[i] = line[i % strlen(line)];
+    noise[i] = rand();
+  }
+
+  _roundtrip(text, n, &packed);
+  ASSERT(packed < n / 20, "repetitive text compresses well. %zu", packed);
+
+  _roundtrip(noise, n, &packed);
+  ASSERT(packed > n, "noise doesn't");
+
+  _roundtrip((const uint8_t*)"", 0, &packed);
+  ASSERT(packed == 1, "a single empty sequence");
+  _roundtrip((const uint8_t*)"abcabcabcabcabcabc", 18, &packed);
+
+  // runs overlap their own source
+  memset(text, 'x', n);
+  _roundtrip(text, n, &packed);
+  ASSERT(packed < 300, "actually: %zu", packed);
+
+  free(text);
+  free(noise);
+}
+
+void test2()
+{
+  const char* input = "abcdabcdabcdabcdabcdabcdabcdabcdabcdabcd";
+  uint8_t dst[64];
+  uint8_t back[64];
+  size_t packed = fs_lz_compress((const uint8_t*)input, strlen(input), dst,
+                                 sizeof(dst));
+
+  ASSERT(packed && packed < strlen(input), "");
+  ASSERT(!fs_lz_compress((const uint8_t*)input, strlen(input), dst, 4),
+         "must tell when it doesn't fit");
+
+  ASSERT(fs_lz_decompress(dst, packed, back, strlen(input) - 1) == -1,
+         "must not overflow `dst`");
+  ASSERT(fs_lz_decompress(dst, packed - 1, back, sizeof(back)) == -1,
+         "truncated input");
+
+  // an offset past what was decoded
+  memcpy(dst, "\x10" "a" "\x05\x00", 4);
+  ASSERT(fs_lz_decompress(dst, 4, back, sizeof(back)) == -1, "");
+  memcpy(dst, "\x10" "a" "\x00\x00", 4);
+  ASSERT(fs_lz_decompress(dst, 4, back, sizeof(back)) == -1, "offset 0");
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "roundtrips");
+  TEST(test2, "bounds and malformed input");
+
+  return 0;
+}
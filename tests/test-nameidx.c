@@ -0,0 +1,96 @@
+#include "fssim/common.h"
+#include "fssim/nameidx.h"
+
+// /a(1)/b(2)/x(3), /x(4), /a(1)/x(5)
+static fs_nameidx_t* _sample()
+{
+  fs_nameidx_t* idx = fs_nameidx_create(0);
+
+  fs_nameidx_add(idx, "a", 1, 0, 1);
+  fs_nameidx_add(idx, "b", 2, 1, 1);
+  fs_nameidx_add(idx, "x", 3, 2, 0);
+  fs_nameidx_add(idx, "x", 4, 0, 0);
+  fs_nameidx_add(idx, "x", 5, 1, 0);
+
+  return idx;
+}
+
+void test1()
+{
+  fs_nameidx_t* idx = _sample();
+  fs_nameidx_entry_t* entry = NULL;
+  char path[16] = { 0 };
+  unsigned found = 0;
+
+  while ((entry = fs_nameidx_next(idx, "x/whatever", 1, entry)))
+    found |= 1 << entry->fblock;
+  ASSERT(found == (1 << 3 | 1 << 4 | 1 << 5), "actually: %x", found);
+  ASSERT(!fs_nameidx_next(idx, "y", 1, NULL), "");
+
+  entry = fs_nameidx_get(idx, 3);
+  ASSERT(fs_nameidx_is_below(idx, entry, 0), "");
+  ASSERT(fs_nameidx_is_below(idx, entry, 1), "");
+  ASSERT(fs_nameidx_is_below(idx, entry, 2), "");
+  ASSERT(!fs_nameidx_is_below(idx, fs_nameidx_get(idx, 4), 1), "");
+
+  ASSERT(fs_nameidx_path(idx, entry, path, 4) == 6, "must not fit");
+  ASSERT(fs_nameidx_path(idx, entry, path, 16) == 6, "");
+  ASSERT(!strcmp(path, "/a/b/x"), "actually: %s", path);
+
+  ASSERT(fs_nameidx_remove(idx, 3), "");
+  ASSERT(!fs_nameidx_remove(idx, 3), "");
+  ASSERT(!fs_nameidx_get(idx, 3), "");
+  ASSERT(idx->count == 4, "");
+
+  // removing a directory orphans its subtree
+  fs_nameidx_add(idx, "x", 3, 2, 0);
+  fs_nameidx_remove(idx, 2);
+  ASSERT(fs_nameidx_path(idx, fs_nameidx_get(idx, 3), path, 16) == -1, "");
+
+  fs_nameidx_destroy(idx);
+}
+
+void test2()
+{
+  char fname[FS_NAME_MAX] = { 0 };
+  fs_nameidx_t* idx = fs_nameidx_create(0);
+  fs_nameidx_t* loaded = NULL;
+  unsigned char* buf = NULL;
+  size_t size = 0;
+
+  // grows past its initial buckets and slots
+  for (uint32_t i = 1; i <= 3 * FS_NAMEIDX_SIZE; i++) {
+    snprintf(fname, FS_NAME_MAX, "f%u", i % 1000);
+    fs_nameidx_add(idx, fname, i, 0, 0);
+  }
+  for (uint32_t i = 1; i <= 3 * FS_NAMEIDX_SIZE; i += 2)
+    fs_nameidx_remove(idx, i);
+  ASSERT(idx->count == 3 * FS_NAMEIDX_SIZE / 2, "");
+
+  size = fs_nameidx_serialized_size(idx);
+  buf = malloc(size);
+  ASSERT(fs_nameidx_serialize(idx, buf, size) == size, "");
+  ASSERT(!fs_nameidx_load(0, buf, size - 1), "must reject bad sizes");
+  ASSERT((loaded = fs_nameidx_load(0, buf, size)), "");
+  ASSERT(loaded->count == idx->count, "");
+
+  for (uint32_t i = 1; i <= 3 * FS_NAMEIDX_SIZE; i++) {
+    ASSERT((fs_nameidx_get(loaded, i) == NULL) == (i % 2 == 1), "%u", i);
+    if (i % 2 == 0)
+      ASSERT(!strcmp(fs_nameidx_get(loaded, i)->fname,
+                     fs_nameidx_get(idx, i)->fname),
+             "");
+  }
+
+  free(buf);
+  fs_nameidx_destroy(idx);
+  fs_nameidx_destroy(loaded);
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "name index - probes, ancestors and paths");
+  TEST(test2, "name index - growth and (de)serialization");
+
+  return 0;
+}
@@ -0,0 +1,41 @@
+#include "fssim/common.h"
+#include "fssim/scratch.h"
+
+void test1()
+{
+  fs_scratch_t* scratch = fs_scratch_create(64);
+  char* a = fs_scratch_strndup(scratch, "hello/world", 5);
+  char* b = fs_scratch_alloc(scratch, 3);
+
+  ASSERT(!strcmp(a, "hello"), "actually: %s", a);
+  ASSERT(!((uintptr_t)b % sizeof(void*)), "allocations must be aligned");
+  ASSERT(b >= a + 6, "allocations must not overlap");
+
+  fs_scratch_destroy(scratch);
+}
+
+void test2()
+{
+  fs_scratch_t* scratch = fs_scratch_create(64);
+  size_t mark = 0;
+  char* a = NULL;
+
+  fs_scratch_alloc(scratch, 8);
+  mark = fs_scratch_mark(scratch);
+  a = fs_scratch_alloc(scratch, 32);
+  fs_scratch_release(scratch, mark);
+
+  ASSERT(scratch->used == 8, "actually: %lu", scratch->used);
+  ASSERT(fs_scratch_alloc(scratch, 56) == a,
+         "released memory must be handed back");
+
+  fs_scratch_destroy(scratch);
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "scratch allocation");
+  TEST(test2, "scratch mark/release");
+
+  return 0;
+}
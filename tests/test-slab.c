@@ -0,0 +1,69 @@
+#include "fssim/common.h"
+#include "fssim/slab.h"
+
+void test1()
+{
+  fs_slab_t* slab = fs_slab_create(3, 4);
+
+  ASSERT(slab->objsize == sizeof(void*), "room for the free list pointer");
+  ASSERT(slab->live == 0, "");
+  ASSERT(slab->chunks_count == 0, "lazily allocates chunks");
+
+  fs_slab_destroy(slab);
+}
+
+void test2()
+{
+  fs_slab_t* slab = fs_slab_create(sizeof(uint32_t) * 3, 4);
+  uint32_t* objs[10] = { 0 };
+
+  for (int i = 0; i < 10; i++) {
+    objs[i] = fs_slab_alloc(slab);
+    objs[i][0] = objs[i][1] = objs[i][2] = i;
+  }
+
+  ASSERT(slab->chunks_count == 3, "actually: %lu", slab->chunks_count);
+  ASSERT(slab->live == 10, "");
+
+  for (int i = 0; i < 10; i++)
+    ASSERT(objs[i][2] == i, "objects must not overlap");
+
+  fs_slab_free(slab, objs[3]);
+  fs_slab_free(slab, objs[7]);
+  ASSERT(slab->live == 8, "");
+
+  // LIFO reuse
+  ASSERT(fs_slab_alloc(slab) == objs[7], "");
+  ASSERT(fs_slab_alloc(slab) == objs[3], "");
+  ASSERT(slab->chunks_count == 3, "no new chunk needed");
+
+  // no need to free each object
+  fs_slab_destroy(slab);
+}
+
+void test3()
+{
+  fs_slab_t* slab = fs_slab_create(sizeof(uint64_t), 4);
+  uint64_t* objs[10] = { 0 };
+
+  for (int i = 0; i < 10; i++) {
+    objs[i] = fs_slab_alloc(slab);
+    ASSERT(fs_slab_id(objs[i]) == i, "actually: %u", fs_slab_id(objs[i]));
+    ASSERT(fs_slab_at(slab, i) == objs[i], "");
+  }
+
+  fs_slab_free(slab, objs[5]);
+  ASSERT(fs_slab_alloc(slab) == objs[5], "");
+  ASSERT(fs_slab_id(objs[5]) == 5, "ids survive reuse");
+
+  fs_slab_destroy(slab);
+}
+
+int main(int argc, char* argv[])
+{
+  TEST(test1, "creation and deletion");
+  TEST(test2, "allocation, free list reuse and release");
+  TEST(test3, "ids");
+
+  return 0;
+}